@@ -0,0 +1,1429 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "common.h"
+#include "error.h"
+#include "opcode_table.h"
+#include "string_builder.h"
+#include "decoder.h"
+#include "disassembler.h"
+#include "parallel.h"
+#include "lexer.h"
+#include "assembler.h"
+
+/** Assembler
+ * Two phases over line-aligned chunks of the source, one thread per chunk.
+ * The first parses every line into statements. Encodings that no label or
+ * address can change are final at once and kept as runs of bytes; the
+ * others keep their parsed operands. Every instruction is encoded by trying
+ * the opcode_table descriptors of its mnemonic against the operands and
+ * keeping the shortest encoding; ties go to the lower opcode byte.
+ *
+ * The chunks' labels are then merged and a prefix sum over the chunk
+ * lengths lays the output out. A label defined above its use is known and
+ * its value can pick a shorter form (d8 instead of d16, imm8 instead of
+ * imm16); one defined below always takes the 16-bit form and only its
+ * bytes wait. Deferred statements are re-sized against the last layout
+ * until no length moves. Jump sizes never depend on label values (jcc and
+ * jmp short are rel8, jmp and call are rel16), so a few rounds are enough
+ * in practice; chains that need more finish in one in-order sweep.
+ *
+ * The second phase writes every chunk into its own region of the output.
+ * The result, errors included, is the one a single pass over the source
+ * gives.
+ */
+
+uint8_t lookup_mnemonic(const token_t *token) {
+  /** lookup_mnemonic
+   * Mnemonic id of an identifier, aliases included, or MNEMONIC_COUNT
+   */
+  const keyword_t *keyword = lookup_keyword(token);
+  return keyword != NULL && keyword->kind == KEYWORD_MNEMONIC ? keyword->value : MNEMONIC_COUNT;
+}
+
+uint8_t lookup_register(const token_t *token, uint8_t *kind, uint8_t *reg) {
+  /** lookup_register
+   * Resolves a byte, word or segment register name
+   */
+  static const uint8_t register_kinds[] = {
+    [KEYWORD_REG8] = OPERAND_REG8, [KEYWORD_REG16] = OPERAND_REG16, [KEYWORD_SEGMENT] = OPERAND_SEG,
+  };
+  const keyword_t *keyword = lookup_keyword(token);
+  if (keyword == NULL || keyword->kind < KEYWORD_REG8 || keyword->kind > KEYWORD_SEGMENT) {
+    return 0;
+  }
+  *kind = register_kinds[keyword->kind];
+  *reg = keyword->value;
+  return 1;
+}
+
+error_t init_assembler(assembler_t *assembler) {
+  /** init_assembler
+   * Empty output and label table, and the encoding candidates of every
+   * mnemonic taken from opcode_table and group_table
+   */
+  uint16_t counts[MNEMONIC_COUNT] = {0};
+  memset(assembler, 0, sizeof(*assembler));
+  init_string(&assembler->output, BUFFER_SIZE, NULL);
+  for (int pass = 0; pass < 2; ++pass) {
+    if (pass == 1) {
+      uint16_t total = 0;
+      for (size_t idx = 0; idx < MNEMONIC_COUNT; ++idx) {
+        assembler->candidate_start[idx] = total;
+        total += counts[idx];
+        counts[idx] = 0;
+      }
+      assembler->candidate_start[MNEMONIC_COUNT] = total;
+    }
+    for (uint16_t byte_1 = 0; byte_1 < 256; ++byte_1) {
+      const opcode_t *opcode = &opcode_table[byte_1];
+      for (uint8_t reg = 0; reg < 8; ++reg) {
+        opcode_t resolved = resolve_opcode(byte_1, reg << 3);
+        if (resolved.mnemonic == MN_INVALID || resolved.form == FORM_PREFIX) {
+          continue;
+        }
+        if (opcode->group == GROUP_NONE && reg > 0) {
+          break;
+        }
+        if (pass == 1) {
+          candidate_t *candidate = &assembler->candidates[assembler->candidate_start[resolved.mnemonic] + counts[resolved.mnemonic]];
+          candidate->byte_1 = byte_1;
+          candidate->reg = reg;
+        }
+        counts[resolved.mnemonic]++;
+      }
+    }
+  }
+  return JASM_SUCCESS;
+}
+
+error_t free_label_table(label_table_t *table) {
+  free(table->labels);
+  free(table->slots);
+  memset(table, 0, sizeof(*table));
+  return JASM_SUCCESS;
+}
+
+error_t free_assembler(assembler_t *assembler) {
+  free_string(&assembler->output);
+  return free_label_table(&assembler->labels);
+}
+
+error_t grow_label_slots(label_table_t *table) {
+  /** grow_label_slots
+   * Doubles the slots and re-enters every label
+   */
+  size_t slot_count = table->slot_count ? table->slot_count * 2 : 64;
+  int32_t *slots = malloc(slot_count * sizeof(int32_t));
+  if (slots == NULL) {
+    return JASM_MEMORY_ERROR;
+  }
+  memset(slots, 0xff, slot_count * sizeof(int32_t));
+  for (size_t idx = 0; idx < table->count; ++idx) {
+    size_t slot = table->labels[idx].hash & (slot_count - 1);
+    while (slots[slot] >= 0) {
+      slot = (slot + 1) & (slot_count - 1);
+    }
+    slots[slot] = (int32_t)idx;
+  }
+  free(table->slots);
+  table->slots = slots;
+  table->slot_count = slot_count;
+  return JASM_SUCCESS;
+}
+
+int32_t find_label(label_table_t *table, const char *name, uint32_t length, uint32_t hash) {
+  /** find_label
+   * Index of a label, adding it undefined on first reference; -1 when out
+   * of memory
+   */
+  size_t slot;
+  if (2 * (table->count + 1) > table->slot_count && grow_label_slots(table) != JASM_SUCCESS) {
+    return -1;
+  }
+  for (slot = hash & (table->slot_count - 1); table->slots[slot] >= 0; slot = (slot + 1) & (table->slot_count - 1)) {
+    label_t *label = &table->labels[table->slots[slot]];
+    if (label->hash == hash && label->length == length && memcmp(label->name, name, length) == 0) {
+      return table->slots[slot];
+    }
+  }
+  if (table->count == table->capacity) {
+    size_t capacity = table->capacity ? table->capacity * 2 : 64;
+    label_t *labels = realloc(table->labels, capacity * sizeof(label_t));
+    if (labels == NULL) {
+      return -1;
+    }
+    table->labels = labels;
+    table->capacity = capacity;
+  }
+  table->labels[table->count].name = name;
+  table->labels[table->count].length = length;
+  table->labels[table->count].hash = hash;
+  table->labels[table->count].value = 0;
+  table->labels[table->count].position = NO_POSITION;
+  table->slots[slot] = (int32_t)table->count;
+  return (int32_t)table->count++;
+}
+
+statement_t *push_statement(source_chunk_t *chunk, uint8_t kind, uint32_t line) {
+  /** push_statement
+   * Appends an empty statement; NULL when out of memory
+   */
+  statement_t *statement;
+  if (chunk->statement_count == chunk->statement_capacity) {
+    size_t capacity = chunk->statement_capacity ? chunk->statement_capacity * 2 : 256;
+    statement_t *statements = realloc(chunk->statements, capacity * sizeof(statement_t));
+    if (statements == NULL) {
+      return NULL;
+    }
+    chunk->statements = statements;
+    chunk->statement_capacity = capacity;
+  }
+  statement = &chunk->statements[chunk->statement_count++];
+  statement->kind = kind;
+  statement->line = line;
+  statement->detail = 0;
+  statement->length = 0;
+  statement->address = 0;
+  return statement;
+}
+
+error_t push_term(source_chunk_t *chunk, int32_t label, int32_t sign) {
+  if (chunk->term_count == chunk->term_capacity) {
+    size_t capacity = chunk->term_capacity ? chunk->term_capacity * 2 : 256;
+    term_t *terms = realloc(chunk->terms, capacity * sizeof(term_t));
+    if (terms == NULL) {
+      return JASM_MEMORY_ERROR;
+    }
+    chunk->terms = terms;
+    chunk->term_capacity = capacity;
+  }
+  chunk->terms[chunk->term_count].label = label;
+  chunk->terms[chunk->term_count].sign = sign;
+  chunk->term_count++;
+  return JASM_SUCCESS;
+}
+
+error_t push_deferred(source_chunk_t *chunk, const deferred_t *deferred) {
+  if (chunk->deferred_count == chunk->deferred_capacity) {
+    size_t capacity = chunk->deferred_capacity ? chunk->deferred_capacity * 2 : 256;
+    deferred_t *records = realloc(chunk->deferred, capacity * sizeof(deferred_t));
+    if (records == NULL) {
+      return JASM_MEMORY_ERROR;
+    }
+    chunk->deferred = records;
+    chunk->deferred_capacity = capacity;
+  }
+  chunk->deferred[chunk->deferred_count++] = *deferred;
+  return JASM_SUCCESS;
+}
+
+void init_expression(const source_chunk_t *chunk, expression_t *expression) {
+  expression->constant = 0;
+  expression->dollar = 0;
+  expression->first_term = (uint32_t)chunk->term_count;
+  expression->term_count = 0;
+}
+
+uint8_t is_constant(const expression_t *expression) {
+  return expression->term_count == 0 && expression->dollar == 0;
+}
+
+error_t parse_term(source_chunk_t *chunk, lexer_t *lexer, token_t *token, int32_t sign, expression_t *expression) {
+  /** parse_term
+   * Adds one number, $ or label to an expression
+   */
+  int32_t term;
+  if (token->type == TOKEN_NUMBER) {
+    error_t error_code = token_number(token, &term);
+    int64_t constant = (int64_t)expression->constant + (int64_t)sign * term;
+    if (error_code != JASM_SUCCESS) {
+      return error_code;
+    }
+    if (constant < INT32_MIN || constant > INT32_MAX) {
+      return JASM_RANGE_ERROR;
+    }
+    expression->constant = (int32_t)constant;
+  } else if (token->type == TOKEN_DOLLAR) {
+    expression->dollar += sign;
+  } else if (token->type == TOKEN_IDENTIFIER) {
+    int32_t idx = find_label(&chunk->labels, token->start, token->length, token->hash);
+    if (idx < 0 || push_term(chunk, idx, sign) != JASM_SUCCESS) {
+      return JASM_MEMORY_ERROR;
+    }
+    expression->term_count++;
+  } else {
+    return JASM_SYNTAX_ERROR;
+  }
+  return next_token(lexer, token);
+}
+
+error_t parse_expression(source_chunk_t *chunk, lexer_t *lexer, token_t *token, expression_t *expression) {
+  /** parse_expression
+   * Sum of terms: [+|-] term { (+|-) term }
+   */
+  int32_t sign = 1;
+  error_t error_code;
+  init_expression(chunk, expression);
+  if (token->type == TOKEN_MINUS || token->type == TOKEN_PLUS) {
+    sign = token->type == TOKEN_MINUS ? -1 : 1;
+    next_token(lexer, token);
+  }
+  for (;;) {
+    error_code = parse_term(chunk, lexer, token, sign, expression);
+    if (error_code != JASM_SUCCESS) {
+      return error_code;
+    }
+    if (token->type != TOKEN_PLUS && token->type != TOKEN_MINUS) {
+      return JASM_SUCCESS;
+    }
+    sign = token->type == TOKEN_MINUS ? -1 : 1;
+    next_token(lexer, token);
+  }
+}
+
+error_t parse_memory(source_chunk_t *chunk, lexer_t *lexer, token_t *token, operand_t *operand) {
+  /** parse_memory
+   * [seg: base + index + displacement], token is the opening bracket
+   */
+  uint8_t bases = 0; /* 1 bx, 2 bp, 4 si, 8 di */
+  int32_t sign = 1;
+  next_token(lexer, token);
+  operand->kind = OPERAND_MEM;
+  init_expression(chunk, &operand->expression);
+  if (token->type == TOKEN_IDENTIFIER) {
+    uint8_t kind, reg;
+    lexer_t peek = *lexer;
+    token_t colon;
+    next_token(&peek, &colon);
+    if (lookup_register(token, &kind, &reg) && kind == OPERAND_SEG && colon.type == TOKEN_COLON) {
+      operand->segment = reg;
+      *lexer = peek;
+      next_token(lexer, token);
+    }
+  }
+  if (token->type == TOKEN_MINUS || token->type == TOKEN_PLUS) {
+    sign = token->type == TOKEN_MINUS ? -1 : 1;
+    next_token(lexer, token);
+  }
+  for (;;) {
+    uint8_t kind, reg;
+    if (token->type == TOKEN_IDENTIFIER && lookup_register(token, &kind, &reg)) {
+      uint8_t bit = kind != OPERAND_REG16 ? 0 : reg == 3 ? 1 : reg == 5 ? 2 : reg == 6 ? 4 : reg == 7 ? 8 : 0;
+      if (bit == 0 || (bases & bit) || sign < 0) {
+        return JASM_SYNTAX_ERROR;
+      }
+      bases |= bit;
+      next_token(lexer, token);
+    } else {
+      error_t error_code = parse_term(chunk, lexer, token, sign, &operand->expression);
+      if (error_code != JASM_SUCCESS) {
+        return error_code;
+      }
+      operand->has_disp = 1;
+    }
+    if (token->type == TOKEN_RBRACKET) {
+      break;
+    }
+    if (token->type != TOKEN_PLUS && token->type != TOKEN_MINUS) {
+      return JASM_SYNTAX_ERROR;
+    }
+    sign = token->type == TOKEN_MINUS ? -1 : 1;
+    next_token(lexer, token);
+  }
+  next_token(lexer, token);
+  switch (bases) {
+    case 1 | 4: operand->reg = 0; break;
+    case 1 | 8: operand->reg = 1; break;
+    case 2 | 4: operand->reg = 2; break;
+    case 2 | 8: operand->reg = 3; break;
+    case 4: operand->reg = 4; break;
+    case 8: operand->reg = 5; break;
+    case 2: operand->reg = 6; break;
+    case 1: operand->reg = 7; break;
+    case 0: operand->reg = EA_DIRECT; break;
+    default: return JASM_SYNTAX_ERROR;
+  }
+  return JASM_SUCCESS;
+}
+
+error_t parse_operand(source_chunk_t *chunk, lexer_t *lexer, token_t *token, operand_t *operand) {
+  /** parse_operand
+   * Register, memory reference, immediate or jump target, or seg:off far
+   * pointer, after optional byte/word/short/far modifiers
+   */
+  uint8_t kind, reg;
+  error_t error_code;
+  memset(operand, 0, sizeof(*operand));
+  operand->segment = -1;
+  operand->label = -1;
+  for (;;) {
+    const keyword_t *keyword = lookup_keyword(token);
+    if (keyword == NULL || keyword->kind != KEYWORD_MODIFIER) {
+      break;
+    }
+    if (keyword->value == MODIFIER_BYTE) {
+      operand->size = SIZE_BYTE;
+    } else if (keyword->value == MODIFIER_WORD) {
+      operand->size = SIZE_WORD;
+    } else if (keyword->value == MODIFIER_SHORT) {
+      operand->modifiers |= MOD_SHORT;
+    } else if (keyword->value == MODIFIER_FAR) {
+      operand->modifiers |= MOD_FAR;
+    }
+    next_token(lexer, token);
+  }
+  if (token->type == TOKEN_LBRACKET) {
+    return parse_memory(chunk, lexer, token, operand);
+  }
+  if (lookup_register(token, &kind, &reg)) {
+    next_token(lexer, token);
+    if (kind == OPERAND_SEG && token->type == TOKEN_COLON) {
+      /* es:[bx] spelling of a segment override */
+      next_token(lexer, token);
+      if (token->type != TOKEN_LBRACKET) {
+        return JASM_SYNTAX_ERROR;
+      }
+      error_code = parse_memory(chunk, lexer, token, operand);
+      operand->segment = reg;
+      return error_code;
+    }
+    operand->kind = kind;
+    operand->reg = reg;
+    return JASM_SUCCESS;
+  }
+  error_code = parse_expression(chunk, lexer, token, &operand->expression);
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  operand->kind = OPERAND_IMM;
+  if (token->type == TOKEN_COLON) {
+    next_token(lexer, token);
+    operand->segment_expression = operand->expression;
+    operand->kind = OPERAND_FAR;
+    return parse_expression(chunk, lexer, token, &operand->expression);
+  }
+  return JASM_SUCCESS;
+}
+
+error_t resolve_expression(const source_chunk_t *chunk, const expression_t *expression, size_t position,
+                           size_t address, int32_t *value, int32_t *label) {
+  /** resolve_expression
+   * Folds an expression for the statement at position and address. Labels
+   * defined above position are known; at most one unknown label may be
+   * added, and is left in *label. Before the merge every label is unknown.
+   */
+  const label_t *labels = chunk->assembler->labels.labels;
+  *value = expression->constant + expression->dollar * (int32_t)address;
+  *label = -1;
+  for (uint32_t idx = 0; idx < expression->term_count; ++idx) {
+    const term_t *term = &chunk->terms[expression->first_term + idx];
+    int32_t global = chunk->globals != NULL ? chunk->globals[term->label] : -1;
+    if (global >= 0 && labels[global].position < position) {
+      *value += term->sign * labels[global].value;
+    } else if (term->sign > 0 && *label < 0) {
+      *label = global >= 0 ? global : term->label;
+    } else {
+      return JASM_SYNTAX_ERROR;
+    }
+  }
+  return JASM_SUCCESS;
+}
+
+uint8_t value_fits(const operand_t *operand, uint8_t bits, uint8_t sign_extended) {
+  /** value_fits
+   * Whether an immediate can be encoded in bits (8 or 16). Unknown labels
+   * only fit 16 bits. sign_extended checks an imm8 that the CPU widens.
+   */
+  int32_t value = operand->value;
+  if (operand->label >= 0) {
+    return bits == 16 && !sign_extended;
+  }
+  if (sign_extended) {
+    return value >= -32768 && value <= 65535 && (int16_t)value >= -128 && (int16_t)value <= 127;
+  }
+  if (bits == 8) {
+    return value >= -128 && value <= 255;
+  }
+  return value >= -32768 && value <= 65535;
+}
+
+void emit_value(encoding_t *encoding, const operand_t *operand, uint8_t bytes) {
+  /** emit_value
+   * Appends an immediate or displacement, recording a fixup for an
+   * unknown label
+   */
+  if (operand->label >= 0) {
+    fixup_t *fixup = &encoding->fixups[encoding->fixup_count++];
+    fixup->position = encoding->length;
+    fixup->kind = bytes == 1 ? FIXUP_ABS8 : FIXUP_ABS16;
+    fixup->label = operand->label;
+    fixup->addend = operand->value;
+  }
+  encoding->bytes[encoding->length++] = (uint8_t)operand->value;
+  if (bytes == 2) {
+    encoding->bytes[encoding->length++] = (uint8_t)(operand->value >> 8);
+  }
+}
+
+uint8_t is_register(const operand_t *operand, uint8_t w_bit) {
+  return operand->kind == (w_bit ? OPERAND_REG16 : OPERAND_REG8) &&
+         (operand->size == SIZE_NONE || operand->size == (w_bit ? SIZE_WORD : SIZE_BYTE));
+}
+
+uint8_t is_rm(const operand_t *operand, uint8_t w_bit, uint8_t size_required) {
+  /** is_rm
+   * Whether an operand fits an r/m slot of width w. Memory needs an
+   * explicit size when nothing else in the instruction implies one.
+   */
+  if (operand->kind == OPERAND_MEM) {
+    if (operand->size != SIZE_NONE) {
+      return operand->size == (w_bit ? SIZE_WORD : SIZE_BYTE);
+    }
+    return !size_required;
+  }
+  return is_register(operand, w_bit);
+}
+
+uint8_t emit_modrm(encoding_t *encoding, uint8_t reg, const operand_t *operand) {
+  /** emit_modrm
+   * Appends the mod reg r/m byte and the shortest displacement
+   */
+  uint8_t *modrm = &encoding->bytes[encoding->length++];
+  if (operand->kind != OPERAND_MEM) {
+    *modrm = 0xc0 | (reg << 3) | operand->reg;
+    return 1;
+  }
+  if (operand->reg == EA_DIRECT) {
+    if (!value_fits(operand, 16, 0)) {
+      return 0;
+    }
+    *modrm = (reg << 3) | 0b110;
+    emit_value(encoding, operand, 2);
+  } else if (operand->label < 0 && !operand->has_disp && operand->reg != 0b110) {
+    *modrm = (reg << 3) | operand->reg;
+  } else if (operand->label < 0 && operand->value >= -128 && operand->value <= 127) {
+    *modrm = 0x40 | (reg << 3) | operand->reg;
+    emit_value(encoding, operand, 1);
+  } else if (value_fits(operand, 16, 0)) {
+    *modrm = 0x80 | (reg << 3) | operand->reg;
+    emit_value(encoding, operand, 2);
+  } else {
+    return 0;
+  }
+  return 1;
+}
+
+uint8_t is_accumulator(const operand_t *operand, uint8_t w_bit) {
+  return is_register(operand, w_bit) && operand->reg == 0;
+}
+
+uint8_t emit_relative(encoding_t *encoding, const operand_t *operand, uint8_t bytes, size_t origin) {
+  /** emit_relative
+   * Appends a jump displacement from the end of the encoding, which starts
+   * at address origin
+   */
+  size_t next = origin + encoding->length + bytes;
+  int32_t relative = operand->value - (int32_t)next;
+  if (operand->kind != OPERAND_IMM || (operand->modifiers & MOD_FAR)) {
+    return 0;
+  }
+  if (operand->label >= 0) {
+    fixup_t *fixup = &encoding->fixups[encoding->fixup_count++];
+    fixup->position = encoding->length;
+    fixup->kind = bytes == 1 ? FIXUP_REL8 : FIXUP_REL16;
+    fixup->label = operand->label;
+    fixup->addend = operand->value;
+    relative = 0;
+  } else if (bytes == 1 && (relative < -128 || relative > 127)) {
+    return 0;
+  }
+  encoding->relative = 1;
+  encoding->bytes[encoding->length++] = (uint8_t)relative;
+  if (bytes == 2) {
+    encoding->bytes[encoding->length++] = (uint8_t)(relative >> 8);
+  }
+  return 1;
+}
+
+uint8_t try_candidate(const candidate_t *candidate, const operand_t *operands, uint8_t count,
+                      size_t origin, encoding_t *encoding) {
+  /** try_candidate
+   * Encodes the operands with one opcode descriptor; 0 when they don't fit
+   */
+  uint8_t byte_1 = candidate->byte_1;
+  opcode_t opcode = resolve_opcode(byte_1, candidate->reg << 3);
+  uint8_t w_bit = byte_1 & W_MASK;
+  uint8_t d_bit = (opcode.flags & OPF_D) ? (byte_1 & D_MASK) >> 1 : 0;
+  uint8_t imm_bits;
+  const operand_t *first = &operands[0];
+  const operand_t *second = &operands[1];
+  if (opcode.flags & OPF_WORD) {
+    w_bit = 1;
+  } else if (opcode.flags & OPF_W3) {
+    w_bit = (byte_1 >> 3) & 1;
+  } else if (!(opcode.flags & OPF_W)) {
+    w_bit = 0;
+  }
+  imm_bits = immediate_length(opcode.imm, w_bit) * 8;
+  for (uint8_t idx = 0; idx < count; ++idx) {
+    if ((operands[idx].modifiers & MOD_SHORT) && opcode.form != FORM_REL8) {
+      return 0;
+    }
+    if ((operands[idx].modifiers & MOD_FAR) && !(opcode.flags & OPF_FAR) && opcode.form != FORM_FAR) {
+      return 0;
+    }
+  }
+  encoding->length = 0;
+  encoding->relative = 0;
+  encoding->fixup_count = 0;
+  encoding->bytes[encoding->length++] = byte_1;
+  switch (opcode.form) {
+    case FORM_NONE:
+      if (opcode.imm == IMM_8) {
+        /* aam and aad take an optional base, 10 by default */
+        if (count == 0) {
+          encoding->bytes[encoding->length++] = 10;
+          return 1;
+        }
+        if (count != 1 || first->kind != OPERAND_IMM || !value_fits(first, 8, 0)) {
+          return 0;
+        }
+        emit_value(encoding, first, 1);
+        return 1;
+      }
+      return count == 0;
+    case FORM_MODRM_REG: {
+      const operand_t *rm = d_bit ? second : first;
+      const operand_t *reg = d_bit ? first : second;
+      if (count != 2 || !is_register(reg, w_bit) || !is_rm(rm, w_bit, 0)) {
+        return 0;
+      }
+      return emit_modrm(encoding, reg->reg, rm);
+    }
+    case FORM_REG_MEM:
+      if (count != 2 || !is_register(first, 1) || !is_rm(second, 1, 0)) {
+        return 0;
+      }
+      return emit_modrm(encoding, first->reg, second);
+    case FORM_MODRM_SEG: {
+      const operand_t *rm = d_bit ? second : first;
+      const operand_t *seg = d_bit ? first : second;
+      if (count != 2 || seg->kind != OPERAND_SEG || !is_rm(rm, 1, 0)) {
+        return 0;
+      }
+      return emit_modrm(encoding, seg->reg, rm);
+    }
+    case FORM_MODRM:
+      if (count != 1) {
+        return 0;
+      }
+      if (opcode.flags & OPF_FAR) {
+        if (!(first->modifiers & MOD_FAR) || !is_rm(first, 1, 0)) {
+          return 0;
+        }
+      } else if (!is_rm(first, w_bit, !(opcode.flags & OPF_WORD))) {
+        return 0;
+      }
+      return emit_modrm(encoding, candidate->reg, first);
+    case FORM_MODRM_IMM:
+      if (count != 2 || !is_rm(first, w_bit, 1) || second->kind != OPERAND_IMM ||
+          !value_fits(second, imm_bits, opcode.imm == IMM_S)) {
+        return 0;
+      }
+      if (!emit_modrm(encoding, candidate->reg, first)) {
+        return 0;
+      }
+      emit_value(encoding, second, imm_bits / 8);
+      return 1;
+    case FORM_SHIFT:
+      if (count != 2 || !is_rm(first, w_bit, 1)) {
+        return 0;
+      }
+      if (opcode.flags & OPF_CL) {
+        if (!is_register(second, 0) || second->reg != 1) {
+          return 0;
+        }
+      } else if (second->kind != OPERAND_IMM || second->label >= 0 || second->value != 1) {
+        return 0;
+      }
+      return emit_modrm(encoding, candidate->reg, first);
+    case FORM_ACC_IMM:
+    case FORM_REG_IMM:
+      if (count != 2 || !is_register(first, w_bit) || second->kind != OPERAND_IMM ||
+          first->reg != (opcode.form == FORM_ACC_IMM ? 0 : (byte_1 & RM_MASK)) ||
+          !value_fits(second, imm_bits, 0)) {
+        return 0;
+      }
+      emit_value(encoding, second, imm_bits / 8);
+      return 1;
+    case FORM_REG:
+      return count == 1 && is_register(first, 1) && first->reg == (byte_1 & RM_MASK);
+    case FORM_ACC_REG:
+      return count == 2 && is_accumulator(first, 1) && is_register(second, 1) &&
+             second->reg == (byte_1 & RM_MASK);
+    case FORM_SEG:
+      return count == 1 && first->kind == OPERAND_SEG && first->reg == ((byte_1 >> 3) & 0b11);
+    case FORM_ACC_MEM: {
+      const operand_t *memory = d_bit ? first : second;
+      const operand_t *accumulator = d_bit ? second : first;
+      if (count != 2 || !is_accumulator(accumulator, w_bit) || memory->kind != OPERAND_MEM ||
+          memory->reg != EA_DIRECT || !is_rm(memory, w_bit, 0) || !value_fits(memory, 16, 0)) {
+        return 0;
+      }
+      emit_value(encoding, memory, 2);
+      return 1;
+    }
+    case FORM_REL8:
+      if (count != 1 || (opcode.mnemonic == MN_JMP && !(first->modifiers & MOD_SHORT))) {
+        return 0;
+      }
+      return emit_relative(encoding, first, 1, origin);
+    case FORM_REL16:
+      if (count != 1) {
+        return 0;
+      }
+      return emit_relative(encoding, first, 2, origin);
+    case FORM_FAR:
+      if (count != 1 || first->kind != OPERAND_FAR || !value_fits(first, 16, 0) ||
+          first->segment_value < -32768 || first->segment_value > 65535) {
+        return 0;
+      }
+      emit_value(encoding, first, 2);
+      encoding->bytes[encoding->length++] = (uint8_t)first->segment_value;
+      encoding->bytes[encoding->length++] = (uint8_t)(first->segment_value >> 8);
+      return 1;
+    case FORM_IMM:
+      if (count != 1 || first->kind != OPERAND_IMM || !value_fits(first, imm_bits, 0)) {
+        return 0;
+      }
+      emit_value(encoding, first, imm_bits / 8);
+      return 1;
+    case FORM_PORT_IMM: {
+      const operand_t *port = (opcode.flags & OPF_CL) ? first : second;
+      const operand_t *accumulator = (opcode.flags & OPF_CL) ? second : first;
+      if (count != 2 || !is_accumulator(accumulator, w_bit) || port->kind != OPERAND_IMM ||
+          !value_fits(port, 8, 0)) {
+        return 0;
+      }
+      emit_value(encoding, port, 1);
+      return 1;
+    }
+    case FORM_PORT_DX: {
+      const operand_t *port = (opcode.flags & OPF_CL) ? first : second;
+      const operand_t *accumulator = (opcode.flags & OPF_CL) ? second : first;
+      return count == 2 && is_accumulator(accumulator, w_bit) && is_register(port, 1) && port->reg == 2;
+    }
+    case FORM_ESC:
+      if (count != 2 || first->kind != OPERAND_IMM || first->label >= 0 ||
+          first->value < 0 || first->value > 63 || (first->value >> 3) != (byte_1 & RM_MASK) ||
+          !is_rm(second, 1, 0)) {
+        return 0;
+      }
+      return emit_modrm(encoding, first->value & 0b111, second);
+  }
+  return 0;
+}
+
+uint8_t fits_with_values(const assembler_t *assembler, const deferred_t *instruction, const operand_t *operands,
+                         size_t address, int32_t value) {
+  /** fits_with_values
+   * Whether some candidate encodes the instruction once every known value
+   * is replaced by value, i.e. whether only a value's range stopped it
+   */
+  operand_t replaced[2];
+  encoding_t encoding;
+  uint8_t changed = 0;
+  for (uint8_t idx = 0; idx < instruction->count; ++idx) {
+    replaced[idx] = operands[idx];
+    if (replaced[idx].kind != OPERAND_IMM && replaced[idx].kind != OPERAND_MEM && replaced[idx].kind != OPERAND_FAR) {
+      continue;
+    }
+    if (replaced[idx].label < 0 && replaced[idx].value != value) {
+      replaced[idx].value = value;
+      changed = 1;
+    }
+    if (replaced[idx].kind == OPERAND_FAR && replaced[idx].segment_value != 0) {
+      replaced[idx].segment_value = 0;
+      changed = 1;
+    }
+  }
+  for (uint16_t idx = assembler->candidate_start[instruction->mnemonic];
+       changed && idx < assembler->candidate_start[instruction->mnemonic + 1]; ++idx) {
+    if (try_candidate(&assembler->candidates[idx], replaced, instruction->count, address, &encoding)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+error_t encode_instruction(const assembler_t *assembler, const deferred_t *instruction, const operand_t *operands,
+                           size_t address, encoding_t *result) {
+  /** encode_instruction
+   * Picks the shortest encoding among the mnemonic's candidates and puts
+   * it after its prefixes in result; the instruction starts at address
+   */
+  encoding_t encoding;
+  encoding_t *best = result;
+  uint8_t prefixes[2];
+  uint8_t prefix_count = 0;
+  int8_t segment = instruction->segment;
+  uint8_t mnemonic = instruction->mnemonic;
+  best->length = 0;
+  for (uint8_t idx = 0; idx < instruction->count; ++idx) {
+    if (operands[idx].kind == OPERAND_MEM && operands[idx].segment >= 0) {
+      if (segment >= 0) {
+        return JASM_SYNTAX_ERROR;
+      }
+      segment = operands[idx].segment;
+    }
+  }
+  if (instruction->repeat != REPEAT_NONE) {
+    prefixes[prefix_count++] = instruction->repeat == REPEAT_LOCK ? 0xf0 : instruction->repeat == REPEAT_REP ? 0xf3 : 0xf2;
+  }
+  if (segment >= 0) {
+    prefixes[prefix_count++] = 0x26 | (segment << 3);
+  }
+  address += prefix_count;
+  for (uint16_t idx = assembler->candidate_start[mnemonic]; idx < assembler->candidate_start[mnemonic + 1]; ++idx) {
+    if (try_candidate(&assembler->candidates[idx], operands, instruction->count, address, &encoding) &&
+        (best->length == 0 || encoding.length < best->length)) {
+      *best = encoding;
+    }
+  }
+  if (best->length == 0) {
+    /* Zero fits every field; a relative target at the instruction fits every displacement */
+    if (fits_with_values(assembler, instruction, operands, address, 0) ||
+        fits_with_values(assembler, instruction, operands, address, (int32_t)address)) {
+      return JASM_RANGE_ERROR;
+    }
+    return JASM_SYNTAX_ERROR;
+  }
+  if (prefix_count > 0) {
+    memmove(result->bytes + prefix_count, result->bytes, result->length);
+    memcpy(result->bytes, prefixes, prefix_count);
+    result->length += prefix_count;
+    for (uint8_t idx = 0; idx < result->fixup_count; ++idx) {
+      result->fixups[idx].position += prefix_count;
+    }
+  }
+  return JASM_SUCCESS;
+}
+
+error_t encode_deferred(const source_chunk_t *chunk, const deferred_t *deferred, uint8_t kind,
+                        size_t position, size_t address, encoding_t *encoding) {
+  /** encode_deferred
+   * Folds the operands of a data item or instruction for its position and
+   * address, and encodes it
+   */
+  operand_t operands[2];
+  for (uint8_t idx = 0; idx < deferred->count; ++idx) {
+    operand_t *operand = &operands[idx];
+    *operand = deferred->operands[idx];
+    if (resolve_expression(chunk, &operand->expression, position, address, &operand->value, &operand->label) != JASM_SUCCESS) {
+      return JASM_SYNTAX_ERROR;
+    }
+    if (operand->kind == OPERAND_FAR) {
+      int32_t label;
+      if (resolve_expression(chunk, &operand->segment_expression, position, address, &operand->segment_value, &label) != JASM_SUCCESS ||
+          label >= 0) {
+        return JASM_SYNTAX_ERROR;
+      }
+    }
+  }
+  if (kind == STATEMENT_DATA) {
+    if (!value_fits(&operands[0], deferred->mnemonic * 8, 0) && operands[0].label < 0) {
+      return JASM_RANGE_ERROR;
+    }
+    encoding->length = 0;
+    encoding->relative = 0;
+    encoding->fixup_count = 0;
+    emit_value(encoding, &operands[0], deferred->mnemonic);
+    return JASM_SUCCESS;
+  }
+  return encode_instruction(chunk->assembler, deferred, operands, address, encoding);
+}
+
+error_t add_statement(source_chunk_t *chunk, uint8_t kind, const deferred_t *deferred, uint32_t line) {
+  /** add_statement
+   * Adds a parsed data item or instruction. Encodings that neither labels
+   * nor the address can change join the last run of bytes; the others are
+   * deferred with a first guess at their length.
+   */
+  encoding_t encoding;
+  statement_t *statement;
+  uint8_t constant = 1;
+  error_t error_code;
+  for (uint8_t idx = 0; idx < deferred->count; ++idx) {
+    constant &= is_constant(&deferred->operands[idx].expression) && is_constant(&deferred->operands[idx].segment_expression);
+  }
+  error_code = encode_deferred(chunk, deferred, kind, 0, 0, &encoding);
+  if (constant && kind == STATEMENT_DATA && error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  if (constant && error_code == JASM_SUCCESS && !encoding.relative) {
+    statement = chunk->statement_count > 0 ? &chunk->statements[chunk->statement_count - 1] : NULL;
+    if (statement == NULL || statement->kind != STATEMENT_BYTES) {
+      statement = push_statement(chunk, STATEMENT_BYTES, line);
+      if (statement == NULL) {
+        return JASM_MEMORY_ERROR;
+      }
+    }
+    statement->length += encoding.length;
+    return append_string(&chunk->bytes, encoding.length, (const char *)encoding.bytes);
+  }
+  statement = push_statement(chunk, kind, line);
+  if (statement == NULL || push_deferred(chunk, deferred) != JASM_SUCCESS) {
+    return JASM_MEMORY_ERROR;
+  }
+  statement->detail = (uint32_t)chunk->deferred_count - 1;
+  statement->length = error_code == JASM_SUCCESS ? encoding.length : 0;
+  return JASM_SUCCESS;
+}
+
+error_t assemble_data(source_chunk_t *chunk, lexer_t *lexer, token_t *token, uint8_t bytes) {
+  /** assemble_data
+   * db/dw: comma-separated expressions stored as bytes or words
+   */
+  for (;;) {
+    deferred_t item;
+    error_t error_code;
+    memset(&item, 0, sizeof(item));
+    item.mnemonic = bytes;
+    item.count = 1;
+    item.operands[0].label = -1;
+    error_code = parse_expression(chunk, lexer, token, &item.operands[0].expression);
+    if (error_code == JASM_SUCCESS) {
+      error_code = add_statement(chunk, STATEMENT_DATA, &item, token->line);
+    }
+    if (error_code != JASM_SUCCESS) {
+      return error_code;
+    }
+    if (token->type != TOKEN_COMMA) {
+      return JASM_SUCCESS;
+    }
+    next_token(lexer, token);
+  }
+}
+
+error_t assemble_line(source_chunk_t *chunk, lexer_t *lexer, token_t *token) {
+  /** assemble_line
+   * [label:] [prefixes] mnemonic [operand [, operand]], or a directive:
+   * bits 16, org, db, dw
+   */
+  deferred_t instruction;
+  uint8_t kind, reg;
+  const keyword_t *keyword;
+  memset(&instruction, 0, sizeof(instruction));
+  instruction.repeat = REPEAT_NONE;
+  instruction.segment = -1;
+  if (token->type == TOKEN_IDENTIFIER) {
+    lexer_t peek = *lexer;
+    token_t colon;
+    next_token(&peek, &colon);
+    if (colon.type == TOKEN_COLON) {
+      int32_t idx = find_label(&chunk->labels, token->start, token->length, token->hash);
+      statement_t *statement;
+      if (idx < 0) {
+        return JASM_MEMORY_ERROR;
+      }
+      if (chunk->labels.labels[idx].position != NO_POSITION) {
+        return JASM_SYNTAX_ERROR;
+      }
+      chunk->labels.labels[idx].position = chunk->statement_count;
+      statement = push_statement(chunk, STATEMENT_LABEL, token->line);
+      if (statement == NULL) {
+        return JASM_MEMORY_ERROR;
+      }
+      statement->detail = (uint32_t)idx;
+      *lexer = peek;
+      next_token(lexer, token);
+    }
+  }
+  if (token->type == TOKEN_NEWLINE || token->type == TOKEN_END) {
+    return JASM_SUCCESS;
+  }
+  if (token->type != TOKEN_IDENTIFIER) {
+    return JASM_SYNTAX_ERROR;
+  }
+  keyword = lookup_keyword(token);
+  if (keyword != NULL && keyword->kind == KEYWORD_DIRECTIVE && keyword->value == DIRECTIVE_BITS) {
+    int32_t bits;
+    next_token(lexer, token);
+    if (token->type != TOKEN_NUMBER || token_number(token, &bits) != JASM_SUCCESS || bits != 16) {
+      return JASM_SYNTAX_ERROR;
+    }
+    return next_token(lexer, token);
+  }
+  if (keyword != NULL && keyword->kind == KEYWORD_DIRECTIVE && keyword->value == DIRECTIVE_ORG) {
+    /* Address of the next byte; labels and $ follow it. Checked once laid out. */
+    statement_t *statement;
+    int32_t label;
+    next_token(lexer, token);
+    if (parse_expression(chunk, lexer, token, &instruction.operands[0].expression) != JASM_SUCCESS) {
+      return JASM_SYNTAX_ERROR;
+    }
+    resolve_expression(chunk, &instruction.operands[0].expression, 0, 0, &instruction.value, &label);
+    statement = push_statement(chunk, STATEMENT_ORG, token->line);
+    if (statement == NULL || push_deferred(chunk, &instruction) != JASM_SUCCESS) {
+      return JASM_MEMORY_ERROR;
+    }
+    statement->detail = (uint32_t)chunk->deferred_count - 1;
+    return JASM_SUCCESS;
+  }
+  if (keyword != NULL && keyword->kind == KEYWORD_DIRECTIVE) {
+    uint8_t bytes = keyword->value == DIRECTIVE_DB ? 1 : 2;
+    next_token(lexer, token);
+    return assemble_data(chunk, lexer, token, bytes);
+  }
+  for (;;) {
+    instruction.mnemonic = lookup_mnemonic(token);
+    if (instruction.mnemonic == MN_LOCK || instruction.mnemonic == MN_REP || instruction.mnemonic == MN_REPNE) {
+      if (instruction.repeat != REPEAT_NONE) {
+        return JASM_SYNTAX_ERROR;
+      }
+      instruction.repeat = instruction.mnemonic == MN_LOCK ? REPEAT_LOCK : instruction.mnemonic == MN_REP ? REPEAT_REP : REPEAT_REPNE;
+    } else if (lookup_register(token, &kind, &reg) && kind == OPERAND_SEG && instruction.segment < 0) {
+      instruction.segment = reg;
+    } else {
+      break;
+    }
+    next_token(lexer, token);
+    if (token->type != TOKEN_IDENTIFIER) {
+      return JASM_SYNTAX_ERROR;
+    }
+  }
+  if (instruction.mnemonic == MNEMONIC_COUNT) {
+    return JASM_SYNTAX_ERROR;
+  }
+  next_token(lexer, token);
+  while (token->type != TOKEN_NEWLINE && token->type != TOKEN_END) {
+    error_t error_code;
+    if (instruction.count == 2 || (instruction.count > 0 && token->type != TOKEN_COMMA)) {
+      return JASM_SYNTAX_ERROR;
+    }
+    if (instruction.count > 0) {
+      next_token(lexer, token);
+    }
+    error_code = parse_operand(chunk, lexer, token, &instruction.operands[instruction.count++]);
+    if (error_code != JASM_SUCCESS) {
+      return error_code;
+    }
+  }
+  return add_statement(chunk, STATEMENT_INSTRUCTION, &instruction, token->line);
+}
+
+void measure_chunk(source_chunk_t *chunk) {
+  /** measure_chunk
+   * Length of the chunk and its last org, for the layout
+   */
+  chunk->length = 0;
+  chunk->has_org = 0;
+  for (size_t idx = 0; idx < chunk->statement_count; ++idx) {
+    const statement_t *statement = &chunk->statements[idx];
+    if (statement->kind == STATEMENT_ORG) {
+      chunk->has_org = 1;
+      chunk->org_offset = chunk->length;
+      chunk->org_value = chunk->deferred[statement->detail].value;
+    }
+    chunk->length += statement->length;
+  }
+}
+
+void *parse_chunk(void *argument) {
+  /** parse_chunk
+   * Thread body: parses a chunk into statements, stopping at the first
+   * error as a single pass would
+   */
+  source_chunk_t *chunk = argument;
+  lexer_t lexer;
+  token_t token;
+  init_string(&chunk->bytes, chunk->size / 4 + 16, NULL);
+  init_lexer(&lexer, chunk->source, chunk->size);
+  next_token(&lexer, &token);
+  while (token.type != TOKEN_END) {
+    error_t error_code = assemble_line(chunk, &lexer, &token);
+    if (error_code == JASM_SUCCESS && token.type != TOKEN_NEWLINE && token.type != TOKEN_END) {
+      error_code = JASM_SYNTAX_ERROR;
+    }
+    if (error_code != JASM_SUCCESS) {
+      chunk->error_code = error_code;
+      chunk->error_line = token.line;
+      chunk->error_position = chunk->statement_count;
+      break;
+    }
+    if (token.type == TOKEN_NEWLINE) {
+      next_token(&lexer, &token);
+    }
+  }
+  chunk->line_count = lexer.line - 1;
+  measure_chunk(chunk);
+  return NULL;
+}
+
+error_t merge_labels(assembler_t *assembler, source_chunk_t *chunks, size_t *chunk_count) {
+  /** merge_labels
+   * Enters the chunks' labels into the assembler's table in source order.
+   * A label already defined by an earlier chunk stops the chunk at its
+   * second definition, a syntax error, and drops the chunks after it.
+   */
+  for (size_t idx = 0; idx < *chunk_count; ++idx) {
+    source_chunk_t *chunk = &chunks[idx];
+    size_t stop = chunk->statement_count;
+    chunk->globals = malloc((chunk->labels.count + 1) * sizeof(int32_t));
+    if (chunk->globals == NULL) {
+      return JASM_MEMORY_ERROR;
+    }
+    for (size_t local = 0; local < chunk->labels.count; ++local) {
+      const label_t *label = &chunk->labels.labels[local];
+      int32_t global = find_label(&assembler->labels, label->name, label->length, label->hash);
+      if (global < 0) {
+        return JASM_MEMORY_ERROR;
+      }
+      chunk->globals[local] = global;
+      if (label->position < stop && assembler->labels.labels[global].position != NO_POSITION) {
+        stop = label->position;
+      }
+    }
+    for (size_t local = 0; local < chunk->labels.count; ++local) {
+      if (chunk->labels.labels[local].position < stop) {
+        assembler->labels.labels[chunk->globals[local]].position = chunk->first_statement + chunk->labels.labels[local].position;
+      }
+    }
+    if (stop < chunk->statement_count) {
+      chunk->error_code = JASM_SYNTAX_ERROR;
+      chunk->error_line = chunk->statements[stop].line;
+      chunk->error_position = stop;
+      chunk->statement_count = stop;
+      measure_chunk(chunk);
+    }
+    if (chunk->error_code != JASM_SUCCESS) {
+      *chunk_count = idx + 1;
+      break;
+    }
+  }
+  return JASM_SUCCESS;
+}
+
+void *size_chunk(void *argument) {
+  /** size_chunk
+   * Thread body: re-encodes the deferred statements against the last
+   * layout and notes whether any length or org moved
+   */
+  source_chunk_t *chunk = argument;
+  chunk->changed = 0;
+  if (chunk->deferred_count == 0) {
+    return NULL;
+  }
+  for (size_t idx = 0; idx < chunk->statement_count; ++idx) {
+    statement_t *statement = &chunk->statements[idx];
+    size_t position = chunk->first_statement + idx;
+    if (statement->kind == STATEMENT_ORG) {
+      deferred_t *org = &chunk->deferred[statement->detail];
+      int32_t value, label;
+      resolve_expression(chunk, &org->operands[0].expression, position, statement->address, &value, &label);
+      chunk->changed |= value != org->value;
+      org->value = value;
+    } else if (statement->kind == STATEMENT_DATA || statement->kind == STATEMENT_INSTRUCTION) {
+      encoding_t encoding;
+      size_t length = 0;
+      if (encode_deferred(chunk, &chunk->deferred[statement->detail], statement->kind, position, statement->address, &encoding) == JASM_SUCCESS) {
+        length = encoding.length;
+      }
+      chunk->changed |= length != statement->length;
+      statement->length = length;
+    }
+  }
+  measure_chunk(chunk);
+  return NULL;
+}
+
+void layout_chunks(source_chunk_t *chunks, size_t chunk_count) {
+  /** layout_chunks
+   * Prefix sum of the chunk lengths: where each chunk starts and the
+   * origin in effect there
+   */
+  size_t start = 0;
+  size_t origin = 0;
+  for (size_t idx = 0; idx < chunk_count; ++idx) {
+    chunks[idx].start = start;
+    chunks[idx].origin = origin;
+    if (chunks[idx].has_org) {
+      origin = (size_t)chunks[idx].org_value - (start + chunks[idx].org_offset);
+    }
+    start += chunks[idx].length;
+  }
+}
+
+void *place_chunk(void *argument) {
+  /** place_chunk
+   * Thread body: addresses of the chunk's statements and values of the
+   * labels it defines
+   */
+  source_chunk_t *chunk = argument;
+  label_t *labels = chunk->assembler->labels.labels;
+  size_t offset = chunk->start;
+  size_t origin = chunk->origin;
+  for (size_t idx = 0; idx < chunk->statement_count; ++idx) {
+    statement_t *statement = &chunk->statements[idx];
+    statement->address = origin + offset;
+    if (statement->kind == STATEMENT_LABEL) {
+      label_t *label = &labels[chunk->globals[statement->detail]];
+      if (label->position == chunk->first_statement + idx) {
+        label->value = (int32_t)statement->address;
+      }
+    } else if (statement->kind == STATEMENT_ORG) {
+      origin = (size_t)chunk->deferred[statement->detail].value - offset;
+    }
+    offset += statement->length;
+  }
+  return NULL;
+}
+
+void sweep_chunks(source_chunk_t *chunks, size_t chunk_count) {
+  /** sweep_chunks
+   * Lays the chunks out in one pass in source order. A statement only
+   * depends on the ones above it, so each is sized once against its final
+   * address and labels.
+   */
+  size_t offset = 0;
+  size_t origin = 0;
+  for (size_t idx = 0; idx < chunk_count; ++idx) {
+    source_chunk_t *chunk = &chunks[idx];
+    chunk->start = offset;
+    chunk->origin = origin;
+    for (size_t jdx = 0; jdx < chunk->statement_count; ++jdx) {
+      statement_t *statement = &chunk->statements[jdx];
+      size_t position = chunk->first_statement + jdx;
+      statement->address = origin + offset;
+      if (statement->kind == STATEMENT_LABEL) {
+        label_t *label = &chunk->assembler->labels.labels[chunk->globals[statement->detail]];
+        if (label->position == position) {
+          label->value = (int32_t)statement->address;
+        }
+      } else if (statement->kind == STATEMENT_ORG) {
+        deferred_t *org = &chunk->deferred[statement->detail];
+        int32_t label;
+        resolve_expression(chunk, &org->operands[0].expression, position, statement->address, &org->value, &label);
+        origin = (size_t)org->value - offset;
+      } else if (statement->kind != STATEMENT_BYTES) {
+        encoding_t encoding;
+        statement->length = 0;
+        if (encode_deferred(chunk, &chunk->deferred[statement->detail], statement->kind, position, statement->address, &encoding) == JASM_SUCCESS) {
+          statement->length = encoding.length;
+        }
+      }
+      offset += statement->length;
+    }
+    chunk->length = offset - chunk->start;
+  }
+}
+
+error_t patch_fixup(const source_chunk_t *chunk, const fixup_t *fixup, size_t next, uint8_t *bytes) {
+  /** patch_fixup
+   * Writes a reference to a label defined below it; next is the address
+   * after the instruction
+   */
+  const label_t *label = &chunk->assembler->labels.labels[fixup->label];
+  int32_t value;
+  if (label->position == NO_POSITION) {
+    return JASM_UNDEFINED_LABEL_ERROR;
+  }
+  value = label->value + fixup->addend;
+  if (fixup->kind == FIXUP_REL8 || fixup->kind == FIXUP_REL16) {
+    value -= (int32_t)next;
+  }
+  if ((fixup->kind == FIXUP_REL8 && (value < -128 || value > 127)) ||
+      (fixup->kind == FIXUP_ABS8 && (value < -128 || value > 255)) ||
+      (fixup->kind == FIXUP_ABS16 && (value < -32768 || value > 65535))) {
+    return JASM_RANGE_ERROR;
+  }
+  bytes[fixup->position] = (uint8_t)value;
+  if (fixup->kind == FIXUP_ABS16 || fixup->kind == FIXUP_REL16) {
+    bytes[fixup->position + 1] = (uint8_t)(value >> 8);
+  }
+  return JASM_SUCCESS;
+}
+
+void *emit_chunk(void *argument) {
+  /** emit_chunk
+   * Thread body: writes the chunk into its region of the output. The
+   * first error stops it; unresolved references are only noted, since a
+   * single pass reports them after every line has been read.
+   */
+  source_chunk_t *chunk = argument;
+  uint8_t *output = (uint8_t *)chunk->assembler->output.buffer + chunk->start;
+  const char *bytes = chunk->bytes.buffer;
+  size_t offset = 0;
+  for (size_t idx = 0; idx < chunk->statement_count; ++idx) {
+    statement_t *statement = &chunk->statements[idx];
+    size_t position = chunk->first_statement + idx;
+    error_t error_code = JASM_SUCCESS;
+    if (statement->kind == STATEMENT_BYTES) {
+      memcpy(output + offset, bytes, statement->length);
+      bytes += statement->length;
+    } else if (statement->kind == STATEMENT_ORG) {
+      int32_t value, label;
+      if (resolve_expression(chunk, &chunk->deferred[statement->detail].operands[0].expression, position,
+                             statement->address, &value, &label) != JASM_SUCCESS ||
+          label >= 0 || value < (int32_t)(chunk->start + offset) || value > 0xffff) {
+        error_code = JASM_SYNTAX_ERROR;
+      }
+    } else if (statement->kind != STATEMENT_LABEL) {
+      encoding_t encoding;
+      error_code = encode_deferred(chunk, &chunk->deferred[statement->detail], statement->kind, position, statement->address, &encoding);
+      if (error_code == JASM_SUCCESS) {
+        memcpy(output + offset, encoding.bytes, encoding.length);
+        for (uint8_t fixup = 0; fixup < encoding.fixup_count; ++fixup) {
+          error_t fixup_error = patch_fixup(chunk, &encoding.fixups[fixup], statement->address + encoding.length, output + offset);
+          if (fixup_error != JASM_SUCCESS && chunk->fixup_error_code == JASM_SUCCESS) {
+            chunk->fixup_error_code = fixup_error;
+            chunk->fixup_error_line = statement->line;
+          }
+        }
+      }
+    }
+    if (error_code != JASM_SUCCESS) {
+      chunk->error_code = error_code;
+      chunk->error_line = statement->line;
+      chunk->error_position = idx;
+      break;
+    }
+    offset += statement->length;
+  }
+  return NULL;
+}
+
+void run_chunks(source_chunk_t *chunks, pthread_t *threads, size_t chunk_count, void *(*body)(void *)) {
+  /** run_chunks
+   * Runs a thread body over every chunk; the calling thread takes the
+   * first
+   */
+  for (size_t idx = 1; idx < chunk_count; ++idx) {
+    chunks[idx].threaded = pthread_create(&threads[idx], NULL, body, &chunks[idx]) == 0;
+    if (!chunks[idx].threaded) {
+      body(&chunks[idx]);
+    }
+  }
+  body(&chunks[0]);
+  for (size_t idx = 1; idx < chunk_count; ++idx) {
+    if (chunks[idx].threaded) {
+      pthread_join(threads[idx], NULL);
+    }
+  }
+}
+
+void split_source(const char *source, size_t size, source_chunk_t *chunks, size_t chunk_count) {
+  /** split_source
+   * Cuts the source into chunk_count slices of about the same size that
+   * end after a line break
+   */
+  size_t begin = 0;
+  for (size_t idx = 0; idx < chunk_count; ++idx) {
+    size_t end = size / chunk_count * (idx + 1);
+    if (idx + 1 == chunk_count || end <= begin) {
+      end = idx + 1 == chunk_count ? size : begin;
+    }
+    if (end < size && idx + 1 < chunk_count) {
+      const char *newline = memchr(source + end, '\n', size - end);
+      end = newline != NULL ? (size_t)(newline - source) + 1 : size;
+    }
+    chunks[idx].source = source + begin;
+    chunks[idx].size = end - begin;
+    begin = end;
+  }
+}
+
+void free_chunk(source_chunk_t *chunk) {
+  free(chunk->statements);
+  free(chunk->deferred);
+  free(chunk->terms);
+  free(chunk->globals);
+  free_string(&chunk->bytes);
+  free_label_table(&chunk->labels);
+}
+
+error_t assemble(assembler_t *assembler, const char *source, size_t size) {
+  /** assemble
+   * Assembles a whole source buffer into assembler->output, on
+   * assembler->thread_count threads for sources of more than one
+   * ASSEMBLY_MIN_CHUNK
+   */
+  size_t chunk_count = assembler->thread_count ? assembler->thread_count : online_threads();
+  size_t parsed_count, statement_count = 0;
+  uint32_t line_count = 0;
+  uint8_t converged = 0;
+  source_chunk_t *chunks;
+  pthread_t *threads;
+  error_t error_code;
+  if (chunk_count > size / ASSEMBLY_MIN_CHUNK) {
+    chunk_count = size / ASSEMBLY_MIN_CHUNK ? size / ASSEMBLY_MIN_CHUNK : 1;
+  }
+  chunks = calloc(chunk_count, sizeof(source_chunk_t));
+  threads = calloc(chunk_count, sizeof(pthread_t));
+  if (chunks == NULL || threads == NULL) {
+    free(chunks);
+    free(threads);
+    return JASM_MEMORY_ERROR;
+  }
+  split_source(source, size, chunks, chunk_count);
+  parsed_count = chunk_count;
+  for (size_t idx = 0; idx < chunk_count; ++idx) {
+    chunks[idx].assembler = assembler;
+  }
+  /* Phase one: parse, and keep the chunks up to the first one that failed */
+  run_chunks(chunks, threads, chunk_count, parse_chunk);
+  for (size_t idx = 0; idx < chunk_count; ++idx) {
+    chunks[idx].first_statement = statement_count;
+    chunks[idx].first_line = line_count;
+    statement_count += chunks[idx].statement_count;
+    line_count += chunks[idx].line_count;
+    if (chunks[idx].error_code != JASM_SUCCESS) {
+      chunk_count = idx + 1;
+    }
+  }
+  error_code = merge_labels(assembler, chunks, &chunk_count);
+  /* Layout: relax until no length moves */
+  if (error_code == JASM_SUCCESS) {
+    layout_chunks(chunks, chunk_count);
+    run_chunks(chunks, threads, chunk_count, place_chunk);
+    for (size_t round = 0; round < RELAX_ROUNDS && !converged; ++round) {
+      run_chunks(chunks, threads, chunk_count, size_chunk);
+      converged = 1;
+      for (size_t idx = 0; idx < chunk_count; ++idx) {
+        converged &= !chunks[idx].changed;
+      }
+      if (!converged) {
+        layout_chunks(chunks, chunk_count);
+        run_chunks(chunks, threads, chunk_count, place_chunk);
+      }
+    }
+    if (!converged) {
+      sweep_chunks(chunks, chunk_count);
+    }
+    error_code = reserve_string(&assembler->output, chunks[chunk_count - 1].start + chunks[chunk_count - 1].length);
+  }
+  /* Phase two: encode into disjoint regions of the output */
+  if (error_code == JASM_SUCCESS) {
+    run_chunks(chunks, threads, chunk_count, emit_chunk);
+    assembler->output.idx = chunks[chunk_count - 1].start + chunks[chunk_count - 1].length;
+    for (size_t idx = 0; idx < chunk_count && error_code == JASM_SUCCESS; ++idx) {
+      error_code = chunks[idx].error_code;
+      if (error_code != JASM_SUCCESS) {
+        assembler->error_line = chunks[idx].first_line + chunks[idx].error_line;
+      }
+    }
+    for (size_t idx = 0; idx < chunk_count && error_code == JASM_SUCCESS; ++idx) {
+      error_code = chunks[idx].fixup_error_code;
+      if (error_code != JASM_SUCCESS) {
+        assembler->error_line = chunks[idx].first_line + chunks[idx].fixup_error_line;
+      }
+    }
+  }
+  for (size_t idx = 0; idx < parsed_count; ++idx) {
+    free_chunk(&chunks[idx]);
+  }
+  free(chunks);
+  free(threads);
+  return error_code;
+}
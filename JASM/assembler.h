@@ -0,0 +1,169 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include <stddef.h>
+
+/* Smallest source slice worth a thread */
+#define ASSEMBLY_MIN_CHUNK  (1 << 16)
+/* Parallel relaxation rounds before the layout is finished by one in-order sweep */
+#define RELAX_ROUNDS        4
+#define NO_POSITION         SIZE_MAX
+
+/* Operand size and distance modifiers */
+#define SIZE_NONE   0
+#define SIZE_BYTE   1
+#define SIZE_WORD   2
+#define MOD_SHORT   0x01
+#define MOD_FAR     0x02
+
+/* One label in an expression, added or subtracted */
+typedef struct term_t {
+  int32_t   label;
+  int32_t   sign;
+} term_t;
+
+/* constant + dollar * $ + terms; labels are folded once the layout is known */
+typedef struct expression_t {
+  int32_t   constant;
+  int32_t   dollar;     /* coefficient of $ */
+  uint32_t  first_term; /* into the chunk's terms */
+  uint32_t  term_count;
+} expression_t;
+
+typedef struct operand_t {
+  uint8_t   kind;       /* operand_kind_t; jump targets parse as OPERAND_IMM */
+  uint8_t   reg;        /* register number, r/m base or EA_DIRECT */
+  uint8_t   size;       /* SIZE_* */
+  uint8_t   modifiers;  /* MOD_* */
+  uint8_t   has_disp;   /* memory operand had a constant term */
+  int8_t    segment;    /* segment override, -1 for none */
+  int32_t   value;      /* immediate, displacement or target */
+  int32_t   segment_value; /* far pointer segment */
+  int32_t   label;      /* label added to value, -1 for none */
+  expression_t expression;          /* value and label before folding */
+  expression_t segment_expression;  /* segment_value before folding */
+} operand_t;
+
+typedef struct label_t {
+  const char  *name;
+  uint32_t    length;
+  uint32_t    hash;       /* lexer hash of the name */
+  int32_t     value;
+  size_t      position;   /* statement that defines it, NO_POSITION if none */
+} label_t;
+
+/* Labels by name, open addressing over slots of label indices */
+typedef struct label_table_t {
+  label_t   *labels;
+  size_t    count;
+  size_t    capacity;
+  int32_t   *slots;       /* -1 for empty */
+  size_t    slot_count;   /* power of two */
+} label_table_t;
+
+typedef enum fixup_kind_t {
+  FIXUP_ABS8,
+  FIXUP_ABS16,
+  FIXUP_REL8,
+  FIXUP_REL16,
+} fixup_kind_t;
+
+/* Bytes of an encoding that wait for a label that is not yet defined */
+typedef struct fixup_t {
+  uint8_t   position;   /* first byte to patch */
+  uint8_t   kind;       /* fixup_kind_t */
+  int32_t   label;
+  int32_t   addend;
+} fixup_t;
+
+/* Machine code for one instruction or data item */
+typedef struct encoding_t {
+  uint8_t   bytes[8];
+  uint8_t   length;
+  uint8_t   relative;   /* bytes depend on the address (emit_relative) */
+  uint8_t   fixup_count;
+  fixup_t   fixups[2];  /* position is relative to the encoding */
+} encoding_t;
+
+typedef enum statement_kind_t {
+  STATEMENT_BYTES,        /* run of encodings that need no layout */
+  STATEMENT_LABEL,
+  STATEMENT_ORG,
+  STATEMENT_DATA,
+  STATEMENT_INSTRUCTION,
+} statement_kind_t;
+
+/* Unit of the layout; only ORG, DATA and INSTRUCTION are re-encoded */
+typedef struct statement_t {
+  uint8_t   kind;       /* statement_kind_t */
+  uint32_t  line;       /* relative to the chunk */
+  uint32_t  detail;     /* LABEL: chunk label; others but BYTES: deferred record */
+  size_t    length;     /* bytes it takes in the output */
+  size_t    address;    /* set by the layout */
+} statement_t;
+
+/* Parsed statement whose encoding waits for the layout */
+typedef struct deferred_t {
+  uint8_t   mnemonic;   /* DATA: item width in bytes */
+  uint8_t   repeat;
+  int8_t    segment;
+  uint8_t   count;
+  int32_t   value;      /* ORG: address it sets */
+  operand_t operands[2];
+} deferred_t;
+
+/* One encoding choice for a mnemonic: a first byte and, for groups, the reg field */
+typedef struct candidate_t {
+  uint8_t   byte_1;
+  uint8_t   reg;
+} candidate_t;
+
+typedef struct assembler_t {
+  string_t    output;
+  label_table_t labels;     /* position is a statement number across chunks */
+  candidate_t candidates[512];
+  uint16_t    candidate_start[MNEMONIC_COUNT + 1];
+  size_t      thread_count; /* 0 for every online processor */
+  uint32_t    error_line;
+} assembler_t;
+
+/* A line-aligned slice of the source and what its lines parsed to */
+typedef struct source_chunk_t {
+  assembler_t   *assembler;
+  const char    *source;
+  size_t        size;
+  statement_t   *statements;
+  size_t        statement_count;
+  size_t        statement_capacity;
+  deferred_t    *deferred;
+  size_t        deferred_count;
+  size_t        deferred_capacity;
+  term_t        *terms;
+  size_t        term_count;
+  size_t        term_capacity;
+  string_t      bytes;          /* contents of the BYTES statements, in order */
+  label_table_t labels;         /* position is a statement of this chunk */
+  int32_t       *globals;       /* chunk label to assembler label */
+  size_t        first_statement;
+  uint32_t      first_line;
+  uint32_t      line_count;
+  size_t        start;          /* output offset of the chunk */
+  size_t        origin;         /* origin in effect at its start */
+  size_t        length;         /* bytes it takes in the output */
+  size_t        org_offset;     /* chunk offset of its last org */
+  int32_t       org_value;
+  uint8_t       has_org;
+  uint8_t       changed;        /* a length or org moved in the last sizing */
+  error_t       error_code;     /* first parse, encoding or org error */
+  uint32_t      error_line;
+  size_t        error_position; /* statement it stopped at */
+  error_t       fixup_error_code; /* first unresolved or out of range label */
+  uint32_t      fixup_error_line;
+  uint8_t       threaded;
+} source_chunk_t;
+
+error_t init_assembler(assembler_t *assembler);
+error_t free_assembler(assembler_t *assembler);
+error_t assemble(assembler_t *assembler, const char *source, size_t size);
+
+#endif
@@ -0,0 +1,217 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "common.h"
+#include "error.h"
+#include "file_handler.h"
+#include "string_builder.h"
+#include "writer.h"
+#include "decoder.h"
+#include "disassembler.h"
+#include "parallel.h"
+#include "batch.h"
+
+error_t init_batch(batch_t *batch, size_t thread_count) {
+  /** init_batch
+   * Empty batch for thread_count workers, 0 for every online processor
+   */
+  memset(batch, 0, sizeof(*batch));
+  batch->thread_count = thread_count ? thread_count : online_threads();
+  batch->workers = calloc(batch->thread_count, sizeof(batch_worker_t));
+  if (batch->workers == NULL || init_string(&batch->names, BUFFER_SIZE, NULL) != JASM_SUCCESS) {
+    free(batch->workers);
+    return JASM_MEMORY_ERROR;
+  }
+  for (size_t idx = 0; idx < batch->thread_count; ++idx) {
+    batch->workers[idx].batch = batch;
+  }
+  pthread_mutex_init(&batch->lock, NULL);
+  return JASM_SUCCESS;
+}
+
+error_t free_batch(batch_t *batch) {
+  for (size_t idx = 0; idx < batch->thread_count; ++idx) {
+    free_string(&batch->workers[idx].arena);
+  }
+  free(batch->workers);
+  free(batch->jobs);
+  free_string(&batch->names);
+  pthread_mutex_destroy(&batch->lock);
+  return JASM_SUCCESS;
+}
+
+error_t add_batch_file(batch_t *batch, const char *file_name, size_t length) {
+  /** add_batch_file
+   * Queues a file by name, copying the name
+   */
+  error_t error_code;
+  if (batch->job_count == batch->job_capacity) {
+    size_t capacity = batch->job_capacity ? batch->job_capacity * 2 : 256;
+    batch_job_t *jobs = realloc(batch->jobs, capacity * sizeof(batch_job_t));
+    if (jobs == NULL) {
+      return JASM_MEMORY_ERROR;
+    }
+    batch->jobs = jobs;
+    batch->job_capacity = capacity;
+  }
+  batch->jobs[batch->job_count].name = batch->names.idx;
+  error_code = append_string(&batch->names, length, file_name);
+  if (error_code == JASM_SUCCESS) {
+    error_code = push_char(&batch->names, '\0');
+  }
+  if (error_code == JASM_SUCCESS) {
+    batch->job_count++;
+  }
+  return error_code;
+}
+
+error_t read_manifest(batch_t *batch, char *manifest_name) {
+  /** read_manifest
+   * Queues every non-empty line of a manifest, "-" for stdin
+   */
+  binary_file_t manifest;
+  size_t start = 0;
+  error_t error_code = load_binary_file(manifest_name, &manifest);
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  for (size_t idx = 0; idx <= manifest.byte_count && error_code == JASM_SUCCESS; ++idx) {
+    if (idx == manifest.byte_count || manifest.bytes[idx] == '\n') {
+      size_t end = idx;
+      if (end > start && manifest.bytes[end - 1] == '\r') {
+        end--;
+      }
+      if (end > start) {
+        error_code = add_batch_file(batch, (const char *)manifest.bytes + start, end - start);
+      }
+      start = idx + 1;
+    }
+  }
+  unload_binary_file(&manifest);
+  return error_code;
+}
+
+error_t read_directory(batch_t *batch, const char *directory_name) {
+  /** read_directory
+   * Queues the regular files of a directory in name order
+   */
+  struct dirent **entries;
+  string_t path;
+  error_t error_code = JASM_SUCCESS;
+  int count = scandir(directory_name, &entries, NULL, alphasort);
+  if (count < 0) {
+    return JASM_FILE_OPEN_ERROR;
+  }
+  init_string(&path, BUFFER_SIZE, NULL);
+  for (int idx = 0; idx < count; ++idx) {
+    struct stat status;
+    if (error_code == JASM_SUCCESS) {
+      clear_string(&path);
+      append_string(&path, strlen(directory_name), directory_name);
+      push_char(&path, '/');
+      append_string(&path, strlen(entries[idx]->d_name), entries[idx]->d_name);
+      push_char(&path, '\0');
+      if (stat(path.buffer, &status) == 0 && S_ISREG(status.st_mode)) {
+        error_code = add_batch_file(batch, path.buffer, path.idx - 1);
+      }
+    }
+    free(entries[idx]);
+  }
+  free(entries);
+  free_string(&path);
+  return error_code;
+}
+
+error_t list_job(const char *file_name, batch_job_t *job, string_t *arena) {
+  /** list_job
+   * Appends a file's name and listing, as jasm prints it for several
+   * files, to a worker's arena. An empty file lists as its banner alone.
+   */
+  binary_file_t binary;
+  error_t error_code = load_binary_contents((char *)file_name, &binary);
+  job->text_offset = arena->idx;
+  if (error_code == JASM_SUCCESS) {
+    append_file_header(FORMAT_TEXT, strlen(file_name), file_name, arena);
+    append_format_header(FORMAT_TEXT, arena);
+    for (size_t idx = 0; idx < binary.byte_count;) {
+      idx += disassemble_line(binary.bytes, idx, binary.byte_count, arena);
+    }
+    unload_binary_file(&binary);
+  }
+  job->text_length = arena->idx - job->text_offset;
+  return error_code;
+}
+
+void *batch_worker(void *argument) {
+  /** batch_worker
+   * Thread body: lists jobs of the current round until none are left
+   */
+  batch_worker_t *worker = argument;
+  batch_t *batch = worker->batch;
+  for (;;) {
+    size_t job;
+    pthread_mutex_lock(&batch->lock);
+    job = batch->next < batch->window_end ? batch->next++ : batch->window_end;
+    pthread_mutex_unlock(&batch->lock);
+    if (job == batch->window_end) {
+      break;
+    }
+    batch->jobs[job].worker = (size_t)(worker - batch->workers);
+    batch->jobs[job].error_code = list_job(batch->names.buffer + batch->jobs[job].name, &batch->jobs[job],
+                                           &worker->arena);
+  }
+  return NULL;
+}
+
+error_t run_batch(batch_t *batch, writer_t *writer) {
+  /** run_batch
+   * Lists every queued file, BATCH_WINDOW jobs per round, and writes the
+   * listings in queue order. Files that fail are reported on stderr and
+   * skipped; the first failure is returned once all are done.
+   */
+  error_t error_code = JASM_SUCCESS;
+  size_t workers = batch->thread_count;
+  for (size_t first = 0; first < batch->job_count; first = batch->window_end) {
+    batch->next = first;
+    batch->window_end = batch->job_count - first > BATCH_WINDOW ? first + BATCH_WINDOW : batch->job_count;
+    if (workers > batch->window_end - first) {
+      workers = batch->window_end - first;
+    }
+    for (size_t idx = 0; idx < workers; ++idx) {
+      clear_string(&batch->workers[idx].arena);
+    }
+    for (size_t idx = 1; idx < workers; ++idx) {
+      batch_worker_t *worker = &batch->workers[idx];
+      worker->threaded = pthread_create(&worker->thread, NULL, batch_worker, worker) == 0;
+    }
+    /* The calling thread works too, and picks up what failed to start */
+    batch_worker(&batch->workers[0]);
+    for (size_t idx = 1; idx < workers; ++idx) {
+      if (batch->workers[idx].threaded) {
+        pthread_join(batch->workers[idx].thread, NULL);
+      }
+    }
+    for (size_t job = first; job < batch->window_end; ++job) {
+      batch_job_t *entry = &batch->jobs[job];
+      if (entry->error_code != JASM_SUCCESS) {
+        fprintf(stderr, "%s: skipped, error %u\n", batch->names.buffer + entry->name, (unsigned)entry->error_code);
+        if (error_code == JASM_SUCCESS) {
+          error_code = entry->error_code;
+        }
+        continue;
+      }
+      if (write_bytes(writer, entry->text_length,
+                      batch->workers[entry->worker].arena.buffer + entry->text_offset) != JASM_SUCCESS) {
+        return JASM_FILE_WRITE_ERROR;
+      }
+    }
+  }
+  if (flush_writer(writer) != JASM_SUCCESS) {
+    return JASM_FILE_WRITE_ERROR;
+  }
+  return error_code;
+}
@@ -0,0 +1,50 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+/* Files listed per round before their output is written */
+#define BATCH_WINDOW 4096
+
+typedef struct batch_job_t {
+  size_t      name;         /* offset of the file name in names */
+  size_t      worker;       /* worker whose arena holds the listing */
+  size_t      text_offset;
+  size_t      text_length;
+  error_t     error_code;
+} batch_job_t;
+
+typedef struct batch_worker_t {
+  struct batch_t  *batch;
+  string_t        arena;      /* listings of the jobs it ran this round */
+  pthread_t       thread;
+  uint8_t         threaded;   /* running on its own thread */
+} batch_worker_t;
+
+/** Batch
+ * Many small files listed by a pool of workers in one process. Workers
+ * claim jobs in order from a shared counter and append each listing to
+ * their own arena; once a window of jobs is done the listings are written
+ * in job order, so the output does not depend on scheduling.
+ */
+typedef struct batch_t {
+  batch_job_t     *jobs;
+  size_t          job_count;
+  size_t          job_capacity;
+  string_t        names;        /* file names, NUL-terminated, back to back */
+  size_t          next;         /* next unclaimed job */
+  size_t          window_end;   /* jobs of the current round end here */
+  pthread_mutex_t lock;
+  batch_worker_t  *workers;
+  size_t          thread_count;
+} batch_t;
+
+error_t init_batch(batch_t *batch, size_t thread_count);
+error_t free_batch(batch_t *batch);
+error_t add_batch_file(batch_t *batch, const char *file_name, size_t length);
+error_t read_manifest(batch_t *batch, char *manifest_name);
+error_t read_directory(batch_t *batch, const char *directory_name);
+error_t run_batch(batch_t *batch, writer_t *writer);
+
+#endif
@@ -0,0 +1,1797 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "common.h"
+#include "error.h"
+#include "file_handler.h"
+#include "opcode_table.h"
+#include "string_builder.h"
+#include "writer.h"
+#include "format.h"
+#include "decoder.h"
+#include "disassembler.h"
+#include "lexer.h"
+#include "assembler.h"
+#include "incremental.h"
+#include "parallel.h"
+#include "emulator.h"
+#include "jit.h"
+#include "stream.h"
+#include "flow.h"
+#include "cfg.h"
+#include "batch.h"
+
+/** Bench
+ * make check: the test.asm seed corpus and a random stream of valid 8086
+ * instructions are disassembled, reassembled and compared byte for byte,
+ * a label-heavy source must assemble the same on one thread and on
+ * several, the SIMD formatting kernels must match the scalar ones, the
+ * random stream's records must render like its listing and its JSON Lines
+ * must parse and name each instruction. A small program's traced listing
+ * must label its branch targets and list its unreached bytes as data,
+ * and its control-flow graph must have the expected blocks and edges.
+ * Symbols must index in address and insertion order, a NASM map must
+ * load relative to its origin, and a damaged map.idx must be rebuilt. An
+ * image past PARALLEL_THRESHOLD must list the same in parallel as
+ * serially, an image over several ring wraps the same streamed as mapped,
+ * and a manifest of small files the same batched as one by one. Random
+ * self-modifying programs must end in the same state under run_cpu as
+ * single-stepped, and hot loops the same with the JIT; every lazily
+ * flagged operation must materialize the flags computed eagerly.
+ * make bench: the same checks, then disassembly and assembly throughput.
+ * Results are written one "name value" pair per line so runs can be
+ * diffed; only the throughput lines change between identical builds.
+ */
+
+#define BENCH_SEED          0x8086
+#define BENCH_INSTRUCTIONS  (1 << 18)
+#define BENCH_WINDOW        8           /* longest 8086 instruction with prefixes */
+#define BENCH_SECONDS       0.5
+#define BENCH_THREADS       4           /* chunks of the parallel assembly check */
+#define BENCH_PATCHES       256         /* patches of the incremental relisting check */
+#define BENCH_PATCH_WINDOW  4096        /* bytes of the random stream they land in */
+#define BENCH_LABEL_LINES   20000       /* lines of the label-heavy source, about 330 KB */
+#define BENCH_LABEL_SPACING 4           /* lines per label definition */
+#define BENCH_LABEL_REACH   4           /* labels a jz may reach either way */
+#define BENCH_KERNEL_BYTES  64          /* longest input of the formatting kernel check */
+#define BENCH_PREFIX_RUN    64          /* longest run of prefixes in the parallel listing check */
+#define BENCH_PROGRAMS      200         /* random programs of the emulator check */
+#define BENCH_PROGRAM_OPS   12          /* most operations in a program's loop body */
+#define BENCH_PROGRAM_LIMIT 20000       /* instruction budget per program */
+#define BENCH_FLAG_RANDOM   6           /* random operands of the flags check, after the boundaries */
+#define BENCH_RING_WRAPS    5           /* ring wraps in the stream check's image */
+#define BENCH_BATCH_FILES   (BATCH_WINDOW + 37) /* files of the batch check, over two rounds */
+#define BENCH_SYMBOLS       30000       /* generated symbols of the symbol check, three per address */
+
+uint64_t next_random(uint64_t *state) {
+  /** next_random
+   * xorshift64*, fixed seed so every run generates the same stream
+   */
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 0x2545f4914f6cdd1dull;
+}
+
+double elapsed_seconds(const struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+size_t generate_stream(uint64_t *state, uint8_t *bytes, size_t instruction_count) {
+  /** generate_stream
+   * Appends random byte windows and keeps the instruction each one decodes
+   * to, skipping windows that decode as data. bytes holds
+   * instruction_count * BENCH_WINDOW bytes.
+   */
+  instruction_t instruction;
+  size_t byte_count = 0;
+  for (size_t idx = 0; idx < instruction_count;) {
+    uint64_t window = next_random(state);
+    memcpy(bytes + byte_count, &window, BENCH_WINDOW);
+    decode_instruction(bytes + byte_count, BENCH_WINDOW, byte_count, &instruction);
+    if (instruction.mnemonic == MN_INVALID) {
+      continue;
+    }
+    byte_count += instruction.length;
+    ++idx;
+  }
+  return byte_count;
+}
+
+size_t disassemble_source(uint8_t *bytes, size_t byte_count, string_t *source) {
+  /** disassemble_source
+   * Renders a binary as assembler source, one instruction per line.
+   * Returns the instruction count.
+   */
+  size_t count = 0;
+  clear_string(source);
+  append_literal(source, "bits 16\n");
+  for (size_t idx = 0; idx < byte_count; ++count) {
+    idx += disassemble_8086(bytes + idx, byte_count - idx, source);
+    push_char(source, '\n');
+  }
+  return count;
+}
+
+void generate_labels(uint64_t *state, string_t *source) {
+  /** generate_labels
+   * Writes BENCH_LABEL_LINES lines that define a label every
+   * BENCH_LABEL_SPACING lines and use labels forward and backward: jmp,
+   * call, mov reg, label and add reg, label reach any label, jz only the
+   * labels within BENCH_LABEL_REACH. The image stays under 64 KiB so every
+   * label fits an imm16.
+   */
+  static const char *const registers[] = {"ax", "bx", "cx", "dx", "si", "di"};
+  size_t label_count = BENCH_LABEL_LINES / BENCH_LABEL_SPACING;
+  char line[STRING_SIZE];
+  clear_string(source);
+  append_literal(source, "bits 16\n");
+  for (size_t idx = 0; idx < BENCH_LABEL_LINES; ++idx) {
+    size_t here = idx / BENCH_LABEL_SPACING;
+    size_t target = (size_t)(next_random(state) % label_count);
+    uint64_t choice = next_random(state);
+    int length;
+    if (idx % BENCH_LABEL_SPACING == 0) {
+      length = snprintf(line, sizeof(line), "label_%05zu:\n", here);
+    } else if (choice % 5 == 0) {
+      length = snprintf(line, sizeof(line), "jmp label_%05zu\n", target);
+    } else if (choice % 5 == 1) {
+      length = snprintf(line, sizeof(line), "call label_%05zu\n", target);
+    } else if (choice % 5 == 2) {
+      target = here + (size_t)(choice >> 8) % (2 * BENCH_LABEL_REACH + 1);
+      target = target < BENCH_LABEL_REACH ? 0 : target - BENCH_LABEL_REACH;
+      target = target < label_count ? target : label_count - 1;
+      length = snprintf(line, sizeof(line), "jz label_%05zu\n", target);
+    } else {
+      length = snprintf(line, sizeof(line), "%s %s, label_%05zu\n", choice % 5 == 3 ? "mov" : "add",
+                        registers[(choice >> 8) % 6], target);
+    }
+    append_string(source, (size_t)length, line);
+  }
+}
+
+error_t assemble_source(const string_t *source, string_t *binary, uint32_t *error_line, size_t thread_count) {
+  /** assemble_source
+   * Assembles source into binary, replacing its contents. A thread_count
+   * of 0 uses every online processor.
+   */
+  assembler_t assembler;
+  error_t error_code;
+  init_assembler(&assembler);
+  assembler.thread_count = thread_count;
+  error_code = assemble(&assembler, source->buffer, source->idx);
+  clear_string(binary);
+  if (error_code == JASM_SUCCESS) {
+    append_string(binary, assembler.output.idx, assembler.output.buffer);
+  }
+  *error_line = assembler.error_line;
+  free_assembler(&assembler);
+  return error_code;
+}
+
+uint8_t round_trip(const char *name, string_t *binary, string_t *source, FILE *report) {
+  /** round_trip
+   * Disassembles binary, reassembles the listing and compares the result
+   * with binary. Reports the outcome under name.
+   */
+  string_t again;
+  uint32_t error_line = 0;
+  uint8_t passed = 0;
+  size_t count = disassemble_source((uint8_t *)binary->buffer, binary->idx, source);
+  error_t error_code;
+  size_t mismatch = binary->idx;
+  init_string(&again, binary->idx + 1, NULL);
+  error_code = assemble_source(source, &again, &error_line, 0);
+  if (error_code == JASM_SUCCESS) {
+    for (size_t idx = 0; idx < binary->idx; ++idx) {
+      if (idx >= again.idx || binary->buffer[idx] != again.buffer[idx]) {
+        mismatch = idx;
+        break;
+      }
+    }
+    if (mismatch == binary->idx && again.idx != binary->idx) {
+      mismatch = again.idx;
+    }
+  }
+  fprintf(report, "%s.instructions %zu\n", name, count);
+  fprintf(report, "%s.bytes %zu\n", name, binary->idx);
+  if (error_code != JASM_SUCCESS) {
+    fprintf(report, "%s.roundtrip fail line %u error 0x%02x\n", name, (unsigned)error_line, error_code);
+  } else if (mismatch != binary->idx || again.idx != binary->idx) {
+    fprintf(report, "%s.roundtrip fail offset %zu\n", name, mismatch);
+  } else {
+    fprintf(report, "%s.roundtrip ok\n", name);
+    passed = 1;
+  }
+  free_string(&again);
+  return passed;
+}
+
+uint8_t check_seed(char *seed_name, string_t *source, FILE *report) {
+  /** check_seed
+   * The seed corpus must assemble and survive a disassembly round trip
+   */
+  binary_file_t seed;
+  string_t text, binary;
+  uint32_t error_line = 0;
+  uint8_t passed = 0;
+  if (load_binary_file(seed_name, &seed) != JASM_SUCCESS) {
+    fprintf(report, "seed.assemble fail missing %s\n", seed_name);
+    return 0;
+  }
+  init_string(&text, seed.byte_count + 1, NULL);
+  init_string(&binary, BUFFER_SIZE, NULL);
+  append_string(&text, seed.byte_count, (const char *)seed.bytes);
+  if (assemble_source(&text, &binary, &error_line, 0) != JASM_SUCCESS) {
+    fprintf(report, "seed.assemble fail line %u\n", (unsigned)error_line);
+  } else {
+    fprintf(report, "seed.assemble ok\n");
+    passed = round_trip("seed", &binary, source, report);
+  }
+  free_string(&binary);
+  free_string(&text);
+  unload_binary_file(&seed);
+  return passed;
+}
+
+uint8_t check_random(string_t *binary, string_t *source, FILE *report) {
+  /** check_random
+   * Generates the random stream, canonicalizes it through one round trip
+   * (the same instruction often has several encodings), then requires a
+   * second round trip to be exact and to render identically. Assembling
+   * it in BENCH_THREADS chunks must give the same bytes.
+   */
+  uint64_t state = BENCH_SEED;
+  uint32_t error_line = 0;
+  uint8_t *bytes = malloc(BENCH_INSTRUCTIONS * BENCH_WINDOW);
+  size_t byte_count;
+  string_t text;
+  uint8_t passed = 0;
+  if (bytes == NULL) {
+    return 0;
+  }
+  byte_count = generate_stream(&state, bytes, BENCH_INSTRUCTIONS);
+  init_string(&text, BUFFER_SIZE, NULL);
+  disassemble_source(bytes, byte_count, &text);
+  if (assemble_source(&text, binary, &error_line, 0) != JASM_SUCCESS) {
+    fprintf(report, "random.assemble fail line %u\n", (unsigned)error_line);
+  } else {
+    fprintf(report, "random.assemble ok\n");
+    passed = round_trip("random", binary, source, report);
+    if (source->idx != text.idx || memcmp(source->buffer, text.buffer, text.idx) != 0) {
+      fprintf(report, "random.listing fail\n");
+      passed = 0;
+    } else {
+      fprintf(report, "random.listing ok\n");
+    }
+    clear_string(&text);
+    if (assemble_source(source, &text, &error_line, BENCH_THREADS) != JASM_SUCCESS ||
+        text.idx != binary->idx || memcmp(text.buffer, binary->buffer, text.idx) != 0) {
+      fprintf(report, "random.parallel fail\n");
+      passed = 0;
+    } else {
+      fprintf(report, "random.parallel ok\n");
+    }
+  }
+  free_string(&text);
+  free(bytes);
+  return passed;
+}
+
+typedef struct bench_kernel_t {
+  const char      *name;
+  format_kernel_t kernel;
+  format_kernel_t scalar;
+  uint8_t         width;
+  uint8_t         supported;
+} bench_kernel_t;
+
+uint8_t check_kernels(FILE *report) {
+  /** check_kernels
+   * Every SIMD formatting kernel the CPU can run must expand 0 to
+   * BENCH_KERNEL_BYTES bytes, from every alignment, like its scalar kernel
+   */
+  uint64_t state = BENCH_SEED;
+  uint8_t bytes[BENCH_KERNEL_BYTES + 32];
+  char expected[BENCH_KERNEL_BYTES * BITS_WIDTH];
+  char actual[BENCH_KERNEL_BYTES * BITS_WIDTH];
+  uint8_t passed = 1;
+#if defined(__x86_64__) || defined(__i386__)
+  bench_kernel_t kernels[4];
+  __builtin_cpu_init();
+  kernels[0] = (bench_kernel_t){"sse2.bits", format_bits_sse2, format_bits_scalar, BITS_WIDTH,
+                                (uint8_t)(__builtin_cpu_supports("sse2") != 0)};
+  kernels[1] = (bench_kernel_t){"sse2.hex", format_hex_sse2, format_hex_scalar, HEX_WIDTH, kernels[0].supported};
+  kernels[2] = (bench_kernel_t){"avx2.bits", format_bits_avx2, format_bits_scalar, BITS_WIDTH,
+                                (uint8_t)(__builtin_cpu_supports("avx2") != 0)};
+  kernels[3] = (bench_kernel_t){"avx2.hex", format_hex_avx2, format_hex_scalar, HEX_WIDTH, kernels[2].supported};
+  for (size_t idx = 0; idx < sizeof(bytes); ++idx) {
+    bytes[idx] = (uint8_t)next_random(&state);
+  }
+  for (size_t kernel = 0; kernel < 4; ++kernel) {
+    const bench_kernel_t *entry = &kernels[kernel];
+    size_t mismatch = SIZE_MAX;
+    if (!entry->supported) {
+      fprintf(report, "format.%s skipped\n", entry->name);
+      continue;
+    }
+    for (size_t count = 0; count <= BENCH_KERNEL_BYTES && mismatch == SIZE_MAX; ++count) {
+      for (size_t start = 0; start < 32 && mismatch == SIZE_MAX; ++start) {
+        memset(expected, 0, sizeof(expected));
+        memset(actual, 0, sizeof(actual));
+        entry->scalar(expected, bytes + start, count);
+        entry->kernel(actual, bytes + start, count);
+        if (memcmp(expected, actual, sizeof(actual)) != 0) {
+          mismatch = count;
+        }
+      }
+    }
+    if (mismatch != SIZE_MAX) {
+      fprintf(report, "format.%s fail length %zu\n", entry->name, mismatch);
+      passed = 0;
+    } else {
+      fprintf(report, "format.%s ok\n", entry->name);
+    }
+  }
+#else
+  (void)state;
+  (void)bytes;
+  (void)expected;
+  (void)actual;
+  fprintf(report, "format.kernels skipped\n");
+#endif
+  return passed;
+}
+
+uint8_t check_records(const string_t *binary, FILE *report) {
+  /** check_records
+   * Every record of the random stream must carry enough to render its
+   * instruction exactly as the listing does
+   */
+  const uint8_t *bytes = (const uint8_t *)binary->buffer;
+  string_t record, expected, restored;
+  instruction_t instruction, copy;
+  size_t mismatch = binary->idx;
+  init_string(&record, RECORD_SIZE, NULL);
+  init_string(&expected, STRING_SIZE, NULL);
+  init_string(&restored, STRING_SIZE, NULL);
+  for (size_t idx = 0; idx < binary->idx && mismatch == binary->idx; idx += instruction.length) {
+    const uint8_t *fields = (const uint8_t *)record.buffer;
+    decode_instruction(bytes + idx, binary->idx - idx, idx, &instruction);
+    clear_string(&record);
+    render_record(&instruction, &record);
+    copy.offset = fields[0] | fields[1] << 8 | fields[2] << 16 | (uint32_t)fields[3] << 24;
+    copy.length = fields[4];
+    copy.mnemonic = fields[5];
+    copy.attributes = (uint16_t)(fields[6] | fields[7] << 8);
+    copy.kinds[0] = fields[8];
+    copy.kinds[1] = fields[9];
+    copy.registers[0] = fields[10];
+    copy.registers[1] = fields[11];
+    copy.displacement = (int16_t)(fields[12] | fields[13] << 8);
+    copy.immediate = (uint16_t)(fields[14] | fields[15] << 8);
+    clear_string(&expected);
+    clear_string(&restored);
+    render_line(bytes, &instruction, &expected);
+    render_line(bytes, &copy, &restored);
+    if (record.idx != RECORD_SIZE || expected.idx != restored.idx ||
+        memcmp(expected.buffer, restored.buffer, expected.idx) != 0) {
+      mismatch = idx;
+    }
+  }
+  if (mismatch != binary->idx) {
+    fprintf(report, "random.records fail offset %zu\n", mismatch);
+  } else {
+    fprintf(report, "random.records ok\n");
+  }
+  free_string(&restored);
+  free_string(&expected);
+  free_string(&record);
+  return mismatch == binary->idx;
+}
+
+uint8_t relist_matches(uint8_t *bytes, size_t byte_count, size_t first, const uint8_t *patch, size_t length) {
+  /** relist_matches
+   * Lists bytes, applies patch at first and requires the incremental
+   * relisting to equal a full listing of the patched bytes
+   */
+  string_t old_listing, listing, full;
+  decode_index_t old_index, index, full_index;
+  uint8_t passed = 0;
+  init_string(&old_listing, BUFFER_SIZE, NULL);
+  init_string(&listing, BUFFER_SIZE, NULL);
+  init_string(&full, BUFFER_SIZE, NULL);
+  index.boundaries = NULL;
+  index.text_offsets = NULL;
+  if (init_decode_index(&old_index, byte_count) == JASM_SUCCESS &&
+      init_decode_index(&full_index, byte_count) == JASM_SUCCESS &&
+      build_listing(bytes, byte_count, &old_listing, &old_index) == JASM_SUCCESS) {
+    memcpy(bytes + first, patch, length);
+    if (relist_range(bytes, &old_index, old_listing.buffer, first, first + length, &listing, &index) == JASM_SUCCESS &&
+        build_listing(bytes, byte_count, &full, &full_index) == JASM_SUCCESS) {
+      passed = listing.idx == full.idx && memcmp(listing.buffer, full.buffer, full.idx) == 0 &&
+               index.count == full_index.count &&
+               memcmp(index.boundaries, full_index.boundaries, full_index.count * sizeof(uint32_t)) == 0;
+    }
+  }
+  free_decode_index(&full_index);
+  free_decode_index(&index);
+  free_decode_index(&old_index);
+  free_string(&full);
+  free_string(&listing);
+  free_string(&old_listing);
+  return passed;
+}
+
+uint8_t check_relist(const string_t *binary, FILE *report) {
+  /** check_relist
+   * Incremental relisting must match a full relisting, including where a
+   * patch changes how an instruction ending before it decodes: 90 fe d0
+   * 90 90 with byte 2 patched to c0 turns db 0xfe, db 0xc0 into inc al.
+   * Then random patches land in the start of the random stream.
+   */
+  uint8_t lookahead[] = {0x90, 0xfe, 0xd0, 0x90, 0x90};
+  uint8_t patched_byte = 0xc0;
+  uint8_t window[BENCH_PATCH_WINDOW];
+  size_t window_size = binary->idx < BENCH_PATCH_WINDOW ? binary->idx : BENCH_PATCH_WINDOW;
+  uint64_t state = BENCH_SEED;
+  if (!relist_matches(lookahead, sizeof(lookahead), 2, &patched_byte, 1)) {
+    fprintf(report, "relist.lookahead fail\n");
+    return 0;
+  }
+  fprintf(report, "relist.lookahead ok\n");
+  for (size_t idx = 0; idx < BENCH_PATCHES && window_size > 0; ++idx) {
+    uint64_t random = next_random(&state);
+    uint8_t patch[4];
+    size_t length = 1 + random % sizeof(patch);
+    size_t first = (random >> 8) % window_size;
+    if (first + length > window_size) {
+      length = window_size - first;
+    }
+    memcpy(patch, &random, sizeof(patch));
+    memcpy(window, binary->buffer, window_size);
+    if (!relist_matches(window, window_size, first, patch, length)) {
+      fprintf(report, "relist.random fail offset %zu\n", first);
+      return 0;
+    }
+  }
+  fprintf(report, "relist.random ok\n");
+  return 1;
+}
+
+error_t read_capture(FILE *file, string_t *output) {
+  /* Reads everything written to a temporary file into output */
+  off_t size = lseek(fileno(file), 0, SEEK_END);
+  error_t error_code = size >= 0 ? reserve_string(output, (size_t)size) : JASM_FILE_READ_ERROR;
+  if (error_code == JASM_SUCCESS && pread(fileno(file), output->buffer, (size_t)size, 0) == size) {
+    output->idx = (size_t)size;
+  } else if (error_code == JASM_SUCCESS) {
+    error_code = JASM_FILE_READ_ERROR;
+  }
+  return error_code;
+}
+
+error_t capture_listing(disassembler_t *context, stream_t *stream, string_t *output) {
+  /** capture_listing
+   * Runs dump_buffer on a context, or dump_stream in its format if stream
+   * is not NULL, into output, through a temporary file
+   */
+  char buffer[OUTPUT_SIZE];
+  writer_t writer;
+  FILE *file = tmpfile();
+  error_t error_code;
+  clear_string(output);
+  if (file == NULL) {
+    return JASM_FILE_OPEN_ERROR;
+  }
+  init_writer(&writer, fileno(file), OUTPUT_SIZE, buffer);
+  context->writer = &writer;
+  error_code = stream != NULL ? dump_stream(&writer, stream, context->format) : dump_buffer(context);
+  if (error_code == JASM_SUCCESS) {
+    error_code = read_capture(file, output);
+  }
+  fclose(file);
+  return error_code;
+}
+
+size_t parse_json_string(const char *text, size_t idx, size_t end, string_t *decoded) {
+  /** parse_json_string
+   * Parses the JSON string at text[idx], appending its bytes to decoded if
+   * it is not NULL. Returns the index past the closing quote, 0 if it is
+   * not a string. \u escapes are only read up to 0xff, all jasm writes.
+   */
+  if (idx >= end || text[idx++] != '"') {
+    return 0;
+  }
+  while (idx < end && text[idx] != '"') {
+    char c = text[idx++];
+    if ((uint8_t)c < 0x20) {
+      return 0;
+    }
+    if (c == '\\') {
+      c = idx < end ? text[idx++] : 0;
+      switch (c) {
+        case '"':
+        case '\\':
+        case '/':
+          break;
+        case 'b':
+          c = '\b';
+          break;
+        case 'f':
+          c = '\f';
+          break;
+        case 'n':
+          c = '\n';
+          break;
+        case 'r':
+          c = '\r';
+          break;
+        case 't':
+          c = '\t';
+          break;
+        case 'u':
+          if (end - idx < 4 || text[idx] != '0' || text[idx + 1] != '0' || !isxdigit((uint8_t)text[idx + 2]) ||
+              !isxdigit((uint8_t)text[idx + 3])) {
+            return 0;
+          }
+          c = (char)strtoul((char[]){text[idx + 2], text[idx + 3], 0}, NULL, 16);
+          idx += 4;
+          break;
+        default:
+          return 0;
+      }
+    }
+    if (decoded != NULL) {
+      push_char(decoded, c);
+    }
+  }
+  return idx < end ? idx + 1 : 0;
+}
+
+size_t parse_json_value(const char *text, size_t idx, size_t end) {
+  /** parse_json_value
+   * Parses the JSON value at text[idx]. Returns the index past it, 0 if it
+   * is not well formed.
+   */
+  size_t first = idx;
+  if (idx >= end) {
+    return 0;
+  }
+  if (text[idx] == '"') {
+    return parse_json_string(text, idx, end, NULL);
+  }
+  if (text[idx] == '{' || text[idx] == '[') {
+    char close = text[idx] == '{' ? '}' : ']';
+    if (++idx < end && text[idx] == close) {
+      return idx + 1;
+    }
+    while (idx < end) {
+      if (close == '}') {
+        idx = parse_json_string(text, idx, end, NULL);
+        if (idx == 0 || idx >= end || text[idx++] != ':') {
+          return 0;
+        }
+      }
+      idx = parse_json_value(text, idx, end);
+      if (idx == 0 || idx >= end) {
+        return 0;
+      }
+      if (text[idx] == close) {
+        return idx + 1;
+      }
+      if (text[idx++] != ',') {
+        return 0;
+      }
+    }
+    return 0;
+  }
+  if (end - idx >= 4 && memcmp(text + idx, "true", 4) == 0) {
+    return idx + 4;
+  }
+  if (end - idx >= 5 && memcmp(text + idx, "false", 5) == 0) {
+    return idx + 5;
+  }
+  idx += text[idx] == '-';
+  if (idx >= end || !isdigit((uint8_t)text[idx]) ||
+      (text[idx] == '0' && idx + 1 < end && isdigit((uint8_t)text[idx + 1]))) {
+    return 0;
+  }
+  while (idx < end && isdigit((uint8_t)text[idx])) {
+    ++idx;
+  }
+  return idx > first ? idx : 0;
+}
+
+uint8_t check_json(const string_t *binary, FILE *report) {
+  /** check_json
+   * Every line of the random stream's JSON listing must be one well-formed
+   * object whose offset, length and mnemonic are its instruction's, and a
+   * file header must give back any file name, quotes, backslashes and
+   * control characters included
+   */
+  static const char *const names[] = {
+    "plain.bin", "quote\"d.bin", "back\\slash.bin", "new\nline\r\t.bin", "\x01\x1f\x7f.bin", "caf\xc3\xa9/\"\\\"\\.bin", "",
+  };
+  const uint8_t *bytes = (const uint8_t *)binary->buffer;
+  string_t listing, expected, decoded;
+  disassembler_t context;
+  instruction_t instruction;
+  size_t line = 0, mismatch = binary->idx;
+  uint8_t passed = 1;
+  init_string(&listing, 0, NULL);
+  init_string(&expected, STRING_SIZE, NULL);
+  init_string(&decoded, STRING_SIZE, NULL);
+  init_disassembler(&context, bytes, binary->idx, NULL);
+  context.format = FORMAT_JSON;
+  if (capture_listing(&context, NULL, &listing) != JASM_SUCCESS) {
+    mismatch = 0;
+  }
+  for (size_t idx = 0; idx < binary->idx && mismatch == binary->idx; idx += instruction.length) {
+    size_t end = line;
+    while (end < listing.idx && listing.buffer[end] != '\n') {
+      ++end;
+    }
+    decode_instruction(bytes + idx, binary->idx - idx, idx, &instruction);
+    clear_string(&expected);
+    append_literal(&expected, "{\"offset\":");
+    append_decimal(&expected, idx);
+    append_literal(&expected, ",\"length\":");
+    append_decimal(&expected, instruction.length);
+    append_literal(&expected, ",\"bytes\":\"");
+    append_hex(&expected, bytes + idx, instruction.length);
+    append_literal(&expected, "\",\"mnemonic\":");
+    append_json_string(&expected, mnemonic_lengths[instruction.mnemonic], mnemonic_names[instruction.mnemonic]);
+    if (end >= listing.idx || parse_json_value(listing.buffer, line, end) != end ||
+        end - line < expected.idx || memcmp(listing.buffer + line, expected.buffer, expected.idx) != 0) {
+      mismatch = idx;
+    }
+    line = end + 1;
+  }
+  if (mismatch != binary->idx || line != listing.idx) {
+    fprintf(report, "json.random fail offset %zu\n", mismatch);
+    passed = 0;
+  } else {
+    fprintf(report, "json.random ok\n");
+  }
+  for (size_t idx = 0; idx < sizeof(names) / sizeof(names[0]) && passed; ++idx) {
+    size_t length = strlen(names[idx]);
+    size_t value;
+    clear_string(&listing);
+    clear_string(&decoded);
+    append_file_header(FORMAT_JSON, length, names[idx], &listing);
+    value = parse_json_string(listing.buffer, sizeof("{\"file\":") - 1, listing.idx, &decoded);
+    if (parse_json_value(listing.buffer, 0, listing.idx) != listing.idx - 1 ||
+        listing.buffer[listing.idx - 1] != '\n' || value == 0 || decoded.idx != length || memcmp(decoded.buffer, names[idx], length) != 0) {
+      fprintf(report, "json.names fail name %zu\n", idx);
+      passed = 0;
+    }
+  }
+  if (passed) {
+    fprintf(report, "json.names ok\n");
+  }
+  free_string(&decoded);
+  free_string(&expected);
+  free_string(&listing);
+  return passed;
+}
+
+void reference_listing(uint8_t format, const uint8_t *bytes, size_t first, size_t last, string_t *output) {
+  /** reference_listing
+   * Lists bytes [first, last) one decode_instruction at a time, with
+   * offsets from the start of bytes, the way jasm -s first -n length must
+   */
+  instruction_t instruction;
+  clear_string(output);
+  append_format_header(format, output);
+  for (size_t idx = first; idx < last; idx += instruction.length) {
+    decode_instruction(bytes + idx, last - idx, idx, &instruction);
+    render_format_line(format, bytes + idx, &instruction, output);
+  }
+}
+
+uint8_t check_stream(FILE *report) {
+  /** check_stream
+   * An image over BENCH_RING_WRAPS ring wraps, random bytes with an
+   * instruction straddling every wrap, must stream like dump_buffer lists
+   * it, in every format. Streams that start and stop around the wraps, as
+   * -s and -n ask, must list like their bytes decoded in place.
+   */
+  static const uint8_t straddle[] = {0x26, 0xc7, 0x80, 0x34, 0x12, 0x78, 0x56}; /* mov word [es:bx+si+0x1234], 0x5678 */
+  static const char *const names[] = {"text", "records", "json"};
+  const size_t byte_count = BENCH_RING_WRAPS * RING_SIZE + 777;
+  const size_t windows[][2] = {
+    {0, SIZE_MAX}, {0, 2 * RING_SIZE + 3}, {1, SIZE_MAX}, {RING_SIZE - 2, SIZE_MAX}, {RING_SIZE + 5, RING_SIZE},
+    {3 * RING_SIZE - 1, 100}, {BENCH_RING_WRAPS * RING_SIZE + 770, SIZE_MAX}, {BENCH_RING_WRAPS * RING_SIZE + 800, 1},
+  };
+  char file_name[] = "/tmp/jasm_streamXXXXXX";
+  uint64_t state = BENCH_SEED;
+  uint8_t *bytes = malloc(byte_count);
+  string_t expected, streamed;
+  disassembler_t context;
+  stream_t stream;
+  uint8_t passed = 1;
+  int file_descriptor;
+  if (bytes == NULL) {
+    return 0;
+  }
+  for (size_t idx = 0; idx < byte_count; ++idx) {
+    bytes[idx] = (uint8_t)next_random(&state);
+  }
+  for (size_t wrap = 1; wrap <= BENCH_RING_WRAPS; ++wrap) {
+    /* nops to fall into step, then the instruction starting 1 to 6 bytes before the wrap */
+    size_t first = wrap * RING_SIZE - 1 - (wrap - 1) % (sizeof(straddle) - 1);
+    memset(bytes + first - 2 * MAX_INSTRUCTION_LENGTH, 0x90, 2 * MAX_INSTRUCTION_LENGTH);
+    memcpy(bytes + first, straddle, sizeof(straddle));
+  }
+  file_descriptor = mkstemp(file_name);
+  if (file_descriptor < 0 || write(file_descriptor, bytes, byte_count) != (ssize_t)byte_count) {
+    fprintf(report, "stream.ring fail temporary file\n");
+    if (file_descriptor >= 0) {
+      close(file_descriptor);
+      unlink(file_name);
+    }
+    free(bytes);
+    return 0;
+  }
+  close(file_descriptor);
+  init_string(&expected, 0, NULL);
+  init_string(&streamed, 0, NULL);
+  for (uint8_t format = FORMAT_TEXT; format <= FORMAT_JSON && passed; ++format) {
+    for (size_t idx = 0; idx < sizeof(windows) / sizeof(windows[0]) && passed; ++idx) {
+      size_t first = windows[idx][0];
+      size_t last = first >= byte_count                      ? first
+                    : windows[idx][1] < byte_count - first ? first + windows[idx][1]
+                                                           : byte_count;
+      error_t error_code = JASM_SUCCESS;
+      if (first == 0) {
+        init_disassembler(&context, bytes, last, NULL);
+        context.format = format;
+        error_code = capture_listing(&context, NULL, &expected);
+      } else {
+        reference_listing(format, bytes, first, last, &expected);
+      }
+      if (error_code == JASM_SUCCESS) {
+        error_code = open_stream(&stream, file_name, first, windows[idx][1]);
+      }
+      if (error_code == JASM_SUCCESS) {
+        init_disassembler(&context, NULL, 0, NULL);
+        context.format = format;
+        error_code = capture_listing(&context, &stream, &streamed);
+        close_stream(&stream);
+      }
+      if (error_code != JASM_SUCCESS || streamed.idx != expected.idx ||
+          memcmp(streamed.buffer, expected.buffer, expected.idx) != 0) {
+        fprintf(report, "stream.%s fail offset %zu length %zu\n", names[format], first, windows[idx][1]);
+        passed = 0;
+      }
+    }
+    if (passed) {
+      fprintf(report, "stream.%s ok\n", names[format]);
+    }
+  }
+  unlink(file_name);
+  free_string(&streamed);
+  free_string(&expected);
+  free(bytes);
+  return passed;
+}
+
+uint8_t check_parallel_listing(FILE *report) {
+  /** check_parallel_listing
+   * An image past PARALLEL_THRESHOLD, random bytes with runs of prefixes
+   * over every chunk boundary so the merge has to resynchronize, must list
+   * the same on 2 to 4 threads as serially, in every format
+   */
+  static const uint8_t prefixes[] = {0xf3, 0x26, 0x2e, 0xf2, 0x3e};
+  static const char *const names[] = {"text", "records", "json"};
+  uint64_t state = BENCH_SEED;
+  size_t byte_count = PARALLEL_THRESHOLD + PARALLEL_CHUNK / 2 + 3;
+  uint8_t *bytes = malloc(byte_count);
+  string_t serial, parallel;
+  disassembler_t context;
+  uint8_t passed = 1;
+  if (bytes == NULL) {
+    return 0;
+  }
+  for (size_t idx = 0; idx < byte_count; ++idx) {
+    bytes[idx] = (uint8_t)next_random(&state);
+  }
+  for (size_t idx = 0; idx < byte_count; idx += BUFFER_SIZE) {
+    /* A run ending at or just past each chunk start, and one at random */
+    size_t length = 1 + next_random(&state) % BENCH_PREFIX_RUN;
+    size_t first = idx % PARALLEL_CHUNK == 0 && idx > length ? idx - length + next_random(&state) % 4
+                                                             : idx + next_random(&state) % BUFFER_SIZE;
+    for (size_t jdx = first; jdx < first + length && jdx < byte_count; ++jdx) {
+      bytes[jdx] = prefixes[next_random(&state) % sizeof(prefixes)];
+    }
+  }
+  init_string(&serial, 0, NULL);
+  init_string(&parallel, 0, NULL);
+  for (uint8_t format = FORMAT_TEXT; format <= FORMAT_JSON && passed; ++format) {
+    init_disassembler(&context, bytes, byte_count, NULL);
+    context.format = format;
+    context.options |= LIST_SERIAL;
+    if (capture_listing(&context, NULL, &serial) != JASM_SUCCESS) {
+      fprintf(report, "parallel.%s fail serial\n", names[format]);
+      passed = 0;
+      break;
+    }
+    for (size_t threads = 2; threads <= BENCH_THREADS && passed; ++threads) {
+      init_disassembler(&context, bytes, byte_count, NULL);
+      context.format = format;
+      context.thread_count = threads;
+      if (capture_listing(&context, NULL, &parallel) != JASM_SUCCESS || parallel.idx != serial.idx ||
+          memcmp(parallel.buffer, serial.buffer, serial.idx) != 0) {
+        fprintf(report, "parallel.%s fail threads %zu\n", names[format], threads);
+        passed = 0;
+      }
+    }
+    if (passed) {
+      fprintf(report, "parallel.%s ok\n", names[format]);
+    }
+  }
+  free_string(&parallel);
+  free_string(&serial);
+  free(bytes);
+  return passed;
+}
+
+void generate_program(uint64_t *state, string_t *source, uint8_t compilable) {
+  /** generate_program
+   * Writes a loop of random register, flag, memory and self-modifying
+   * operations: stores into the immediates of mov instructions in the loop
+   * itself, some in the block being run, and stores to data. cx counts the
+   * loop and is never an operand. A compilable loop keeps to the register
+   * and immediate ALU operations, inc, dec and jcc the JIT translates, and
+   * runs long enough to be compiled.
+   */
+  static const char *const words[] = {"ax", "dx", "bx", "si", "di", "bp"};
+  static const char *const bytes[] = {"al", "ah", "dl", "dh", "bl", "bh"};
+  static const char *const alu[] = {"add", "or", "adc", "sbb", "and", "sub", "xor", "cmp", "test", "mov"};
+  static const char *const shifts[] = {"shl", "shr", "sar", "rol", "ror", "rcl", "rcr"};
+  static const char *const jumps[] = {"jz", "jnz", "jc", "jnc", "jo", "js", "jp", "jl", "jg", "jbe"};
+  size_t op_count = 1 + next_random(state) % BENCH_PROGRAM_OPS;
+  char line[STRING_SIZE];
+  int length;
+  clear_string(source);
+  length = snprintf(line, sizeof(line), "bits 16\norg 0x100\nmov cx, %u\n",
+                    (unsigned)((compilable ? 2 * JIT_THRESHOLD : 20) + next_random(state) % 200));
+  append_string(source, (size_t)length, line);
+  for (size_t idx = 0; idx < 6; ++idx) {
+    length = snprintf(line, sizeof(line), "mov %s, %u\n", words[idx], (unsigned)(next_random(state) & 0xffff));
+    append_string(source, (size_t)length, line);
+  }
+  append_literal(source, "top:\n");
+  for (size_t idx = 0; idx < op_count; ++idx) {
+    uint64_t random = next_random(state);
+    uint8_t wide = random >> 8 & 1;
+    const char *const *registers = wide ? words : bytes;
+    const char *left = registers[(random >> 9) % 6];
+    const char *right = registers[(random >> 12) % 6];
+    unsigned value = (unsigned)(random >> 16 & (wide ? 0xffff : 0xff));
+    unsigned slot = (unsigned)(random >> 32) % 8;
+    if (compilable && random % 12 == 6) {
+      random -= 6; /* an ALU register operation for the shift */
+    }
+    switch (compilable ? random % 8 : random % 12) {
+      case 0: case 1: case 2:
+        length = snprintf(line, sizeof(line), "%s %s, %s\n", alu[(random >> 40) % 10], left, right);
+        break;
+      case 3: case 4:
+        length = snprintf(line, sizeof(line), "%s %s, %u\n", alu[(random >> 40) % 10], left, value);
+        break;
+      case 5:
+        length = snprintf(line, sizeof(line), "%s %s\n", random >> 40 & 1 ? "inc" : "dec", left);
+        break;
+      case 6:
+        length = snprintf(line, sizeof(line), "%s %s, 1\n", shifts[(random >> 40) % 7], left);
+        break;
+      case 7:
+        length = snprintf(line, sizeof(line), "%s skip_%zu\n%s %s\nskip_%zu:\n", jumps[(random >> 40) % 10], idx,
+                          compilable ? "inc" : "neg", left, idx);
+        break;
+      case 8:
+        length = snprintf(line, sizeof(line), "%s [data + %u], %s\n", alu[(random >> 40) % 10], slot * 2, left);
+        break;
+      case 9:
+        length = snprintf(line, sizeof(line), "pushf\npop %s\n", words[(random >> 9) % 6]);
+        break;
+      case 10:
+        /* Patch an immediate later in this block */
+        length = snprintf(line, sizeof(line), "mov [patch_%zu + 1], %s\npatch_%zu:\nmov %s, 0x1234\n", idx, left, idx,
+                          words[(random >> 12) % 6]);
+        break;
+      default:
+        /* Patch an immediate the next iteration runs */
+        length = snprintf(line, sizeof(line), "patch_%zu:\nmov %s, 0x1234\n%s [patch_%zu + 1], %s\n", idx,
+                          words[(random >> 12) % 6], random >> 40 & 1 ? "add" : "mov", idx, left);
+        break;
+    }
+    append_string(source, (size_t)length, line);
+  }
+  append_literal(source, "loop top\nhlt\ndata:\ndw 1, 2, 3, 4, 5, 6, 7, 8\n");
+}
+
+typedef struct bench_run_t {
+  cpu_t     cpu;
+  error_t   error_code;
+} bench_run_t;
+
+error_t run_program(const string_t *binary, uint8_t blocks, jit_t *jit, bench_run_t *run) {
+  /** run_program
+   * Loads a flat binary and runs it for at most BENCH_PROGRAM_LIMIT
+   * instructions with run_cpu when blocks is set, compiling hot blocks
+   * into jit if it is not NULL, one step_cpu at a time otherwise
+   */
+  error_t error_code = init_cpu(&run->cpu);
+  run->error_code = JASM_SUCCESS;
+  run->cpu.jit = jit;
+  if (error_code == JASM_SUCCESS) {
+    error_code = load_program(&run->cpu, (const uint8_t *)binary->buffer, binary->idx, LOAD_SEGMENT, LOAD_OFFSET);
+  }
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  if (blocks) {
+    run->error_code = run_cpu(&run->cpu, BENCH_PROGRAM_LIMIT);
+  }
+  while (!blocks && run->error_code == JASM_SUCCESS && !run->cpu.halted &&
+         run->cpu.instruction_count < BENCH_PROGRAM_LIMIT) {
+    run->error_code = step_cpu(&run->cpu);
+  }
+  return JASM_SUCCESS;
+}
+
+uint8_t same_state(const bench_run_t *left, const bench_run_t *right) {
+  /* Registers, segments, ip, flags, counts, outcome and all of memory */
+  return left->error_code == right->error_code && left->cpu.halted == right->cpu.halted &&
+         left->cpu.instruction_count == right->cpu.instruction_count && left->cpu.ip == right->cpu.ip &&
+         left->cpu.flags == right->cpu.flags &&
+         memcmp(left->cpu.registers, right->cpu.registers, sizeof(left->cpu.registers)) == 0 &&
+         memcmp(left->cpu.segments, right->cpu.segments, sizeof(left->cpu.segments)) == 0 &&
+         memcmp(left->cpu.memory, right->cpu.memory, MEMORY_SIZE) == 0;
+}
+
+uint8_t check_emulator(FILE *report) {
+  /** check_emulator
+   * Random looping programs, storing into their own code, must end in the
+   * same state under run_cpu's block cache as single-stepped
+   */
+  uint64_t state = BENCH_SEED;
+  uint64_t code_writes = 0;
+  uint32_t error_line = 0;
+  string_t source, binary;
+  bench_run_t stepped, blocks;
+  uint8_t passed = 1;
+  init_string(&source, BUFFER_SIZE, NULL);
+  init_string(&binary, BUFFER_SIZE, NULL);
+  for (size_t idx = 0; idx < BENCH_PROGRAMS && passed; ++idx) {
+    generate_program(&state, &source, 0);
+    if (assemble_source(&source, &binary, &error_line, 1) != JASM_SUCCESS) {
+      fprintf(report, "emulator.blocks fail program %zu line %u\n", idx, (unsigned)error_line);
+      passed = 0;
+      break;
+    }
+    if (run_program(&binary, 0, NULL, &stepped) != JASM_SUCCESS ||
+        run_program(&binary, 1, NULL, &blocks) != JASM_SUCCESS || !same_state(&stepped, &blocks)) {
+      fprintf(report, "emulator.blocks fail program %zu\n", idx);
+      passed = 0;
+    }
+    code_writes += blocks.cpu.code_writes;
+    free_cpu(&stepped.cpu);
+    free_cpu(&blocks.cpu);
+  }
+  if (passed && code_writes == 0) {
+    fprintf(report, "emulator.blocks fail no code writes\n");
+    passed = 0;
+  } else if (passed) {
+    fprintf(report, "emulator.blocks ok\n");
+  }
+  free_string(&binary);
+  free_string(&source);
+  return passed;
+}
+
+uint8_t check_jit(FILE *report) {
+  /** check_jit
+   * Random hot loops of ALU operations, inc, dec, jcc and loop must end in
+   * the same state, flags included, with their blocks compiled as
+   * single-stepped
+   */
+  uint64_t state = BENCH_SEED;
+  uint32_t error_line = 0;
+  string_t source, binary;
+  bench_run_t stepped, compiled;
+  jit_t jit;
+  uint8_t passed = 1;
+  if (init_jit(&jit) != JASM_SUCCESS) {
+    fprintf(report, "emulator.jit skipped\n");
+    return 1;
+  }
+  init_string(&source, BUFFER_SIZE, NULL);
+  init_string(&binary, BUFFER_SIZE, NULL);
+  for (size_t idx = 0; idx < BENCH_PROGRAMS && passed; ++idx) {
+    generate_program(&state, &source, 1);
+    if (assemble_source(&source, &binary, &error_line, 1) != JASM_SUCCESS) {
+      fprintf(report, "emulator.jit fail program %zu line %u\n", idx, (unsigned)error_line);
+      passed = 0;
+      break;
+    }
+    if (run_program(&binary, 0, NULL, &stepped) != JASM_SUCCESS ||
+        run_program(&binary, 1, &jit, &compiled) != JASM_SUCCESS || !same_state(&stepped, &compiled)) {
+      fprintf(report, "emulator.jit fail program %zu\n", idx);
+      passed = 0;
+    }
+    free_cpu(&stepped.cpu);
+    free_cpu(&compiled.cpu);
+    jit.used = 0; /* the next program starts with an empty block cache */
+  }
+  if (passed && jit.compiled == 0) {
+    fprintf(report, "emulator.jit fail nothing compiled\n");
+    passed = 0;
+  } else if (passed) {
+    fprintf(report, "emulator.jit ok\n");
+  }
+  free_jit(&jit);
+  free_string(&binary);
+  free_string(&source);
+  return passed;
+}
+
+typedef enum bench_flag_kind_t {
+  FLAG_KIND_ADD = 0, FLAG_KIND_ADC, FLAG_KIND_SUB, FLAG_KIND_SBB, FLAG_KIND_CMP, FLAG_KIND_NEG,
+  FLAG_KIND_AND, FLAG_KIND_OR, FLAG_KIND_XOR, FLAG_KIND_TEST, FLAG_KIND_INC, FLAG_KIND_DEC,
+} bench_flag_kind_t;
+
+typedef struct bench_flag_op_t {
+  const char  *name;
+  uint8_t     kind;         /* bench_flag_kind_t */
+  uint8_t     opcode;       /* byte form; the word form is opcode + 1 */
+  uint8_t     modrm;        /* al, bl or ax, bx */
+  uint8_t     short_word;   /* one-byte word form, run_cpu's fast path */
+} bench_flag_op_t;
+
+uint16_t reference_flags(uint8_t kind, uint16_t left, uint16_t right, uint8_t carry, uint8_t w_bit,
+                         uint16_t *result) {
+  /** reference_flags
+   * Computes an operation's result and status flags eagerly, from the
+   * operands' unsigned and signed values rather than a carry chain. carry
+   * is CF before the operation.
+   */
+  int32_t mask = w_bit ? 0xffff : 0xff;
+  int32_t sign = w_bit ? 0x8000 : 0x80;
+  int32_t l = left & mask;
+  int32_t r = right & mask;
+  int32_t c = 0, wide = 0, signed_wide = 0, nibble = 0;
+  uint16_t flags = 0;
+  uint8_t arithmetic = 1;
+  if (kind == FLAG_KIND_NEG) {
+    r = l;
+    l = 0;
+  } else if (kind == FLAG_KIND_INC || kind == FLAG_KIND_DEC) {
+    r = 1;
+  }
+  if (kind == FLAG_KIND_ADC || kind == FLAG_KIND_SBB) {
+    c = carry;
+  }
+  switch (kind) {
+    case FLAG_KIND_ADD:
+    case FLAG_KIND_ADC:
+    case FLAG_KIND_INC:
+      wide = l + r + c;
+      signed_wide = (l ^ sign) - sign + (r ^ sign) - sign + c;
+      nibble = (l & 0xf) + (r & 0xf) + c;
+      break;
+    case FLAG_KIND_SUB:
+    case FLAG_KIND_SBB:
+    case FLAG_KIND_CMP:
+    case FLAG_KIND_NEG:
+    case FLAG_KIND_DEC:
+      wide = l - r - c;
+      signed_wide = ((l ^ sign) - sign) - ((r ^ sign) - sign) - c;
+      nibble = (l & 0xf) - (r & 0xf) - c;
+      break;
+    default:
+      arithmetic = 0;
+      wide = kind == FLAG_KIND_OR ? (l | r) : kind == FLAG_KIND_XOR ? (l ^ r) : (l & r);
+      break;
+  }
+  *result = (uint16_t)(wide & mask);
+  if (kind == FLAG_KIND_INC || kind == FLAG_KIND_DEC) {
+    flags |= carry ? FLAG_CF : 0;
+  } else if (arithmetic && (wide < 0 || wide > mask)) {
+    flags |= FLAG_CF;
+  }
+  if (arithmetic && (signed_wide < -sign || signed_wide >= sign)) {
+    flags |= FLAG_OF;
+  }
+  if (arithmetic && (nibble < 0 || nibble > 0xf)) {
+    flags |= FLAG_AF;
+  }
+  flags |= *result == 0 ? FLAG_ZF : 0;
+  flags |= (*result & sign) ? FLAG_SF : 0;
+  uint8_t parity = (uint8_t)*result;
+  parity ^= parity >> 4;
+  parity ^= parity >> 2;
+  parity ^= parity >> 1;
+  flags |= (parity & 1) ? 0 : FLAG_PF;
+  return flags;
+}
+
+size_t flag_program(const bench_flag_op_t *op, uint16_t left, uint16_t right, uint8_t carry, uint8_t w_bit,
+                    uint8_t lazy_carry, uint8_t *code) {
+  /** flag_program
+   * Writes the bytes of: CF set to carry, by stc or clc or as the lazy
+   * carry of add dx, si, then mov ax, left, mov bx, right, the operation on
+   * al, bl or ax, bx, and hlt
+   */
+  size_t length = 0;
+  if (lazy_carry) {
+    const uint8_t prefix[] = {0xba, 0xff, 0xff, 0xbe, carry, 0x00, 0x01, 0xf2}; /* mov dx, -1; mov si, carry; add dx, si */
+    memcpy(code, prefix, sizeof(prefix));
+    length = sizeof(prefix);
+  } else {
+    code[length++] = carry ? 0xf9 : 0xf8;
+  }
+  code[length++] = 0xb8;
+  code[length++] = (uint8_t)left;
+  code[length++] = (uint8_t)(left >> 8);
+  code[length++] = 0xbb;
+  code[length++] = (uint8_t)right;
+  code[length++] = (uint8_t)(right >> 8);
+  if (w_bit && op->short_word) {
+    code[length++] = op->short_word;
+  } else {
+    code[length++] = (uint8_t)(op->opcode + w_bit);
+    code[length++] = op->modrm;
+  }
+  code[length++] = 0xf4;
+  return length;
+}
+
+uint8_t check_flags(FILE *report) {
+  /** check_flags
+   * Every lazily flagged operation, on byte and word operands at the
+   * carry, auxiliary carry and sign boundaries and on random ones, with CF
+   * clear and set beforehand, must leave ax and the materialized status
+   * flags as computed eagerly, single-stepped and under run_cpu. inc and
+   * dec must keep CF, whether it was set eagerly or is itself pending.
+   */
+  const bench_flag_op_t ops[] = {
+    {"add", FLAG_KIND_ADD, 0x00, 0xd8, 0},    {"adc", FLAG_KIND_ADC, 0x10, 0xd8, 0},
+    {"sub", FLAG_KIND_SUB, 0x28, 0xd8, 0},    {"sbb", FLAG_KIND_SBB, 0x18, 0xd8, 0},
+    {"cmp", FLAG_KIND_CMP, 0x38, 0xd8, 0},    {"neg", FLAG_KIND_NEG, 0xf6, 0xd8, 0},
+    {"and", FLAG_KIND_AND, 0x20, 0xd8, 0},    {"or", FLAG_KIND_OR, 0x08, 0xd8, 0},
+    {"xor", FLAG_KIND_XOR, 0x30, 0xd8, 0},    {"test", FLAG_KIND_TEST, 0x84, 0xd8, 0},
+    {"inc", FLAG_KIND_INC, 0xfe, 0xc0, 0x40}, {"dec", FLAG_KIND_DEC, 0xfe, 0xc8, 0x48},
+  };
+  uint16_t values[] = {0x0000, 0x0001, 0x000f, 0x0010, 0x007f, 0x0080, 0x00ff, 0x0100, 0x7fff, 0x8000, 0xffff,
+                       0, 0, 0, 0, 0, 0};
+  const size_t value_count = sizeof(values) / sizeof(values[0]);
+  uint64_t state = BENCH_SEED;
+  uint8_t code[32];
+  cpu_t cpus[2];
+  uint8_t passed = 1;
+  for (size_t idx = value_count - BENCH_FLAG_RANDOM; idx < value_count; ++idx) {
+    values[idx] = (uint16_t)next_random(&state);
+  }
+  if (init_cpu(&cpus[0]) != JASM_SUCCESS || init_cpu(&cpus[1]) != JASM_SUCCESS) {
+    fprintf(report, "emulator.flags fail init\n");
+    return 0;
+  }
+  for (size_t op = 0; op < sizeof(ops) / sizeof(ops[0]) && passed; ++op) {
+    for (size_t cases = 0; cases < value_count * value_count * 8 && passed; ++cases) {
+      uint16_t left = values[cases / 8 / value_count], right = values[cases / 8 % value_count];
+      uint8_t w_bit = cases & 1, carry = (cases >> 1) & 1, lazy_carry = (cases >> 2) & 1;
+      uint16_t result = 0;
+      uint16_t flags = reference_flags(ops[op].kind, left, right, carry, w_bit, &result);
+      uint16_t ax = ops[op].kind == FLAG_KIND_CMP || ops[op].kind == FLAG_KIND_TEST ? left
+                    : w_bit                                                           ? result
+                                                                                      : (left & 0xff00) | result;
+      size_t length = flag_program(&ops[op], left, right, carry, w_bit, lazy_carry, code);
+      for (uint8_t blocks = 0; blocks < 2 && passed; ++blocks) {
+        cpu_t *cpu = &cpus[blocks];
+        error_t error_code = load_program(cpu, code, length, LOAD_SEGMENT, LOAD_OFFSET);
+        if (error_code == JASM_SUCCESS && blocks) {
+          error_code = run_cpu(cpu, BENCH_WINDOW);
+        }
+        while (error_code == JASM_SUCCESS && !blocks && !cpu->halted) {
+          error_code = step_cpu(cpu);
+        }
+        materialize_flags(cpu);
+        if (error_code != JASM_SUCCESS || !cpu->halted || cpu->registers[REG_AX] != ax ||
+            (cpu->flags & FLAG_STATUS) != flags) {
+          fprintf(report, "emulator.flags fail %s%s w%u 0x%04x 0x%04x cf %u: ax 0x%04x flags 0x%03x, want 0x%04x 0x%03x\n",
+                  blocks ? "run " : "", ops[op].name, (unsigned)w_bit, (unsigned)left, (unsigned)right,
+                  (unsigned)carry, (unsigned)cpu->registers[REG_AX], (unsigned)(cpu->flags & FLAG_STATUS),
+                  (unsigned)ax, (unsigned)flags);
+          passed = 0;
+        }
+      }
+    }
+  }
+  if (passed) {
+    fprintf(report, "emulator.flags ok\n");
+  }
+  free_cpu(&cpus[1]);
+  free_cpu(&cpus[0]);
+  return passed;
+}
+
+/* A loop with a call, a forward jmp over two data bytes, and the subroutine */
+const char flow_source[] =
+  "bits 16\n"
+  "mov cx, 3\n"
+  "top:\n"
+  "call sub1\n"
+  "loop top\n"
+  "jmp done\n"
+  "db 0x12, 0x34\n"
+  "sub1:\n"
+  "inc ax\n"
+  "ret\n"
+  "done:\n"
+  "hlt\n";
+
+error_t trace_source(const char *text, string_t *binary, flow_t *flow) {
+  /** trace_source
+   * Assembles text into binary and traces it from offset 0 into flow,
+   * which is left to be freed on success
+   */
+  string_t source;
+  uint32_t error_line = 0;
+  error_t error_code;
+  init_string(&source, STRING_SIZE, NULL);
+  append_string(&source, strlen(text), text);
+  error_code = assemble_source(&source, binary, &error_line, 1);
+  free_string(&source);
+  if (error_code == JASM_SUCCESS) {
+    error_code = init_flow(flow, (const uint8_t *)binary->buffer, binary->idx);
+  }
+  if (error_code == JASM_SUCCESS) {
+    error_code = trace_flow(flow, 0);
+    if (error_code != JASM_SUCCESS) {
+      free_flow(flow);
+    }
+  }
+  return error_code;
+}
+
+uint8_t check_flow(FILE *report) {
+  /** check_flow
+   * The traced listing of flow_source must label the loop head, the
+   * subroutine and the jmp target, list the unreached bytes as db, and
+   * leave the fallthrough after call unlabelled
+   */
+  const char expected[] =
+    "=======<DISASSEMBLY OUTPUT>=======\n"
+    "L0000:\n"
+    "0000 10111001 00000011 00000000 mov cx, 3\n"
+    "L0003:\n"
+    "0003 11101000 00000111 00000000 call L0013\n"
+    "0006 11100010 11111011 loop L0003\n"
+    "0008 11101001 00000100 00000000 jmp L0015\n"
+    "0011 00010010 db 0x12\n"
+    "0012 00110100 db 0x34\n"
+    "L0013:\n"
+    "0013 01000000 inc ax\n"
+    "0014 11000011 ret\n"
+    "L0015:\n"
+    "0015 11110100 hlt\n";
+  char buffer[OUTPUT_SIZE];
+  string_t binary, listing;
+  writer_t writer;
+  flow_t flow;
+  FILE *file = tmpfile();
+  error_t error_code;
+  uint8_t passed = 0;
+  init_string(&binary, STRING_SIZE, NULL);
+  init_string(&listing, STRING_SIZE, NULL);
+  error_code = file != NULL ? trace_source(flow_source, &binary, &flow) : JASM_FILE_OPEN_ERROR;
+  if (error_code == JASM_SUCCESS) {
+    init_writer(&writer, fileno(file), OUTPUT_SIZE, buffer);
+    error_code = dump_flow(&writer, &flow);
+    if (error_code == JASM_SUCCESS) {
+      error_code = read_capture(file, &listing);
+    }
+    passed = flow.instruction_count == 7;
+    free_flow(&flow);
+  }
+  passed = passed && error_code == JASM_SUCCESS && listing.idx == sizeof(expected) - 1 &&
+           memcmp(listing.buffer, expected, listing.idx) == 0;
+  fprintf(report, passed ? "flow.listing ok\n" : "flow.listing fail\n");
+  if (file != NULL) {
+    fclose(file);
+  }
+  free_string(&listing);
+  free_string(&binary);
+  return passed;
+}
+
+uint8_t same_words(const uint32_t *words, const uint32_t *expected, size_t count) {
+  return memcmp(words, expected, count * sizeof(uint32_t)) == 0;
+}
+
+uint8_t check_cfg(FILE *report) {
+  /** check_cfg
+   * flow_source must split into its six blocks, with the call edge to the
+   * subroutine, the loop's back edge and the jmp's forward edge, the
+   * predecessors they imply, and an index file laid out as cfg.h says
+   */
+  const uint32_t starts[] = {0, 3, 6, 8, 13, 15};
+  const uint32_t ends[] = {3, 6, 8, 11, 15, 16};
+  const uint32_t instruction_counts[] = {1, 1, 1, 1, 2, 1};
+  const uint32_t successor_index[] = {0, 1, 3, 5, 6, 6, 6};
+  const uint32_t successors[] = {1, 2, 4, 3, 1, 5};
+  const uint8_t successor_kinds[] = {EDGE_FALLTHROUGH, EDGE_FALLTHROUGH, EDGE_CALL, EDGE_FALLTHROUGH, EDGE_JUMP,
+                                     EDGE_JUMP};
+  const uint32_t predecessor_index[] = {0, 0, 2, 3, 4, 5, 6};
+  const uint32_t predecessors[] = {0, 2, 1, 2, 1, 3};
+  const uint32_t header[] = {CFG_MAGIC, CFG_VERSION, 6, 6};
+  const uint32_t *sections[] = {header, starts, ends, instruction_counts, successor_index, successors,
+                                predecessor_index, predecessors};
+  const size_t lengths[] = {4, 6, 6, 6, 7, 6, 7, 6};
+  string_t binary, index, expected;
+  flow_t flow;
+  cfg_t cfg;
+  uint8_t passed = 0;
+  init_string(&binary, STRING_SIZE, NULL);
+  init_string(&index, STRING_SIZE, NULL);
+  init_string(&expected, STRING_SIZE, NULL);
+  /* The index file expected, little-endian */
+  for (size_t section = 0; section < sizeof(sections) / sizeof(sections[0]); ++section) {
+    for (size_t idx = 0; idx < lengths[section]; ++idx) {
+      uint32_t value = sections[section][idx];
+      uint8_t bytes[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+      append_string(&expected, 4, (const char *)bytes);
+    }
+  }
+  append_string(&expected, sizeof(successor_kinds), (const char *)successor_kinds);
+  if (trace_source(flow_source, &binary, &flow) == JASM_SUCCESS) {
+    if (build_cfg(&cfg, &flow) == JASM_SUCCESS) {
+      passed = cfg.block_count == 6 && cfg.edge_count == 6 && same_words(cfg.starts, starts, 6) &&
+               same_words(cfg.ends, ends, 6) && same_words(cfg.instruction_counts, instruction_counts, 6) &&
+               same_words(cfg.successor_index, successor_index, 7) && same_words(cfg.successors, successors, 6) &&
+               memcmp(cfg.successor_kinds, successor_kinds, 6) == 0 &&
+               same_words(cfg.predecessor_index, predecessor_index, 7) &&
+               same_words(cfg.predecessors, predecessors, 6) && find_cfg_block(&cfg, 14) == 4 &&
+               export_cfg_index(&cfg, &index) == JASM_SUCCESS && index.idx == expected.idx &&
+               memcmp(index.buffer, expected.buffer, expected.idx) == 0;
+      free_cfg(&cfg);
+    }
+    free_flow(&flow);
+  }
+  fprintf(report, passed ? "flow.cfg ok\n" : "flow.cfg fail\n");
+  free_string(&expected);
+  free_string(&index);
+  free_string(&binary);
+  return passed;
+}
+
+error_t run_manifest(char *manifest_name, size_t thread_count, string_t *output, string_t *errors) {
+  /** run_manifest
+   * Lists a manifest with run_batch on thread_count workers, capturing
+   * what it writes to stdout in output and to stderr in errors
+   */
+  char buffer[OUTPUT_SIZE];
+  writer_t writer;
+  batch_t batch;
+  FILE *listing = tmpfile();
+  FILE *messages = tmpfile();
+  int saved = dup(STDERR_FILENO);
+  error_t error_code = listing != NULL && messages != NULL && saved >= 0 ? init_batch(&batch, thread_count)
+                                                                        : JASM_FILE_OPEN_ERROR;
+  clear_string(output);
+  clear_string(errors);
+  if (error_code == JASM_SUCCESS) {
+    error_code = read_manifest(&batch, manifest_name);
+    if (error_code == JASM_SUCCESS) {
+      init_writer(&writer, fileno(listing), OUTPUT_SIZE, buffer);
+      fflush(stderr);
+      dup2(fileno(messages), STDERR_FILENO);
+      error_code = run_batch(&batch, &writer);
+      fflush(stderr);
+      dup2(saved, STDERR_FILENO);
+    }
+    free_batch(&batch);
+  }
+  if (listing != NULL && messages != NULL && (read_capture(listing, output) != JASM_SUCCESS ||
+                                              read_capture(messages, errors) != JASM_SUCCESS)) {
+    error_code = JASM_FILE_READ_ERROR;
+  }
+  if (saved >= 0) {
+    close(saved);
+  }
+  if (listing != NULL) {
+    fclose(listing);
+  }
+  if (messages != NULL) {
+    fclose(messages);
+  }
+  return error_code;
+}
+
+uint8_t check_batch(FILE *report) {
+  /** check_batch
+   * A manifest of BENCH_BATCH_FILES small files, with an empty file, a
+   * missing one and a directory among them, must list on 1 to
+   * BENCH_THREADS workers as jasm lists the readable files one after
+   * another. The other two must be reported on stderr in order, and the
+   * missing file's error returned though the directory's differs.
+   */
+  const size_t empty = 5, missing = 100, directory = BATCH_WINDOW + 3;
+  char directory_name[] = "/tmp/jasm_batchXXXXXX";
+  char path[64];
+  char manifest_name[64];
+  uint8_t bytes[24];
+  uint64_t state = BENCH_SEED;
+  string_t manifest, expected, expected_errors, listing, output, errors;
+  disassembler_t context;
+  uint8_t passed = 1;
+  if (mkdtemp(directory_name) == NULL) {
+    fprintf(report, "batch.manifest fail temporary directory\n");
+    return 0;
+  }
+  init_string(&manifest, BUFFER_SIZE, NULL);
+  init_string(&expected, BUFFER_SIZE, NULL);
+  init_string(&expected_errors, STRING_SIZE, NULL);
+  init_string(&listing, STRING_SIZE, NULL);
+  init_string(&output, BUFFER_SIZE, NULL);
+  init_string(&errors, STRING_SIZE, NULL);
+  for (size_t idx = 0; idx < BENCH_BATCH_FILES && passed; ++idx) {
+    size_t length = idx == empty ? 0 : 1 + next_random(&state) % sizeof(bytes);
+    int path_length = snprintf(path, sizeof(path), "%s/%05zu", directory_name, idx);
+    append_string(&manifest, (size_t)path_length, path);
+    push_char(&manifest, '\n');
+    if (idx == missing || idx == directory) {
+      char line[96];
+      int line_length = snprintf(line, sizeof(line), "%s: skipped, error %u\n", path,
+                                 idx == missing ? JASM_FILE_OPEN_ERROR : JASM_FILE_READ_ERROR);
+      append_string(&expected_errors, (size_t)line_length, line);
+      passed = idx == missing || mkdir(path, 0700) == 0;
+      continue;
+    }
+    for (size_t jdx = 0; jdx < length; ++jdx) {
+      bytes[jdx] = (uint8_t)next_random(&state);
+    }
+    init_disassembler(&context, bytes, length, NULL);
+    passed = save_binary_file(path, bytes, length) == JASM_SUCCESS &&
+             capture_listing(&context, NULL, &listing) == JASM_SUCCESS;
+    append_file_header(FORMAT_TEXT, (size_t)path_length, path, &expected);
+    append_string(&expected, listing.idx, listing.buffer);
+  }
+  snprintf(manifest_name, sizeof(manifest_name), "%s/manifest", directory_name);
+  passed = passed && save_binary_file(manifest_name, (const uint8_t *)manifest.buffer, manifest.idx) == JASM_SUCCESS;
+  for (size_t threads = 1; threads <= BENCH_THREADS && passed; ++threads) {
+    error_t error_code = run_manifest(manifest_name, threads, &output, &errors);
+    if (error_code != JASM_FILE_OPEN_ERROR || output.idx != expected.idx ||
+        memcmp(output.buffer, expected.buffer, expected.idx) != 0 || errors.idx != expected_errors.idx ||
+        memcmp(errors.buffer, expected_errors.buffer, expected_errors.idx) != 0) {
+      fprintf(report, "batch.manifest fail threads %zu\n", threads);
+      passed = 0;
+    }
+  }
+  if (passed) {
+    fprintf(report, "batch.manifest ok\n");
+  }
+  for (size_t idx = 0; idx < BENCH_BATCH_FILES; ++idx) {
+    snprintf(path, sizeof(path), "%s/%05zu", directory_name, idx);
+    if (idx == directory) {
+      rmdir(path);
+    } else {
+      unlink(path);
+    }
+  }
+  unlink(manifest_name);
+  rmdir(directory_name);
+  free_string(&errors);
+  free_string(&output);
+  free_string(&listing);
+  free_string(&expected_errors);
+  free_string(&expected);
+  free_string(&manifest);
+  return passed;
+}
+
+uint8_t symbol_is(const symbol_index_t *index, size_t position, const char *name) {
+  /* Whether the symbol at position is name */
+  size_t length = 0;
+  const char *text = position < index->count ? symbol_name(index, position, &length) : NULL;
+  return text != NULL && length == strlen(name) && memcmp(text, name, length) == 0;
+}
+
+uint8_t check_symbols(FILE *report) {
+  /** check_symbols
+   * Symbols sharing an address must come out of the index in insertion
+   * order, a repeated name must keep its first address, and symbol_below
+   * must find the first symbol at or below an address, none below the
+   * lowest. BENCH_SYMBOLS more, added from the highest address down, make
+   * the table and index grow.
+   */
+  const char *const shared[] = {"zeta", "alpha", "mid"};
+  char name[32];
+  symbol_table_t table;
+  symbol_index_t index;
+  string_t exported;
+  size_t position;
+  uint8_t passed;
+  init_symbol_table(&table);
+  init_string(&exported, 0, NULL);
+  passed = add_symbol(&table, "zeta", 4, 0x10) == JASM_SUCCESS && add_symbol(&table, "low", 3, 0x4) == JASM_SUCCESS &&
+           add_symbol(&table, "alpha", 5, 0x10) == JASM_SUCCESS && add_symbol(&table, "high", 4, 0x200) == JASM_SUCCESS &&
+           add_symbol(&table, "mid", 3, 0x10) == JASM_SUCCESS && add_symbol(&table, "alpha", 5, 0x300) == JASM_SUCCESS;
+  for (size_t idx = BENCH_SYMBOLS; idx-- > 0 && passed;) {
+    int length = snprintf(name, sizeof(name), "s%zu", idx);
+    passed = add_symbol(&table, name, (size_t)length, (uint32_t)(0x1000 + idx / 3 * 8)) == JASM_SUCCESS;
+  }
+  position = find_symbol(&table, "alpha", 5);
+  passed = passed && table.count == 5 + BENCH_SYMBOLS && position != NO_SYMBOL &&
+           table.symbols[position].address == 0x10 && find_symbol(&table, "alph", 4) == NO_SYMBOL &&
+           export_symbol_index(&table, &exported) == JASM_SUCCESS &&
+           open_symbol_index((const uint8_t *)exported.buffer, exported.idx, &index) == JASM_SUCCESS;
+  position = passed ? first_symbol_at(&index, 0x10) : NO_SYMBOL;
+  for (size_t idx = 0; idx < 3 && passed; ++idx) {
+    passed = position != NO_SYMBOL && symbol_is(&index, position + idx, shared[idx]) &&
+             symbol_address(&index, position + idx) == 0x10;
+  }
+  passed = passed && symbol_address(&index, position + 3) == 0x200 && first_symbol_at(&index, 0x11) == NO_SYMBOL &&
+           symbol_below(&index, 0x3) == NO_SYMBOL && symbol_is(&index, symbol_below(&index, 0x4), "low") &&
+           symbol_is(&index, symbol_below(&index, 0xf), "low") && symbol_below(&index, 0x10) == position &&
+           symbol_below(&index, 0x1ff) == position && symbol_is(&index, symbol_below(&index, 0x200), "high") &&
+           symbol_is(&index, symbol_below(&index, 0xfff), "high");
+  for (size_t group = 0; group < BENCH_SYMBOLS / 3 && passed; ++group) {
+    uint32_t address = (uint32_t)(0x1000 + group * 8);
+    position = first_symbol_at(&index, address);
+    for (size_t idx = 0; idx < 3 && passed; ++idx) {
+      snprintf(name, sizeof(name), "s%zu", group * 3 + 2 - idx);
+      passed = symbol_is(&index, position + idx, name);
+    }
+    passed = passed && symbol_below(&index, address) == position && symbol_below(&index, address + 7) == position &&
+             first_symbol_at(&index, address + 4) == NO_SYMBOL;
+  }
+  snprintf(name, sizeof(name), "s%zu", (size_t)BENCH_SYMBOLS - 1);
+  passed = passed && symbol_is(&index, symbol_below(&index, UINT32_MAX), name);
+  fprintf(report, passed ? "symbols.index ok\n" : "symbols.index fail\n");
+  free_string(&exported);
+  free_symbol_table(&table);
+  return passed;
+}
+
+/* A NASM map with origin 0x100, a constant, and a symbol below the origin */
+const char nasm_map[] =
+  "\n- NASM Map file ---------------------------------------------------------------\n\n"
+  "Source file:  prog.asm\nOutput file:  prog.bin\n\n"
+  "-- Program origin -------------------------------------------------------------\n\n"
+  "00000100\n\n"
+  "-- Sections (summary) ---------------------------------------------------------\n\n"
+  "Vstart            Start             Stop              Length    Class     Name\n"
+  "             100               100               120  00000020  progbits  .text\n\n"
+  "-- Symbols --------------------------------------------------------------------\n\n"
+  "---- No Section ---------------------------------------------------------------\n\n"
+  "Value     Name\n"
+  "00000005  COUNT\n\n"
+  "---- Section .text ------------------------------------------------------------\n\n"
+  "Real              Virtual           Name\n"
+  "              F0                F0  before\n"
+  "             100               100  start\n"
+  "             110               110  top\n"
+  "             110               110  top.inner\n"
+  "             11F               11F  last\n";
+
+uint8_t map_index_matches(const symbol_index_t *index) {
+  /* The symbols of nasm_map, at their offsets from the origin */
+  size_t position = first_symbol_at(index, 0x10);
+  return index->count == 4 && symbol_is(index, first_symbol_at(index, 0), "start") && position != NO_SYMBOL &&
+         symbol_is(index, position, "top") && symbol_is(index, position + 1, "top.inner") &&
+         symbol_below(index, 0x1e) == position && symbol_is(index, first_symbol_at(index, 0x1f), "last");
+}
+
+uint8_t open_map_matches(char *map_name, uint8_t cached) {
+  /** open_map_matches
+   * Opens a map's index with open_map_index, which must have mapped
+   * map.idx if cached is set and rebuilt it otherwise, and checks it
+   */
+  binary_file_t index_file;
+  symbol_index_t index;
+  string_t exported;
+  uint8_t matches;
+  init_string(&exported, 0, NULL);
+  matches = open_map_index(map_name, &index_file, &exported, &index) == JASM_SUCCESS &&
+            (index_file.bytes != NULL) == cached && (exported.idx == 0) == cached && map_index_matches(&index);
+  if (index_file.bytes != NULL) {
+    unload_binary_file(&index_file);
+  }
+  free_string(&exported);
+  return matches;
+}
+
+uint8_t check_symbol_map(FILE *report) {
+  /** check_symbol_map
+   * A NASM map must load its section symbols at their offsets from the
+   * program origin, without its constants or symbols below the origin.
+   * Its cached map.idx must be used while valid, and rebuilt and saved
+   * again when it is truncated or its header is corrupt.
+   */
+  char directory_name[] = "/tmp/jasm_mapXXXXXX";
+  char map_name[64], index_name[64];
+  symbol_table_t table;
+  symbol_index_t index;
+  string_t exported;
+  struct timespec times[2];
+  struct stat status;
+  uint8_t passed;
+  init_symbol_table(&table);
+  init_string(&exported, 0, NULL);
+  passed = load_symbol_map(&table, nasm_map, sizeof(nasm_map) - 1) == JASM_SUCCESS &&
+           find_symbol(&table, "COUNT", 5) == NO_SYMBOL && find_symbol(&table, "before", 6) == NO_SYMBOL &&
+           export_symbol_index(&table, &exported) == JASM_SUCCESS &&
+           open_symbol_index((const uint8_t *)exported.buffer, exported.idx, &index) == JASM_SUCCESS &&
+           map_index_matches(&index);
+  fprintf(report, passed ? "symbols.nasm ok\n" : "symbols.nasm fail\n");
+  free_symbol_table(&table);
+  if (!passed || mkdtemp(directory_name) == NULL) {
+    free_string(&exported);
+    return 0;
+  }
+  snprintf(map_name, sizeof(map_name), "%s/prog.map", directory_name);
+  snprintf(index_name, sizeof(index_name), "%s/prog.map.idx", directory_name);
+  /* The map is older than any index written from here on */
+  clock_gettime(CLOCK_REALTIME, &times[0]);
+  times[0].tv_sec -= 10;
+  times[1] = times[0];
+  passed = save_binary_file(map_name, (const uint8_t *)nasm_map, sizeof(nasm_map) - 1) == JASM_SUCCESS &&
+           utimensat(AT_FDCWD, map_name, times, 0) == 0 && open_map_matches(map_name, 0) &&
+           open_map_matches(map_name, 1);
+  if (passed) {
+    /* Truncated, then a bad magic, then a slot count that is no power of two */
+    passed = save_binary_file(index_name, (const uint8_t *)exported.buffer, exported.idx - 1) == JASM_SUCCESS &&
+             open_map_matches(map_name, 0) && stat(index_name, &status) == 0 &&
+             (size_t)status.st_size == exported.idx && open_map_matches(map_name, 1);
+    exported.buffer[0] ^= 1;
+    passed = passed &&
+             save_binary_file(index_name, (const uint8_t *)exported.buffer, exported.idx) == JASM_SUCCESS &&
+             open_map_matches(map_name, 0) && open_map_matches(map_name, 1);
+    exported.buffer[0] ^= 1;
+    exported.buffer[12] ^= 3;
+    passed = passed &&
+             save_binary_file(index_name, (const uint8_t *)exported.buffer, exported.idx) == JASM_SUCCESS &&
+             open_map_matches(map_name, 0) && open_map_matches(map_name, 1);
+  }
+  fprintf(report, passed ? "symbols.cache ok\n" : "symbols.cache fail\n");
+  unlink(index_name);
+  unlink(map_name);
+  rmdir(directory_name);
+  free_string(&exported);
+  return passed;
+}
+
+uint8_t check_labels(FILE *report) {
+  /** check_labels
+   * A label-heavy source split into BENCH_THREADS chunks must assemble to
+   * the bytes of a single-threaded assembly
+   */
+  uint64_t state = BENCH_SEED;
+  uint32_t error_line = 0;
+  string_t source, serial, parallel;
+  uint8_t passed = 0;
+  init_string(&source, BUFFER_SIZE, NULL);
+  init_string(&serial, BUFFER_SIZE, NULL);
+  init_string(&parallel, BUFFER_SIZE, NULL);
+  generate_labels(&state, &source);
+  if (assemble_source(&source, &serial, &error_line, 1) != JASM_SUCCESS) {
+    fprintf(report, "labels.assemble fail line %u\n", (unsigned)error_line);
+  } else if (source.idx < BENCH_THREADS * ASSEMBLY_MIN_CHUNK) {
+    fprintf(report, "labels.assemble fail short source\n");
+  } else {
+    fprintf(report, "labels.assemble ok\n");
+    fprintf(report, "labels.bytes %zu\n", serial.idx);
+    if (assemble_source(&source, &parallel, &error_line, BENCH_THREADS) != JASM_SUCCESS ||
+        parallel.idx != serial.idx || memcmp(parallel.buffer, serial.buffer, serial.idx) != 0) {
+      fprintf(report, "labels.parallel fail\n");
+    } else {
+      fprintf(report, "labels.parallel ok\n");
+      passed = 1;
+    }
+  }
+  free_string(&parallel);
+  free_string(&serial);
+  free_string(&source);
+  return passed;
+}
+
+void bench_throughput(string_t *binary, string_t *source, FILE *report) {
+  /** bench_throughput
+   * Repeats the listing dump (to /dev/null) and the assembly of the random
+   * stream until each has run for BENCH_SECONDS
+   */
+  char listing[OUTPUT_SIZE];
+  struct timespec start;
+  writer_t writer;
+  disassembler_t context;
+  string_t output;
+  uint32_t error_line;
+  size_t runs = 0;
+  size_t count = 0;
+  double seconds;
+  int null_descriptor = open("/dev/null", O_WRONLY);
+  for (size_t idx = 0; idx < source->idx; ++idx) {
+    count += source->buffer[idx] == '\n';
+  }
+  count -= 1; /* bits 16 */
+  init_writer(&writer, null_descriptor, OUTPUT_SIZE, listing);
+  init_disassembler(&context, (const uint8_t *)binary->buffer, binary->idx, &writer);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  do {
+    dump_buffer(&context);
+    ++runs;
+  } while ((seconds = elapsed_seconds(&start)) < BENCH_SECONDS);
+  close(null_descriptor);
+  fprintf(report, "disassemble.kernel %s\n", format_kernel_name());
+  fprintf(report, "disassemble.mb_per_s %.1f\n", (double)(binary->idx * runs) / seconds / 1e6);
+  fprintf(report, "disassemble.instructions_per_s %.0f\n", (double)(count * runs) / seconds);
+  init_string(&output, binary->idx + 1, NULL);
+  runs = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  do {
+    assemble_source(source, &output, &error_line, 0);
+    ++runs;
+  } while ((seconds = elapsed_seconds(&start)) < BENCH_SECONDS);
+  fprintf(report, "assemble.mb_per_s %.1f\n", (double)(source->idx * runs) / seconds / 1e6);
+  fprintf(report, "assemble.instructions_per_s %.0f\n", (double)(count * runs) / seconds);
+  free_string(&output);
+}
+
+int main(int argc, char **argv) {
+  /** main
+   * bench check|bench [report] [seed]
+   */
+  char *mode = argc >= 2 ? argv[1] : "check";
+  char *report_name = argc >= 3 ? argv[2] : "bench_output.txt";
+  char *seed_name = argc >= 4 ? argv[3] : "test.asm";
+  string_t binary, source;
+  uint8_t passed;
+  FILE *report = fopen(report_name, "w");
+  if (report == NULL) {
+    dump_error_code(JASM_FILE_OPEN_ERROR);
+    return 1;
+  }
+  init_string(&binary, BUFFER_SIZE, NULL);
+  init_string(&source, BUFFER_SIZE, NULL);
+  passed = check_seed(seed_name, &source, report);
+  passed &= check_random(&binary, &source, report);
+  passed &= check_labels(report);
+  passed &= check_flow(report);
+  passed &= check_cfg(report);
+  passed &= check_symbols(report);
+  passed &= check_symbol_map(report);
+  passed &= check_kernels(report);
+  passed &= check_records(&binary, report);
+  passed &= check_json(&binary, report);
+  passed &= check_relist(&binary, report);
+  passed &= check_parallel_listing(report);
+  passed &= check_stream(report);
+  passed &= check_batch(report);
+  passed &= check_emulator(report);
+  passed &= check_jit(report);
+  passed &= check_flags(report);
+  if (passed && strcmp(mode, "bench") == 0) {
+    bench_throughput(&binary, &source, report);
+  }
+  fclose(report);
+  free_string(&source);
+  free_string(&binary);
+  if (!passed) {
+    fprintf(stderr, "round trip failed, see %s\n", report_name);
+    return 1;
+  }
+  return 0;
+}
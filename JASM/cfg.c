@@ -0,0 +1,276 @@
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "error.h"
+#include "opcode_table.h"
+#include "string_builder.h"
+#include "writer.h"
+#include "decoder.h"
+#include "disassembler.h"
+#include "flow.h"
+#include "cfg.h"
+
+/** Control-flow graph
+ * Built from a traced flow_t in two sweeps over the visited bitmap. The
+ * first cuts the decoded instructions into blocks: a block starts at a
+ * branch target, after a control transfer, or after a gap, and ends
+ * after a control transfer. The second adds the fallthrough, jump and
+ * call edges of each block's last instruction; predecessors are a
+ * counting sort of the same edges by destination.
+ */
+
+uint8_t ends_basic_block(const instruction_t *instruction) {
+  /** ends_basic_block
+   * Relative branches, calls, interrupts and everything that does not
+   * fall through
+   */
+  switch (instruction->mnemonic) {
+    case MN_CALL:
+    case MN_INT:
+    case MN_INT3:
+    case MN_INTO:
+      return 1;
+  }
+  return instruction->kinds[0] == OPERAND_REL || !falls_through(instruction);
+}
+
+error_t free_cfg(cfg_t *cfg) {
+  free(cfg->starts);
+  free(cfg->ends);
+  free(cfg->instruction_counts);
+  free(cfg->successor_index);
+  free(cfg->successors);
+  free(cfg->successor_kinds);
+  free(cfg->predecessor_index);
+  free(cfg->predecessors);
+  memset(cfg, 0, sizeof(*cfg));
+  return JASM_SUCCESS;
+}
+
+size_t find_cfg_block(const cfg_t *cfg, size_t offset) {
+  /** find_cfg_block
+   * Block containing an offset, by binary search over the starts;
+   * NO_TARGET when no block does
+   */
+  size_t low = 0;
+  size_t high = cfg->block_count;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (cfg->starts[middle] <= offset) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if (low == 0 || offset >= cfg->ends[low - 1]) {
+    return NO_TARGET;
+  }
+  return low - 1;
+}
+
+void split_blocks(cfg_t *cfg, const flow_t *flow, uint32_t *last_offsets) {
+  /** split_blocks
+   * First sweep: block starts, ends, instruction counts and the offset of
+   * each block's last instruction
+   */
+  instruction_t instruction;
+  size_t offset = 0;
+  size_t previous_end = NO_TARGET;
+  uint8_t ended = 1;
+  while (offset < flow->byte_count) {
+    if ((offset & 7) == 0 && flow->visited[offset >> 3] == 0) {
+      offset += 8;
+      continue;
+    }
+    if (!test_bit(flow->visited, offset)) {
+      offset++;
+      continue;
+    }
+    decode_instruction(flow->bytes + offset, flow->byte_count - offset, offset, &instruction);
+    if (ended || offset != previous_end || test_bit(flow->targets, offset)) {
+      cfg->starts[cfg->block_count] = (uint32_t)offset;
+      cfg->instruction_counts[cfg->block_count] = 0;
+      cfg->block_count++;
+    }
+    cfg->instruction_counts[cfg->block_count - 1]++;
+    cfg->ends[cfg->block_count - 1] = (uint32_t)(offset + instruction.length);
+    last_offsets[cfg->block_count - 1] = (uint32_t)offset;
+    ended = ends_basic_block(&instruction);
+    previous_end = offset + instruction.length;
+    offset = previous_end;
+  }
+}
+
+void link_blocks(cfg_t *cfg, const flow_t *flow, const uint32_t *last_offsets) {
+  /** link_blocks
+   * Second sweep: the successors of every block, fallthrough first
+   */
+  instruction_t instruction;
+  size_t edge_count = 0;
+  for (size_t block = 0; block < cfg->block_count; ++block) {
+    size_t offset = last_offsets[block];
+    size_t target;
+    cfg->successor_index[block] = (uint32_t)edge_count;
+    decode_instruction(flow->bytes + offset, flow->byte_count - offset, offset, &instruction);
+    if (falls_through(&instruction) && block + 1 < cfg->block_count && cfg->starts[block + 1] == cfg->ends[block]) {
+      cfg->successors[edge_count] = (uint32_t)(block + 1);
+      cfg->successor_kinds[edge_count++] = EDGE_FALLTHROUGH;
+    }
+    target = branch_target(&instruction, flow->byte_count);
+    if (target != NO_TARGET && test_bit(flow->visited, target)) {
+      cfg->successors[edge_count] = (uint32_t)find_cfg_block(cfg, target);
+      cfg->successor_kinds[edge_count++] = instruction.mnemonic == MN_CALL ? EDGE_CALL : EDGE_JUMP;
+    }
+  }
+  cfg->successor_index[cfg->block_count] = (uint32_t)edge_count;
+  cfg->edge_count = edge_count;
+}
+
+void invert_edges(cfg_t *cfg) {
+  /** invert_edges
+   * Predecessor lists by counting sort of the successor edges
+   */
+  memset(cfg->predecessor_index, 0, (cfg->block_count + 1) * sizeof(uint32_t));
+  for (size_t edge = 0; edge < cfg->edge_count; ++edge) {
+    cfg->predecessor_index[cfg->successors[edge] + 1]++;
+  }
+  for (size_t block = 0; block < cfg->block_count; ++block) {
+    cfg->predecessor_index[block + 1] += cfg->predecessor_index[block];
+  }
+  for (size_t block = 0; block < cfg->block_count; ++block) {
+    for (uint32_t edge = cfg->successor_index[block]; edge < cfg->successor_index[block + 1]; ++edge) {
+      /* predecessor_index[b] runs ahead while filling and is shifted back below */
+      cfg->predecessors[cfg->predecessor_index[cfg->successors[edge]]++] = (uint32_t)block;
+    }
+  }
+  memmove(cfg->predecessor_index + 1, cfg->predecessor_index, cfg->block_count * sizeof(uint32_t));
+  cfg->predecessor_index[0] = 0;
+}
+
+error_t build_cfg(cfg_t *cfg, const flow_t *flow) {
+  /** build_cfg
+   * Basic blocks and edges of a traced image. Every decoded instruction
+   * can start a block and has at most two successors, which bounds the
+   * arrays.
+   */
+  size_t capacity = flow->instruction_count + 1;
+  uint32_t *last_offsets = malloc(capacity * sizeof(uint32_t));
+  memset(cfg, 0, sizeof(*cfg));
+  cfg->starts = malloc(capacity * sizeof(uint32_t));
+  cfg->ends = malloc(capacity * sizeof(uint32_t));
+  cfg->instruction_counts = malloc(capacity * sizeof(uint32_t));
+  cfg->successor_index = malloc((capacity + 1) * sizeof(uint32_t));
+  cfg->successors = malloc(2 * capacity * sizeof(uint32_t));
+  cfg->successor_kinds = malloc(2 * capacity);
+  cfg->predecessor_index = malloc((capacity + 1) * sizeof(uint32_t));
+  cfg->predecessors = malloc(2 * capacity * sizeof(uint32_t));
+  if (last_offsets == NULL || cfg->starts == NULL || cfg->ends == NULL || cfg->instruction_counts == NULL ||
+      cfg->successor_index == NULL || cfg->successors == NULL || cfg->successor_kinds == NULL ||
+      cfg->predecessor_index == NULL || cfg->predecessors == NULL) {
+    free(last_offsets);
+    free_cfg(cfg);
+    return JASM_MEMORY_ERROR;
+  }
+  split_blocks(cfg, flow, last_offsets);
+  link_blocks(cfg, flow, last_offsets);
+  invert_edges(cfg);
+  free(last_offsets);
+  return JASM_SUCCESS;
+}
+
+error_t append_words(string_t *output, const uint32_t *words, size_t count) {
+  /** append_words
+   * Appends uint32_t values in little-endian byte order
+   */
+  uint8_t *bytes;
+  error_t error_code = reserve_string(output, count * 4);
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  bytes = (uint8_t *)output->buffer + output->idx;
+  for (size_t idx = 0; idx < count; ++idx) {
+    bytes[idx * 4] = (uint8_t)words[idx];
+    bytes[idx * 4 + 1] = (uint8_t)(words[idx] >> 8);
+    bytes[idx * 4 + 2] = (uint8_t)(words[idx] >> 16);
+    bytes[idx * 4 + 3] = (uint8_t)(words[idx] >> 24);
+  }
+  output->idx += count * 4;
+  return JASM_SUCCESS;
+}
+
+error_t export_cfg_index(const cfg_t *cfg, string_t *output) {
+  /** export_cfg_index
+   * Appends the binary index file described in cfg.h
+   */
+  uint32_t header[4] = {CFG_MAGIC, CFG_VERSION, (uint32_t)cfg->block_count, (uint32_t)cfg->edge_count};
+  error_t error_code = append_words(output, header, 4);
+  if (error_code == JASM_SUCCESS) {
+    error_code = append_words(output, cfg->starts, cfg->block_count);
+  }
+  if (error_code == JASM_SUCCESS) {
+    error_code = append_words(output, cfg->ends, cfg->block_count);
+  }
+  if (error_code == JASM_SUCCESS) {
+    error_code = append_words(output, cfg->instruction_counts, cfg->block_count);
+  }
+  if (error_code == JASM_SUCCESS) {
+    error_code = append_words(output, cfg->successor_index, cfg->block_count + 1);
+  }
+  if (error_code == JASM_SUCCESS) {
+    error_code = append_words(output, cfg->successors, cfg->edge_count);
+  }
+  if (error_code == JASM_SUCCESS) {
+    error_code = append_words(output, cfg->predecessor_index, cfg->block_count + 1);
+  }
+  if (error_code == JASM_SUCCESS) {
+    error_code = append_words(output, cfg->predecessors, cfg->edge_count);
+  }
+  if (error_code == JASM_SUCCESS) {
+    error_code = append_string(output, cfg->edge_count, (const char *)cfg->successor_kinds);
+  }
+  return error_code;
+}
+
+void append_node(string_t *output, size_t block) {
+  push_char(output, 'b');
+  append_number(output, (int32_t)block);
+}
+
+error_t export_cfg_dot(const cfg_t *cfg, const flow_t *flow, string_t *output) {
+  /** export_cfg_dot
+   * Appends the graph in Graphviz dot syntax: one box per block listing
+   * its instructions, solid edges for fallthrough, bold for jumps and
+   * dashed for calls
+   */
+  static const char *const edge_styles[3] = {"", " [style=bold]", " [style=dashed]"};
+  instruction_t instruction;
+  append_literal(output, "digraph cfg {\n  node [shape=box, fontname=monospace];\n");
+  for (size_t block = 0; block < cfg->block_count; ++block) {
+    size_t offset = cfg->starts[block];
+    append_literal(output, "  ");
+    append_node(output, block);
+    append_literal(output, " [label=\"");
+    append_label(output, offset);
+    append_literal(output, ":\\l");
+    while (offset < cfg->ends[block]) {
+      decode_instruction(flow->bytes + offset, flow->byte_count - offset, offset, &instruction);
+      append_literal(output, "  ");
+      render_flow_instruction(flow, &instruction, output);
+      append_literal(output, "\\l");
+      offset += instruction.length;
+    }
+    append_literal(output, "\"];\n");
+  }
+  for (size_t block = 0; block < cfg->block_count; ++block) {
+    for (uint32_t edge = cfg->successor_index[block]; edge < cfg->successor_index[block + 1]; ++edge) {
+      const char *style = edge_styles[cfg->successor_kinds[edge]];
+      append_literal(output, "  ");
+      append_node(output, block);
+      append_literal(output, " -> ");
+      append_node(output, cfg->successors[edge]);
+      append_string(output, strlen(style), style);
+      append_literal(output, ";\n");
+    }
+  }
+  return append_literal(output, "}\n");
+}
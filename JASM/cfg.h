@@ -0,0 +1,50 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include <stddef.h>
+
+/* Index file magic, "JCFG" little-endian, and layout version */
+#define CFG_MAGIC   0x4746434aU
+#define CFG_VERSION 1
+
+typedef enum edge_kind_t {
+  EDGE_FALLTHROUGH = 0,   /* next block, no transfer or a branch not taken */
+  EDGE_JUMP,              /* jmp, jcc, loop or jcxz taken */
+  EDGE_CALL,              /* call to a subroutine entry */
+} edge_kind_t;
+
+/** Control-flow graph
+ * Basic blocks of a traced image in offset order, struct-of-arrays. Edges
+ * are stored compressed by row: the successors of block b are
+ * successors[successor_index[b] .. successor_index[b + 1]), likewise for
+ * predecessors. Offsets are image offsets; blocks are numbered from 0.
+ *
+ * Index file, every field a little-endian uint32_t unless noted:
+ *   magic, version, block_count, edge_count,
+ *   starts[block_count], ends[block_count] (exclusive),
+ *   instruction_counts[block_count],
+ *   successor_index[block_count + 1], successors[edge_count],
+ *   predecessor_index[block_count + 1], predecessors[edge_count],
+ *   successor_kinds[edge_count] (uint8_t, edge_kind_t)
+ */
+typedef struct cfg_t {
+  size_t    block_count;
+  size_t    edge_count;
+  uint32_t  *starts;
+  uint32_t  *ends;
+  uint32_t  *instruction_counts;
+  uint32_t  *successor_index;
+  uint32_t  *successors;
+  uint8_t   *successor_kinds;
+  uint32_t  *predecessor_index;
+  uint32_t  *predecessors;
+} cfg_t;
+
+uint8_t ends_basic_block(const instruction_t *instruction);
+error_t build_cfg(cfg_t *cfg, const flow_t *flow);
+error_t free_cfg(cfg_t *cfg);
+size_t find_cfg_block(const cfg_t *cfg, size_t offset);
+error_t export_cfg_index(const cfg_t *cfg, string_t *output);
+error_t export_cfg_dot(const cfg_t *cfg, const flow_t *flow, string_t *output);
+
+#endif
@@ -7,5 +7,6 @@
 /* Common definitions */
 #define BUFFER_SIZE 4096
 #define STRING_SIZE 255
+#define OUTPUT_SIZE (1 << 18)
 
 #endif
\ No newline at end of file
@@ -0,0 +1,384 @@
+#include <stdlib.h>
+#include "common.h"
+#include "error.h"
+#include "opcode_table.h"
+#include "decoder.h"
+
+uint8_t displacement_length(uint8_t byte_2) {
+  /** Displacement length
+   * Bytes of displacement following a mod reg r/m byte
+   */
+  uint8_t mod = (byte_2 & MOD_MASK) >> 6;
+  if (mod == 0b00) {
+    return (byte_2 & RM_MASK) == 0b110 ? 2 : 0;
+  }
+  return mod == 0b11 ? 0 : mod;
+}
+
+uint8_t immediate_length(uint8_t imm, uint8_t w_bit) {
+  /** Immediate length
+   * Bytes of immediate data for an immediate_t rule
+   */
+  switch (imm) {
+    case IMM_8:
+    case IMM_S:
+      return 1;
+    case IMM_16:
+    case IMM_ADDR:
+      return 2;
+    case IMM_W:
+      return w_bit ? 2 : 1;
+    case IMM_FAR:
+      return 4;
+  }
+  return 0;
+}
+
+uint16_t read_word(const uint8_t *bytes) {
+  /** Read word
+   * Reads a little-endian 16-bit value
+   */
+  return (uint16_t)(bytes[0] | (bytes[1] << 8));
+}
+
+uint8_t decode_data(const uint8_t *bytes, size_t offset, instruction_t *instruction) {
+  /** Decode data
+   * A byte that does not start a complete instruction
+   */
+  instruction->offset = offset;
+  instruction->length = 1;
+  instruction->mnemonic = MN_INVALID;
+  instruction->attributes = 0;
+  instruction->kinds[0] = OPERAND_IMM;
+  instruction->kinds[1] = OPERAND_NONE;
+  instruction->registers[0] = 0;
+  instruction->registers[1] = 0;
+  instruction->displacement = 0;
+  instruction->immediate = bytes[0];
+  return 1;
+}
+
+void set_operand(instruction_t *instruction, uint8_t idx, uint8_t kind, uint8_t reg) {
+  instruction->kinds[idx] = kind;
+  instruction->registers[idx] = reg;
+}
+
+void set_modrm(instruction_t *instruction, uint8_t idx, uint8_t byte_2) {
+  /** Set mod r/m
+   * The register or memory operand selected by mod and r/m
+   */
+  uint8_t mod = (byte_2 & MOD_MASK) >> 6;
+  uint8_t rm = (byte_2 & RM_MASK) >> 0;
+  if (mod == 0b11) {
+    set_operand(instruction, idx, (instruction->attributes & ATTR_W) ? OPERAND_REG16 : OPERAND_REG8, rm);
+  } else if (mod == 0b00 && rm == 0b110) {
+    set_operand(instruction, idx, OPERAND_MEM, EA_DIRECT);
+  } else {
+    set_operand(instruction, idx, OPERAND_MEM, rm);
+    if (mod == 0b01) {
+      instruction->attributes |= ATTR_DISP;
+    } else if (mod == 0b10) {
+      instruction->attributes |= ATTR_DISP | ATTR_DISP16;
+    }
+  }
+}
+
+uint8_t decode_instruction(const uint8_t *bytes, size_t remaining, size_t offset, instruction_t *instruction) {
+  /** Decode instruction
+   * Decodes the instruction at bytes from the descriptor indexed by its
+   * first byte and returns the number of bytes consumed. Instructions that
+   * would run past remaining decode as a single data byte.
+   */
+  opcode_t opcode;
+  size_t idx = 0;
+  size_t length;
+  int8_t segment = -1;
+  uint8_t repeat = REPEAT_NONE;
+  uint8_t byte_1, byte_2 = 0;
+  uint8_t d_bit, w_bit, reg, imm_length;
+  uint8_t reg_kind;
+  /* Prefixes: at most one segment override and one lock/rep */
+  while (idx < remaining && opcode_table[bytes[idx]].form == FORM_PREFIX) {
+    uint8_t mnemonic = opcode_table[bytes[idx]].mnemonic;
+    if (mnemonic == MN_SEGMENT) {
+      if (segment >= 0) {
+        return decode_data(bytes, offset, instruction);
+      }
+      segment = (bytes[idx] >> 3) & 0b11;
+    } else {
+      if (repeat != REPEAT_NONE) {
+        return decode_data(bytes, offset, instruction);
+      }
+      repeat = mnemonic == MN_LOCK ? REPEAT_LOCK : mnemonic == MN_REP ? REPEAT_REP : REPEAT_REPNE;
+    }
+    ++idx;
+  }
+  if (idx >= remaining) {
+    return decode_data(bytes, offset, instruction);
+  }
+  byte_1 = bytes[idx];
+  if (opcode_table[byte_1].flags & OPF_MODRM) {
+    if (idx + 1 >= remaining) {
+      return decode_data(bytes, offset, instruction);
+    }
+    byte_2 = bytes[idx + 1];
+  }
+  opcode = resolve_opcode(byte_1, byte_2);
+  if (opcode.mnemonic == MN_INVALID) {
+    return decode_data(bytes, offset, instruction);
+  }
+  d_bit = (opcode.flags & OPF_D) ? (byte_1 & D_MASK) >> 1 : 0;
+  w_bit = (byte_1 & W_MASK) >> 0;
+  reg = (byte_2 & REG_MASK) >> 3;
+  if (opcode.flags & OPF_WORD) {
+    w_bit = 1;
+  } else if (opcode.flags & OPF_W3) {
+    w_bit = (byte_1 >> 3) & 1;
+  } else if (!(opcode.flags & OPF_W)) {
+    w_bit = 0;
+  }
+  instruction->offset = offset;
+  instruction->mnemonic = opcode.mnemonic;
+  instruction->attributes = (w_bit ? ATTR_W : 0) | ATTR_PREFIX(repeat);
+  if (segment >= 0) {
+    instruction->attributes |= ATTR_SEGMENT(segment);
+  }
+  instruction->kinds[0] = OPERAND_NONE;
+  instruction->kinds[1] = OPERAND_NONE;
+  instruction->registers[0] = 0;
+  instruction->registers[1] = 0;
+  instruction->displacement = 0;
+  instruction->immediate = 0;
+  /* Length: opcode, mod reg r/m, displacement, immediate */
+  length = idx + 1;
+  if (opcode.flags & OPF_MODRM) {
+    uint8_t disp_length = displacement_length(byte_2);
+    if (length + 1 + disp_length > remaining) {
+      return decode_data(bytes, offset, instruction);
+    }
+    if (disp_length == 1) {
+      instruction->displacement = (int8_t)bytes[length + 1];
+    } else if (disp_length == 2) {
+      instruction->displacement = (int16_t)read_word(bytes + length + 1);
+    }
+    length += 1 + disp_length;
+  }
+  imm_length = immediate_length(opcode.imm, w_bit);
+  if (length + imm_length > remaining) {
+    return decode_data(bytes, offset, instruction);
+  }
+  switch (imm_length) {
+    case 1:
+      instruction->immediate = (opcode.imm == IMM_S || opcode.form == FORM_REL8) ? (uint16_t)(int8_t)bytes[length] : bytes[length];
+      break;
+    case 2:
+      instruction->immediate = read_word(bytes + length);
+      break;
+    case 4:
+      instruction->immediate = read_word(bytes + length);
+      instruction->displacement = (int16_t)read_word(bytes + length + 2);
+      break;
+  }
+  length += imm_length;
+  instruction->length = length;
+
+  reg_kind = w_bit ? OPERAND_REG16 : OPERAND_REG8;
+  switch (opcode.form) {
+    case FORM_NONE:
+    case FORM_PREFIX:
+      if ((opcode.mnemonic == MN_AAM || opcode.mnemonic == MN_AAD) && instruction->immediate != 10) {
+        set_operand(instruction, 0, OPERAND_IMM, 0);
+      }
+      break;
+    case FORM_MODRM_REG:
+      set_modrm(instruction, d_bit ? 1 : 0, byte_2);
+      set_operand(instruction, d_bit ? 0 : 1, reg_kind, reg);
+      break;
+    case FORM_REG_MEM:
+      set_operand(instruction, 0, OPERAND_REG16, reg);
+      set_modrm(instruction, 1, byte_2);
+      break;
+    case FORM_MODRM_SEG:
+      set_modrm(instruction, d_bit ? 1 : 0, byte_2);
+      set_operand(instruction, d_bit ? 0 : 1, OPERAND_SEG, reg & 0b11);
+      break;
+    case FORM_MODRM:
+      set_modrm(instruction, 0, byte_2);
+      if (opcode.flags & OPF_FAR) {
+        instruction->attributes |= ATTR_FAR;
+      } else if (instruction->kinds[0] == OPERAND_MEM) {
+        instruction->attributes |= ATTR_SIZE;
+      }
+      break;
+    case FORM_MODRM_IMM:
+      set_modrm(instruction, 0, byte_2);
+      set_operand(instruction, 1, OPERAND_IMM, 0);
+      instruction->attributes |= ATTR_SIGNED;
+      if (instruction->kinds[0] == OPERAND_MEM) {
+        instruction->attributes |= ATTR_SIZE;
+      }
+      break;
+    case FORM_SHIFT:
+      set_modrm(instruction, 0, byte_2);
+      if (opcode.flags & OPF_CL) {
+        set_operand(instruction, 1, OPERAND_REG8, 1);
+      } else {
+        set_operand(instruction, 1, OPERAND_IMM, 0);
+        instruction->immediate = 1;
+      }
+      if (instruction->kinds[0] == OPERAND_MEM) {
+        instruction->attributes |= ATTR_SIZE;
+      }
+      break;
+    case FORM_ACC_IMM:
+    case FORM_REG_IMM:
+      set_operand(instruction, 0, reg_kind, opcode.form == FORM_ACC_IMM ? 0 : byte_1 & RM_MASK);
+      set_operand(instruction, 1, OPERAND_IMM, 0);
+      instruction->attributes |= ATTR_SIGNED;
+      break;
+    case FORM_REG:
+      set_operand(instruction, 0, OPERAND_REG16, byte_1 & RM_MASK);
+      break;
+    case FORM_ACC_REG:
+      set_operand(instruction, 0, OPERAND_REG16, 0);
+      set_operand(instruction, 1, OPERAND_REG16, byte_1 & RM_MASK);
+      break;
+    case FORM_SEG:
+      set_operand(instruction, 0, OPERAND_SEG, (byte_1 >> 3) & 0b11);
+      break;
+    case FORM_ACC_MEM:
+      set_operand(instruction, d_bit ? 1 : 0, reg_kind, 0);
+      set_operand(instruction, d_bit ? 0 : 1, OPERAND_MEM, EA_DIRECT);
+      instruction->displacement = (int16_t)instruction->immediate;
+      instruction->immediate = 0;
+      break;
+    case FORM_REL8:
+    case FORM_REL16:
+      set_operand(instruction, 0, OPERAND_REL, 0);
+      if (opcode.form == FORM_REL8 && opcode.mnemonic == MN_JMP) {
+        instruction->attributes |= ATTR_SHORT;
+      }
+      break;
+    case FORM_FAR:
+      set_operand(instruction, 0, OPERAND_FAR, 0);
+      break;
+    case FORM_IMM:
+      set_operand(instruction, 0, OPERAND_IMM, 0);
+      break;
+    case FORM_PORT_IMM:
+      set_operand(instruction, (opcode.flags & OPF_CL) ? 1 : 0, reg_kind, 0);
+      set_operand(instruction, (opcode.flags & OPF_CL) ? 0 : 1, OPERAND_IMM, 0);
+      break;
+    case FORM_PORT_DX:
+      set_operand(instruction, (opcode.flags & OPF_CL) ? 1 : 0, reg_kind, 0);
+      set_operand(instruction, (opcode.flags & OPF_CL) ? 0 : 1, OPERAND_REG16, 2);
+      break;
+    case FORM_ESC:
+      set_operand(instruction, 0, OPERAND_IMM, 0);
+      instruction->immediate = ((byte_1 & RM_MASK) << 3) | reg;
+      instruction->attributes |= ATTR_W;
+      set_modrm(instruction, 1, byte_2);
+      break;
+  }
+  return length;
+}
+
+error_t init_ir_block(ir_block_t *block, size_t capacity) {
+  /** init_ir_block
+   * Allocates the arrays of an empty block
+   */
+  block->base = 0;
+  block->count = 0;
+  block->capacity = capacity;
+  block->offsets = malloc(capacity * sizeof(uint32_t));
+  block->lengths = malloc(capacity * sizeof(uint8_t));
+  block->mnemonics = malloc(capacity * sizeof(uint8_t));
+  block->attributes = malloc(capacity * sizeof(uint16_t));
+  block->kinds = malloc(capacity * sizeof(uint8_t));
+  block->registers = malloc(capacity * sizeof(uint8_t));
+  block->displacements = malloc(capacity * sizeof(int16_t));
+  block->immediates = malloc(capacity * sizeof(uint16_t));
+  if (capacity > 0 && (block->offsets == NULL || block->lengths == NULL || block->mnemonics == NULL ||
+      block->attributes == NULL || block->kinds == NULL || block->registers == NULL ||
+      block->displacements == NULL || block->immediates == NULL)) {
+    free_ir_block(block);
+    return JASM_MEMORY_ERROR;
+  }
+  return JASM_SUCCESS;
+}
+
+error_t free_ir_block(ir_block_t *block) {
+  free(block->offsets);
+  free(block->lengths);
+  free(block->mnemonics);
+  free(block->attributes);
+  free(block->kinds);
+  free(block->registers);
+  free(block->displacements);
+  free(block->immediates);
+  block->offsets = NULL;
+  block->lengths = NULL;
+  block->mnemonics = NULL;
+  block->attributes = NULL;
+  block->kinds = NULL;
+  block->registers = NULL;
+  block->displacements = NULL;
+  block->immediates = NULL;
+  block->count = 0;
+  block->capacity = 0;
+  return JASM_SUCCESS;
+}
+
+error_t push_instruction(ir_block_t *block, const instruction_t *instruction) {
+  /** push_instruction
+   * Packs one decoded instruction onto the end of a block; the block
+   * must have room
+   */
+  size_t idx = block->count;
+  if (idx == block->capacity) {
+    return JASM_MEMORY_ERROR;
+  }
+  block->offsets[idx] = (uint32_t)(instruction->offset - block->base);
+  block->lengths[idx] = instruction->length;
+  block->mnemonics[idx] = instruction->mnemonic;
+  block->attributes[idx] = instruction->attributes;
+  block->kinds[idx] = instruction->kinds[0] | (instruction->kinds[1] << 4);
+  block->registers[idx] = instruction->registers[0] | (instruction->registers[1] << 4);
+  block->displacements[idx] = instruction->displacement;
+  block->immediates[idx] = instruction->immediate;
+  block->count++;
+  return JASM_SUCCESS;
+}
+
+void get_instruction(const ir_block_t *block, size_t idx, instruction_t *instruction) {
+  /** get_instruction
+   * Unpacks one instruction of a block
+   */
+  instruction->offset = block->base + block->offsets[idx];
+  instruction->length = block->lengths[idx];
+  instruction->mnemonic = block->mnemonics[idx];
+  instruction->attributes = block->attributes[idx];
+  instruction->kinds[0] = block->kinds[idx] & 0xf;
+  instruction->kinds[1] = block->kinds[idx] >> 4;
+  instruction->registers[0] = block->registers[idx] & 0xf;
+  instruction->registers[1] = block->registers[idx] >> 4;
+  instruction->displacement = block->displacements[idx];
+  instruction->immediate = block->immediates[idx];
+}
+
+size_t decode_batch(const uint8_t *bytes, size_t byte_count, ir_block_t *block) {
+  /** decode_batch
+   * Decodes instructions from the start of bytes into block until the
+   * bytes or the block's capacity run out, and returns the number of bytes
+   * consumed. Offsets are relative to block->base, which the caller sets
+   * to the position of bytes in the image.
+   */
+  instruction_t instruction;
+  size_t idx = 0;
+  block->count = 0;
+  while (idx < byte_count && block->count < block->capacity) {
+    idx += decode_instruction(bytes + idx, byte_count - idx, block->base + idx, &instruction);
+    push_instruction(block, &instruction);
+  }
+  return idx;
+}
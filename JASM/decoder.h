@@ -0,0 +1,92 @@
+#ifndef DECODER_H
+#define DECODER_H
+
+#include <stddef.h>
+
+/* Operand kinds */
+typedef enum operand_kind_t {
+  OPERAND_NONE = 0,
+  OPERAND_REG8,     /* register: byte register number */
+  OPERAND_REG16,    /* register: word register number */
+  OPERAND_SEG,      /* register: segment register number */
+  OPERAND_MEM,      /* register: r/m base, or EA_DIRECT; displacement */
+  OPERAND_IMM,      /* immediate */
+  OPERAND_REL,      /* immediate: signed displacement from the next instruction */
+  OPERAND_FAR,      /* immediate: offset, displacement: segment */
+} operand_kind_t;
+
+#define EA_DIRECT 8 /* memory operand without base or index registers */
+
+/* Instructions per decode_batch call in the listing loop */
+#define IR_BATCH_SIZE 4096
+
+/* Longest encoding: two prefixes, opcode, mod reg r/m, 16-bit displacement
+ * and 16-bit immediate */
+#define MAX_INSTRUCTION_LENGTH 8
+
+/* Instruction attributes */
+#define ATTR_W          0x0001 /* word operation */
+#define ATTR_FAR        0x0002 /* indirect far call/jmp */
+#define ATTR_SHORT      0x0004 /* jmp with an 8-bit displacement */
+#define ATTR_SIZE       0x0008 /* memory operand needs a byte/word size */
+#define ATTR_DISP       0x0010 /* memory operand was encoded with a displacement */
+#define ATTR_SIGNED     0x0020 /* immediate is signed at the operand width */
+#define ATTR_DISP16     0x0040 /* that displacement was 16 bits wide */
+#define ATTR_SEGMENT(s) (((s) + 1) << 8) /* segment override, 3 bits */
+#define ATTR_PREFIX(p)  ((p) << 11)      /* repeat_t, 2 bits */
+
+#define segment_override(attributes) ((int8_t)(((attributes) >> 8) & 0x7) - 1)
+#define repeat_prefix(attributes) (((attributes) >> 11) & 0x3)
+
+typedef enum repeat_t {
+  REPEAT_NONE = 0,
+  REPEAT_LOCK,
+  REPEAT_REP,
+  REPEAT_REPNE,
+} repeat_t;
+
+/** Decoded instruction
+ * One decoded instruction; operand 0 is the destination.
+ */
+typedef struct instruction_t {
+  size_t    offset;
+  uint8_t   length;
+  uint8_t   mnemonic;       /* mnemonic_t, MN_INVALID for a data byte */
+  uint16_t  attributes;     /* ATTR_* */
+  uint8_t   kinds[2];       /* operand_kind_t */
+  uint8_t   registers[2];
+  int16_t   displacement;
+  uint16_t  immediate;
+} instruction_t;
+
+/** IR block
+ * Struct-of-arrays form of a run of decoded instructions. Offsets are
+ * relative to base; operand kinds and registers pack two 4-bit fields.
+ */
+typedef struct ir_block_t {
+  size_t    base;
+  size_t    count;
+  size_t    capacity;
+  uint32_t  *offsets;
+  uint8_t   *lengths;
+  uint8_t   *mnemonics;
+  uint16_t  *attributes;
+  uint8_t   *kinds;
+  uint8_t   *registers;
+  int16_t   *displacements;
+  uint16_t  *immediates;
+} ir_block_t;
+
+uint8_t displacement_length(uint8_t byte_2);
+uint8_t immediate_length(uint8_t imm, uint8_t w_bit);
+uint16_t read_word(const uint8_t *bytes);
+uint8_t decode_data(const uint8_t *bytes, size_t offset, instruction_t *instruction);
+uint8_t decode_instruction(const uint8_t *bytes, size_t remaining, size_t offset, instruction_t *instruction);
+
+error_t init_ir_block(ir_block_t *block, size_t capacity);
+error_t free_ir_block(ir_block_t *block);
+error_t push_instruction(ir_block_t *block, const instruction_t *instruction);
+void get_instruction(const ir_block_t *block, size_t idx, instruction_t *instruction);
+size_t decode_batch(const uint8_t *bytes, size_t byte_count, ir_block_t *block);
+
+#endif
@@ -0,0 +1,737 @@
+#include <string.h>
+#include "common.h"
+#include "error.h"
+#include "opcode_table.h"
+#include "string_builder.h"
+#include "writer.h"
+#include "format.h"
+#include "decoder.h"
+#include "disassembler.h"
+#include "parallel.h"
+
+/** 8086 data
+ * dec  | bin   | hex
+ * 0      0000    0
+ * 1      0001    1
+ * 2      0010    2
+ * 3      0011    3
+ * 4      0100    4
+ * 5      0101    5
+ * 6      0110    6
+ * 7      0111    7
+ * 8      1000    8
+ * 9      1001    9
+ * 10     1010    A
+ * 11     1011    B
+ * 12     1100    C
+ * 13     1101    D
+ * 14     1110    E 
+ * 15     1111    F
+ */
+
+const char byte_registers[8][3] = {"al", "cl", "dl", "bl", "ah", "ch", "dh", "bh"};
+const char word_registers[8][3] = {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di"};
+const char segment_registers[4][3] = {"es", "cs", "ss", "ds"};
+const char eac_table[8][8] = {"bx + si", "bx + di", "bp + si", "bp + di", "si", "di", "bp", "bx"};
+const uint8_t eac_lengths[8] = {7, 7, 7, 7, 2, 2, 2, 2};
+const char size_names[2][6] = {"byte ", "word "};
+const uint8_t repeat_mnemonics[4] = {MN_INVALID, MN_LOCK, MN_REP, MN_REPNE};
+
+void append_offset(string_t *string, size_t offset) {
+  /** Append offset
+   * Appends a decimal offset padded to at least four digits, like %04zu
+   */
+  char digits[20];
+  size_t idx = sizeof(digits);
+  if (offset < 10000) {
+    digits[0] = '0' + offset / 1000;
+    digits[1] = '0' + offset / 100 % 10;
+    digits[2] = '0' + offset / 10 % 10;
+    digits[3] = '0' + offset % 10;
+    append_string(string, 4, digits);
+    return;
+  }
+  do {
+    digits[--idx] = '0' + offset % 10;
+    offset /= 10;
+  } while (offset != 0);
+  append_string(string, sizeof(digits) - idx, digits + idx);
+}
+
+void append_bits(string_t *string, const uint8_t *bytes, size_t count) {
+  /** Append bits
+   * Appends the binary digits of count bytes, each followed by a space
+   */
+  if (reserve_string(string, count * BITS_WIDTH) != JASM_SUCCESS) {
+    return;
+  }
+  format_bits(string->buffer + string->idx, bytes, count);
+  string->idx += count * BITS_WIDTH;
+}
+
+void append_hex(string_t *string, const uint8_t *bytes, size_t count) {
+  /** Append hex
+   * Appends two hex digits per byte
+   */
+  if (reserve_string(string, count * HEX_WIDTH) != JASM_SUCCESS) {
+    return;
+  }
+  format_hex(string->buffer + string->idx, bytes, count);
+  string->idx += count * HEX_WIDTH;
+}
+
+void append_number(string_t *string, int32_t value) {
+  /** Append number
+   * Appends a signed decimal number
+   */
+  char digits[12];
+  size_t idx = sizeof(digits);
+  uint32_t magnitude = value < 0 ? -(uint32_t)value : (uint32_t)value;
+  do {
+    digits[--idx] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude != 0);
+  if (value < 0) {
+    digits[--idx] = '-';
+  }
+  append_string(string, sizeof(digits) - idx, digits + idx);
+}
+
+void append_register(string_t *string, uint8_t w_bit, uint8_t reg) {
+  /** Append register
+   * Appends the byte or word register selected by w
+   */
+  append_string(string, 2, w_bit ? word_registers[reg] : byte_registers[reg]);
+}
+
+void append_operand(string_t *string, const instruction_t *instruction, uint8_t idx) {
+  /** Append operand
+   * Appends operand idx of a decoded instruction
+   */
+  uint8_t reg = instruction->registers[idx];
+  int32_t value;
+  switch (instruction->kinds[idx]) {
+    case OPERAND_REG8:
+    case OPERAND_REG16:
+      append_register(string, instruction->kinds[idx] == OPERAND_REG16, reg);
+      break;
+    case OPERAND_SEG:
+      append_string(string, 2, segment_registers[reg]);
+      break;
+    case OPERAND_MEM:
+      if (instruction->attributes & ATTR_SIZE) {
+        append_string(string, 5, size_names[instruction->attributes & ATTR_W]);
+      }
+      push_char(string, '[');
+      if (segment_override(instruction->attributes) >= 0) {
+        append_string(string, 2, segment_registers[segment_override(instruction->attributes)]);
+        push_char(string, ':');
+      }
+      if (reg == EA_DIRECT) {
+        append_number(string, (uint16_t)instruction->displacement);
+      } else {
+        int16_t disp = instruction->displacement;
+        append_string(string, eac_lengths[reg], eac_table[reg]);
+        /* [bp] is encoded as [bp + 0] with an 8-bit displacement */
+        if ((instruction->attributes & ATTR_DISP) &&
+            !(reg == 0b110 && disp == 0 && !(instruction->attributes & ATTR_DISP16))) {
+          if (disp < 0) {
+            append_literal(string, " - ");
+          } else {
+            append_literal(string, " + ");
+          }
+          append_number(string, disp < 0 ? -(int32_t)disp : disp);
+        }
+      }
+      push_char(string, ']');
+      break;
+    case OPERAND_IMM:
+      if (!(instruction->attributes & ATTR_SIGNED)) {
+        value = instruction->immediate;
+      } else if (instruction->attributes & ATTR_W) {
+        value = (int16_t)instruction->immediate;
+      } else {
+        value = (int8_t)instruction->immediate;
+      }
+      append_number(string, value);
+      break;
+    case OPERAND_REL:
+      if (instruction->attributes & ATTR_SHORT) {
+        append_literal(string, "short ");
+      }
+      value = (int16_t)instruction->immediate + (int32_t)instruction->length;
+      push_char(string, '$');
+      if (value >= 0) {
+        push_char(string, '+');
+      }
+      append_number(string, value);
+      break;
+    case OPERAND_FAR:
+      append_number(string, (uint16_t)instruction->displacement);
+      push_char(string, ':');
+      append_number(string, instruction->immediate);
+      break;
+  }
+}
+
+void render_instruction(const instruction_t *instruction, string_t *string) {
+  /** Render instruction
+   * Appends the assembly text of a decoded instruction
+   */
+  uint8_t repeat = repeat_prefix(instruction->attributes);
+  int8_t segment = segment_override(instruction->attributes);
+  if (instruction->mnemonic == MN_INVALID) {
+    uint8_t byte = (uint8_t)instruction->immediate;
+    append_literal(string, "db 0x");
+    append_hex(string, &byte, 1);
+    return;
+  }
+  if (repeat != REPEAT_NONE) {
+    append_string(string, mnemonic_lengths[repeat_mnemonics[repeat]], mnemonic_names[repeat_mnemonics[repeat]]);
+    push_char(string, ' ');
+  }
+  if (segment >= 0 && instruction->kinds[0] != OPERAND_MEM && instruction->kinds[1] != OPERAND_MEM) {
+    append_string(string, 2, segment_registers[segment]);
+    push_char(string, ' ');
+  }
+  append_string(string, mnemonic_lengths[instruction->mnemonic], mnemonic_names[instruction->mnemonic]);
+  if (instruction->kinds[0] != OPERAND_NONE) {
+    push_char(string, ' ');
+    if (instruction->attributes & ATTR_FAR) {
+      append_literal(string, "far ");
+    }
+    append_operand(string, instruction, 0);
+  }
+  if (instruction->kinds[1] != OPERAND_NONE) {
+    append_literal(string, ", ");
+    append_operand(string, instruction, 1);
+  }
+}
+
+uint8_t disassemble_8086(const uint8_t *bytes, size_t remaining, string_t *string) {
+  /** Disassemble 8086
+   * Decodes and renders the instruction at bytes and returns the number
+   * of bytes consumed
+   */
+  instruction_t instruction;
+  uint8_t length = decode_instruction(bytes, remaining, 0, &instruction);
+  render_instruction(&instruction, string);
+  return length;
+}
+
+void render_code_line(const uint8_t *code, const instruction_t *instruction, string_t *line) {
+  /** Render code line
+   * Appends one listing line for a decoded instruction: offset, the bits
+   * of every byte it consumed, and its rendering. code points at the
+   * instruction's own bytes.
+   */
+  append_offset(line, instruction->offset);
+  push_char(line, ' ');
+  append_bits(line, code, instruction->length);
+  render_instruction(instruction, line);
+  push_char(line, '\n');
+}
+
+void render_code_text(const char *bits, const instruction_t *instruction, string_t *line) {
+  /* render_code_line with the instruction's bytes already expanded to bits */
+  append_offset(line, instruction->offset);
+  push_char(line, ' ');
+  append_string(line, instruction->length * BITS_WIDTH, bits);
+  render_instruction(instruction, line);
+  push_char(line, '\n');
+}
+
+void render_line(const uint8_t *bytes, const instruction_t *instruction, string_t *line) {
+  /* render_code_line where bytes is the image the offset refers to */
+  render_code_line(bytes + instruction->offset, instruction, line);
+}
+
+uint8_t disassemble_line(const uint8_t *bytes, size_t idx, size_t byte_count, string_t *line) {
+  /** Disassemble line
+   * Decodes the instruction at bytes[idx] and appends its listing line.
+   * Returns the instruction length.
+   */
+  instruction_t instruction;
+  decode_instruction(bytes + idx, byte_count - idx, idx, &instruction);
+  render_line(bytes, &instruction, line);
+  return instruction.length;
+}
+
+void append_format_header(uint8_t format, string_t *string) {
+  /** Append format header
+   * Appends what a listing starts with: the banner for text, the stream
+   * header for records, nothing for JSON Lines
+   */
+  uint8_t header[RECORD_HEADER] = {
+    RECORD_MAGIC & 0xFF, RECORD_MAGIC >> 8 & 0xFF, RECORD_MAGIC >> 16 & 0xFF, RECORD_MAGIC >> 24,
+    RECORD_VERSION & 0xFF, RECORD_VERSION >> 8, RECORD_SIZE & 0xFF, RECORD_SIZE >> 8,
+  };
+  if (format == FORMAT_TEXT) {
+    append_literal(string, "=======<DISASSEMBLY OUTPUT>=======\n");
+  } else if (format == FORMAT_RECORDS) {
+    append_string(string, RECORD_HEADER, (const char *)header);
+  }
+}
+
+void append_file_header(uint8_t format, size_t length, const char *file_name, string_t *string) {
+  /** Append file header
+   * Appends what precedes each listing when several files are listed: the
+   * name and a colon for text, a {"file": name} line for JSON Lines,
+   * nothing for records, whose streams are told apart by their headers
+   */
+  if (format == FORMAT_TEXT) {
+    append_string(string, length, file_name);
+    append_literal(string, ":\n");
+  } else if (format == FORMAT_JSON) {
+    append_literal(string, "{\"file\":");
+    append_json_string(string, length, file_name);
+    append_literal(string, "}\n");
+  }
+}
+
+void render_record(const instruction_t *instruction, string_t *string) {
+  /** Render record
+   * Appends the fixed-width record of a decoded instruction, laid out as
+   * described in disassembler.h
+   */
+  uint8_t *record;
+  uint32_t offset = (uint32_t)instruction->offset;
+  uint16_t displacement = (uint16_t)instruction->displacement;
+  if (reserve_string(string, RECORD_SIZE) != JASM_SUCCESS) {
+    return;
+  }
+  record = (uint8_t *)string->buffer + string->idx;
+  record[0] = (uint8_t)offset;
+  record[1] = (uint8_t)(offset >> 8);
+  record[2] = (uint8_t)(offset >> 16);
+  record[3] = (uint8_t)(offset >> 24);
+  record[4] = instruction->length;
+  record[5] = instruction->mnemonic;
+  record[6] = (uint8_t)instruction->attributes;
+  record[7] = (uint8_t)(instruction->attributes >> 8);
+  record[8] = instruction->kinds[0];
+  record[9] = instruction->kinds[1];
+  record[10] = instruction->registers[0];
+  record[11] = instruction->registers[1];
+  record[12] = (uint8_t)displacement;
+  record[13] = (uint8_t)(displacement >> 8);
+  record[14] = (uint8_t)instruction->immediate;
+  record[15] = (uint8_t)(instruction->immediate >> 8);
+  string->idx += RECORD_SIZE;
+}
+
+void append_decimal(string_t *string, uint64_t value) {
+  /* Appends an unsigned decimal number without padding */
+  char digits[20];
+  size_t idx = sizeof(digits);
+  do {
+    digits[--idx] = '0' + value % 10;
+    value /= 10;
+  } while (value != 0);
+  append_string(string, sizeof(digits) - idx, digits + idx);
+}
+
+void append_json_string(string_t *string, size_t length, const char *text) {
+  /** Append JSON string
+   * Appends text as a quoted JSON string, escaping quotes, backslashes
+   * and control characters
+   */
+  push_char(string, '"');
+  for (size_t idx = 0; idx < length; ++idx) {
+    uint8_t c = (uint8_t)text[idx];
+    if (c == '"' || c == '\\') {
+      push_char(string, '\\');
+      push_char(string, (char)c);
+    } else if (c < 0x20) {
+      append_literal(string, "\\u00");
+      append_hex(string, &c, 1);
+    } else {
+      push_char(string, (char)c);
+    }
+  }
+  push_char(string, '"');
+}
+
+void append_json_operand(string_t *string, const instruction_t *instruction, uint8_t idx) {
+  /** Append JSON operand
+   * Appends operand idx as a JSON object with its kind and the fields the
+   * text form shows. Relative operands give the displacement from the
+   * instruction start, as $+n does, and the target when it is in range.
+   */
+  uint8_t reg = instruction->registers[idx];
+  int32_t value;
+  int64_t target;
+  switch (instruction->kinds[idx]) {
+    case OPERAND_REG8:
+    case OPERAND_REG16:
+      if (instruction->kinds[idx] == OPERAND_REG8) {
+        append_literal(string, "{\"kind\":\"reg8\",\"reg\":\"");
+      } else {
+        append_literal(string, "{\"kind\":\"reg16\",\"reg\":\"");
+      }
+      append_register(string, instruction->kinds[idx] == OPERAND_REG16, reg);
+      append_literal(string, "\"}");
+      break;
+    case OPERAND_SEG:
+      append_literal(string, "{\"kind\":\"seg\",\"reg\":\"");
+      append_string(string, 2, segment_registers[reg]);
+      append_literal(string, "\"}");
+      break;
+    case OPERAND_MEM:
+      append_literal(string, "{\"kind\":\"mem\"");
+      if (instruction->attributes & ATTR_SIZE) {
+        if (instruction->attributes & ATTR_W) {
+          append_literal(string, ",\"size\":\"word\"");
+        } else {
+          append_literal(string, ",\"size\":\"byte\"");
+        }
+      }
+      if (reg == EA_DIRECT) {
+        append_literal(string, ",\"disp\":");
+        append_number(string, (uint16_t)instruction->displacement);
+      } else {
+        append_literal(string, ",\"base\":\"");
+        append_string(string, eac_lengths[reg], eac_table[reg]);
+        push_char(string, '"');
+        if (instruction->attributes & ATTR_DISP) {
+          append_literal(string, ",\"disp\":");
+          append_number(string, instruction->displacement);
+        }
+      }
+      push_char(string, '}');
+      break;
+    case OPERAND_IMM:
+      if (!(instruction->attributes & ATTR_SIGNED)) {
+        value = instruction->immediate;
+      } else if (instruction->attributes & ATTR_W) {
+        value = (int16_t)instruction->immediate;
+      } else {
+        value = (int8_t)instruction->immediate;
+      }
+      append_literal(string, "{\"kind\":\"imm\",\"value\":");
+      append_number(string, value);
+      push_char(string, '}');
+      break;
+    case OPERAND_REL:
+      value = (int16_t)instruction->immediate + (int32_t)instruction->length;
+      target = (int64_t)instruction->offset + value;
+      append_literal(string, "{\"kind\":\"rel\",\"rel\":");
+      append_number(string, value);
+      if (target >= 0) {
+        append_literal(string, ",\"target\":");
+        append_decimal(string, (uint64_t)target);
+      }
+      push_char(string, '}');
+      break;
+    case OPERAND_FAR:
+      append_literal(string, "{\"kind\":\"far\",\"segment\":");
+      append_number(string, (uint16_t)instruction->displacement);
+      append_literal(string, ",\"offset\":");
+      append_number(string, instruction->immediate);
+      push_char(string, '}');
+      break;
+  }
+}
+
+void render_json_text(const char *hex, const instruction_t *instruction, string_t *line) {
+  /** Render JSON text
+   * Appends one JSON object for a decoded instruction: offset, length, its
+   * bytes in hex (already expanded by the caller), mnemonic, prefixes and
+   * operands. A data byte is "db" with the byte as an immediate.
+   */
+  uint8_t repeat = repeat_prefix(instruction->attributes);
+  int8_t segment = segment_override(instruction->attributes);
+  append_literal(line, "{\"offset\":");
+  append_decimal(line, instruction->offset);
+  append_literal(line, ",\"length\":");
+  append_decimal(line, instruction->length);
+  append_literal(line, ",\"bytes\":\"");
+  append_string(line, instruction->length * HEX_WIDTH, hex);
+  append_literal(line, "\",\"mnemonic\":\"");
+  append_string(line, mnemonic_lengths[instruction->mnemonic], mnemonic_names[instruction->mnemonic]);
+  push_char(line, '"');
+  if (instruction->mnemonic == MN_INVALID) {
+    append_literal(line, ",\"operands\":[{\"kind\":\"imm\",\"value\":");
+    append_decimal(line, (uint8_t)instruction->immediate);
+    append_literal(line, "}]}\n");
+    return;
+  }
+  if (repeat != REPEAT_NONE) {
+    append_literal(line, ",\"repeat\":\"");
+    append_string(line, mnemonic_lengths[repeat_mnemonics[repeat]], mnemonic_names[repeat_mnemonics[repeat]]);
+    push_char(line, '"');
+  }
+  if (segment >= 0) {
+    append_literal(line, ",\"segment\":\"");
+    append_string(line, 2, segment_registers[segment]);
+    push_char(line, '"');
+  }
+  if (instruction->attributes & ATTR_FAR) {
+    append_literal(line, ",\"far\":true");
+  }
+  if (instruction->attributes & ATTR_SHORT) {
+    append_literal(line, ",\"short\":true");
+  }
+  append_literal(line, ",\"operands\":[");
+  for (uint8_t idx = 0; idx < 2 && instruction->kinds[idx] != OPERAND_NONE; ++idx) {
+    if (idx > 0) {
+      push_char(line, ',');
+    }
+    append_json_operand(line, instruction, idx);
+  }
+  append_literal(line, "]}\n");
+}
+
+void render_json_line(const uint8_t *code, const instruction_t *instruction, string_t *line) {
+  /* render_json_text for the instruction's bytes at code */
+  char hex[MAX_INSTRUCTION_LENGTH * HEX_WIDTH];
+  format_hex(hex, code, instruction->length);
+  render_json_text(hex, instruction, line);
+}
+
+void render_format_line(uint8_t format, const uint8_t *code, const instruction_t *instruction, string_t *line) {
+  /* The listing line of a decoded instruction in a list_format_t; code points at its bytes */
+  switch (format) {
+    case FORMAT_RECORDS:
+      render_record(instruction, line);
+      break;
+    case FORMAT_JSON:
+      render_json_line(code, instruction, line);
+      break;
+    default:
+      render_code_line(code, instruction, line);
+      break;
+  }
+}
+
+void append_symbol_offset(string_t *line, const symbol_index_t *symbols, size_t position, size_t offset) {
+  /** Append symbol offset
+   * Appends " ; name+0x12" for offset in the symbol at a position, as
+   * found by symbol_below, nothing for NO_SYMBOL
+   */
+  char digits[8];
+  size_t count = 0;
+  size_t length;
+  const char *name;
+  uint32_t distance;
+  if (position == NO_SYMBOL) {
+    return;
+  }
+  name = symbol_name(symbols, position, &length);
+  distance = (uint32_t)(offset - symbol_address(symbols, position));
+  append_literal(line, " ; ");
+  append_string(line, length, name);
+  if (distance == 0) {
+    return;
+  }
+  append_literal(line, "+0x");
+  for (; distance != 0 || count == 0; distance >>= 4) {
+    digits[count++] = "0123456789abcdef"[distance & 0xF];
+  }
+  while (count > 0) {
+    push_char(line, digits[--count]);
+  }
+}
+
+void render_symbol_line(const disassembler_t *context, const char *bits, const instruction_t *instruction,
+                        string_t *line) {
+  /** Render symbol line
+   * render_code_text after a "name:" line for every symbol at the
+   * instruction, with the target of a relative branch written as the first
+   * symbol there. LIST_ANNOTATE also names the symbol each instruction
+   * falls in.
+   */
+  const symbol_index_t *symbols = context->symbols;
+  uint32_t offset = instruction->offset <= UINT32_MAX ? (uint32_t)instruction->offset : UINT32_MAX;
+  size_t below = NO_SYMBOL;
+  size_t position, target = NO_SYMBOL;
+  size_t length;
+  const char *name;
+  /* The symbol below an annotated line is also the first at it, if any */
+  if (context->options & LIST_ANNOTATE) {
+    below = symbol_below(symbols, offset);
+    position = below;
+  } else {
+    position = first_symbol_at(symbols, offset);
+  }
+  for (; position < symbols->count && symbol_address(symbols, position) == instruction->offset; ++position) {
+    name = symbol_name(symbols, position, &length);
+    append_string(line, length, name);
+    append_literal(line, ":\n");
+  }
+  if (instruction->kinds[0] == OPERAND_REL && segment_override(instruction->attributes) < 0 &&
+      repeat_prefix(instruction->attributes) == REPEAT_NONE) {
+    int64_t address = (int64_t)instruction->offset + instruction->length + (int16_t)instruction->immediate;
+    if (address >= 0 && address <= UINT32_MAX) {
+      target = first_symbol_at(symbols, (uint32_t)address);
+    }
+  }
+  /* render_code_text, with the target's name and the annotation before the newline */
+  append_offset(line, instruction->offset);
+  push_char(line, ' ');
+  append_string(line, instruction->length * BITS_WIDTH, bits);
+  if (target == NO_SYMBOL) {
+    render_instruction(instruction, line);
+  } else {
+    name = symbol_name(symbols, target, &length);
+    append_string(line, mnemonic_lengths[instruction->mnemonic], mnemonic_names[instruction->mnemonic]);
+    push_char(line, ' ');
+    if (instruction->attributes & ATTR_SHORT) {
+      append_literal(line, "short ");
+    }
+    append_string(line, length, name);
+  }
+  if (context->options & LIST_ANNOTATE) {
+    append_symbol_offset(line, symbols, below, instruction->offset);
+  }
+  push_char(line, '\n');
+}
+
+uint8_t expanded_width(uint8_t format) {
+  /* Characters per byte expand_bytes writes for a list_format_t */
+  switch (format) {
+    case FORMAT_TEXT:
+      return BITS_WIDTH;
+    case FORMAT_JSON:
+      return HEX_WIDTH;
+    default:
+      return 0;
+  }
+}
+
+error_t expand_bytes(uint8_t format, const uint8_t *bytes, size_t count, string_t *expanded) {
+  /** Expand bytes
+   * Replaces expanded with what the lines of a list_format_t show of
+   * count bytes: binary digits for text, hex digits for JSON, nothing for
+   * records. Expanding a whole batch at once lets the formatting kernels
+   * run at full width instead of on one short instruction at a time.
+   */
+  error_t error_code;
+  clear_string(expanded);
+  error_code = reserve_string(expanded, count * expanded_width(format));
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  if (format == FORMAT_TEXT) {
+    format_bits(expanded->buffer, bytes, count);
+  } else if (format == FORMAT_JSON) {
+    format_hex(expanded->buffer, bytes, count);
+  }
+  expanded->idx = count * expanded_width(format);
+  return JASM_SUCCESS;
+}
+
+void render_expanded_line(const disassembler_t *context, const char *expanded, const instruction_t *instruction,
+                          string_t *line) {
+  /** Render expanded line
+   * render_context_line with the instruction's bytes already expanded by
+   * expand_bytes
+   */
+  switch (context->format) {
+    case FORMAT_RECORDS:
+      render_record(instruction, line);
+      break;
+    case FORMAT_JSON:
+      render_json_text(expanded, instruction, line);
+      break;
+    default:
+      if (context->symbols != NULL) {
+        render_symbol_line(context, expanded, instruction, line);
+      } else {
+        render_code_text(expanded, instruction, line);
+      }
+      break;
+  }
+}
+
+void render_context_line(const disassembler_t *context, const instruction_t *instruction, string_t *line) {
+  /* The line of a decoded instruction in the context's format, symbolized when it is text */
+  char expanded[MAX_INSTRUCTION_LENGTH * BITS_WIDTH];
+  const uint8_t *code = context->bytes + instruction->offset;
+  if (context->format == FORMAT_TEXT) {
+    format_bits(expanded, code, instruction->length);
+  } else if (context->format == FORMAT_JSON) {
+    format_hex(expanded, code, instruction->length);
+  }
+  render_expanded_line(context, expanded, instruction, line);
+}
+
+uint8_t disassemble_context_line(const disassembler_t *context, size_t idx, string_t *line) {
+  /** Disassemble context line
+   * disassemble_line for the context's image, in its format and with its
+   * symbols. Returns the instruction length.
+   */
+  instruction_t instruction;
+  decode_instruction(context->bytes + idx, context->byte_count - idx, idx, &instruction);
+  render_context_line(context, &instruction, line);
+  return instruction.length;
+}
+
+error_t init_disassembler(disassembler_t *context, const uint8_t *bytes, size_t byte_count, writer_t *writer) {
+  /** init_disassembler
+   * Context listing an image to a writer with the banner, on every online
+   * processor when the image is large
+   */
+  context->bytes = bytes;
+  context->byte_count = byte_count;
+  context->writer = writer;
+  context->thread_count = 0;
+  context->symbols = NULL;
+  context->format = FORMAT_TEXT;
+  context->options = LIST_HEADER;
+  return JASM_SUCCESS;
+}
+
+error_t dump_buffer(const disassembler_t *context) {
+  /** Dump buffer
+   * Writes the binary contents and disassembly of every instruction in the
+   * context's image, advancing by the length of each decoded instruction,
+   * in the context's format. Large images are decoded in parallel with
+   * identical output unless LIST_SERIAL is set.
+   */
+  char text[STRING_SIZE];
+  string_t line, expanded;
+  ir_block_t block;
+  instruction_t instruction;
+  size_t width = expanded_width(context->format);
+  size_t idx = 0;
+  error_t error_code = JASM_SUCCESS;
+  init_string(&line, STRING_SIZE, text);
+  if (context->options & LIST_HEADER) {
+    append_format_header(context->format, &line);
+    write_bytes(context->writer, line.idx, line.buffer);
+  }
+  if (context->byte_count >= PARALLEL_THRESHOLD && !(context->options & LIST_SERIAL)) {
+    error_code = dump_buffer_parallel(context);
+    if (error_code != JASM_SUCCESS) {
+      return error_code;
+    }
+    return flush_writer(context->writer);
+  }
+  error_code = init_ir_block(&block, IR_BATCH_SIZE);
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  init_string(&expanded, 0, NULL);
+  while (idx < context->byte_count && error_code == JASM_SUCCESS) {
+    /* Decode a batch into the IR, expand its bytes at once, then render it */
+    size_t consumed;
+    block.base = idx;
+    consumed = decode_batch(context->bytes + idx, context->byte_count - idx, &block);
+    error_code = expand_bytes(context->format, context->bytes + idx, consumed, &expanded);
+    for (size_t jdx = 0; jdx < block.count && error_code == JASM_SUCCESS; ++jdx) {
+      get_instruction(&block, jdx, &instruction);
+      clear_string(&line);
+      render_expanded_line(context, expanded.buffer + (instruction.offset - block.base) * width, &instruction, &line);
+      error_code = write_bytes(context->writer, line.idx, line.buffer);
+    }
+    idx += consumed;
+  }
+  free_ir_block(&block);
+  free_string(&expanded);
+  free_string(&line);
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  return flush_writer(context->writer);
+}
@@ -0,0 +1,87 @@
+#ifndef DISASSEMBLER_H
+#define DISASSEMBLER_H
+
+#include "decoder.h"
+#include "writer.h"
+#include "symbols.h"
+
+/* Listing options */
+#define LIST_HEADER   0x01  /* start with the DISASSEMBLY OUTPUT banner */
+#define LIST_SERIAL   0x02  /* decode on the calling thread only */
+#define LIST_ANNOTATE 0x04  /* end each line with the symbol it falls in, as name+0x12 */
+
+/* Listing formats */
+typedef enum list_format_t {
+  FORMAT_TEXT = 0,  /* offset, bits and assembly per line */
+  FORMAT_RECORDS,   /* fixed-width binary records */
+  FORMAT_JSON,      /* one JSON object per line */
+} list_format_t;
+
+/* Record stream magic, "JREC" little-endian, layout version and widths */
+#define RECORD_MAGIC   0x4345524aU
+#define RECORD_VERSION 1
+#define RECORD_HEADER  8
+#define RECORD_SIZE    16
+
+/** Record stream
+ * A header of uint32_t magic, uint16_t version and uint16_t record size,
+ * then one record per instruction, all little-endian: uint32_t offset,
+ * modulo 2^32 for longer streams, uint8_t length, uint8_t mnemonic_t
+ * (MN_INVALID for a data byte, its value in immediate), uint16_t ATTR_*
+ * attributes, uint8_t operand kinds[2], uint8_t registers[2], int16_t
+ * displacement and uint16_t immediate, as in instruction_t.
+ */
+
+/** Disassembler
+ * One listing job: the image it reads, the writer it fills and the
+ * options that shape it. The decoder keeps no other state, so contexts on
+ * different threads never share anything but read-only tables.
+ */
+typedef struct disassembler_t {
+  const uint8_t *bytes;       /* input view */
+  size_t        byte_count;
+  writer_t      *writer;      /* output sink */
+  size_t        thread_count; /* workers for large images, 0 for every online processor */
+  const symbol_index_t *symbols; /* names for offsets, or NULL */
+  uint8_t       format;       /* list_format_t; symbols only name the text form */
+  uint8_t       options;      /* LIST_* */
+} disassembler_t;
+
+extern const char byte_registers[8][3];
+extern const char word_registers[8][3];
+extern const char segment_registers[4][3];
+
+void append_offset(string_t *string, size_t offset);
+void append_bits(string_t *string, const uint8_t *bytes, size_t count);
+void append_hex(string_t *string, const uint8_t *bytes, size_t count);
+void append_number(string_t *string, int32_t value);
+void append_register(string_t *string, uint8_t w_bit, uint8_t reg);
+void append_operand(string_t *string, const instruction_t *instruction, uint8_t idx);
+void render_instruction(const instruction_t *instruction, string_t *string);
+uint8_t disassemble_8086(const uint8_t *bytes, size_t remaining, string_t *string);
+void render_code_line(const uint8_t *code, const instruction_t *instruction, string_t *line);
+void render_code_text(const char *bits, const instruction_t *instruction, string_t *line);
+void render_line(const uint8_t *bytes, const instruction_t *instruction, string_t *line);
+uint8_t disassemble_line(const uint8_t *bytes, size_t idx, size_t byte_count, string_t *line);
+void append_decimal(string_t *string, uint64_t value);
+void append_json_string(string_t *string, size_t length, const char *text);
+void append_json_operand(string_t *string, const instruction_t *instruction, uint8_t idx);
+void append_format_header(uint8_t format, string_t *string);
+void append_file_header(uint8_t format, size_t length, const char *file_name, string_t *string);
+void render_record(const instruction_t *instruction, string_t *string);
+void render_json_text(const char *hex, const instruction_t *instruction, string_t *line);
+void render_json_line(const uint8_t *code, const instruction_t *instruction, string_t *line);
+void render_format_line(uint8_t format, const uint8_t *code, const instruction_t *instruction, string_t *line);
+void append_symbol_offset(string_t *line, const symbol_index_t *symbols, size_t position, size_t offset);
+void render_symbol_line(const disassembler_t *context, const char *bits, const instruction_t *instruction,
+                        string_t *line);
+uint8_t expanded_width(uint8_t format);
+error_t expand_bytes(uint8_t format, const uint8_t *bytes, size_t count, string_t *expanded);
+void render_expanded_line(const disassembler_t *context, const char *expanded, const instruction_t *instruction,
+                          string_t *line);
+void render_context_line(const disassembler_t *context, const instruction_t *instruction, string_t *line);
+uint8_t disassemble_context_line(const disassembler_t *context, size_t idx, string_t *line);
+error_t init_disassembler(disassembler_t *context, const uint8_t *bytes, size_t byte_count, writer_t *writer);
+error_t dump_buffer(const disassembler_t *context);
+
+#endif
@@ -0,0 +1,1244 @@
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "error.h"
+#include "opcode_table.h"
+#include "decoder.h"
+#include "emulator.h"
+#include "jit.h"
+
+/** 8086 emulator
+ * Executes the decoder's instruction_t directly. run_cpu works on basic
+ * blocks: straight-line runs decoded once, keyed by cs:ip, and dispatched
+ * as threaded code (computed goto) with fast paths for the hottest
+ * register forms. step_cpu, used for tracing, decodes one instruction at
+ * a time through a per-address cache. Both caches are retired a page at a
+ * time when a store lands on code.
+ *
+ * Status flags are lazy. add, adc, sub, sbb, cmp, neg and the string
+ * compares record LAZY_ADD or LAZY_SUB with their operands and result; and,
+ * or, xor and test record LAZY_LOGIC; inc and dec record LAZY_INC or
+ * LAZY_DEC. cpu->flags is stale until materialize_flags computes the
+ * status flags from that record, which happens before anything reads or
+ * partly rewrites them: conditional jumps, loopz and loopnz, adc and sbb,
+ * shifts and rotates, multiplies and divides, decimal adjusts, pushf,
+ * lahf, sahf, cmc, clc and stc, interrupts, an inc or dec following
+ * another kind of operation (for its CF), and JIT block entry. popf drops
+ * the record. step_cpu and run_cpu return with the flags materialized.
+ */
+
+uint32_t linear_address(uint16_t segment, uint16_t offset) {
+  return (((uint32_t)segment << 4) + offset) & MEMORY_MASK;
+}
+
+error_t init_cpu(cpu_t *cpu) {
+  /** init_cpu
+   * Zeroed memory and registers, an empty decode cache
+   */
+  memset(cpu, 0, sizeof(*cpu));
+  cpu->memory = calloc(MEMORY_SIZE, 1);
+  cpu->cache = malloc(DECODE_CACHE_SIZE * sizeof(decoded_t));
+  cpu->blocks = malloc(BLOCK_CACHE_SIZE * sizeof(block_t));
+  cpu->page_generations = calloc(CODE_PAGE_COUNT, sizeof(uint32_t));
+  cpu->code_pages = calloc(CODE_PAGE_COUNT, 1);
+  if (cpu->memory == NULL || cpu->cache == NULL || cpu->page_generations == NULL || cpu->code_pages == NULL ||
+      cpu->blocks == NULL) {
+    free_cpu(cpu);
+    return JASM_MEMORY_ERROR;
+  }
+  for (size_t idx = 0; idx < DECODE_CACHE_SIZE; ++idx) {
+    cpu->cache[idx].address = UINT32_MAX;
+  }
+  for (size_t idx = 0; idx < BLOCK_CACHE_SIZE; ++idx) {
+    cpu->blocks[idx].address = UINT32_MAX;
+  }
+  cpu->flags = 0xf002;
+  return JASM_SUCCESS;
+}
+
+error_t free_cpu(cpu_t *cpu) {
+  free(cpu->memory);
+  free(cpu->cache);
+  free(cpu->page_generations);
+  free(cpu->code_pages);
+  free(cpu->blocks);
+  cpu->memory = NULL;
+  cpu->cache = NULL;
+  cpu->page_generations = NULL;
+  cpu->code_pages = NULL;
+  cpu->blocks = NULL;
+  return JASM_SUCCESS;
+}
+
+error_t load_program(cpu_t *cpu, const uint8_t *bytes, size_t byte_count, uint16_t segment, uint16_t offset) {
+  /** load_program
+   * Copies a flat binary to segment:offset and points every segment
+   * register there, with the stack at the top of the segment
+   */
+  uint32_t address = linear_address(segment, offset);
+  if (byte_count > MEMORY_SIZE - address) {
+    return JASM_MEMORY_ERROR;
+  }
+  for (size_t idx = 0; idx < byte_count; ++idx) {
+    store_byte(cpu, address + idx, bytes[idx]);
+  }
+  for (uint8_t idx = 0; idx < 4; ++idx) {
+    cpu->segments[idx] = segment;
+  }
+  cpu->registers[REG_SP] = 0xfffe;
+  cpu->ip = offset;
+  cpu->halted = 0;
+  return JASM_SUCCESS;
+}
+
+uint8_t load_byte(const cpu_t *cpu, uint32_t address) {
+  return cpu->memory[address & MEMORY_MASK];
+}
+
+void store_byte(cpu_t *cpu, uint32_t address, uint8_t value) {
+  /** store_byte
+   * Writes a byte and retires cached instructions that may contain it: an
+   * instruction is at most MAX_INSTRUCTION_LENGTH bytes with its prefixes,
+   * so one starting on the previous page can reach into this one
+   */
+  uint32_t page;
+  address &= MEMORY_MASK;
+  cpu->memory[address] = value;
+  page = address >> CODE_PAGE_SHIFT;
+  if (cpu->code_pages[page]) {
+    cpu->code_writes++;
+    cpu->page_generations[page]++;
+    if ((address & ((1 << CODE_PAGE_SHIFT) - 1)) < MAX_INSTRUCTION_LENGTH) {
+      cpu->page_generations[(page - 1) & (CODE_PAGE_COUNT - 1)]++;
+    }
+  }
+}
+
+uint16_t load_word(const cpu_t *cpu, uint16_t segment, uint16_t offset) {
+  /* Word accesses wrap within the segment */
+  return (uint16_t)(load_byte(cpu, linear_address(segment, offset)) |
+                    (load_byte(cpu, linear_address(segment, (uint16_t)(offset + 1))) << 8));
+}
+
+void store_word(cpu_t *cpu, uint16_t segment, uint16_t offset, uint16_t value) {
+  store_byte(cpu, linear_address(segment, offset), (uint8_t)value);
+  store_byte(cpu, linear_address(segment, (uint16_t)(offset + 1)), (uint8_t)(value >> 8));
+}
+
+void push_word(cpu_t *cpu, uint16_t value) {
+  cpu->registers[REG_SP] -= 2;
+  store_word(cpu, cpu->segments[SEG_SS], cpu->registers[REG_SP], value);
+}
+
+uint16_t pop_word(cpu_t *cpu) {
+  uint16_t value = load_word(cpu, cpu->segments[SEG_SS], cpu->registers[REG_SP]);
+  cpu->registers[REG_SP] += 2;
+  return value;
+}
+
+uint8_t get_byte_register(const cpu_t *cpu, uint8_t reg) {
+  /* al cl dl bl are the low bytes of ax..bx, ah ch dh bh the high bytes */
+  return reg < 4 ? (uint8_t)cpu->registers[reg] : (uint8_t)(cpu->registers[reg - 4] >> 8);
+}
+
+void set_byte_register(cpu_t *cpu, uint8_t reg, uint8_t value) {
+  if (reg < 4) {
+    cpu->registers[reg] = (cpu->registers[reg] & 0xff00) | value;
+  } else {
+    cpu->registers[reg - 4] = (cpu->registers[reg - 4] & 0x00ff) | (value << 8);
+  }
+}
+
+const instruction_t *fetch_instruction(cpu_t *cpu) {
+  /** fetch_instruction
+   * The instruction at cs:ip, decoded on a cache miss. The decode window
+   * wraps within the code segment like the 8086 prefetch does; such an
+   * instruction spans two unrelated pages and is not kept.
+   */
+  uint32_t address = linear_address(cpu->segments[SEG_CS], cpu->ip);
+  uint32_t page = address >> CODE_PAGE_SHIFT;
+  decoded_t *entry = &cpu->cache[address & (DECODE_CACHE_SIZE - 1)];
+  uint8_t window[8];
+  if (entry->address == address && entry->generation == cpu->page_generations[page]) {
+    return &entry->instruction;
+  }
+  for (uint8_t idx = 0; idx < sizeof(window); ++idx) {
+    window[idx] = load_byte(cpu, linear_address(cpu->segments[SEG_CS], (uint16_t)(cpu->ip + idx)));
+  }
+  decode_instruction(window, sizeof(window), cpu->ip, &entry->instruction);
+  cpu->code_pages[page] = 1;
+  cpu->code_pages[((address + entry->instruction.length - 1) & MEMORY_MASK) >> CODE_PAGE_SHIFT] = 1;
+  entry->address = (uint32_t)cpu->ip + entry->instruction.length > 0x10000 ? UINT32_MAX : address;
+  entry->generation = cpu->page_generations[page];
+  return &entry->instruction;
+}
+
+void set_result_flags(cpu_t *cpu, uint16_t result, uint8_t w_bit) {
+  /** set_result_flags
+   * SF, ZF and PF of a result; PF looks at the low byte only
+   */
+  uint16_t sign = w_bit ? 0x8000 : 0x80;
+  uint16_t mask = w_bit ? 0xffff : 0xff;
+  cpu->flags &= ~(FLAG_SF | FLAG_ZF | FLAG_PF);
+  if (result & sign) {
+    cpu->flags |= FLAG_SF;
+  }
+  if ((result & mask) == 0) {
+    cpu->flags |= FLAG_ZF;
+  }
+  if (!__builtin_parity(result & 0xff)) {
+    cpu->flags |= FLAG_PF;
+  }
+}
+
+uint16_t lazy_result(cpu_t *cpu, uint8_t op, uint16_t left, uint16_t right, uint16_t result, uint8_t w_bit) {
+  /** lazy_result
+   * Records a flag-setting operation in place of its status flags
+   */
+  cpu->lazy_op = op;
+  cpu->lazy_w = w_bit;
+  cpu->lazy_left = left;
+  cpu->lazy_right = right;
+  cpu->lazy_result = result;
+  return result;
+}
+
+void materialize_flags(cpu_t *cpu) {
+  /** materialize_flags
+   * Computes the status flags of the pending lazy operation. The carry and
+   * borrow out of the top bit come from the carry chain of left, right and
+   * result, so adc and sbb need no extra state.
+   */
+  uint16_t left = cpu->lazy_left;
+  uint16_t right = cpu->lazy_right;
+  uint16_t result = cpu->lazy_result;
+  uint16_t sign = cpu->lazy_w ? 0x8000 : 0x80;
+  uint16_t carry = 0;
+  uint16_t overflow = 0;
+  uint16_t status = 0;
+  switch (cpu->lazy_op) {
+    case LAZY_NONE:
+      return;
+    case LAZY_ADD:
+    case LAZY_INC:
+      carry = (left & right) | ((left | right) & ~result);
+      overflow = (left ^ result) & (right ^ result);
+      break;
+    case LAZY_SUB:
+    case LAZY_DEC:
+      carry = (~left & right) | ((~left | right) & result);
+      overflow = (left ^ right) & (left ^ result);
+      break;
+    case LAZY_LOGIC:
+      break;
+  }
+  if (cpu->lazy_op == LAZY_INC || cpu->lazy_op == LAZY_DEC) {
+    status = cpu->flags & FLAG_CF;
+  } else if (carry & sign) {
+    status = FLAG_CF;
+  }
+  if (overflow & sign) {
+    status |= FLAG_OF;
+  }
+  if (cpu->lazy_op != LAZY_LOGIC && ((left ^ right ^ result) & 0x10)) {
+    status |= FLAG_AF;
+  }
+  cpu->flags = (cpu->flags & ~FLAG_STATUS) | status;
+  set_result_flags(cpu, result, cpu->lazy_w);
+  cpu->lazy_op = LAZY_NONE;
+}
+
+uint16_t add_values(cpu_t *cpu, uint16_t left, uint16_t right, uint8_t carry, uint8_t w_bit) {
+  /* left + right + carry */
+  uint16_t mask = w_bit ? 0xffff : 0xff;
+  return lazy_result(cpu, LAZY_ADD, left, right, (uint16_t)((left + right + carry) & mask), w_bit);
+}
+
+uint16_t subtract_values(cpu_t *cpu, uint16_t left, uint16_t right, uint8_t borrow, uint8_t w_bit) {
+  /* left - right - borrow */
+  uint16_t mask = w_bit ? 0xffff : 0xff;
+  return lazy_result(cpu, LAZY_SUB, left, right, (uint16_t)((left - right - borrow) & mask), w_bit);
+}
+
+uint16_t logic_result(cpu_t *cpu, uint16_t result, uint8_t w_bit) {
+  /* and, or, xor, test: CF, OF and AF cleared */
+  return lazy_result(cpu, LAZY_LOGIC, 0, 0, result, w_bit);
+}
+
+uint16_t step_value(cpu_t *cpu, uint8_t mnemonic, uint16_t value, uint8_t w_bit) {
+  /** step_value
+   * inc and dec leave CF alone, so the CF of a pending operation is
+   * settled into cpu->flags first
+   */
+  uint16_t mask = w_bit ? 0xffff : 0xff;
+  if (cpu->lazy_op != LAZY_NONE && cpu->lazy_op != LAZY_INC && cpu->lazy_op != LAZY_DEC) {
+    materialize_flags(cpu);
+  }
+  if (mnemonic == MN_INC) {
+    return lazy_result(cpu, LAZY_INC, value, 1, (uint16_t)((value + 1) & mask), w_bit);
+  }
+  return lazy_result(cpu, LAZY_DEC, value, 1, (uint16_t)((value - 1) & mask), w_bit);
+}
+
+uint16_t shift_value(cpu_t *cpu, uint8_t mnemonic, uint16_t value, uint8_t count, uint8_t w_bit) {
+  /** shift_value
+   * Rotates and shifts one bit at a time; a count of 0 leaves the flags
+   * alone. Rotates only touch CF and OF.
+   */
+  uint16_t mask = w_bit ? 0xffff : 0xff;
+  uint16_t sign = w_bit ? 0x8000 : 0x80;
+  uint16_t carry;
+  uint16_t original = value;
+  if (count == 0) {
+    return value;
+  }
+  materialize_flags(cpu);
+  carry = cpu->flags & FLAG_CF;
+  for (uint8_t idx = 0; idx < count; ++idx) {
+    uint16_t out;
+    switch (mnemonic) {
+      case MN_ROL:
+        carry = (value & sign) != 0;
+        value = ((value << 1) | carry) & mask;
+        break;
+      case MN_ROR:
+        carry = value & 1;
+        value = (value >> 1) | (carry ? sign : 0);
+        break;
+      case MN_RCL:
+        out = (value & sign) != 0;
+        value = ((value << 1) | carry) & mask;
+        carry = out;
+        break;
+      case MN_RCR:
+        out = value & 1;
+        value = (value >> 1) | (carry ? sign : 0);
+        carry = out;
+        break;
+      case MN_SHL:
+        carry = (value & sign) != 0;
+        value = (value << 1) & mask;
+        break;
+      case MN_SHR:
+        carry = value & 1;
+        value >>= 1;
+        break;
+      case MN_SAR:
+        carry = value & 1;
+        value = (value >> 1) | (value & sign);
+        break;
+    }
+  }
+  cpu->flags &= ~(FLAG_CF | FLAG_OF);
+  if (carry) {
+    cpu->flags |= FLAG_CF;
+  }
+  switch (mnemonic) {
+    case MN_ROL:
+    case MN_RCL:
+    case MN_SHL:
+      if (((value & sign) != 0) != (carry != 0)) {
+        cpu->flags |= FLAG_OF;
+      }
+      break;
+    case MN_ROR:
+    case MN_RCR:
+      if (((value ^ (value << 1)) & sign) != 0) {
+        cpu->flags |= FLAG_OF;
+      }
+      break;
+    case MN_SHR:
+      if (original & sign) {
+        cpu->flags |= FLAG_OF;
+      }
+      break;
+  }
+  if (mnemonic == MN_SHL || mnemonic == MN_SHR || mnemonic == MN_SAR) {
+    cpu->flags &= ~FLAG_AF;
+    set_result_flags(cpu, value, w_bit);
+  }
+  return value;
+}
+
+void interrupt(cpu_t *cpu, uint8_t number) {
+  /** interrupt
+   * Pushes flags, cs and ip and enters the vector at 0000:number*4
+   */
+  materialize_flags(cpu);
+  push_word(cpu, cpu->flags);
+  cpu->flags &= ~(FLAG_IF | FLAG_TF);
+  push_word(cpu, cpu->segments[SEG_CS]);
+  push_word(cpu, cpu->ip);
+  cpu->ip = load_word(cpu, 0, (uint16_t)(number * 4));
+  cpu->segments[SEG_CS] = load_word(cpu, 0, (uint16_t)(number * 4 + 2));
+}
+
+uint8_t condition_met(cpu_t *cpu, uint8_t mnemonic) {
+  /** condition_met
+   * Conditional jumps come in pairs; the odd one of each pair negates
+   */
+  uint16_t flags;
+  uint8_t sign_overflow;
+  uint8_t met = 0;
+  materialize_flags(cpu);
+  flags = cpu->flags;
+  sign_overflow = ((flags & FLAG_SF) != 0) != ((flags & FLAG_OF) != 0);
+  switch (mnemonic) {
+    case MN_JO: case MN_JNO: met = (flags & FLAG_OF) != 0; break;
+    case MN_JB: case MN_JNB: met = (flags & FLAG_CF) != 0; break;
+    case MN_JE: case MN_JNE: met = (flags & FLAG_ZF) != 0; break;
+    case MN_JBE: case MN_JA: met = (flags & (FLAG_CF | FLAG_ZF)) != 0; break;
+    case MN_JS: case MN_JNS: met = (flags & FLAG_SF) != 0; break;
+    case MN_JP: case MN_JNP: met = (flags & FLAG_PF) != 0; break;
+    case MN_JL: case MN_JNL: met = sign_overflow; break;
+    case MN_JLE: case MN_JG: met = sign_overflow || (flags & FLAG_ZF) != 0; break;
+  }
+  return ((mnemonic - MN_JO) & 1) ? !met : met;
+}
+
+uint16_t effective_address(const cpu_t *cpu, const instruction_t *instruction, uint8_t rm) {
+  /** effective_address
+   * Offset of a memory operand: base + index + displacement
+   */
+  const uint16_t *registers = cpu->registers;
+  uint16_t offset = (uint16_t)instruction->displacement;
+  switch (rm) {
+    case 0: return offset + registers[REG_BX] + registers[REG_SI];
+    case 1: return offset + registers[REG_BX] + registers[REG_DI];
+    case 2: return offset + registers[REG_BP] + registers[REG_SI];
+    case 3: return offset + registers[REG_BP] + registers[REG_DI];
+    case 4: return offset + registers[REG_SI];
+    case 5: return offset + registers[REG_DI];
+    case 6: return offset + registers[REG_BP];
+    case 7: return offset + registers[REG_BX];
+  }
+  return offset;
+}
+
+uint16_t data_segment(const cpu_t *cpu, const instruction_t *instruction, uint8_t rm) {
+  /** data_segment
+   * Segment override, else ss for bp-based operands and ds otherwise
+   */
+  int8_t segment = segment_override(instruction->attributes);
+  if (segment >= 0) {
+    return cpu->segments[segment];
+  }
+  return (rm == 2 || rm == 3 || rm == 6) ? cpu->segments[SEG_SS] : cpu->segments[SEG_DS];
+}
+
+uint16_t read_operand(const cpu_t *cpu, const instruction_t *instruction, uint8_t idx,
+                      uint16_t segment, uint16_t offset) {
+  /** read_operand
+   * Value of operand idx; segment:offset locate a memory operand
+   */
+  uint8_t reg = instruction->registers[idx];
+  switch (instruction->kinds[idx]) {
+    case OPERAND_REG8:
+      return get_byte_register(cpu, reg);
+    case OPERAND_REG16:
+      return cpu->registers[reg];
+    case OPERAND_SEG:
+      return cpu->segments[reg];
+    case OPERAND_MEM:
+      if (instruction->attributes & ATTR_W) {
+        return load_word(cpu, segment, offset);
+      }
+      return load_byte(cpu, linear_address(segment, offset));
+  }
+  return instruction->immediate;
+}
+
+void write_operand(cpu_t *cpu, const instruction_t *instruction, uint8_t idx,
+                   uint16_t segment, uint16_t offset, uint16_t value) {
+  uint8_t reg = instruction->registers[idx];
+  switch (instruction->kinds[idx]) {
+    case OPERAND_REG8:
+      set_byte_register(cpu, reg, (uint8_t)value);
+      break;
+    case OPERAND_REG16:
+      cpu->registers[reg] = value;
+      break;
+    case OPERAND_SEG:
+      cpu->segments[reg] = value;
+      break;
+    case OPERAND_MEM:
+      if (instruction->attributes & ATTR_W) {
+        store_word(cpu, segment, offset, value);
+      } else {
+        store_byte(cpu, linear_address(segment, offset), (uint8_t)value);
+      }
+      break;
+  }
+}
+
+error_t multiply_divide(cpu_t *cpu, uint8_t mnemonic, uint16_t value, uint8_t w_bit) {
+  /** multiply_divide
+   * mul, imul, div and idiv of the accumulator; a zero divisor or a
+   * quotient that does not fit raises interrupt 0
+   */
+  uint16_t *registers = cpu->registers;
+  uint8_t overflow = 0;
+  if (!w_bit) {
+    uint16_t ax = registers[REG_AX];
+    switch (mnemonic) {
+      case MN_MUL:
+        registers[REG_AX] = (uint16_t)((ax & 0xff) * (value & 0xff));
+        overflow = (registers[REG_AX] >> 8) != 0;
+        break;
+      case MN_IMUL:
+        registers[REG_AX] = (uint16_t)((int8_t)ax * (int8_t)value);
+        overflow = (int16_t)registers[REG_AX] != (int8_t)registers[REG_AX];
+        break;
+      case MN_DIV: {
+        uint16_t quotient;
+        if ((value & 0xff) == 0 || (quotient = ax / (value & 0xff)) > 0xff) {
+          interrupt(cpu, 0);
+          return JASM_SUCCESS;
+        }
+        registers[REG_AX] = (uint16_t)(((ax % (value & 0xff)) << 8) | quotient);
+        return JASM_SUCCESS;
+      }
+      case MN_IDIV: {
+        int16_t dividend = (int16_t)ax;
+        int16_t divisor = (int8_t)value;
+        int16_t quotient;
+        if (divisor == 0 || (quotient = dividend / divisor) > 127 || quotient < -127) {
+          interrupt(cpu, 0);
+          return JASM_SUCCESS;
+        }
+        registers[REG_AX] = (uint16_t)((((uint8_t)(dividend % divisor)) << 8) | (uint8_t)quotient);
+        return JASM_SUCCESS;
+      }
+    }
+  } else {
+    uint32_t dx_ax = ((uint32_t)registers[REG_DX] << 16) | registers[REG_AX];
+    switch (mnemonic) {
+      case MN_MUL: {
+        uint32_t product = (uint32_t)registers[REG_AX] * value;
+        registers[REG_AX] = (uint16_t)product;
+        registers[REG_DX] = (uint16_t)(product >> 16);
+        overflow = registers[REG_DX] != 0;
+        break;
+      }
+      case MN_IMUL: {
+        int32_t product = (int32_t)(int16_t)registers[REG_AX] * (int16_t)value;
+        registers[REG_AX] = (uint16_t)product;
+        registers[REG_DX] = (uint16_t)((uint32_t)product >> 16);
+        overflow = product != (int16_t)product;
+        break;
+      }
+      case MN_DIV: {
+        uint32_t quotient;
+        if (value == 0 || (quotient = dx_ax / value) > 0xffff) {
+          interrupt(cpu, 0);
+          return JASM_SUCCESS;
+        }
+        registers[REG_AX] = (uint16_t)quotient;
+        registers[REG_DX] = (uint16_t)(dx_ax % value);
+        return JASM_SUCCESS;
+      }
+      case MN_IDIV: {
+        int32_t dividend = (int32_t)dx_ax;
+        int32_t divisor = (int16_t)value;
+        int32_t quotient;
+        if (divisor == 0 || (dividend == INT32_MIN && divisor == -1) ||
+            (quotient = dividend / divisor) > 32767 || quotient < -32767) {
+          interrupt(cpu, 0);
+          return JASM_SUCCESS;
+        }
+        registers[REG_AX] = (uint16_t)quotient;
+        registers[REG_DX] = (uint16_t)(dividend % divisor);
+        return JASM_SUCCESS;
+      }
+    }
+  }
+  materialize_flags(cpu);
+  cpu->flags &= ~(FLAG_CF | FLAG_OF);
+  if (overflow) {
+    cpu->flags |= FLAG_CF | FLAG_OF;
+  }
+  return JASM_SUCCESS;
+}
+
+void string_step(cpu_t *cpu, const instruction_t *instruction) {
+  /** string_step
+   * One iteration of movs, cmps, stos, lods or scas: ds:si (overridable)
+   * to es:di, stepping by the operand size against DF
+   */
+  uint16_t *registers = cpu->registers;
+  uint8_t mnemonic = instruction->mnemonic;
+  uint8_t w_bit = mnemonic == MN_MOVSW || mnemonic == MN_CMPSW || mnemonic == MN_STOSW ||
+                  mnemonic == MN_LODSW || mnemonic == MN_SCASW;
+  uint16_t step = (uint16_t)((cpu->flags & FLAG_DF) ? -(1 + w_bit) : (1 + w_bit));
+  int8_t override = segment_override(instruction->attributes);
+  uint16_t source = override >= 0 ? cpu->segments[override] : cpu->segments[SEG_DS];
+  uint16_t target = cpu->segments[SEG_ES];
+  uint16_t value;
+  switch (mnemonic) {
+    case MN_MOVSB:
+    case MN_MOVSW:
+      if (w_bit) {
+        store_word(cpu, target, registers[REG_DI], load_word(cpu, source, registers[REG_SI]));
+      } else {
+        store_byte(cpu, linear_address(target, registers[REG_DI]),
+                   load_byte(cpu, linear_address(source, registers[REG_SI])));
+      }
+      registers[REG_SI] += step;
+      registers[REG_DI] += step;
+      break;
+    case MN_CMPSB:
+    case MN_CMPSW:
+      value = w_bit ? load_word(cpu, source, registers[REG_SI]) : load_byte(cpu, linear_address(source, registers[REG_SI]));
+      subtract_values(cpu, value, w_bit ? load_word(cpu, target, registers[REG_DI])
+                                        : load_byte(cpu, linear_address(target, registers[REG_DI])), 0, w_bit);
+      registers[REG_SI] += step;
+      registers[REG_DI] += step;
+      break;
+    case MN_STOSB:
+    case MN_STOSW:
+      if (w_bit) {
+        store_word(cpu, target, registers[REG_DI], registers[REG_AX]);
+      } else {
+        store_byte(cpu, linear_address(target, registers[REG_DI]), (uint8_t)registers[REG_AX]);
+      }
+      registers[REG_DI] += step;
+      break;
+    case MN_LODSB:
+    case MN_LODSW:
+      if (w_bit) {
+        registers[REG_AX] = load_word(cpu, source, registers[REG_SI]);
+      } else {
+        set_byte_register(cpu, 0, load_byte(cpu, linear_address(source, registers[REG_SI])));
+      }
+      registers[REG_SI] += step;
+      break;
+    case MN_SCASB:
+    case MN_SCASW:
+      value = w_bit ? load_word(cpu, target, registers[REG_DI]) : load_byte(cpu, linear_address(target, registers[REG_DI]));
+      subtract_values(cpu, w_bit ? registers[REG_AX] : (registers[REG_AX] & 0xff), value, 0, w_bit);
+      registers[REG_DI] += step;
+      break;
+  }
+}
+
+void string_instruction(cpu_t *cpu, const instruction_t *instruction) {
+  /** string_instruction
+   * rep repeats cx times; cmps and scas also stop when ZF disagrees with
+   * rep (repe) or repne
+   */
+  uint8_t repeat = repeat_prefix(instruction->attributes);
+  uint8_t compares = instruction->mnemonic == MN_CMPSB || instruction->mnemonic == MN_CMPSW ||
+                     instruction->mnemonic == MN_SCASB || instruction->mnemonic == MN_SCASW;
+  if (repeat != REPEAT_REP && repeat != REPEAT_REPNE) {
+    string_step(cpu, instruction);
+    return;
+  }
+  while (cpu->registers[REG_CX] != 0) {
+    string_step(cpu, instruction);
+    cpu->registers[REG_CX]--;
+    if (compares && (cpu->lazy_result == 0) != (repeat == REPEAT_REP)) {
+      break;
+    }
+  }
+}
+
+void decimal_adjust(cpu_t *cpu, uint8_t mnemonic) {
+  /** decimal_adjust
+   * daa, das, aaa and aas on al
+   */
+  uint8_t al = (uint8_t)cpu->registers[REG_AX];
+  uint8_t carry, low;
+  materialize_flags(cpu);
+  carry = (cpu->flags & FLAG_CF) != 0;
+  low = (al & 0x0f) > 9 || (cpu->flags & FLAG_AF);
+  switch (mnemonic) {
+    case MN_DAA:
+    case MN_DAS:
+      cpu->flags &= ~(FLAG_AF | FLAG_CF);
+      if (low) {
+        cpu->flags |= FLAG_AF;
+        if (mnemonic == MN_DAS && al < 6) {
+          cpu->flags |= FLAG_CF;
+        }
+        al = mnemonic == MN_DAA ? al + 6 : al - 6;
+      }
+      if ((uint8_t)cpu->registers[REG_AX] > 0x99 || carry) {
+        al = mnemonic == MN_DAA ? al + 0x60 : al - 0x60;
+        cpu->flags |= FLAG_CF;
+      }
+      set_byte_register(cpu, 0, al);
+      set_result_flags(cpu, al, 0);
+      break;
+    case MN_AAA:
+    case MN_AAS:
+      cpu->flags &= ~(FLAG_AF | FLAG_CF);
+      if (low) {
+        if (mnemonic == MN_AAA) {
+          cpu->registers[REG_AX] += 0x106;
+        } else {
+          cpu->registers[REG_AX] -= 0x106;
+        }
+        cpu->flags |= FLAG_AF | FLAG_CF;
+      }
+      cpu->registers[REG_AX] &= 0xff0f;
+      break;
+  }
+}
+
+error_t far_pointer(cpu_t *cpu, const instruction_t *instruction, uint16_t segment, uint16_t offset,
+                    uint16_t *target_segment, uint16_t *target_offset) {
+  /** far_pointer
+   * Target of a far call or jmp: immediate segment:offset, or a pointer in
+   * memory for the indirect forms
+   */
+  if (instruction->kinds[0] == OPERAND_FAR) {
+    *target_segment = (uint16_t)instruction->displacement;
+    *target_offset = instruction->immediate;
+    return JASM_SUCCESS;
+  }
+  if (instruction->kinds[0] != OPERAND_MEM) {
+    return JASM_UNKNOWN_INSTRUCTION_ERROR;
+  }
+  *target_offset = load_word(cpu, segment, offset);
+  *target_segment = load_word(cpu, segment, (uint16_t)(offset + 2));
+  return JASM_SUCCESS;
+}
+
+error_t execute_instruction(cpu_t *cpu, const instruction_t *instruction) {
+  /** execute_instruction
+   * Executes one decoded instruction; ip already points past it
+   */
+  uint16_t *registers = cpu->registers;
+  uint8_t w_bit = (instruction->attributes & ATTR_W) != 0;
+  uint8_t mnemonic = instruction->mnemonic;
+  uint16_t segment = 0, offset = 0;
+  uint16_t left, right, carry;
+  uint16_t target_segment, target_offset;
+  error_t error_code;
+  if (instruction->kinds[0] == OPERAND_MEM || instruction->kinds[1] == OPERAND_MEM) {
+    uint8_t rm = instruction->registers[instruction->kinds[0] == OPERAND_MEM ? 0 : 1];
+    segment = data_segment(cpu, instruction, rm);
+    offset = effective_address(cpu, instruction, rm);
+  }
+  switch (mnemonic) {
+    case MN_MOV:
+      write_operand(cpu, instruction, 0, segment, offset, read_operand(cpu, instruction, 1, segment, offset));
+      break;
+    case MN_ADD:
+    case MN_ADC:
+    case MN_SUB:
+    case MN_SBB:
+    case MN_CMP:
+      left = read_operand(cpu, instruction, 0, segment, offset);
+      right = read_operand(cpu, instruction, 1, segment, offset);
+      carry = 0;
+      if (mnemonic == MN_ADC || mnemonic == MN_SBB) {
+        materialize_flags(cpu);
+        carry = cpu->flags & FLAG_CF;
+      }
+      if (mnemonic == MN_ADD || mnemonic == MN_ADC) {
+        left = add_values(cpu, left, right, (uint8_t)carry, w_bit);
+      } else {
+        left = subtract_values(cpu, left, right, (uint8_t)carry, w_bit);
+      }
+      if (mnemonic != MN_CMP) {
+        write_operand(cpu, instruction, 0, segment, offset, left);
+      }
+      break;
+    case MN_AND:
+    case MN_OR:
+    case MN_XOR:
+    case MN_TEST:
+      left = read_operand(cpu, instruction, 0, segment, offset);
+      right = read_operand(cpu, instruction, 1, segment, offset);
+      left = mnemonic == MN_OR ? left | right : mnemonic == MN_XOR ? left ^ right : left & right;
+      logic_result(cpu, left, w_bit);
+      if (mnemonic != MN_TEST) {
+        write_operand(cpu, instruction, 0, segment, offset, left);
+      }
+      break;
+    case MN_INC:
+    case MN_DEC:
+      left = step_value(cpu, mnemonic, read_operand(cpu, instruction, 0, segment, offset), w_bit);
+      write_operand(cpu, instruction, 0, segment, offset, left);
+      break;
+    case MN_NOT:
+      write_operand(cpu, instruction, 0, segment, offset, (uint16_t)~read_operand(cpu, instruction, 0, segment, offset));
+      break;
+    case MN_NEG:
+      left = subtract_values(cpu, 0, read_operand(cpu, instruction, 0, segment, offset), 0, w_bit);
+      write_operand(cpu, instruction, 0, segment, offset, left);
+      break;
+    case MN_MUL:
+    case MN_IMUL:
+    case MN_DIV:
+    case MN_IDIV:
+      return multiply_divide(cpu, mnemonic, read_operand(cpu, instruction, 0, segment, offset), w_bit);
+    case MN_ROL:
+    case MN_ROR:
+    case MN_RCL:
+    case MN_RCR:
+    case MN_SHL:
+    case MN_SHR:
+    case MN_SAR:
+      left = read_operand(cpu, instruction, 0, segment, offset);
+      right = read_operand(cpu, instruction, 1, segment, offset);
+      write_operand(cpu, instruction, 0, segment, offset, shift_value(cpu, mnemonic, left, (uint8_t)right, w_bit));
+      break;
+    case MN_XCHG:
+      left = read_operand(cpu, instruction, 0, segment, offset);
+      right = read_operand(cpu, instruction, 1, segment, offset);
+      write_operand(cpu, instruction, 0, segment, offset, right);
+      write_operand(cpu, instruction, 1, segment, offset, left);
+      break;
+    case MN_LEA:
+      if (instruction->kinds[1] != OPERAND_MEM) {
+        return JASM_UNKNOWN_INSTRUCTION_ERROR;
+      }
+      registers[instruction->registers[0]] = offset;
+      break;
+    case MN_LES:
+    case MN_LDS:
+      if (instruction->kinds[1] != OPERAND_MEM) {
+        return JASM_UNKNOWN_INSTRUCTION_ERROR;
+      }
+      registers[instruction->registers[0]] = load_word(cpu, segment, offset);
+      cpu->segments[mnemonic == MN_LES ? SEG_ES : SEG_DS] = load_word(cpu, segment, (uint16_t)(offset + 2));
+      break;
+    case MN_PUSH:
+      if (instruction->kinds[0] == OPERAND_REG16 && instruction->registers[0] == REG_SP) {
+        /* The 8086 pushes the decremented sp */
+        registers[REG_SP] -= 2;
+        store_word(cpu, cpu->segments[SEG_SS], registers[REG_SP], registers[REG_SP]);
+        break;
+      }
+      push_word(cpu, read_operand(cpu, instruction, 0, segment, offset));
+      break;
+    case MN_POP:
+      write_operand(cpu, instruction, 0, segment, offset, pop_word(cpu));
+      break;
+    case MN_PUSHF:
+      materialize_flags(cpu);
+      push_word(cpu, cpu->flags);
+      break;
+    case MN_POPF:
+      cpu->flags = (pop_word(cpu) & 0x0fd5) | 0xf002;
+      cpu->lazy_op = LAZY_NONE;
+      break;
+    case MN_SAHF:
+      materialize_flags(cpu);
+      cpu->flags = (cpu->flags & 0xff00) | ((registers[REG_AX] >> 8) & 0xd5) | 0x02;
+      break;
+    case MN_LAHF:
+      materialize_flags(cpu);
+      set_byte_register(cpu, 4, (uint8_t)cpu->flags);
+      break;
+    case MN_CBW:
+      registers[REG_AX] = (uint16_t)(int8_t)registers[REG_AX];
+      break;
+    case MN_CWD:
+      registers[REG_DX] = (registers[REG_AX] & 0x8000) ? 0xffff : 0;
+      break;
+    case MN_JO: case MN_JNO: case MN_JB: case MN_JNB:
+    case MN_JE: case MN_JNE: case MN_JBE: case MN_JA:
+    case MN_JS: case MN_JNS: case MN_JP: case MN_JNP:
+    case MN_JL: case MN_JNL: case MN_JLE: case MN_JG:
+      if (condition_met(cpu, mnemonic)) {
+        cpu->ip += instruction->immediate;
+      }
+      break;
+    case MN_LOOP:
+    case MN_LOOPZ:
+    case MN_LOOPNZ:
+      registers[REG_CX]--;
+      materialize_flags(cpu);
+      if (registers[REG_CX] != 0 && (mnemonic == MN_LOOP || ((cpu->flags & FLAG_ZF) != 0) == (mnemonic == MN_LOOPZ))) {
+        cpu->ip += instruction->immediate;
+      }
+      break;
+    case MN_JCXZ:
+      if (registers[REG_CX] == 0) {
+        cpu->ip += instruction->immediate;
+      }
+      break;
+    case MN_JMP:
+    case MN_CALL:
+      if (instruction->kinds[0] == OPERAND_FAR || (instruction->attributes & ATTR_FAR)) {
+        error_code = far_pointer(cpu, instruction, segment, offset, &target_segment, &target_offset);
+        if (error_code != JASM_SUCCESS) {
+          return error_code;
+        }
+        if (mnemonic == MN_CALL) {
+          push_word(cpu, cpu->segments[SEG_CS]);
+          push_word(cpu, cpu->ip);
+        }
+        cpu->segments[SEG_CS] = target_segment;
+        cpu->ip = target_offset;
+        break;
+      }
+      target_offset = instruction->kinds[0] == OPERAND_REL ? (uint16_t)(cpu->ip + instruction->immediate)
+                                                          : read_operand(cpu, instruction, 0, segment, offset);
+      if (mnemonic == MN_CALL) {
+        push_word(cpu, cpu->ip);
+      }
+      cpu->ip = target_offset;
+      break;
+    case MN_RET:
+    case MN_RETF:
+      cpu->ip = pop_word(cpu);
+      if (mnemonic == MN_RETF) {
+        cpu->segments[SEG_CS] = pop_word(cpu);
+      }
+      if (instruction->kinds[0] == OPERAND_IMM) {
+        registers[REG_SP] += instruction->immediate;
+      }
+      break;
+    case MN_IRET:
+      cpu->ip = pop_word(cpu);
+      cpu->segments[SEG_CS] = pop_word(cpu);
+      cpu->flags = (pop_word(cpu) & 0x0fd5) | 0xf002;
+      cpu->lazy_op = LAZY_NONE;
+      break;
+    case MN_INT:
+      interrupt(cpu, (uint8_t)instruction->immediate);
+      break;
+    case MN_INT3:
+      interrupt(cpu, 3);
+      break;
+    case MN_INTO:
+      materialize_flags(cpu);
+      if (cpu->flags & FLAG_OF) {
+        interrupt(cpu, 4);
+      }
+      break;
+    case MN_MOVSB: case MN_MOVSW: case MN_CMPSB: case MN_CMPSW:
+    case MN_STOSB: case MN_STOSW: case MN_LODSB: case MN_LODSW:
+    case MN_SCASB: case MN_SCASW:
+      string_instruction(cpu, instruction);
+      break;
+    case MN_XLAT: {
+      int8_t override = segment_override(instruction->attributes);
+      uint16_t table = override >= 0 ? cpu->segments[override] : cpu->segments[SEG_DS];
+      set_byte_register(cpu, 0, load_byte(cpu, linear_address(table, (uint16_t)(registers[REG_BX] + (registers[REG_AX] & 0xff)))));
+      break;
+    }
+    case MN_DAA:
+    case MN_DAS:
+    case MN_AAA:
+    case MN_AAS:
+      decimal_adjust(cpu, mnemonic);
+      break;
+    case MN_AAM: {
+      uint8_t base = (uint8_t)instruction->immediate;
+      uint8_t al = (uint8_t)registers[REG_AX];
+      if (base == 0) {
+        interrupt(cpu, 0);
+        break;
+      }
+      registers[REG_AX] = (uint16_t)(((al / base) << 8) | (al % base));
+      materialize_flags(cpu);
+      set_result_flags(cpu, registers[REG_AX] & 0xff, 0);
+      break;
+    }
+    case MN_AAD:
+      registers[REG_AX] = (uint8_t)((registers[REG_AX] & 0xff) + (registers[REG_AX] >> 8) * (uint8_t)instruction->immediate);
+      materialize_flags(cpu);
+      set_result_flags(cpu, registers[REG_AX], 0);
+      break;
+    case MN_IN:
+      /* No devices: every port reads as all ones */
+      write_operand(cpu, instruction, 0, segment, offset, 0xffff);
+      break;
+    case MN_OUT:
+    case MN_NOP:
+    case MN_WAIT:
+    case MN_ESC:
+      break;
+    case MN_HLT:
+      cpu->halted = 1;
+      break;
+    case MN_CMC:
+      materialize_flags(cpu);
+      cpu->flags ^= FLAG_CF;
+      break;
+    case MN_CLC:
+      materialize_flags(cpu);
+      cpu->flags &= ~FLAG_CF;
+      break;
+    case MN_STC:
+      materialize_flags(cpu);
+      cpu->flags |= FLAG_CF;
+      break;
+    case MN_CLI:
+      cpu->flags &= ~FLAG_IF;
+      break;
+    case MN_STI:
+      cpu->flags |= FLAG_IF;
+      break;
+    case MN_CLD:
+      cpu->flags &= ~FLAG_DF;
+      break;
+    case MN_STD:
+      cpu->flags |= FLAG_DF;
+      break;
+    default:
+      return JASM_UNKNOWN_INSTRUCTION_ERROR;
+  }
+  return JASM_SUCCESS;
+}
+
+error_t step_cpu(cpu_t *cpu) {
+  /** step_cpu
+   * Fetches and executes the instruction at cs:ip. On an error ip is left
+   * on the failing instruction. The flags are materialized on return.
+   */
+  const instruction_t *instruction = fetch_instruction(cpu);
+  uint16_t ip = cpu->ip;
+  error_t error_code;
+  cpu->ip += instruction->length;
+  error_code = execute_instruction(cpu, instruction);
+  materialize_flags(cpu);
+  if (error_code != JASM_SUCCESS) {
+    cpu->ip = ip;
+    cpu->halted = 1;
+    return error_code;
+  }
+  cpu->instruction_count++;
+  return JASM_SUCCESS;
+}
+
+uint8_t ends_block(const instruction_t *instruction) {
+  /** ends_block
+   * Control transfers, and anything else that can move cs:ip
+   */
+  switch (instruction->mnemonic) {
+    case MN_JO: case MN_JNO: case MN_JB: case MN_JNB:
+    case MN_JE: case MN_JNE: case MN_JBE: case MN_JA:
+    case MN_JS: case MN_JNS: case MN_JP: case MN_JNP:
+    case MN_JL: case MN_JNL: case MN_JLE: case MN_JG:
+    case MN_LOOP: case MN_LOOPZ: case MN_LOOPNZ: case MN_JCXZ:
+    case MN_JMP: case MN_CALL: case MN_RET: case MN_RETF: case MN_IRET:
+    case MN_INT: case MN_INT3: case MN_INTO: case MN_HLT: case MN_INVALID:
+    case MN_DIV: case MN_IDIV: case MN_AAM:
+      return 1;
+    case MN_MOV:
+    case MN_POP:
+      return instruction->kinds[0] == OPERAND_SEG && instruction->registers[0] == SEG_CS;
+  }
+  return 0;
+}
+
+uint8_t select_handler(const instruction_t *instruction) {
+  /** select_handler
+   * Fast path for an instruction, or HANDLER_GENERIC
+   */
+  const uint8_t *kinds = instruction->kinds;
+  switch (instruction->mnemonic) {
+    case MN_MOV:
+      if (kinds[0] == OPERAND_REG16 && kinds[1] == OPERAND_REG16) {
+        return HANDLER_MOV_REG16;
+      }
+      if (kinds[0] == OPERAND_REG16 && kinds[1] == OPERAND_IMM) {
+        return HANDLER_MOV_IMM16;
+      }
+      break;
+    case MN_INC:
+    case MN_DEC:
+      if (kinds[0] == OPERAND_REG16) {
+        return instruction->mnemonic == MN_INC ? HANDLER_INC_REG16 : HANDLER_DEC_REG16;
+      }
+      break;
+    case MN_JO: case MN_JNO: case MN_JB: case MN_JNB:
+    case MN_JE: case MN_JNE: case MN_JBE: case MN_JA:
+    case MN_JS: case MN_JNS: case MN_JP: case MN_JNP:
+    case MN_JL: case MN_JNL: case MN_JLE: case MN_JG:
+      return HANDLER_JCC;
+    case MN_LOOP:
+      return HANDLER_LOOP;
+    case MN_JMP:
+      if (kinds[0] == OPERAND_REL) {
+        return HANDLER_JMP;
+      }
+      break;
+  }
+  return HANDLER_GENERIC;
+}
+
+void build_block(cpu_t *cpu, block_t *block, const void *const *handlers) {
+  /** build_block
+   * Decodes from cs:ip until a control transfer, BLOCK_LENGTH
+   * instructions, the end of the segment or an instruction on a third
+   * code page. The first instruction is always taken.
+   */
+  uint16_t cs = cpu->segments[SEG_CS];
+  uint16_t ip = cpu->ip;
+  uint32_t first_page = linear_address(cs, ip) >> CODE_PAGE_SHIFT;
+  block->address = linear_address(cs, ip);
+  block->cs = cs;
+  block->ip = ip;
+  block->pages[0] = first_page;
+  block->pages[1] = first_page;
+  block->count = 0;
+  block->hits = 0;
+  block->native = NULL;
+  while (block->count < BLOCK_LENGTH) {
+    block_op_t *op = &block->ops[block->count];
+    uint8_t window[8];
+    uint32_t start_page, end_page, second_page;
+    for (uint8_t idx = 0; idx < sizeof(window); ++idx) {
+      window[idx] = load_byte(cpu, linear_address(cs, (uint16_t)(ip + idx)));
+    }
+    decode_instruction(window, sizeof(window), ip, &op->instruction);
+    start_page = linear_address(cs, ip) >> CODE_PAGE_SHIFT;
+    end_page = linear_address(cs, (uint16_t)(ip + op->instruction.length - 1)) >> CODE_PAGE_SHIFT;
+    second_page = block->pages[1];
+    if (second_page == first_page) {
+      second_page = start_page != first_page ? start_page : end_page;
+    }
+    if ((start_page != first_page && start_page != second_page) || (end_page != first_page && end_page != second_page)) {
+      break;
+    }
+    block->pages[1] = second_page;
+    cpu->code_pages[start_page] = 1;
+    cpu->code_pages[end_page] = 1;
+    op->handler = handlers[select_handler(&op->instruction)];
+    block->count++;
+    if (ends_block(&op->instruction) || (uint32_t)ip + op->instruction.length > 0xffff) {
+      break;
+    }
+    ip += op->instruction.length;
+  }
+  block->generations[0] = cpu->page_generations[block->pages[0]];
+  block->generations[1] = cpu->page_generations[block->pages[1]];
+}
+
+block_t *lookup_block(cpu_t *cpu, const void *const *handlers) {
+  /** lookup_block
+   * The cached block at cs:ip, rebuilt when missing or when one of its
+   * pages was written since it was decoded
+   */
+  uint32_t address = linear_address(cpu->segments[SEG_CS], cpu->ip);
+  block_t *block = &cpu->blocks[(address ^ (address >> 12)) & (BLOCK_CACHE_SIZE - 1)];
+  if (block->address != address || block->cs != cpu->segments[SEG_CS] || block->ip != cpu->ip ||
+      block->generations[0] != cpu->page_generations[block->pages[0]] ||
+      block->generations[1] != cpu->page_generations[block->pages[1]]) {
+    build_block(cpu, block, handlers);
+  }
+  return block;
+}
+
+/* Retire the current op and jump straight to the next one's handler */
+#define NEXT_OP() \
+  do { \
+    cpu->instruction_count++; \
+    if (op == last) { \
+      goto block_end; \
+    } \
+    ++op; \
+    goto *op->handler; \
+  } while (0)
+
+error_t run_cpu(cpu_t *cpu, uint64_t instruction_limit) {
+  /** run_cpu
+   * Runs blocks until hlt, an error or instruction_limit instructions. A
+   * block that would overshoot the limit is single-stepped instead. A
+   * generic op that stores into code or moves cs:ip ends its block early.
+   * With cpu->jit set, a block run JIT_THRESHOLD times is compiled and
+   * then entered natively. The flags are materialized on return.
+   */
+  static const void *const handlers[HANDLER_COUNT] = {
+    [HANDLER_GENERIC] = &&generic,
+    [HANDLER_MOV_REG16] = &&mov_reg16,
+    [HANDLER_MOV_IMM16] = &&mov_imm16,
+    [HANDLER_INC_REG16] = &&inc_reg16,
+    [HANDLER_DEC_REG16] = &&dec_reg16,
+    [HANDLER_JCC] = &&jcc,
+    [HANDLER_LOOP] = &&loop,
+    [HANDLER_JMP] = &&jmp,
+  };
+  uint64_t end = cpu->instruction_count + instruction_limit;
+  uint16_t *registers = cpu->registers;
+  while (!cpu->halted && cpu->instruction_count < end) {
+    block_t *block = lookup_block(cpu, handlers);
+    const block_op_t *op = block->ops;
+    const block_op_t *last = op + block->count - 1;
+    const instruction_t *instruction;
+    uint64_t writes = cpu->code_writes;
+    error_t error_code;
+    if (block->count > end - cpu->instruction_count) {
+      error_code = step_cpu(cpu);
+      if (error_code != JASM_SUCCESS) {
+        return error_code;
+      }
+      continue;
+    }
+    if (block->native != NULL) {
+      materialize_flags(cpu);
+      cpu->ip = ((jit_function_t)block->native)(cpu);
+      cpu->instruction_count += block->count;
+      continue;
+    }
+    if (cpu->jit != NULL && ++block->hits == JIT_THRESHOLD && compile_block(cpu, block)) {
+      continue;
+    }
+    goto *op->handler;
+  generic:
+    instruction = &op->instruction;
+    cpu->ip = (uint16_t)(instruction->offset + instruction->length);
+    error_code = execute_instruction(cpu, instruction);
+    if (error_code != JASM_SUCCESS) {
+      materialize_flags(cpu);
+      cpu->ip = (uint16_t)instruction->offset;
+      cpu->halted = 1;
+      return error_code;
+    }
+    if (cpu->code_writes != writes || cpu->segments[SEG_CS] != block->cs ||
+        cpu->ip != (uint16_t)(instruction->offset + instruction->length)) {
+      cpu->instruction_count++;
+      goto block_end;
+    }
+    NEXT_OP();
+  mov_reg16:
+    instruction = &op->instruction;
+    registers[instruction->registers[0]] = registers[instruction->registers[1]];
+    cpu->ip = (uint16_t)(instruction->offset + instruction->length);
+    NEXT_OP();
+  mov_imm16:
+    instruction = &op->instruction;
+    registers[instruction->registers[0]] = instruction->immediate;
+    cpu->ip = (uint16_t)(instruction->offset + instruction->length);
+    NEXT_OP();
+  inc_reg16:
+    instruction = &op->instruction;
+    registers[instruction->registers[0]] = step_value(cpu, MN_INC, registers[instruction->registers[0]], 1);
+    cpu->ip = (uint16_t)(instruction->offset + instruction->length);
+    NEXT_OP();
+  dec_reg16:
+    instruction = &op->instruction;
+    registers[instruction->registers[0]] = step_value(cpu, MN_DEC, registers[instruction->registers[0]], 1);
+    cpu->ip = (uint16_t)(instruction->offset + instruction->length);
+    NEXT_OP();
+  jcc:
+    instruction = &op->instruction;
+    cpu->ip = (uint16_t)(instruction->offset + instruction->length);
+    if (condition_met(cpu, instruction->mnemonic)) {
+      cpu->ip += instruction->immediate;
+    }
+    NEXT_OP();
+  loop:
+    instruction = &op->instruction;
+    cpu->ip = (uint16_t)(instruction->offset + instruction->length);
+    if (--registers[REG_CX] != 0) {
+      cpu->ip += instruction->immediate;
+    }
+    NEXT_OP();
+  jmp:
+    instruction = &op->instruction;
+    cpu->ip = (uint16_t)(instruction->offset + instruction->length + instruction->immediate);
+    NEXT_OP();
+  block_end:
+    ;
+  }
+  materialize_flags(cpu);
+  return JASM_SUCCESS;
+}
@@ -0,0 +1,136 @@
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+#include <stddef.h>
+
+/* 20-bit segmented address space */
+#define MEMORY_SIZE       (1 << 20)
+#define MEMORY_MASK       (MEMORY_SIZE - 1)
+/* Pre-decoded instructions, direct-mapped by linear address */
+#define DECODE_CACHE_SIZE (1 << 14)
+/* Basic blocks, direct-mapped by linear address */
+#define BLOCK_CACHE_SIZE  (1 << 12)
+#define BLOCK_LENGTH      32
+/* Code writes invalidate cached instructions a page at a time */
+#define CODE_PAGE_SHIFT   8
+#define CODE_PAGE_COUNT   (MEMORY_SIZE >> CODE_PAGE_SHIFT)
+/* Where jasm -e loads a flat binary, .COM style */
+#define LOAD_SEGMENT      0x1000
+#define LOAD_OFFSET       0x0100
+/* Default instruction budget for jasm -e and jasm -t */
+#define RUN_LIMIT         100000000ull
+
+/* Register numbers, as encoded in the reg and r/m fields */
+typedef enum cpu_register_t {
+  REG_AX = 0, REG_CX, REG_DX, REG_BX, REG_SP, REG_BP, REG_SI, REG_DI,
+} cpu_register_t;
+
+typedef enum cpu_segment_t {
+  SEG_ES = 0, SEG_CS, SEG_SS, SEG_DS,
+} cpu_segment_t;
+
+/* Flags register bits */
+#define FLAG_CF 0x0001
+#define FLAG_PF 0x0004
+#define FLAG_AF 0x0010
+#define FLAG_ZF 0x0040
+#define FLAG_SF 0x0080
+#define FLAG_TF 0x0100
+#define FLAG_IF 0x0200
+#define FLAG_DF 0x0400
+#define FLAG_OF 0x0800
+#define FLAG_STATUS (FLAG_CF | FLAG_PF | FLAG_AF | FLAG_ZF | FLAG_SF | FLAG_OF)
+
+/** Lazy flags
+ * The last flag-setting ALU operation, kept instead of its status flags.
+ * While it is pending the FLAG_STATUS bits of cpu->flags are stale (CF
+ * excepted after inc and dec) and materialize_flags recomputes them.
+ */
+typedef enum lazy_op_t {
+  LAZY_NONE = 0,
+  LAZY_ADD,             /* add, adc */
+  LAZY_SUB,             /* sub, sbb, cmp, neg, cmps, scas */
+  LAZY_LOGIC,           /* and, or, xor, test */
+  LAZY_INC,
+  LAZY_DEC,
+} lazy_op_t;
+
+/** Decoded entry
+ * An instruction decoded at a linear address. It is valid while its page
+ * generation matches the page's current generation.
+ */
+typedef struct decoded_t {
+  uint32_t      address;
+  uint32_t      generation;
+  instruction_t instruction;
+} decoded_t;
+
+/* Threaded-code handlers; everything without a fast path is generic */
+typedef enum handler_t {
+  HANDLER_GENERIC = 0,
+  HANDLER_MOV_REG16,    /* mov r16, r16 */
+  HANDLER_MOV_IMM16,    /* mov r16, imm16 */
+  HANDLER_INC_REG16,
+  HANDLER_DEC_REG16,
+  HANDLER_JCC,
+  HANDLER_LOOP,
+  HANDLER_JMP,          /* jmp rel8/rel16 */
+  HANDLER_COUNT
+} handler_t;
+
+typedef struct block_op_t {
+  const void    *handler; /* label address in run_cpu */
+  instruction_t instruction;
+} block_op_t;
+
+/** Basic block
+ * Straight-line run of decoded instructions starting at cs:ip and ending
+ * after the first control transfer. It is valid while the generations of
+ * the (at most two) code pages it covers are unchanged.
+ */
+typedef struct block_t {
+  uint32_t    address;
+  uint16_t    cs;
+  uint16_t    ip;
+  uint32_t    pages[2];
+  uint32_t    generations[2];
+  uint16_t    count;
+  uint32_t    hits;       /* interpreted runs, for the JIT threshold */
+  void        *native;    /* compiled code, NULL while interpreted */
+  block_op_t  ops[BLOCK_LENGTH];
+} block_t;
+
+typedef struct cpu_t {
+  uint16_t  registers[8];     /* ax cx dx bx sp bp si di */
+  uint16_t  segments[4];      /* es cs ss ds */
+  uint16_t  ip;
+  uint16_t  flags;
+  uint8_t   lazy_op;          /* lazy_op_t */
+  uint8_t   lazy_w;
+  uint16_t  lazy_left;
+  uint16_t  lazy_right;
+  uint16_t  lazy_result;
+  uint8_t   halted;
+  uint64_t  instruction_count;
+  uint8_t   *memory;          /* MEMORY_SIZE bytes */
+  decoded_t *cache;           /* DECODE_CACHE_SIZE entries */
+  uint32_t  *page_generations;
+  uint8_t   *code_pages;      /* page holds decoded instructions */
+  uint64_t  code_writes;      /* stores that hit a code page */
+  block_t   *blocks;          /* BLOCK_CACHE_SIZE entries */
+  struct jit_t *jit;          /* NULL unless the JIT tier is enabled */
+} cpu_t;
+
+error_t init_cpu(cpu_t *cpu);
+error_t free_cpu(cpu_t *cpu);
+error_t load_program(cpu_t *cpu, const uint8_t *bytes, size_t byte_count, uint16_t segment, uint16_t offset);
+uint8_t load_byte(const cpu_t *cpu, uint32_t address);
+void store_byte(cpu_t *cpu, uint32_t address, uint8_t value);
+void materialize_flags(cpu_t *cpu);
+const instruction_t *fetch_instruction(cpu_t *cpu);
+error_t execute_instruction(cpu_t *cpu, const instruction_t *instruction);
+error_t step_cpu(cpu_t *cpu);
+block_t *lookup_block(cpu_t *cpu, const void *const *handlers);
+error_t run_cpu(cpu_t *cpu, uint64_t instruction_limit);
+
+#endif
@@ -2,28 +2,38 @@
 #include "common.h"
 #include "error.h"
 
-void dump_error_code(uint8_t error_code) {
+const char *error_message(uint8_t error_code) {
+  /* Status line for an error code, NULL for an unknown one */
   switch (error_code) {
     case 0x00:
-    puts("JASM SUCCESS: Program ran successfully.");
-    break;
+    return "JASM SUCCESS: Program ran successfully.";
     case 0x01:
-    puts("JASM FILE OPEN ERROR: Couldn't open file.");
-    break;
+    return "JASM FILE OPEN ERROR: Couldn't open file.";
     case 0x02:
-    puts("JASM FILE READ ERROR: Couldn't read from file.");
-    break;
+    return "JASM FILE READ ERROR: Couldn't read from file.";
     case 0x03:
-    puts("JASM FILE WRITE ERROR: Couldn't write to file.");
-    break;
+    return "JASM FILE WRITE ERROR: Couldn't write to file.";
     case 0x04:
-    puts("JASM FILE CLOSE ERROR: Couldn't close file.");
-    break;
+    return "JASM FILE CLOSE ERROR: Couldn't close file.";
     case 0x05:
-    puts("JASM PRINTF STDOUT ERROR: Couldn't print to stdout.");
-    break;
+    return "JASM PRINTF STDOUT ERROR: Couldn't print to stdout.";
     case 0x06:
-    puts("JASM UNKNOWN INSTRUCTION ERROR: Couldn't decode current instruction.");
-    break;
+    return "JASM UNKNOWN INSTRUCTION ERROR: Couldn't decode current instruction.";
+    case 0x07:
+    return "JASM MEMORY ERROR: Couldn't allocate memory.";
+    case 0x08:
+    return "JASM SYNTAX ERROR: Couldn't parse or encode current line.";
+    case 0x09:
+    return "JASM UNDEFINED LABEL ERROR: Couldn't resolve label.";
+    case 0x0A:
+    return "JASM RANGE ERROR: Value doesn't fit its encoding.";
+  }
+  return NULL;
+}
+
+void dump_error_code(uint8_t error_code) {
+  const char *message = error_message(error_code);
+  if (message != NULL) {
+    puts(message);
   }
-}
\ No newline at end of file
+}
@@ -9,8 +9,13 @@ typedef enum error_t {
   JASM_FILE_CLOSE_ERROR = 0x04,
   JASM_PRINT_STDOUT_ERROR = 0x05,
   JASM_UNKNOWN_INSTRUCTION_ERROR = 0x06,
+  JASM_MEMORY_ERROR = 0x07,
+  JASM_SYNTAX_ERROR = 0x08,
+  JASM_UNDEFINED_LABEL_ERROR = 0x09,
+  JASM_RANGE_ERROR = 0x0A,
 } error_t;
 
+const char *error_message(uint8_t error_code);
 void dump_error_code(uint8_t error_code);
 
 #endif
\ No newline at end of file
@@ -1,4 +1,12 @@
+#define _DEFAULT_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "common.h"
 #include "error.h"
 #include "file_handler.h"
@@ -7,16 +15,18 @@ error_t load_file(char *file_name, uint8_t *char_buffer, uint32_t *byte_count) {
   /** load_file
    * Writes the file contents into a buffer
    */
-  int8_t return_code; /* fclose error code */
+  size_t read_count;  /* fread byte count */
+  int return_code;    /* fclose error code */
   FILE *file_pointer; /* fopen file pointer */
   file_pointer = fopen(file_name, "r");
   if (file_pointer == NULL) {
     return JASM_FILE_OPEN_ERROR;
   }
-  return_code = fread(char_buffer, sizeof(uint8_t), BUFFER_SIZE, file_pointer);
-  if (return_code > 0) {
-    *byte_count = return_code;
+  read_count = fread(char_buffer, sizeof(uint8_t), BUFFER_SIZE, file_pointer);
+  if (read_count > 0) {
+    *byte_count = read_count;
   } else {
+    fclose(file_pointer);
     return JASM_FILE_READ_ERROR;
   }
   return_code = fclose(file_pointer);
@@ -26,25 +36,142 @@ error_t load_file(char *file_name, uint8_t *char_buffer, uint32_t *byte_count) {
   return JASM_SUCCESS;
 }
 
-error_t load_binary_file(char *file_name, uint8_t *bytecode_buffer, uint32_t *byte_count) {
-  /** load_binary_file
-   * Writes the binary file contents into a buffer
+error_t read_stream(int file_descriptor, binary_file_t *binary) {
+  /** read_stream
+   * Reads a pipe or other unmappable descriptor to its end into a heap
+   * buffer, doubling the buffer as it fills
    */
-  int8_t return_code; /* error code */
-  FILE *file_pointer; /* fopen file pointer */
-  file_pointer = fopen(file_name, "rb");
-  if (file_pointer == NULL) {
-    return JASM_FILE_OPEN_ERROR;
+  size_t capacity = BUFFER_SIZE;
+  uint8_t *buffer = malloc(capacity);
+  binary->byte_count = 0;
+  if (buffer == NULL) {
+    return JASM_MEMORY_ERROR;
+  }
+  for (;;) {
+    ssize_t read_count;
+    if (binary->byte_count == capacity) {
+      uint8_t *grown = realloc(buffer, capacity * 2);
+      if (grown == NULL) {
+        free(buffer);
+        return JASM_MEMORY_ERROR;
+      }
+      buffer = grown;
+      capacity *= 2;
+    }
+    read_count = read(file_descriptor, buffer + binary->byte_count, capacity - binary->byte_count);
+    if (read_count == 0) {
+      break;
+    }
+    if (read_count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      free(buffer);
+      return JASM_FILE_READ_ERROR;
+    }
+    binary->byte_count += read_count;
   }
-  return_code = fread(bytecode_buffer, sizeof(uint8_t), BUFFER_SIZE, file_pointer);
-  if (return_code > 0) {
-    *byte_count = return_code;
+  binary->bytes = buffer;
+  binary->mapped = 0;
+  return JASM_SUCCESS;
+}
+
+error_t load_binary_contents(char *file_name, binary_file_t *binary) {
+  /** load_binary_contents
+   * Maps the binary file read-only for sequential access. Files that cannot
+   * be mapped, and "-" for stdin, are streamed into a heap buffer instead.
+   * The decoder reads the bytes in place either way. An empty file loads
+   * as zero bytes.
+   */
+  int file_descriptor; /* open file descriptor */
+  struct stat status;  /* fstat result */
+  error_t error_code = JASM_SUCCESS;
+  binary->bytes = NULL;
+  binary->byte_count = 0;
+  binary->mapped = 0;
+  if (strcmp(file_name, "-") == 0) {
+    file_descriptor = STDIN_FILENO;
   } else {
-    return JASM_FILE_READ_ERROR;
+    file_descriptor = open(file_name, O_RDONLY);
   }
-  return_code = fclose(file_pointer);
-  if (return_code != 0) {
-    return JASM_FILE_CLOSE_ERROR;
+  if (file_descriptor < 0) {
+    return JASM_FILE_OPEN_ERROR;
+  }
+  if (fstat(file_descriptor, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0) {
+    void *mapping = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    if (mapping != MAP_FAILED) {
+      madvise(mapping, status.st_size, MADV_SEQUENTIAL);
+      binary->bytes = mapping;
+      binary->byte_count = status.st_size;
+      binary->mapped = 1;
+    }
+  }
+  if (binary->bytes == NULL) {
+    error_code = read_stream(file_descriptor, binary);
+  }
+  if (file_descriptor != STDIN_FILENO && close(file_descriptor) != 0 && error_code == JASM_SUCCESS) {
+    unload_binary_file(binary);
+    error_code = JASM_FILE_CLOSE_ERROR;
   }
+  return error_code;
+}
+
+error_t load_binary_file(char *file_name, binary_file_t *binary) {
+  /** load_binary_file
+   * load_binary_contents for files that must hold at least one byte; an
+   * empty file is a JASM_FILE_READ_ERROR
+   */
+  error_t error_code = load_binary_contents(file_name, binary);
+  if (error_code == JASM_SUCCESS && binary->byte_count == 0) {
+    unload_binary_file(binary);
+    error_code = JASM_FILE_READ_ERROR;
+  }
+  return error_code;
+}
+
+error_t unload_binary_file(binary_file_t *binary) {
+  /** unload_binary_file
+   * Releases the mapping or heap buffer behind a loaded binary
+   */
+  if (binary->bytes != NULL) {
+    if (binary->mapped) {
+      munmap(binary->bytes, binary->byte_count);
+    } else {
+      free(binary->bytes);
+    }
+  }
+  binary->bytes = NULL;
+  binary->byte_count = 0;
+  binary->mapped = 0;
   return JASM_SUCCESS;
-}
\ No newline at end of file
+}
+
+error_t save_binary_file(char *file_name, const uint8_t *bytes, size_t byte_count) {
+  /** save_binary_file
+   * Writes a buffer to a file, "-" for stdout
+   */
+  int file_descriptor = STDOUT_FILENO;
+  error_t error_code = JASM_SUCCESS;
+  if (strcmp(file_name, "-") != 0) {
+    file_descriptor = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file_descriptor < 0) {
+      return JASM_FILE_OPEN_ERROR;
+    }
+  }
+  while (byte_count > 0) {
+    ssize_t written = write(file_descriptor, bytes, byte_count);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      error_code = JASM_FILE_WRITE_ERROR;
+      break;
+    }
+    bytes += written;
+    byte_count -= (size_t)written;
+  }
+  if (file_descriptor != STDOUT_FILENO && close(file_descriptor) != 0 && error_code == JASM_SUCCESS) {
+    error_code = JASM_FILE_CLOSE_ERROR;
+  }
+  return error_code;
+}
@@ -1,7 +1,19 @@
 #ifndef FILE_HANDLER_H
 #define FILE_HANDLER_H
 
+#include <stddef.h>
+
+typedef struct binary_file_t {
+  uint8_t   *bytes;
+  size_t    byte_count;
+  uint8_t   mapped;
+} binary_file_t;
+
 error_t load_file(char *file_name, uint8_t *char_buffer, uint32_t *byte_count);
-error_t load_binary_file(char *file_name, uint8_t *bytecode_buffer, uint32_t *byte_count);
+error_t read_stream(int file_descriptor, binary_file_t *binary);
+error_t load_binary_contents(char *file_name, binary_file_t *binary);
+error_t load_binary_file(char *file_name, binary_file_t *binary);
+error_t unload_binary_file(binary_file_t *binary);
+error_t save_binary_file(char *file_name, const uint8_t *bytes, size_t byte_count);
 
-#endif
\ No newline at end of file
+#endif
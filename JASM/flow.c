@@ -0,0 +1,263 @@
+#include <stdlib.h>
+#include "common.h"
+#include "error.h"
+#include "opcode_table.h"
+#include "string_builder.h"
+#include "writer.h"
+#include "decoder.h"
+#include "disassembler.h"
+#include "flow.h"
+
+/** Recursive-descent disassembly
+ * Decoding starts at the entry points and follows the instruction stream
+ * like the CPU would: through fallthrough, into the targets of relative
+ * jmp, call, jcc, loop and jcxz, and not past jmp, ret, iret or hlt.
+ * Indirect and far transfers are not followed. A path stops where it
+ * reaches an instruction already decoded, or would decode over one, so
+ * every byte belongs to at most one instruction and data embedded in code
+ * never desynchronizes the listing.
+ */
+
+error_t init_flow(flow_t *flow, const uint8_t *bytes, size_t byte_count) {
+  /** init_flow
+   * Empty bitmaps and worklist for an image
+   */
+  flow->bytes = bytes;
+  flow->byte_count = byte_count;
+  flow->visited = calloc(bitmap_bytes(byte_count) + 1, 1);
+  flow->covered = calloc(bitmap_bytes(byte_count) + 1, 1);
+  flow->targets = calloc(bitmap_bytes(byte_count) + 1, 1);
+  flow->worklist = NULL;
+  flow->work_count = 0;
+  flow->work_capacity = 0;
+  flow->instruction_count = 0;
+  if (flow->visited == NULL || flow->covered == NULL || flow->targets == NULL) {
+    free_flow(flow);
+    return JASM_MEMORY_ERROR;
+  }
+  return JASM_SUCCESS;
+}
+
+error_t free_flow(flow_t *flow) {
+  free(flow->visited);
+  free(flow->covered);
+  free(flow->targets);
+  free(flow->worklist);
+  flow->visited = NULL;
+  flow->covered = NULL;
+  flow->targets = NULL;
+  flow->worklist = NULL;
+  flow->work_count = 0;
+  flow->work_capacity = 0;
+  return JASM_SUCCESS;
+}
+
+size_t branch_target(const instruction_t *instruction, size_t byte_count) {
+  /** branch_target
+   * Image offset a relative branch lands on, NO_TARGET when there is none
+   * or it lies outside the image
+   */
+  int64_t target;
+  if (instruction->kinds[0] != OPERAND_REL) {
+    return NO_TARGET;
+  }
+  target = (int64_t)instruction->offset + instruction->length + (int16_t)instruction->immediate;
+  if (target < 0 || (uint64_t)target >= byte_count) {
+    return NO_TARGET;
+  }
+  return (size_t)target;
+}
+
+uint8_t falls_through(const instruction_t *instruction) {
+  /** falls_through
+   * Whether execution can continue with the next instruction
+   */
+  switch (instruction->mnemonic) {
+    case MN_JMP:
+    case MN_RET:
+    case MN_RETF:
+    case MN_IRET:
+    case MN_HLT:
+    case MN_INVALID:
+      return 0;
+  }
+  return 1;
+}
+
+error_t push_work(flow_t *flow, size_t offset) {
+  /** push_work
+   * Queues an offset to trace
+   */
+  if (flow->work_count == flow->work_capacity) {
+    size_t capacity = flow->work_capacity ? flow->work_capacity * 2 : 256;
+    size_t *worklist = realloc(flow->worklist, capacity * sizeof(size_t));
+    if (worklist == NULL) {
+      return JASM_MEMORY_ERROR;
+    }
+    flow->worklist = worklist;
+    flow->work_capacity = capacity;
+  }
+  flow->worklist[flow->work_count++] = offset;
+  return JASM_SUCCESS;
+}
+
+uint8_t overlaps(const flow_t *flow, const instruction_t *instruction) {
+  /* Any byte of the instruction already belongs to another one */
+  for (uint8_t idx = 0; idx < instruction->length; ++idx) {
+    if (test_bit(flow->covered, instruction->offset + idx)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+error_t trace_flow(flow_t *flow, size_t entry) {
+  /** trace_flow
+   * Decodes everything reachable from entry. Can be called once per entry
+   * point; offsets decoded by earlier calls are not decoded again.
+   */
+  instruction_t instruction;
+  error_t error_code;
+  if (entry >= flow->byte_count) {
+    return JASM_RANGE_ERROR;
+  }
+  set_bit(flow->targets, entry);
+  error_code = push_work(flow, entry);
+  while (error_code == JASM_SUCCESS && flow->work_count > 0) {
+    size_t offset = flow->worklist[--flow->work_count];
+    while (offset < flow->byte_count && !test_bit(flow->visited, offset)) {
+      size_t target;
+      decode_instruction(flow->bytes + offset, flow->byte_count - offset, offset, &instruction);
+      if (instruction.mnemonic == MN_INVALID || overlaps(flow, &instruction)) {
+        break;
+      }
+      set_bit(flow->visited, offset);
+      for (uint8_t idx = 0; idx < instruction.length; ++idx) {
+        set_bit(flow->covered, offset + idx);
+      }
+      flow->instruction_count++;
+      target = branch_target(&instruction, flow->byte_count);
+      if (target != NO_TARGET) {
+        set_bit(flow->targets, target);
+        if (!test_bit(flow->visited, target)) {
+          error_code = push_work(flow, target);
+          if (error_code != JASM_SUCCESS) {
+            break;
+          }
+        }
+      }
+      if (!falls_through(&instruction)) {
+        break;
+      }
+      offset += instruction.length;
+    }
+  }
+  return error_code;
+}
+
+void append_label(string_t *string, size_t offset) {
+  /* Labels are named after the offset they mark, like the listing */
+  push_char(string, 'L');
+  append_offset(string, offset);
+}
+
+error_t label_linear_targets(symbol_table_t *symbols, const uint8_t *bytes, size_t byte_count) {
+  /** label_linear_targets
+   * Adds a symbol, named like the traced listing's labels, for every
+   * relative branch target that starts an instruction of the linear
+   * listing
+   */
+  char text[STRING_SIZE];
+  string_t name;
+  flow_t flow;
+  instruction_t instruction;
+  error_t error_code = init_flow(&flow, bytes, byte_count);
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  for (size_t offset = 0; offset < byte_count; offset += instruction.length) {
+    size_t target;
+    decode_instruction(bytes + offset, byte_count - offset, offset, &instruction);
+    set_bit(flow.visited, offset);
+    target = branch_target(&instruction, byte_count);
+    if (target != NO_TARGET) {
+      set_bit(flow.targets, target);
+    }
+  }
+  init_string(&name, STRING_SIZE, text);
+  for (size_t offset = 0; offset < byte_count && offset <= UINT32_MAX && error_code == JASM_SUCCESS; ++offset) {
+    if (test_bit(flow.targets, offset) && test_bit(flow.visited, offset)) {
+      clear_string(&name);
+      append_label(&name, offset);
+      error_code = add_symbol(symbols, name.buffer, name.idx, (uint32_t)offset);
+    }
+  }
+  free_string(&name);
+  free_flow(&flow);
+  return error_code;
+}
+
+void render_flow_instruction(const flow_t *flow, const instruction_t *instruction, string_t *string) {
+  /** render_flow_instruction
+   * render_instruction with the target of a relative branch written as its
+   * label, when the target was decoded
+   */
+  size_t target = branch_target(instruction, flow->byte_count);
+  if (target == NO_TARGET || !test_bit(flow->visited, target) || segment_override(instruction->attributes) >= 0 ||
+      repeat_prefix(instruction->attributes) != REPEAT_NONE) {
+    render_instruction(instruction, string);
+    return;
+  }
+  append_string(string, mnemonic_lengths[instruction->mnemonic], mnemonic_names[instruction->mnemonic]);
+  push_char(string, ' ');
+  if (instruction->attributes & ATTR_SHORT) {
+    append_literal(string, "short ");
+  }
+  append_label(string, target);
+}
+
+void render_flow_line(const flow_t *flow, const instruction_t *instruction, string_t *line) {
+  /* render_line with render_flow_instruction */
+  append_offset(line, instruction->offset);
+  push_char(line, ' ');
+  append_bits(line, flow->bytes + instruction->offset, instruction->length);
+  render_flow_instruction(flow, instruction, line);
+  push_char(line, '\n');
+}
+
+error_t dump_flow(writer_t *writer, const flow_t *flow) {
+  /** dump_flow
+   * Writes the traced image in offset order: a label line before every
+   * branch target, decoded instructions, and a db line for every byte no
+   * path reached
+   */
+  char text[STRING_SIZE];
+  string_t line;
+  instruction_t instruction;
+  size_t offset = 0;
+  error_t error_code = JASM_SUCCESS;
+  init_string(&line, STRING_SIZE, text);
+  append_format_header(FORMAT_TEXT, &line);
+  error_code = write_bytes(writer, line.idx, line.buffer);
+  while (offset < flow->byte_count && error_code == JASM_SUCCESS) {
+    clear_string(&line);
+    if (test_bit(flow->targets, offset) && test_bit(flow->visited, offset)) {
+      append_label(&line, offset);
+      append_literal(&line, ":\n");
+    }
+    if (test_bit(flow->visited, offset)) {
+      decode_instruction(flow->bytes + offset, flow->byte_count - offset, offset, &instruction);
+      render_flow_line(flow, &instruction, &line);
+    } else {
+      decode_data(flow->bytes + offset, offset, &instruction);
+      render_line(flow->bytes, &instruction, &line);
+    }
+    error_code = write_bytes(writer, line.idx, line.buffer);
+    offset += instruction.length;
+  }
+  free_string(&line);
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  return flush_writer(writer);
+}
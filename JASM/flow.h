@@ -0,0 +1,42 @@
+#ifndef FLOW_H
+#define FLOW_H
+
+#include <stddef.h>
+
+/* Bitmaps with one bit per image byte */
+#define bitmap_bytes(count) (((count) + 7) >> 3)
+#define test_bit(map, idx) (((map)[(idx) >> 3] >> ((idx) & 7)) & 1)
+#define set_bit(map, idx) ((map)[(idx) >> 3] |= (uint8_t)(1 << ((idx) & 7)))
+
+/* Returned by branch_target for anything but an in-image relative branch */
+#define NO_TARGET ((size_t)-1)
+
+/** Flow
+ * Recursive-descent view of an image: every offset reached by following
+ * fallthrough and relative branches from the entry points. Bytes never
+ * reached are data.
+ */
+typedef struct flow_t {
+  const uint8_t *bytes;
+  size_t    byte_count;
+  uint8_t   *visited;       /* instruction starts */
+  uint8_t   *covered;       /* bytes inside a decoded instruction */
+  uint8_t   *targets;       /* branch targets, listed with a label */
+  size_t    *worklist;      /* entry points still to trace */
+  size_t    work_count;
+  size_t    work_capacity;
+  size_t    instruction_count;
+} flow_t;
+
+error_t init_flow(flow_t *flow, const uint8_t *bytes, size_t byte_count);
+error_t free_flow(flow_t *flow);
+size_t branch_target(const instruction_t *instruction, size_t byte_count);
+uint8_t falls_through(const instruction_t *instruction);
+error_t trace_flow(flow_t *flow, size_t entry);
+void append_label(string_t *string, size_t offset);
+error_t label_linear_targets(symbol_table_t *symbols, const uint8_t *bytes, size_t byte_count);
+void render_flow_instruction(const flow_t *flow, const instruction_t *instruction, string_t *string);
+void render_flow_line(const flow_t *flow, const instruction_t *instruction, string_t *line);
+error_t dump_flow(writer_t *writer, const flow_t *flow);
+
+#endif
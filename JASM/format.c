@@ -0,0 +1,216 @@
+#include <string.h>
+#include <pthread.h>
+#include "common.h"
+#include "format.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FORMAT_X86 1
+#endif
+
+/** Formatting kernels
+ * Expand bytes into the binary and hex columns of the listing. The SIMD
+ * kernels handle 16 (SSE2) or 32 (AVX2) input bytes per iteration and
+ * finish the tail with the next narrower kernel. format_bits and format_hex
+ * call through a kernel family picked once, under pthread_once, as the
+ * widest the CPU supports, so every thread sees the finished choice.
+ */
+
+typedef struct format_kernels_t {
+  format_kernel_t bits;
+  format_kernel_t hex;
+  const char      *name;
+} format_kernels_t;
+
+const char hex_digits[16] = "0123456789abcdef";
+
+void format_bits_scalar(char *destination, const uint8_t *bytes, size_t count) {
+  /** format_bits_scalar
+   * The multiply moves bit 7-n into the low bit of byte n (little-endian
+   * host), so every byte is expanded without a per-bit branch
+   */
+  for (size_t idx = 0; idx < count; ++idx) {
+    uint64_t digits = ((bytes[idx] * 0x8040201008040201ull) >> 7) & 0x0101010101010101ull;
+    digits += 0x3030303030303030ull; /* '0' in every byte */
+    memcpy(destination + idx * BITS_WIDTH, &digits, 8);
+    destination[idx * BITS_WIDTH + 8] = ' ';
+  }
+}
+
+void format_hex_scalar(char *destination, const uint8_t *bytes, size_t count) {
+  for (size_t idx = 0; idx < count; ++idx) {
+    destination[idx * HEX_WIDTH] = hex_digits[bytes[idx] >> 4];
+    destination[idx * HEX_WIDTH + 1] = hex_digits[bytes[idx] & 0xf];
+  }
+}
+
+#ifdef FORMAT_X86
+
+void store_bits_pair(char *destination, __m128i digits) {
+  /** store_bits_pair
+   * Stores the digits of two bytes, each followed by a space
+   */
+  _mm_storel_epi64((__m128i *)destination, digits);
+  destination[8] = ' ';
+  _mm_storel_epi64((__m128i *)(destination + BITS_WIDTH), _mm_srli_si128(digits, 8));
+  destination[BITS_WIDTH + 8] = ' ';
+}
+
+void format_bits_sse2(char *destination, const uint8_t *bytes, size_t count) {
+  /** format_bits_sse2
+   * Widens every byte to eight lanes with unpacks, tests one bit per lane
+   * and turns the mask into '0'/'1'
+   */
+  const __m128i bit_mask = _mm_setr_epi8(
+    (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+    (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+  const __m128i zero = _mm_set1_epi8('0');
+  size_t idx = 0;
+  for (; idx + 16 <= count; idx += 16) {
+    __m128i input = _mm_loadu_si128((const __m128i *)(bytes + idx));
+    __m128i halves[2];
+    halves[0] = _mm_unpacklo_epi8(input, input);
+    halves[1] = _mm_unpackhi_epi8(input, input);
+    for (int half = 0; half < 2; ++half) {
+      __m128i quads[2];
+      quads[0] = _mm_unpacklo_epi16(halves[half], halves[half]);
+      quads[1] = _mm_unpackhi_epi16(halves[half], halves[half]);
+      for (int quad = 0; quad < 2; ++quad) {
+        __m128i pairs[2];
+        pairs[0] = _mm_unpacklo_epi32(quads[quad], quads[quad]);
+        pairs[1] = _mm_unpackhi_epi32(quads[quad], quads[quad]);
+        for (int pair = 0; pair < 2; ++pair) {
+          __m128i set = _mm_cmpeq_epi8(_mm_and_si128(pairs[pair], bit_mask), bit_mask);
+          size_t byte_idx = idx + half * 8 + quad * 4 + pair * 2;
+          store_bits_pair(destination + byte_idx * BITS_WIDTH, _mm_sub_epi8(zero, set));
+        }
+      }
+    }
+  }
+  format_bits_scalar(destination + idx * BITS_WIDTH, bytes + idx, count - idx);
+}
+
+__attribute__((target("avx2")))
+void format_bits_avx2(char *destination, const uint8_t *bytes, size_t count) {
+  /** format_bits_avx2
+   * Broadcasts four bytes and shuffles one byte into each group of eight
+   * lanes, so every 256-bit compare expands four bytes
+   */
+  const __m256i bit_mask = _mm256_setr_epi8(
+    (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+    (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+    (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+    (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+  const __m256i spread = _mm256_setr_epi8(
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+    2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+  const __m256i zero = _mm256_set1_epi8('0');
+  size_t idx = 0;
+  for (; idx + 32 <= count; idx += 32) {
+    for (size_t group = 0; group < 32; group += 4) {
+      int32_t word;
+      __m256i lanes, digits;
+      __m128i low, high;
+      memcpy(&word, bytes + idx + group, 4);
+      lanes = _mm256_shuffle_epi8(_mm256_set1_epi32(word), spread);
+      digits = _mm256_sub_epi8(zero, _mm256_cmpeq_epi8(_mm256_and_si256(lanes, bit_mask), bit_mask));
+      low = _mm256_castsi256_si128(digits);
+      high = _mm256_extracti128_si256(digits, 1);
+      store_bits_pair(destination + (idx + group) * BITS_WIDTH, low);
+      store_bits_pair(destination + (idx + group + 2) * BITS_WIDTH, high);
+    }
+  }
+  format_bits_sse2(destination + idx * BITS_WIDTH, bytes + idx, count - idx);
+}
+
+__m128i hex_ascii_sse2(__m128i nibbles) {
+  /** hex_ascii_sse2
+   * Maps sixteen values 0-15 to '0'-'9' and 'a'-'f'
+   */
+  __m128i letters = _mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9));
+  __m128i ascii = _mm_add_epi8(nibbles, _mm_set1_epi8('0'));
+  return _mm_add_epi8(ascii, _mm_and_si128(letters, _mm_set1_epi8('a' - '0' - 10)));
+}
+
+void format_hex_sse2(char *destination, const uint8_t *bytes, size_t count) {
+  const __m128i low_nibble = _mm_set1_epi8(0x0f);
+  size_t idx = 0;
+  for (; idx + 16 <= count; idx += 16) {
+    __m128i input = _mm_loadu_si128((const __m128i *)(bytes + idx));
+    __m128i high = hex_ascii_sse2(_mm_and_si128(_mm_srli_epi16(input, 4), low_nibble));
+    __m128i low = hex_ascii_sse2(_mm_and_si128(input, low_nibble));
+    _mm_storeu_si128((__m128i *)(destination + idx * HEX_WIDTH), _mm_unpacklo_epi8(high, low));
+    _mm_storeu_si128((__m128i *)(destination + idx * HEX_WIDTH + 16), _mm_unpackhi_epi8(high, low));
+  }
+  format_hex_scalar(destination + idx * HEX_WIDTH, bytes + idx, count - idx);
+}
+
+__attribute__((target("avx2")))
+void format_hex_avx2(char *destination, const uint8_t *bytes, size_t count) {
+  const __m256i low_nibble = _mm256_set1_epi8(0x0f);
+  const __m256i nine = _mm256_set1_epi8(9);
+  size_t idx = 0;
+  for (; idx + 32 <= count; idx += 32) {
+    __m256i input = _mm256_loadu_si256((const __m256i *)(bytes + idx));
+    __m256i high = _mm256_and_si256(_mm256_srli_epi16(input, 4), low_nibble);
+    __m256i low = _mm256_and_si256(input, low_nibble);
+    __m256i first, second;
+    high = _mm256_add_epi8(_mm256_add_epi8(high, _mm256_set1_epi8('0')),
+                           _mm256_and_si256(_mm256_cmpgt_epi8(high, nine), _mm256_set1_epi8('a' - '0' - 10)));
+    low = _mm256_add_epi8(_mm256_add_epi8(low, _mm256_set1_epi8('0')),
+                          _mm256_and_si256(_mm256_cmpgt_epi8(low, nine), _mm256_set1_epi8('a' - '0' - 10)));
+    /* Unpacks work per 128-bit lane; reorder the lanes before storing */
+    first = _mm256_unpacklo_epi8(high, low);
+    second = _mm256_unpackhi_epi8(high, low);
+    _mm256_storeu_si256((__m256i *)(destination + idx * HEX_WIDTH), _mm256_permute2x128_si256(first, second, 0x20));
+    _mm256_storeu_si256((__m256i *)(destination + idx * HEX_WIDTH + 32), _mm256_permute2x128_si256(first, second, 0x31));
+  }
+  format_hex_sse2(destination + idx * HEX_WIDTH, bytes + idx, count - idx);
+}
+
+#endif
+
+const format_kernels_t scalar_kernels = {format_bits_scalar, format_hex_scalar, "scalar"};
+#ifdef FORMAT_X86
+const format_kernels_t sse2_kernels = {format_bits_sse2, format_hex_sse2, "sse2"};
+const format_kernels_t avx2_kernels = {format_bits_avx2, format_hex_avx2, "avx2"};
+#endif
+
+/* Written only by select_kernels; pthread_once orders it before every read */
+const format_kernels_t *kernels = &scalar_kernels;
+pthread_once_t kernels_selected = PTHREAD_ONCE_INIT;
+
+void select_kernels(void) {
+  /** select_kernels
+   * Picks the widest kernel family the CPU supports
+   */
+#ifdef FORMAT_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    kernels = &avx2_kernels;
+    return;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    kernels = &sse2_kernels;
+    return;
+  }
+#endif
+  kernels = &scalar_kernels;
+}
+
+void format_bits(char *destination, const uint8_t *bytes, size_t count) {
+  pthread_once(&kernels_selected, select_kernels);
+  kernels->bits(destination, bytes, count);
+}
+
+void format_hex(char *destination, const uint8_t *bytes, size_t count) {
+  pthread_once(&kernels_selected, select_kernels);
+  kernels->hex(destination, bytes, count);
+}
+
+const char *format_kernel_name(void) {
+  /** format_kernel_name
+   * Name of the selected kernel family, for benchmark reports
+   */
+  pthread_once(&kernels_selected, select_kernels);
+  return kernels->name;
+}
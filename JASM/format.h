@@ -0,0 +1,25 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stddef.h>
+
+/* Output width of each kernel per input byte */
+#define BITS_WIDTH 9 /* eight binary digits and a space */
+#define HEX_WIDTH  2 /* two lowercase hex digits */
+
+typedef void (*format_kernel_t)(char *destination, const uint8_t *bytes, size_t count);
+
+/* Kernels selected on first use from the CPU's features */
+void format_bits(char *destination, const uint8_t *bytes, size_t count);
+void format_hex(char *destination, const uint8_t *bytes, size_t count);
+void format_bits_scalar(char *destination, const uint8_t *bytes, size_t count);
+void format_hex_scalar(char *destination, const uint8_t *bytes, size_t count);
+#if defined(__x86_64__) || defined(__i386__)
+void format_bits_sse2(char *destination, const uint8_t *bytes, size_t count);
+void format_bits_avx2(char *destination, const uint8_t *bytes, size_t count);
+void format_hex_sse2(char *destination, const uint8_t *bytes, size_t count);
+void format_hex_avx2(char *destination, const uint8_t *bytes, size_t count);
+#endif
+const char *format_kernel_name(void);
+
+#endif
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <string.h>
+#include "common.h"
+#include "opcode_table.h"
+#include "keywords.h"
+
+/** Keyword table generator
+ * Prints keyword_table.h: a hash-and-displace perfect hash over every
+ * keyword. Keys are spread over KEYWORD_BUCKETS by the low hash bits;
+ * buckets are placed largest first, each with the smallest displacement
+ * that lands all its keys on free slots. A seed that puts two keys of
+ * one bucket on the same slot, or leaves a bucket unplaceable, is
+ * skipped.
+ */
+
+typedef struct entry_t {
+  const char  *name;
+  const char  *kind;
+  const char  *value;
+  uint32_t    hash;
+} entry_t;
+
+#define MNEMONIC_ENTRY(name, text) {text, "MNEMONIC", "MN_" #name, 0},
+#define KEYWORD_ENTRY(text, kind, value) {text, #kind, #value, 0},
+entry_t entries[] = {
+  MNEMONIC_LIST(MNEMONIC_ENTRY)
+  KEYWORD_LIST(KEYWORD_ENTRY)
+};
+#undef MNEMONIC_ENTRY
+#undef KEYWORD_ENTRY
+
+/* INVALID renders as db and SEGMENT is never written; both are skipped */
+#define skipped(entry) (strcmp((entry)->value, "MN_INVALID") == 0 || strcmp((entry)->value, "MN_SEGMENT") == 0)
+
+#define ENTRY_COUNT (sizeof(entries) / sizeof(entry_t))
+
+uint8_t keyword_displacements[KEYWORD_BUCKETS];
+int slots[KEYWORD_SLOTS];
+
+int place(uint32_t seed) {
+  /** place
+   * Builds slots for a seed; 0 when the seed does not give a perfect hash
+   */
+  size_t order[KEYWORD_BUCKETS];
+  size_t sizes[KEYWORD_BUCKETS] = {0};
+  for (size_t idx = 0; idx < ENTRY_COUNT; ++idx) {
+    uint32_t hash = seed;
+    for (const char *c = entries[idx].name; *c; ++c) {
+      hash = keyword_hash_step(hash, *c);
+    }
+    entries[idx].hash = hash;
+    if (!skipped(&entries[idx])) {
+      sizes[hash & (KEYWORD_BUCKETS - 1)]++;
+    }
+  }
+  for (size_t idx = 0; idx < KEYWORD_BUCKETS; ++idx) {
+    size_t jdx = idx;
+    for (; jdx > 0 && sizes[order[jdx - 1]] < sizes[idx]; --jdx) {
+      order[jdx] = order[jdx - 1];
+    }
+    order[jdx] = idx;
+  }
+  for (size_t idx = 0; idx < KEYWORD_SLOTS; ++idx) {
+    slots[idx] = -1;
+  }
+  for (size_t rank = 0; rank < KEYWORD_BUCKETS; ++rank) {
+    size_t bucket = order[rank];
+    int placed = 0;
+    for (uint32_t displacement = 0; displacement < KEYWORD_SLOTS && !placed; ++displacement) {
+      size_t idx;
+      keyword_displacements[bucket] = (uint8_t)displacement;
+      for (idx = 0; idx < ENTRY_COUNT; ++idx) {
+        uint32_t hash = entries[idx].hash;
+        if (skipped(&entries[idx]) || (hash & (KEYWORD_BUCKETS - 1)) != bucket) {
+          continue;
+        }
+        if (slots[keyword_slot(hash)] >= 0) {
+          break;
+        }
+        slots[keyword_slot(hash)] = (int)idx;
+      }
+      placed = idx == ENTRY_COUNT;
+      if (!placed) {
+        /* Undo this bucket's partial placement */
+        for (size_t slot = 0; slot < KEYWORD_SLOTS; ++slot) {
+          if (slots[slot] >= 0 && (entries[slots[slot]].hash & (KEYWORD_BUCKETS - 1)) == bucket) {
+            slots[slot] = -1;
+          }
+        }
+      }
+    }
+    if (!placed) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int main(void) {
+  uint32_t seed = 2166136261u;
+  for (size_t idx = 0; idx < ENTRY_COUNT; ++idx) {
+    if (strlen(entries[idx].name) > KEYWORD_MAX_LENGTH) {
+      fprintf(stderr, "gen_keywords: %s is longer than KEYWORD_MAX_LENGTH\n", entries[idx].name);
+      return 1;
+    }
+  }
+  while (!place(seed)) {
+    seed++;
+  }
+  printf("/* Generated by gen_keywords from keywords.h and opcode_table.h, do not edit */\n");
+  printf("#define KEYWORD_SEED 0x%08xu\n\n", seed);
+  printf("const uint8_t keyword_displacements[KEYWORD_BUCKETS] = {");
+  for (size_t idx = 0; idx < KEYWORD_BUCKETS; ++idx) {
+    printf("%s%u", idx == 0 ? "\n  " : idx % 16 ? ", " : ",\n  ", keyword_displacements[idx]);
+  }
+  printf("\n};\n\nconst keyword_t keyword_table[KEYWORD_SLOTS] = {\n");
+  for (size_t slot = 0; slot < KEYWORD_SLOTS; ++slot) {
+    const entry_t *entry = &entries[slots[slot]];
+    if (slots[slot] >= 0) {
+      printf("  [%zu] = {\"%s\", %zu, KEYWORD_%s, %s},\n", slot, entry->name, strlen(entry->name), entry->kind,
+             entry->value);
+    }
+  }
+  printf("};\n");
+  return 0;
+}
@@ -0,0 +1,239 @@
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "error.h"
+#include "string_builder.h"
+#include "writer.h"
+#include "decoder.h"
+#include "disassembler.h"
+#include "incremental.h"
+
+/** Incremental re-disassembly
+ * A patch can only change the instructions that contain patched bytes and
+ * the ones after them until the stream lands on an old boundary again;
+ * from there on decoding is identical. relist_range re-decodes from the
+ * last old boundary at or before the patch until the first old boundary
+ * at or past its end, and copies the listing and index on either side.
+ * Patches must keep the image size.
+ */
+
+error_t init_decode_index(decode_index_t *index, size_t capacity) {
+  /** init_decode_index
+   * Empty index with room for capacity instructions
+   */
+  index->byte_count = 0;
+  index->count = 0;
+  index->capacity = capacity + 1;
+  index->boundaries = malloc(index->capacity * sizeof(uint32_t));
+  index->text_offsets = malloc(index->capacity * sizeof(uint64_t));
+  if (index->boundaries == NULL || index->text_offsets == NULL) {
+    free_decode_index(index);
+    return JASM_MEMORY_ERROR;
+  }
+  index->text_offsets[0] = 0;
+  return JASM_SUCCESS;
+}
+
+error_t free_decode_index(decode_index_t *index) {
+  free(index->boundaries);
+  free(index->text_offsets);
+  index->boundaries = NULL;
+  index->text_offsets = NULL;
+  index->count = 0;
+  index->capacity = 0;
+  return JASM_SUCCESS;
+}
+
+error_t push_boundary(decode_index_t *index, size_t offset, size_t text_offset) {
+  /** push_boundary
+   * Appends an instruction, keeping room for the closing text offset
+   */
+  if (index->count + 1 == index->capacity) {
+    size_t capacity = index->capacity * 2;
+    uint32_t *boundaries = realloc(index->boundaries, capacity * sizeof(uint32_t));
+    uint64_t *text_offsets;
+    if (boundaries == NULL) {
+      return JASM_MEMORY_ERROR;
+    }
+    index->boundaries = boundaries;
+    text_offsets = realloc(index->text_offsets, capacity * sizeof(uint64_t));
+    if (text_offsets == NULL) {
+      return JASM_MEMORY_ERROR;
+    }
+    index->text_offsets = text_offsets;
+    index->capacity = capacity;
+  }
+  index->boundaries[index->count] = (uint32_t)offset;
+  index->text_offsets[index->count] = text_offset;
+  index->count++;
+  return JASM_SUCCESS;
+}
+
+error_t decode_span(const uint8_t *bytes, size_t byte_count, size_t offset, const decode_index_t *old_index,
+                    size_t *resync, string_t *listing, decode_index_t *index) {
+  /** decode_span
+   * Lists instructions from offset. With old_index, stops at the first
+   * offset at or past *resync that is an old boundary and leaves its old
+   * instruction number in *resync; without, or at the end of the image,
+   * *resync is the old instruction count.
+   */
+  size_t old = 0;
+  size_t last = old_index != NULL ? *resync : byte_count;
+  error_t error_code = JASM_SUCCESS;
+  if (old_index != NULL) {
+    *resync = old_index->count;
+  }
+  while (offset < byte_count && error_code == JASM_SUCCESS) {
+    if (old_index != NULL && offset >= last) {
+      while (old < old_index->count && old_index->boundaries[old] < offset) {
+        ++old;
+      }
+      if (old < old_index->count && old_index->boundaries[old] == offset) {
+        *resync = old;
+        break;
+      }
+    }
+    error_code = push_boundary(index, offset, listing->idx);
+    if (error_code == JASM_SUCCESS) {
+      offset += disassemble_line(bytes, offset, byte_count, listing);
+    }
+  }
+  return error_code;
+}
+
+error_t build_listing(const uint8_t *bytes, size_t byte_count, string_t *listing, decode_index_t *index) {
+  /** build_listing
+   * The linear listing of an image, as dump_buffer writes it, and its index
+   */
+  error_t error_code = append_literal(listing, "=======<DISASSEMBLY OUTPUT>=======\n");
+  index->byte_count = byte_count;
+  if (error_code == JASM_SUCCESS) {
+    error_code = decode_span(bytes, byte_count, 0, NULL, NULL, listing, index);
+  }
+  index->text_offsets[index->count] = listing->idx;
+  return error_code;
+}
+
+void put_word(uint8_t *bytes, uint64_t value, uint8_t width) {
+  /* Little-endian store of width bytes */
+  for (uint8_t idx = 0; idx < width; ++idx) {
+    bytes[idx] = (uint8_t)(value >> (idx * 8));
+  }
+}
+
+uint64_t get_word(const uint8_t *bytes, uint8_t width) {
+  /* Little-endian load of width bytes */
+  uint64_t value = 0;
+  for (uint8_t idx = 0; idx < width; ++idx) {
+    value |= (uint64_t)bytes[idx] << (idx * 8);
+  }
+  return value;
+}
+
+error_t export_decode_index(const decode_index_t *index, string_t *output) {
+  /** export_decode_index
+   * Appends the index file described in incremental.h
+   */
+  size_t size = 16 + index->count * 4 + (index->count + 1) * 8;
+  uint8_t *bytes;
+  error_t error_code = reserve_string(output, size);
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  bytes = (uint8_t *)output->buffer + output->idx;
+  put_word(bytes, INDEX_MAGIC, 4);
+  put_word(bytes + 4, INDEX_VERSION, 4);
+  put_word(bytes + 8, index->byte_count, 4);
+  put_word(bytes + 12, index->count, 4);
+  bytes += 16;
+  for (size_t idx = 0; idx < index->count; ++idx, bytes += 4) {
+    put_word(bytes, index->boundaries[idx], 4);
+  }
+  for (size_t idx = 0; idx <= index->count; ++idx, bytes += 8) {
+    put_word(bytes, index->text_offsets[idx], 8);
+  }
+  output->idx += size;
+  return JASM_SUCCESS;
+}
+
+error_t import_decode_index(const uint8_t *bytes, size_t byte_count, decode_index_t *index) {
+  /** import_decode_index
+   * Reads an index file; JASM_FILE_READ_ERROR if it is not one
+   */
+  size_t count;
+  error_t error_code;
+  if (byte_count < 16 || get_word(bytes, 4) != INDEX_MAGIC || get_word(bytes + 4, 4) != INDEX_VERSION) {
+    return JASM_FILE_READ_ERROR;
+  }
+  count = get_word(bytes + 12, 4);
+  if (byte_count != 16 + count * 4 + (count + 1) * 8) {
+    return JASM_FILE_READ_ERROR;
+  }
+  error_code = init_decode_index(index, count);
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  index->byte_count = get_word(bytes + 8, 4);
+  index->count = count;
+  bytes += 16;
+  for (size_t idx = 0; idx < count; ++idx, bytes += 4) {
+    index->boundaries[idx] = (uint32_t)get_word(bytes, 4);
+  }
+  for (size_t idx = 0; idx <= count; ++idx, bytes += 8) {
+    index->text_offsets[idx] = get_word(bytes, 8);
+  }
+  return JASM_SUCCESS;
+}
+
+error_t relist_range(const uint8_t *bytes, const decode_index_t *old_index, const char *old_listing,
+                     size_t first, size_t last, string_t *listing, decode_index_t *index) {
+  /** relist_range
+   * New listing and index after bytes[first, last) changed. bytes is the
+   * patched image, old_listing and old_index describe it before the patch.
+   */
+  size_t low = 0;
+  size_t high = old_index->count;
+  size_t start, reach, resync = last;
+  uint64_t old_length = old_index->text_offsets[old_index->count];
+  error_t error_code;
+  if (first >= last || last > old_index->byte_count) {
+    return JASM_RANGE_ERROR;
+  }
+  /* The decoder reads up to MAX_INSTRUCTION_LENGTH bytes from an
+   * instruction start even where the instruction ends up shorter, so start
+   * at the last old boundary that cannot have seen the patched bytes */
+  reach = first >= MAX_INSTRUCTION_LENGTH - 1 ? first - (MAX_INSTRUCTION_LENGTH - 1) : 0;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (old_index->boundaries[middle] <= reach) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  start = low > 0 ? low - 1 : 0;
+  error_code = init_decode_index(index, old_index->count + 16);
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  index->byte_count = old_index->byte_count;
+  index->count = start;
+  memcpy(index->boundaries, old_index->boundaries, start * sizeof(uint32_t));
+  memcpy(index->text_offsets, old_index->text_offsets, start * sizeof(uint64_t));
+  error_code = append_string(listing, old_index->text_offsets[start], old_listing);
+  if (error_code == JASM_SUCCESS) {
+    error_code = decode_span(bytes, old_index->byte_count, start < old_index->count ? old_index->boundaries[start] : 0,
+                             old_index, &resync, listing, index);
+  }
+  if (error_code == JASM_SUCCESS && resync < old_index->count) {
+    /* The rest is unchanged apart from where its text now starts */
+    uint64_t shift = listing->idx - old_index->text_offsets[resync];
+    error_code = append_string(listing, old_length - old_index->text_offsets[resync],
+                               old_listing + old_index->text_offsets[resync]);
+    for (size_t idx = resync; idx < old_index->count && error_code == JASM_SUCCESS; ++idx) {
+      error_code = push_boundary(index, old_index->boundaries[idx], old_index->text_offsets[idx] + shift);
+    }
+  }
+  index->text_offsets[index->count] = listing->idx;
+  return error_code;
+}
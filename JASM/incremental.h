@@ -0,0 +1,35 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <stddef.h>
+
+/* Decode index magic, "JIDX" little-endian, and layout version */
+#define INDEX_MAGIC   0x5844494aU
+#define INDEX_VERSION 1
+
+/** Decode index
+ * Where every instruction of a linear listing starts, in the image and in
+ * the listing text. text_offsets has count + 1 entries, the last being
+ * the listing length.
+ *
+ * Index file, little-endian: uint32_t magic, version, byte_count, count,
+ * then uint32_t boundaries[count] and uint64_t text_offsets[count + 1].
+ */
+typedef struct decode_index_t {
+  size_t    byte_count;
+  size_t    count;
+  size_t    capacity;
+  uint32_t  *boundaries;
+  uint64_t  *text_offsets;
+} decode_index_t;
+
+error_t init_decode_index(decode_index_t *index, size_t capacity);
+error_t free_decode_index(decode_index_t *index);
+error_t push_boundary(decode_index_t *index, size_t offset, size_t text_offset);
+error_t build_listing(const uint8_t *bytes, size_t byte_count, string_t *listing, decode_index_t *index);
+error_t export_decode_index(const decode_index_t *index, string_t *output);
+error_t import_decode_index(const uint8_t *bytes, size_t byte_count, decode_index_t *index);
+error_t relist_range(const uint8_t *bytes, const decode_index_t *old_index, const char *old_listing,
+                     size_t first, size_t last, string_t *listing, decode_index_t *index);
+
+#endif
@@ -1,1563 +1,571 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "common.h"
 #include "error.h"
 #include "file_handler.h"
 #include "string_builder.h"
+#include "writer.h"
+#include "decoder.h"
+#include "disassembler.h"
+#include "parallel.h"
+#include "opcode_table.h"
+#include "lexer.h"
+#include "assembler.h"
+#include "emulator.h"
+#include "jit.h"
+#include "flow.h"
+#include "cfg.h"
+#include "incremental.h"
+#include "stream.h"
+#include "batch.h"
 
-/** 8086 data
- * dec  | bin   | hex
- * 0      0000    0
- * 1      0001    1
- * 2      0010    2
- * 3      0011    3
- * 4      0100    4
- * 5      0101    5
- * 6      0110    6
- * 7      0111    7
- * 8      1000    8
- * 9      1001    9
- * 10     1010    A
- * 11     1011    B
- * 12     1100    C
- * 13     1101    D
- * 14     1110    E 
- * 15     1111    F
- */
+error_t dump_file(char *binary_name);
+error_t assemble_file(char *source_name, char *binary_name);
+error_t emulate_file(char *binary_name, char mode, uint64_t instruction_limit);
+error_t label_file(char *binary_name);
+error_t map_file(char *map_name, char *binary_name);
+error_t trace_file(char *binary_name, size_t entry);
+error_t graph_file(char *binary_name, char *index_name, char *dot_name, size_t entry);
+error_t list_file(char *binary_name, char *listing_name, char *index_name);
+error_t relist_file(char *binary_name, char *listing_name, char *index_name, size_t first, size_t last);
+error_t list_mapped_file(writer_t *writer, char *file_name, uint8_t format);
+error_t stream_files(int file_count, char **file_names, size_t offset, size_t length, uint8_t format);
+error_t batch_files(char *source_name, size_t thread_count);
+int parse_format(const char *name);
+int exit_status(error_t error_code);
+void print_usage(const char *program);
 
-#define OPCODE_MASK 0b11111100
-#define D_MASK      0b00000010
-#define W_MASK      0b00000001
-#define MOD_MASK    0b11000000
-#define REG_MASK    0b00111000
-#define RM_MASK     0b00000111
+int main(int argc, char **argv) {
+  if (argc >= 3 && strcmp(argv[1], "-a") == 0) {
+    /* jasm -a source.asm [-o binary] */
+    char *binary_name = argc >= 5 && strcmp(argv[3], "-o") == 0 ? argv[4] : "test";
+    return exit_status(assemble_file(argv[2], binary_name));
+  }
+  if (argc >= 3 && (strcmp(argv[1], "-e") == 0 || strcmp(argv[1], "-t") == 0 || strcmp(argv[1], "-j") == 0)) {
+    /* jasm -e|-t|-j binary [instruction limit] */
+    uint64_t instruction_limit = argc >= 4 ? strtoull(argv[3], NULL, 0) : RUN_LIMIT;
+    return exit_status(emulate_file(argv[2], argv[1][1], instruction_limit));
+  }
+  if (argc >= 3 && strcmp(argv[1], "-S") == 0) {
+    /* jasm -S binary */
+    return exit_status(label_file(argv[2]));
+  }
+  if (argc >= 4 && strcmp(argv[1], "-m") == 0) {
+    /* jasm -m map binary, map a NASM map file or "offset name" lines */
+    return exit_status(map_file(argv[2], argv[3]));
+  }
+  if (argc >= 3 && strcmp(argv[1], "-r") == 0) {
+    /* jasm -r binary [entry offset] */
+    size_t entry = argc >= 4 ? (size_t)strtoull(argv[3], NULL, 0) : 0;
+    return exit_status(trace_file(argv[2], entry));
+  }
+  if (argc >= 5 && strcmp(argv[1], "-g") == 0) {
+    /* jasm -g binary index.cfg graph.dot [entry offset] */
+    size_t entry = argc >= 6 ? (size_t)strtoull(argv[5], NULL, 0) : 0;
+    return exit_status(graph_file(argv[2], argv[3], argv[4], entry));
+  }
+  if (argc >= 5 && strcmp(argv[1], "-l") == 0) {
+    /* jasm -l binary listing index */
+    return exit_status(list_file(argv[2], argv[3], argv[4]));
+  }
+  if (argc >= 7 && strcmp(argv[1], "-u") == 0) {
+    /* jasm -u binary listing index first last, bytes [first, last) patched */
+    size_t first = (size_t)strtoull(argv[5], NULL, 0);
+    size_t last = (size_t)strtoull(argv[6], NULL, 0);
+    return exit_status(relist_file(argv[2], argv[3], argv[4], first, last));
+  }
+  if (argc >= 3 && strcmp(argv[1], "-b") == 0) {
+    /* jasm -b manifest|directory [threads] */
+    size_t thread_count = argc >= 4 ? (size_t)strtoull(argv[3], NULL, 0) : 0;
+    return exit_status(batch_files(argv[2], thread_count));
+  }
+  if (argc >= 2) {
+    /* jasm [-s offset] [-n length] [-f text|records|json] file... with "-" for stdin */
+    size_t offset = 0;
+    size_t length = SIZE_MAX;
+    int format = FORMAT_TEXT;
+    int idx = 1;
+    error_t error_code;
+    for (; idx + 1 < argc && (strcmp(argv[idx], "-s") == 0 || strcmp(argv[idx], "-n") == 0 ||
+                              strcmp(argv[idx], "-f") == 0); idx += 2) {
+      if (argv[idx][1] == 's') {
+        offset = (size_t)strtoull(argv[idx + 1], NULL, 0);
+      } else if (argv[idx][1] == 'n') {
+        length = (size_t)strtoull(argv[idx + 1], NULL, 0);
+      } else {
+        format = parse_format(argv[idx + 1]);
+      }
+    }
+    if (idx < argc && strcmp(argv[idx], "--") == 0) {
+      idx++;
+    } else {
+      for (int name = idx; name < argc; ++name) {
+        if (argv[name][0] == '-' && argv[name][1] != '\0') {
+          /* An unknown option, or a command missing its arguments */
+          print_usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+      }
+    }
+    if (format < 0) {
+      return exit_status(JASM_SYNTAX_ERROR);
+    }
+    if (idx == argc) {
+      error_code = stream_files(1, (char *[]){"-"}, offset, length, (uint8_t)format);
+    } else {
+      error_code = stream_files(argc - idx, argv + idx, offset, length, (uint8_t)format);
+    }
+    if (format == FORMAT_TEXT) {
+      dump_error_code(error_code);
+    } else if (error_code != JASM_SUCCESS) {
+      /* Keep machine-readable output free of the status line */
+      fprintf(stderr, "%s\n", error_message(error_code));
+    }
+    return error_code == JASM_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  return exit_status(dump_file("test"));
+}
 
-char byte_registers[8][3] = {"al", "cl", "dl", "bl", "ah", "ch", "dh", "bh"};
-char word_registers[8][3] = {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di"};
-char eac_table[24][20] = {
-  "(bx) + (si)", 
-  "(bx) + (di)", 
-  "(bp) + (si)", 
-  "(bp) + (di)", 
-  "(si)", "(di)", 
-  "direct address", 
-  "(bx)", 
-  "(bx) + (si) + d8", 
-  "(bx) + (di) + d8", 
-  "(bp) + (si) + d8", 
-  "(bp) + (di) + d8", 
-  "(si) + d8", 
-  "(di) + d8", 
-  "(bp) + d8", 
-  "(bx) + d8", 
-  "(bx) + (si) + d16", 
-  "(bx) + (di) + d16", 
-  "(bp) + (si) + d16", 
-  "(bp) + (di) + d16", 
-  "(si) + d16", 
-  "(di) + d16", 
-  "(bp) + d16", 
-  "(bx) + d16"
-};
-char output[STRING_SIZE];
-uint32_t byte_count;
-uint8_t bytecode[BUFFER_SIZE + 1];
+error_t dump_file(char *binary_name) {
+  /** Dump file
+   * Lists a mapped binary, in parallel when it is large
+   */
+  char output[OUTPUT_SIZE];
+  binary_file_t binary;
+  writer_t writer;
+  disassembler_t context;
+  error_t error_code = load_binary_file(binary_name, &binary);
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  init_writer(&writer, STDOUT_FILENO, OUTPUT_SIZE, output);
+  init_disassembler(&context, binary.bytes, binary.byte_count, &writer);
+  error_code = dump_buffer(&context);
+  unload_binary_file(&binary);
+  return error_code;
+}
+
+error_t assemble_file(char *source_name, char *binary_name) {
+  /** Assemble file
+   * Assembles a source file, read in place, into a flat binary
+   */
+  binary_file_t source;
+  assembler_t assembler;
+  error_t error_code = load_binary_file(source_name, &source);
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  init_assembler(&assembler);
+  error_code = assemble(&assembler, (const char *)source.bytes, source.byte_count);
+  if (error_code == JASM_SUCCESS) {
+    error_code = save_binary_file(binary_name, (const uint8_t *)assembler.output.buffer, assembler.output.idx);
+  } else {
+    fprintf(stderr, "%s:%u: ", source_name, (unsigned)assembler.error_line);
+  }
+  free_assembler(&assembler);
+  unload_binary_file(&source);
+  return error_code;
+}
 
+error_t list_symbols(const binary_file_t *binary, const symbol_index_t *index, uint8_t options) {
+  /* Linear listing of a binary to stdout, named from a symbol index */
+  char output[OUTPUT_SIZE];
+  writer_t writer;
+  disassembler_t context;
+  init_writer(&writer, STDOUT_FILENO, OUTPUT_SIZE, output);
+  init_disassembler(&context, binary->bytes, binary->byte_count, &writer);
+  context.symbols = index;
+  context.options |= options;
+  return dump_buffer(&context);
+}
 
-void display_bits(uint8_t byte);
-void dump_buffer(uint8_t *bytecode_buffer, uint32_t byte_count);
-void disassemble_8086(uint8_t byte_1, uint8_t byte_2);
+error_t label_file(char *binary_name) {
+  /** Label file
+   * Linear listing of a binary with a label line before every branch
+   * target and branches written to their labels
+   */
+  binary_file_t binary;
+  symbol_table_t symbols;
+  symbol_index_t index;
+  string_t exported;
+  error_t error_code = load_binary_file(binary_name, &binary);
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  init_symbol_table(&symbols);
+  init_string(&exported, 0, NULL);
+  error_code = label_linear_targets(&symbols, binary.bytes, binary.byte_count);
+  if (error_code == JASM_SUCCESS) {
+    error_code = export_symbol_index(&symbols, &exported);
+  }
+  if (error_code == JASM_SUCCESS) {
+    error_code = open_symbol_index((const uint8_t *)exported.buffer, exported.idx, &index);
+  }
+  if (error_code == JASM_SUCCESS) {
+    error_code = list_symbols(&binary, &index, 0);
+  }
+  free_string(&exported);
+  free_symbol_table(&symbols);
+  unload_binary_file(&binary);
+  return error_code;
+}
+
+error_t map_file(char *map_name, char *binary_name) {
+  /** Map file
+   * Linear listing of a binary named from a symbol map, each line ending
+   * with the symbol it falls in. The map's index is cached beside it as
+   * map.idx, so later runs start without reading the map.
+   */
+  binary_file_t binary, index_file;
+  symbol_index_t index;
+  string_t exported;
+  error_t error_code = load_binary_file(binary_name, &binary);
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  init_string(&exported, 0, NULL);
+  error_code = open_map_index(map_name, &index_file, &exported, &index);
+  if (error_code == JASM_SUCCESS) {
+    error_code = list_symbols(&binary, &index, LIST_ANNOTATE);
+  }
+  if (index_file.bytes != NULL) {
+    unload_binary_file(&index_file);
+  }
+  free_string(&exported);
+  unload_binary_file(&binary);
+  return error_code;
+}
+
+error_t trace_file(char *binary_name, size_t entry) {
+  /** Trace file
+   * Recursive-descent listing of a binary from an entry offset, with
+   * labels on branch targets and unreached bytes listed as data
+   */
+  binary_file_t binary;
+  char output[OUTPUT_SIZE];
+  writer_t writer;
+  flow_t flow;
+  error_t error_code = load_binary_file(binary_name, &binary);
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  error_code = init_flow(&flow, binary.bytes, binary.byte_count);
+  if (error_code == JASM_SUCCESS) {
+    error_code = trace_flow(&flow, entry);
+    if (error_code == JASM_SUCCESS) {
+      init_writer(&writer, STDOUT_FILENO, OUTPUT_SIZE, output);
+      error_code = dump_flow(&writer, &flow);
+    }
+    free_flow(&flow);
+  }
+  unload_binary_file(&binary);
+  return error_code;
+}
+
+error_t graph_file(char *binary_name, char *index_name, char *dot_name, size_t entry) {
+  /** Graph file
+   * Traces a binary from an entry offset and writes its control-flow
+   * graph as a binary index and as Graphviz text
+   */
+  binary_file_t binary;
+  flow_t flow;
+  cfg_t cfg;
+  string_t output;
+  error_t error_code = load_binary_file(binary_name, &binary);
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  error_code = init_flow(&flow, binary.bytes, binary.byte_count);
+  if (error_code == JASM_SUCCESS) {
+    error_code = trace_flow(&flow, entry);
+    if (error_code == JASM_SUCCESS) {
+      error_code = build_cfg(&cfg, &flow);
+    }
+    if (error_code == JASM_SUCCESS) {
+      init_string(&output, BUFFER_SIZE, NULL);
+      error_code = export_cfg_index(&cfg, &output);
+      if (error_code == JASM_SUCCESS) {
+        error_code = save_binary_file(index_name, (const uint8_t *)output.buffer, output.idx);
+      }
+      clear_string(&output);
+      if (error_code == JASM_SUCCESS) {
+        error_code = export_cfg_dot(&cfg, &flow, &output);
+      }
+      if (error_code == JASM_SUCCESS) {
+        error_code = save_binary_file(dot_name, (const uint8_t *)output.buffer, output.idx);
+      }
+      free_string(&output);
+      free_cfg(&cfg);
+    }
+    free_flow(&flow);
+  }
+  unload_binary_file(&binary);
+  return error_code;
+}
 
-int main(void) {
-  uint8_t error_code;
-  error_code = load_binary_file("test", bytecode, &byte_count);
-  dump_buffer(bytecode, byte_count);
+int exit_status(error_t error_code) {
+  /* Prints the status line and maps it to the process exit status */
   dump_error_code(error_code);
-  return 0;
+  return error_code == JASM_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
-void display_bits(uint8_t byte) {
-  /** Display bits
-   * Prints the binary content of a byte
+void print_usage(const char *program) {
+  /** print_usage
+   * Lists the commands main accepts, on stderr
    */
-  for (uint8_t idx = 8; idx > 0; --idx) {
-    putchar(byte & (1u << (idx - 1)) ? '1' : '0');
+  fprintf(stderr,
+          "usage: %s [-s offset] [-n length] [-f text|records|json] [--] file...\n"
+          "       %s -a source.asm [-o binary]\n"
+          "       %s -e|-t|-j binary [instruction limit]\n"
+          "       %s -S binary\n"
+          "       %s -m map binary\n"
+          "       %s -r binary [entry offset]\n"
+          "       %s -g binary index.cfg graph.dot [entry offset]\n"
+          "       %s -l binary listing index\n"
+          "       %s -u binary listing index first last\n"
+          "       %s -b manifest|directory [threads]\n",
+          program, program, program, program, program, program, program, program, program, program);
+}
+
+int parse_format(const char *name) {
+  /* list_format_t named on the command line, -1 for an unknown name */
+  if (strcmp(name, "text") == 0) {
+    return FORMAT_TEXT;
   }
+  if (strcmp(name, "records") == 0) {
+    return FORMAT_RECORDS;
+  }
+  if (strcmp(name, "json") == 0) {
+    return FORMAT_JSON;
+  }
+  return -1;
 }
 
-void dump_buffer(uint8_t *bytecode_buffer, uint32_t byte_count) {
-  /** Dump buffer
-   * Prints the binary contents of every byte in a buffer
+error_t list_mapped_file(writer_t *writer, char *file_name, uint8_t format) {
+  /* dump_buffer over a whole file, mapped, in a list_format_t and in parallel when it is large */
+  binary_file_t binary;
+  disassembler_t context;
+  error_t error_code = load_binary_contents(file_name, &binary);
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  init_disassembler(&context, binary.bytes, binary.byte_count, writer);
+  context.format = format;
+  error_code = dump_buffer(&context);
+  unload_binary_file(&binary);
+  return error_code;
+}
+
+error_t stream_files(int file_count, char **file_names, size_t offset, size_t length, uint8_t format) {
+  /** Stream files
+   * Lists length bytes of every file from offset. Whole regular files are
+   * mapped and listed by dump_buffer, in parallel when they are large;
+   * stdin, pipes and offset or length windows go through a fixed-size
+   * ring, so they list in constant memory. With several files each text
+   * listing is preceded by its file name and each JSON one by a
+   * {"file": name} line; record streams are told apart by their headers.
    */
-  puts("=======<DISASSEMBLY OUTPUT>=======");
-  for (uint32_t idx = 0; idx < byte_count; idx += 2) {
-    printf("%04d ", idx); /* Missing error handling case */
-    display_bits(bytecode_buffer[idx]);
-    putchar(' ');
-    display_bits(bytecode_buffer[idx + 1]);
-    putchar(' ');
-    disassemble_8086(bytecode_buffer[idx], bytecode_buffer[idx + 1]);
-    putchar('\n');
+  char output[OUTPUT_SIZE];
+  char text[STRING_SIZE];
+  string_t name;
+  writer_t writer;
+  stream_t stream;
+  struct stat status;
+  error_t error_code = JASM_SUCCESS;
+  init_writer(&writer, STDOUT_FILENO, OUTPUT_SIZE, output);
+  init_string(&name, STRING_SIZE, text);
+  for (int idx = 0; idx < file_count && error_code == JASM_SUCCESS; ++idx) {
+    if (file_count > 1) {
+      clear_string(&name);
+      append_file_header(format, strlen(file_names[idx]), file_names[idx], &name);
+      write_bytes(&writer, name.idx, name.buffer);
+    }
+    if (offset == 0 && length == SIZE_MAX && strcmp(file_names[idx], "-") != 0 &&
+        stat(file_names[idx], &status) == 0 && S_ISREG(status.st_mode)) {
+      error_code = list_mapped_file(&writer, file_names[idx], format);
+      continue;
+    }
+    error_code = open_stream(&stream, file_names[idx], offset, length);
+    if (error_code == JASM_SUCCESS) {
+      error_code = dump_stream(&writer, &stream, format);
+      if (close_stream(&stream) != JASM_SUCCESS && error_code == JASM_SUCCESS) {
+        error_code = JASM_FILE_CLOSE_ERROR;
+      }
+    }
   }
+  flush_writer(&writer);
+  free_string(&name);
+  return error_code;
 }
 
-void disassemble_8086(uint8_t byte_1, uint8_t byte_2) {
-  uint8_t opcode = (byte_1 & OPCODE_MASK) >> 2;
-  uint8_t d_bit = (byte_1 & D_MASK) >> 1;
-  uint8_t w_bit = (byte_1 & W_MASK) >> 0;
-  uint8_t mod = (byte_2 & MOD_MASK) >> 6;
-  uint8_t reg = (byte_2 & REG_MASK) >> 3;
-  uint8_t rm = (byte_2 & RM_MASK) >> 0;
-  uint8_t eacidx = (mod << 3) | rm;
-  string_t string;
-  init_string(&string, STRING_SIZE, output);
-  switch (opcode) {
-    case 0b00000000:
-      /* ADD
-       * Register/memory with register to either
-       */
-      break;
-    case 0b00000001:
-      /* ADD
-       * Register/memory with register to either
-       */
-      break;
-    case 0b00000010:
-      /* ADD
-       * Register/memory with register to either
-       */
-      break;
-    case 0b00000011:
-      /* ADD
-       * Register/memory with register to either
-       */
-      break;
-    case 0b00000100:
-      /* ADD
-       * Immediate to accumulator
-       */
-      break;
-    case 0b00000101:
-      /* ADD
-       * Immediate to accumulator
-       */
-      break;
-    case 0b00000110:
-      /** PUSH
-       * Segment register 
-       */
-      break;
-    case 0b00000111:
-      /** POP
-       * Segment register
-       */
-      break;
-    case 0b00001000:
-      /** OR
-       * Register/memory and register to either
-       */
-      break;
-    case 0b00001001:
-      /** OR
-       * Register/memory and register to either
-       */
-      break;
-    case 0b00001010:
-      /** OR
-       * Register/memory and register to either
-       */
-      break;
-    case 0b00001011:
-      /** OR
-       * Register/memory and register to either
-       */
-      break;
-    case 0b00001100:
-      /** OR
-       * Immediate to accumulator
-       */
-      break;
-    case 0b00001101:
-      /** OR
-       * Immediate to accumulator
-       */
-      break;
-    case 0b00001110:
-      /** PUSH
-       * Segment register 
-       */
-      break;
-    case 0b00001111:
-      /** POP
-       * Segment register
-       */
-      break;
-    case 0b00010000:
-      /** ADC
-       * Add with carry
-       * Register/memory with register to either
-       */
-      /** TEST
-       * And function to flags no result
-       * Register/memory and register
-       */
-      break;
-    case 0b00010001:
-      /** ADC
-       * Add with carry
-       * Register/memory with register to either
-       */
-      /** TEST
-       * And function to flags no result
-       * Register/memory and register
-       */
-      break;
-    case 0b00010010:
-      /** ADC
-       * Add with carry
-       * Register/memory with register to either
-       */
-      /** TEST
-       * And function to flags no result
-       * Register/memory and register
-       */
-      break;
-    case 0b00010011:
-      /** ADC
-       * Add with carry
-       * Register/memory with register to either
-       */
-      /** TEST
-       * And function to flags no result
-       * Register/memory and register
-       */
-      break;
-    case 0b00010100:
-      /** ADC
-       * Add with carry
-       * Immediate to ccumulator
-       */
-      break;
-    case 0b00010101:
-      /** ADC
-       * Add with carry
-       * Immediate to ccumulator
-       */
-      break;
-    case 0b00010110:
-      /** PUSH
-       * Segment register 
-       */
-      break;
-    case 0b00010111:
-      /** POP
-       * Segment register
-       */
-      break;
-    case 0b00011000:
-      /** SBB
-       * Subtract with borrow
-       * Register/memory and register to either
-       */
-      break;
-    case 0b00011001:
-      /** SBB
-       * Subtract with borrow
-       * Register/memory and register to either
-       */
-      break;
-    case 0b00011010:
-      /** SBB
-       * Subtract with borrow
-       * Register/memory and register to either
-       */
-      break;
-    case 0b00011011:
-      /** SBB
-       * Subtract with borrow
-       * Register/memory and register to either
-       */
-      break;
-    case 0b00011100:
-      /** SBB
-       * Subtract with borrow
-       * Immediate from accumulator
-       */
-      break;
-    case 0b00011101:
-      /** SBB
-       * Subtract with borrow
-       * Immediate from accumulator
-       */
-      break;
-    case 0b00011110:
-      /** PUSH
-       * Segment register 
-       */
-      break;
-    case 0b00011111:
-      /** POP
-       * Segment register
-       */
-      break;
-    case 0b00100000:
-      /** AND
-       * Register/memory with register to either
-       */
-      break;
-    case 0b00100001:
-      /** AND
-       * Register/memory with register to either
-       */
-      break;
-    case 0b00100010:
-      /** AND
-       * Register/memory with register to either
-       */
-      break;
-    case 0b00100011:
-      /** AND
-       * Register/memory with register to either
-       */
-      break;
-    case 0b00100100:
-      /** AND
-       * Immediate to accumulator
-       */
-      break;
-    case 0b00100101:
-      /** AND
-       * Immediate to accumulator
-       */
-      break;
-    case 0b00100110:
-      /** SEGMENT
-       * Override prefix
-       */
-      break;
-    case 0b00100111:
-      /** DAA
-       * Decimal adjust for add
-       */
-      break;
-    case 0b00101000:
-      /** SUB
-       * Subtract
-       * Register/memory and register to either
-       */
-      break;
-    case 0b00101001:
-      /** SUB
-       * Subtract
-       * Register/memory and register to either
-       */
-      break;
-    case 0b00101010:
-      /** SUB
-       * Subtract
-       * Register/memory and register to either
-       */
-      break;
-    case 0b00101011:
-      /** SUB
-       * Subtract
-       * Register/memory and register to either
-       */
-      break;
-    case 0b00101100:
-      /** SUB
-       * Subtract
-       * Immediate from accumulator
-       */
-      break;
-    case 0b00101101:
-      /** SUB
-       * Subtract
-       * Immediate from accumulator
-       */
-      break;
-    case 0b00101110:
-      /** SEGMENT
-       * Override prefix
-       */
-      break;
-    case 0b00101111:
-      /** DAS
-       * Decimal adjust for subtract
-       */
-      break;
-    case 0b00110000:
-      /** XOR
-       * Exclusive or
-       * Register/memory and register to either
-       */
-      break;
-    case 0b00110001:
-      /** XOR
-       * Exclusive or
-       * Register/memory and register to either
-       */
-      break;
-    case 0b00110010:
-      /** XOR
-       * Exclusive or
-       * Register/memory and register to either
-       */
-      break;
-    case 0b00110011:
-      /** XOR
-       * Exclusive or
-       * Register/memory and register to either
-       */
-      break;
-    case 0b00110100:
-      /** XOR
-       * Exclusive or
-       * Immediate to register/memory
-       */
-      /** XOR
-       * Exclusive or
-       * Immediate to accumulator
-       */
-      break;
-    case 0b00110101:
-      /** XOR
-       * Exclusive or
-       * Immediate to register/memory
-       */
-      /** XOR
-       * Exclusive or
-       * Immediate to accumulator
-       */
-      break;
-    case 0b00110110:
-      /** SEGMENT
-       * Override prefix
-       */
-      break;
-    case 0b00110111:
-      /** AAA
-       * ASCII adjust for add
-       */
-      break;
-    case 0b00111000:
-      /** CMP
-       * Compare
-       * Register/memory and register
-       */
-      break;
-    case 0b00111001:
-      /** CMP
-       * Compare
-       * Register/memory and register
-       */
-      break;
-    case 0b00111010:
-      /** CMP
-       * Compare
-       * Register/memory and register
-       */
-      break;
-    case 0b00111011:
-      /** CMP
-       * Compare
-       * Register/memory and register
-       */
-      break;
-    case 0b00111100:
-      /** CMP
-       * Compare
-       * Immediate with accumulator
-       */
-      break;
-    case 0b00111101:
-      /** CMP
-       * Compare
-       * Immediate with accumulator
-       */
-      break;
-    case 0b00111110:
-      /** SEGMENT
-       * Override prefix
-       */
-      break;
-    case 0b00111111:
-      /** AAS
-       * ASCII adjust for subtract
-       */
-      break;
-    case 0b01000000:
-      /** INC
-       * Increment
-       * Register
-       */
-      break;
-    case 0b01000001:
-      /** INC
-       * Increment
-       * Register
-       */
-      break;
-    case 0b01000010:
-      /** INC
-       * Increment
-       * Register
-       */
-      break;
-    case 0b01000011:
-      /** INC
-       * Increment
-       * Register
-       */
-      break;
-    case 0b01000100:
-      /** INC
-       * Increment
-       * Register
-       */
-      break;
-    case 0b01000101:
-      /** INC
-       * Increment
-       * Register
-       */
-      break;
-    case 0b01000110:
-      /** INC
-       * Increment
-       * Register
-       */
-      break;
-    case 0b01000111:
-      /** INC
-       * Increment
-       * Register
-       */
-      break;
-    case 0b01001000:
-      /** DEC
-       * Decrement
-       * Register
-       */
-      break;
-    case 0b01001001:
-      /** DEC
-       * Decrement
-       * Register
-       */
-      break;
-    case 0b01001010:
-      /** DEC
-       * Decrement
-       * Register
-       */
-      break;
-    case 0b01001011:
-      /** DEC
-       * Decrement
-       * Register
-       */
-      break;
-    case 0b01001100:
-      /** DEC
-       * Decrement
-       * Register
-       */
-      break;
-    case 0b01001101:
-      /** DEC
-       * Decrement
-       * Register
-       */
-      break;
-    case 0b01001110:
-      /** DEC
-       * Decrement
-       * Register
-       */
-      break;
-    case 0b01001111:
-      /** DEC
-       * Decrement
-       * Register
-       */
-      break;
-    case 0b01010000:
-      /** PUSH
-       * Register 
-       */
-      break;
-    case 0b01010001:
-      /* Register */
-      break;
-    case 0b01010010:
-      /* Register */
-      break;
-    case 0b01010011:
-      /* Register */
-      break;
-    case 0b01010100:
-      /* Register */
-      break;
-    case 0b01010101:
-      /* Register */
-      break;
-    case 0b01010110:
-      /* Register */
-      break;
-    case 0b01010111:
-      /* Register */
-      break;
-    case 0b01011000:
-      /** POP
-       * Register
-       */
-      break;
-    case 0b01011001:
-      /** POP
-       * Register
-       */
-      break;
-    case 0b01011010:
-      /** POP
-       * Register
-       */
-      break;
-    case 0b01011011:
-      /** POP
-       * Register
-       */
-      break;
-    case 0b01011100:
-      /** POP
-       * Register
-       */
-      break;
-    case 0b01011101:
-      /** POP
-       * Register
-       */
-      break;
-    case 0b01011110:
-      /** POP
-       * Register
-       */
-      break;
-    case 0b01011111:
-      /** POP
-       * Register
-       */
-      break;
-    case 0b01100000:
-      break;
-    case 0b01100001:
-      break;
-    case 0b01100010:
-      break;
-    case 0b01100011:
-      break;
-    case 0b01100100:
-      break;
-    case 0b01100101:
-      break;
-    case 0b01100110:
-      break;
-    case 0b01100111:
-      break;
-    case 0b01101000:
-      break;
-    case 0b01101001:
-      break;
-    case 0b01101010:
-      break;
-    case 0b01101011:
-      break;
-    case 0b01101100:
-      break;
-    case 0b01101101:
-      break;
-    case 0b01101110:
-      break;
-    case 0b01101111:
-      break;
-    case 0b01110000:
-      /** JO
-       * Jump on overflow
-       */
-      break;
-    case 0b01110001:
-      /** JNO
-       * Jump on not overflow
-       */
-      break;
-    case 0b01110010:
-      /** JB/JNAE
-       * Jump on below/not above or equal
-       */
-      break;
-    case 0b01110011:
-      /** JNB/JAE
-       * Jump on not below/above or equal
-       */
-      break;
-    case 0b01110100:
-      /** JE/JZ
-       * Jump on equal/zero
-       */
-      break;
-    case 0b01110101:
-      /** JNE/JNZ
-       * Jump on not equal/not zero
-       */
-      break;
-    case 0b01110110:
-      /** JBE/JNA
-       * Jump on below or equal/not above
-      */
-      break;
-    case 0b01110111:
-      /** JNBE/JA
-       * Jump on not below or equal/above
-       */
-      break;
-    case 0b01111000:
-      /** JS
-       * Jump on sign
-       */
-      break;
-    case 0b01111001:
-      /** JNS
-       * Jump on not sign
-       */
-      break;
-    case 0b01111010:
-      /** JP/JPE
-       * Jump on parity/parity even
-       */
-      break;
-    case 0b01111011:
-      /** JNP/JPO
-       * Jump on not par/par odd
-       */
-      break;
-    case 0b01111100:
-      /** JL/JNGE 
-       * Jump on less/not greater or equal
-       */
-      break;
-    case 0b01111101:
-      /** JNL/JGE 
-       * Jump on not less/greater or equal
-       */
-      break;
-    case 0b01111110:
-      /** JLE/JNG 
-       * Jump on less or equal/not greater
-      */
-      break;
-    case 0b01111111:
-      /** JNLE/JG
-       * Jump on not less or equal/greater
-       */
-      break;
-    case 0b10000000:
-      /* ADD
-       * Immediate to register/memory
-       */
-      /* ADC
-       * Add with carry
-       * Immediate to register/memory
-       */
-      /** SUB
-       * Subtract
-       * Immediate from register/memory
-       */
-      /** SBB
-       * Subtract with borrow
-       * Immediate from register/memory
-       */
-      /** CMP
-       * Compare
-       * Immediate with register/memory
-       */
-      /** AND
-       * Immediate to register/memory
-       */
-      /** OR
-       * Immediate to register/memory
-       */
-      break;
-    case 0b10000001:
-      /* ADD
-       * Immediate to register/memory
-       */
-      /* ADC
-       * Add with carry
-       * Immediate to register/memory
-       */
-      /** SUB
-       * Subtract
-       * Immediate from register/memory
-       */
-      /** SBB
-       * Subtract with borrow
-       * Immediate from register/memory
-       */
-      /** CMP
-       * Compare
-       * Immediate with register/memory
-       */
-      /** AND
-       * Immediate to register/memory
-       */
-      /** OR
-       * Immediate to register/memory
-       */
-      break;
-    case 0b10000010:
-      /* ADD
-       * Immediate to register/memory
-       */
-      /* ADC
-       * Add with carry
-       * Immediate to register/memory
-       */
-      /** SUB
-       * Subtract
-       * Immediate from register/memory
-       */
-      /** SBB
-       * Subtract with borrow
-       * Immediate from register/memory
-       */
-      /** CMP
-       * Compare
-       * Immediate with register/memory
-       */
-      break;
-    case 0b10000011:
-      /* ADD
-       * Immediate to register/memory
-       */
-      /* ADC
-       * Add with carry
-       * Immediate to register/memory
-       */
-      /** SUB
-       * Subtract
-       * Immediate from register/memory
-       */
-      /** SBB
-       * Subtract with borrow
-       * Immediate from register/memory
-       */
-      /** CMP
-       * Compare
-       * Immediate with register/memory
-       */
-      break;
-    case 0b10000100:
-      break;
-    case 0b10000101:
-      break;
-    case 0b10000110:
-      /** XCHG
-       * Register/memory with register
-       */
-      break;
-    case 0b10000111:
-      /** XCHG
-       * Register/memory with register
-       */
-      break;
-    case 0b10001000:
-      /** MOV
-       * Register/memory to/from register 
-       */
-      break;
-    case 0b10001001:
-      /** MOV
-       * Register/memory to/from register 
-       */
-      break;
-    case 0b10001010:
-      /* Immediate to register/memory */
-      break;
-    case 0b10001011:
-      /* Immediate to register/memory */
-      break;
-    case 0b10001100:
-      /* Segment register to register/memory */
-      break;
-    case 0b10001101:
-      /** LEA
-       * Load EA to register
-       */
-      break;
-    case 0b10001110:
-      /** MOV
-       * Register/memory to segment register 
-       */
-      break;
-    case 0b10001111:
-      /** POP
-       * Register/memory 
-       */
-      break;
-    case 0b10010000:
-      /** XCHG
-       * Register with accumulator
-       */
-      break;
-    case 0b10010001:
-      /** XCHG
-       * Register with accumulator
-       */
-      break;
-    case 0b10010010:
-      /** XCHG
-       * Register with accumulator
-       */
-      break;
-    case 0b10010011:
-      /** XCHG
-       * Register with accumulator
-       */
-      break;
-    case 0b10010100:
-      /** XCHG
-       * Register with accumulator
-       */
-      break;
-    case 0b10010101:
-      /** XCHG
-       * Register with accumulator
-       */
-      break;
-    case 0b10010110:
-      /** XCHG
-       * Register with accumulator
-       */
-      break;
-    case 0b10010111:
-      /** XCHG
-       * Register with accumulator
-       */
-      break;
-    case 0b10011000:
-      /** CBW
-       * Convert byte to word
-       */
-      break;
-    case 0b10011001:
-      /** CWD
-       * Convert word to double word
-       */
-      break;
-    case 0b10011010:
-      /** CALL
-       * Direct intersegment
-       */
-      break;
-    case 0b10011011:
-      /** WAIT
-       * Wait 
-       */
-      append_string(&string, 5, "wait");
-      break;
-    case 0b10011100:
-      /** PUSHF
-       * Push flags
-       */
-      break;
-    case 0b10011101:
-      /** POPF
-       * Pop flags
-       */
-      break;
-    case 0b10011110:
-      /** SAHF
-       * Store AH into flags
-       */
-      break;
-    case 0b10011111:
-      /** LAHF
-       * Load AH with flags
-       */
-      break;
-    case 0b10100000:
-      /* Memory to accumulator */
-      break;
-    case 0b10100001:
-      /* Memory to accumulator */
-      break;
-    case 0b10100010:
-      /* Accumulator to memory */
-      break;
-    case 0b10100011:
-      /* Accumulator to memory */
-      break;
-    case 0b10100100:
-      /** MOVS
-       * Move byte/word
-       */
-      break;
-    case 0b10100101:
-      /** MOVS
-       * Move byte/word
-       */
-      break;
-    case 0b10100110:
-      /** CMPS
-       * Compare byte/word
-       */
-      break;
-    case 0b10100111:
-      /** CMPS
-       * Compare byte/word
-       */
-      break;
-    case 0b10101000:
-      /** TEST
-       * And function to flags no result
-       * Immediate data and accumulator
-       */
-      break;
-    case 0b10101001:
-      /** TEST
-       * And function to flags no result
-       * Immediate data and accumulator
-       */
-      break;
-    case 0b10101010:
-      /** STDS
-       * Store byte/word from AL/AX
-       */
-      break;
-    case 0b10101011:
-      /** STDS
-       * Store byte/word from AL/AX
-       */
-      break;
-    case 0b10101100:
-      /** LODS
-       * Load byte/word to AL/AX
-       */
-      break;
-    case 0b10101101:
-      /** LODS
-       * Load byte/word to AL/AX
-       */
-      break;
-    case 0b10101110:
-      /** SCAS
-       * Scan byte/word
-       */
-      break;
-    case 0b10101111:
-      /** SCAS
-       * Scan byte/word
-       */
-      break;
-    case 0b10110000:
-      /* Immediate to register */
-      break;
-    case 0b10110001:
-      /* Immediate to register */
-      break;
-    case 0b10110010:
-      /* Immediate to register */
-      break;
-    case 0b10110011:
-      /* Immediate to register */
-      break;
-    case 0b10110100:
-      /* Immediate to register */
-      break;
-    case 0b10110101:
-      /* Immediate to register */
-      break;
-    case 0b10110110:
-      /* Immediate to register */
-      break;
-    case 0b10110111:
-      /* Immediate to register */
-      break;
-    case 0b10111000:
-      /* Immediate to register */
-      break;
-    case 0b10111001:
-      /* Immediate to register */
-      break;
-    case 0b10111010:
-      /* Immediate to register */
-      break;
-    case 0b10111011:
-      /* Immediate to register */
-      break;
-    case 0b10111100:
-      /* Immediate to register */
-      break;
-    case 0b10111101:
-      /* Immediate to register */
-      break;
-    case 0b10111110:
-      /* Immediate to register */
-      break;
-    case 0b10111111:
-      /* Immediate to register */
-      break;
-    case 0b11000000:
-      break;
-    case 0b11000001:
-      break;
-    case 0b11000010:
-      /** RET
-       * Return from call
-       * Within segment adding immediate to SP
-       */
-      break;
-    case 0b11000011:
-      /** RET
-       * Return from call
-       * Within segment
-       */
-      break;
-    case 0b11000100:
-      /** LES
-       * Load pointer to ES
-       */
-      break;
-    case 0b11000101:
-      /** LDS
-       * Load pointer to DS
-       */
-      break;
-    case 0b11000110:
-      break;
-    case 0b11000111:
-      break;
-    case 0b11001000:
-      break;
-    case 0b11001001:
-      break;
-    case 0b11001010:
-      /** RET
-       * Return from call
-       * Intersegment adding immediate to SP
-       */
-      break;
-    case 0b11001011:
-      /** RET
-       * Return from call
-       * Intersegment
-       */
-      break;
-    case 0b11001100:
-      /** INT
-       * Interrupt
-       * Type 3
-       */
-      break;
-    case 0b11001101:
-      /** INT
-       * Interrupt
-       * Type specified
-       */
-      break;
-    case 0b11001110:
-      /** INTO
-       * Interrupt on overflow
-       */
-      break;
-    case 0b11001111:
-      /** IRET
-       * Interrupt return
-       */
-      break;
-    case 0b11010000:
-      /** SHL/SAL
-       * Shift logical/arithmetic left
-       */
-      /** SHR
-       * Shift logical right
-       */
-      /** SAR
-       * Shift arithmetic right
-       */
-      /** ROL
-       * Rotate left
-       */
-      /** ROR
-       * Rotate right
-       */
-      /** RCL
-       * Rotate through carry flag left
-       */
-      /** RCR
-       * Rotate through carry right
-       */
-      break;
-    case 0b11010001:
-      /** SHL/SAL
-       * Shift logical/arithmetic left
-       */
-      /** SHR
-       * Shift logical right
-       */
-      /** SAR
-       * Shift arithmetic right
-       */
-      /** ROL
-       * Rotate left
-       */
-      /** ROR
-       * Rotate right
-       */
-      /** RCL
-       * Rotate through carry flag left
-       */
-      /** RCR
-       * Rotate through carry right
-       */
-      break;
-    case 0b11010010:
-      /** SHL/SAL
-       * Shift logical/arithmetic left
-       */
-      /** SHR
-       * Shift logical right
-       */
-      /** SAR
-       * Shift arithmetic right
-       */
-      /** ROL
-       * Rotate left
-       */
-      /** ROR
-       * Rotate right
-       */
-      /** RCL
-       * Rotate through carry flag left
-       */
-      /** RCR
-       * Rotate through carry right
-       */
-      break;
-    case 0b11010011:
-      /** SHL/SAL
-       * Shift logical/arithmetic left
-       */
-      /** SHR
-       * Shift logical right
-       */
-      /** SAR
-       * Shift arithmetic right
-       */
-      /** ROL
-       * Rotate left
-       */
-      /** ROR
-       * Rotate right
-       */
-      /** RCL
-       * Rotate through carry flag left
-       */
-      /** RCR
-       * Rotate through carry right
-       */
-      break;
-    case 0b11010100:
-      /** AAM
-       * ASCII adjust for multiply
-       */
-      break;
-    case 0b11010101:
-      /** AAD
-       * ASCII adjust for divide
-       */
-      break;
-    case 0b11010110:
-      break;
-    case 0b11010111:
-      /** XLAT
-       * Translate byte to AL
-       */
-      break;
-    case 0b11011000:
-      /** ESC
-       * Escape (to external device)
-       */
-      break;
-    case 0b11011001:
-      /** ESC
-       * Escape (to external device)
-       */
-      break;
-    case 0b11011010:
-      /** ESC
-       * Escape (to external device)
-       */
-      break;
-    case 0b11011011:
-      /** ESC
-       * Escape (to external device)
-       */
-      break;
-    case 0b11011100:
-      /** ESC
-       * Escape (to external device)
-       */
-      break;
-    case 0b11011101:
-      /** ESC
-       * Escape (to external device)
-       */
-      break;
-    case 0b11011110:
-      /** ESC
-       * Escape (to external device)
-       */
-      break;
-    case 0b11011111:
-      /** ESC
-       * Escape (to external device)
-       */
-      break;
-    case 0b11100000:
-      /** LOOPNZ/LOOPNE
-       * Loop while not zero/equal
-       */
-      break;
-    case 0b11100001:
-      /** LOOPZ/LOOPE
-       * loop while zero/equal
-       */
-      break;
-    case 0b11100010:
-      /** LOOP
-       * Loop CX times
-       */
-      break;
-    case 0b11100011:
-      /** JCXZ
-       * Jump on CX zero
-       */
-      break;
-    case 0b11100100:
-      /** IN
-       * Fixed port
-       */
-      break;
-    case 0b11100101:
-      /** IN
-       * Fixed port
-       */
-      break;
-    case 0b11100110:
-      /** OUT
-       * Fixed port
-       */
-      break;
-    case 0b11100111:
-      /** OUT
-       * Fixed port
-       */
-      break;
-    case 0b11101000:
-      /** CALL
-       * Direct within segment
-       */
-      break;
-    case 0b11101001:
-      /** JMP
-       * Unconditional jump
-       * Direct within segment
-       */
-      break;
-    case 0b11101010:
-      /** JMP
-       * Unconditional jump
-       * Direct intersegment
-       */
-      break;
-    case 0b11101011:
-      /** JMP
-       * Unconditional jump
-       * Direct within segment-short
-       */
-      break;
-    case 0b11101100:
-      /** IN
-       * Variable port
-       */
-      break;
-    case 0b11101101:
-      /** IN
-       * Fixed port
-       */
-      break;
-    case 0b11101110:
-      /** OUT
-       * Variable port
-       */
-      break;
-    case 0b11101111:
-      /** OUT
-       * Variable port
-       */
-      break;
-    case 0b11110000:
-      /** LOCK
-       * Bus lock prefix 
-       */
-      append_string(&string, 5, "lock");
-      break;
-    case 0b11110001:
-      break;
-    case 0b11110010:
-      /** REP
-       * Repeat
-       */
-      break;
-    case 0b11110011:
-      /** REP
-       * Repeat
-       */
-      break;
-    case 0b11110100:
-      /** HLT
-       * Halt 
-       */
-      append_string(&string, 4, "hlt");
-      break;
-    case 0b11110101:
-      /** CMC
-       * Complement carry 
-       */
-      append_string(&string, 4, "cwc");
-      break;
-    case 0b11110110:
-      /** NEG
-       * Change sign
-       */
-      /** MUL
-       * Multiply (unsigned)
-       */
-      /** IMUL
-       * Integer multiply (signed)
-       */
-      /** DIV
-       * Divide (unsigned)
-       */
-      /** IDIV
-       * Integer divide (signed)
-       */
-      /** NOT
-       * Invert
-       */
-      /** TEST
-       * And function to flags no result
-       * Immediate data and register/memory
-       */
-      break;
-    case 0b11110111:
-      /** NEG
-       * Change sign
-       */
-      /** MUL
-       * Multiply (unsigned)
-       */
-      /** IMUL
-       * Integer multiply (signed)
-       */
-      /** DIV
-       * Divide (unsigned)
-       */
-      /** IDIV
-       * Integer divide (signed)
-       */
-      /** NOT
-       * Invert
-       */
-      /** TEST
-       * And function to flags no result
-       * Immediate data and register/memory
-       */
-      break;
-    case 0b11111000:
-      /** CLC
-       * Clear carry 
-       */
-      append_string(&string, 4, "clc");
-      break;
-    case 0b11111001:
-      /** STC
-       * Set carry 
-       */
-      append_string(&string, 4, "stc");
-      break;
-    case 0b11111010:
-      /** CLI
-       * Clear interrupt 
-       */
-      append_string(&string, 4, "cli");
-      break;
-    case 0b11111011:
-      /** STI
-       * Set interrupt 
-       */
-      append_string(&string, 4, "sti");
-      break;
-    case 0b11111100:
-      /** CLD
-       * Clear direction 
-       */
-      append_string(&string, 4, "std");
-      break;
-    case 0b11111101:
-      /** STD
-       * Set direction
-       */
-      break;
-    case 0b11111110:
-      /** INC
-       * Increment
-       * Register/memory
-       */
-      /** DEC
-       * Decrement
-       * Register/memory
-       */
-      break;
-    case 0b11111111:
-      /** PUSH
-       * Register/memory 
-       */
-      /** INC
-       * Increment
-       * Register/memory
-       */
-      /** DEC
-       * Decrement
-       * Register/memory
-       */
-      /** CALL
-       * Indirect within segment
-       */
-      /** CALL
-       * Indirect intersegment
-       */
-      /** JMP
-       * Unconditional jump
-       * Indirect within segment
-       */
-      /** JMP
-       * Unconditional jump
-       * Indirect intersegment
-       */
-      break;
-    default:
-      append_string(&string, 15, "UNKNOWN OPCODE");
+error_t batch_files(char *source_name, size_t thread_count) {
+  /** Batch files
+   * Lists every file named in a manifest, one path per line, or every
+   * regular file of a directory, on a pool of thread_count workers. The
+   * output is what jasm file... prints for the same files in order.
+   */
+  batch_t batch;
+  char output[OUTPUT_SIZE];
+  writer_t writer;
+  struct stat status;
+  error_t error_code = init_batch(&batch, thread_count);
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  if (stat(source_name, &status) == 0 && S_ISDIR(status.st_mode)) {
+    error_code = read_directory(&batch, source_name);
+  } else {
+    error_code = read_manifest(&batch, source_name);
+  }
+  if (error_code == JASM_SUCCESS) {
+    init_writer(&writer, STDOUT_FILENO, OUTPUT_SIZE, output);
+    error_code = run_batch(&batch, &writer);
   }
-  print_string(&string);
-} 
+  free_batch(&batch);
+  return error_code;
+}
+
+error_t save_listing(char *listing_name, char *index_name, const string_t *listing, const decode_index_t *index) {
+  /* Writes a listing and its decode index */
+  string_t output;
+  error_t error_code = save_binary_file(listing_name, (const uint8_t *)listing->buffer, listing->idx);
+  if (error_code == JASM_SUCCESS) {
+    init_string(&output, BUFFER_SIZE, NULL);
+    error_code = export_decode_index(index, &output);
+    if (error_code == JASM_SUCCESS) {
+      error_code = save_binary_file(index_name, (const uint8_t *)output.buffer, output.idx);
+    }
+    free_string(&output);
+  }
+  return error_code;
+}
+
+error_t list_file(char *binary_name, char *listing_name, char *index_name) {
+  /** List file
+   * Writes the linear listing of a binary and the decode index that
+   * relist_file needs to update it
+   */
+  binary_file_t binary;
+  decode_index_t index;
+  string_t listing;
+  error_t error_code = load_binary_file(binary_name, &binary);
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  error_code = init_decode_index(&index, binary.byte_count / 2);
+  if (error_code == JASM_SUCCESS) {
+    init_string(&listing, OUTPUT_SIZE, NULL);
+    error_code = build_listing(binary.bytes, binary.byte_count, &listing, &index);
+    if (error_code == JASM_SUCCESS) {
+      error_code = save_listing(listing_name, index_name, &listing, &index);
+    }
+    free_string(&listing);
+    free_decode_index(&index);
+  }
+  unload_binary_file(&binary);
+  return error_code;
+}
+
+error_t relist_file(char *binary_name, char *listing_name, char *index_name, size_t first, size_t last) {
+  /** Relist file
+   * Updates a listing and its index in place after bytes [first, last) of
+   * the binary were patched. The old files are mapped, so the new ones
+   * are built in memory and written after unmapping them.
+   */
+  binary_file_t binary, old_listing, old_index_file;
+  decode_index_t old_index, index;
+  string_t listing;
+  error_t error_code = load_binary_file(binary_name, &binary);
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  error_code = load_binary_file(listing_name, &old_listing);
+  if (error_code != JASM_SUCCESS) {
+    unload_binary_file(&binary);
+    return error_code;
+  }
+  error_code = load_binary_file(index_name, &old_index_file);
+  if (error_code == JASM_SUCCESS) {
+    error_code = import_decode_index(old_index_file.bytes, old_index_file.byte_count, &old_index);
+    unload_binary_file(&old_index_file);
+  }
+  init_string(&listing, old_listing.byte_count + BUFFER_SIZE, NULL);
+  index.boundaries = NULL;
+  index.text_offsets = NULL;
+  if (error_code == JASM_SUCCESS) {
+    if (old_index.byte_count != binary.byte_count || old_index.text_offsets[old_index.count] != old_listing.byte_count) {
+      error_code = JASM_RANGE_ERROR;
+    } else {
+      error_code = relist_range(binary.bytes, &old_index, (const char *)old_listing.bytes, first, last,
+                                &listing, &index);
+    }
+    free_decode_index(&old_index);
+  }
+  unload_binary_file(&old_listing);
+  unload_binary_file(&binary);
+  if (error_code == JASM_SUCCESS) {
+    error_code = save_listing(listing_name, index_name, &listing, &index);
+  }
+  free_string(&listing);
+  free_decode_index(&index);
+  return error_code;
+}
+
+void print_cpu(const cpu_t *cpu) {
+  for (uint8_t idx = 0; idx < 8; ++idx) {
+    printf("%.2s=%04x ", word_registers[idx], cpu->registers[idx]);
+  }
+  printf("flags=%04x\n", cpu->flags);
+}
+
+error_t emulate_file(char *binary_name, char mode, uint64_t instruction_limit) {
+  /** Emulate file
+   * Runs a flat binary from LOAD_SEGMENT:LOAD_OFFSET until hlt, an error
+   * or the instruction limit, then prints the registers. Mode 't' traces
+   * every instruction before it executes and the registers after; mode
+   * 'j' compiles hot blocks, falling back to the interpreter when the
+   * host has no JIT.
+   */
+  binary_file_t binary;
+  cpu_t cpu;
+  jit_t jit;
+  uint8_t trace = mode == 't';
+  error_t error_code = load_binary_file(binary_name, &binary);
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  error_code = init_cpu(&cpu);
+  if (error_code == JASM_SUCCESS) {
+    error_code = load_program(&cpu, binary.bytes, binary.byte_count, LOAD_SEGMENT, LOAD_OFFSET);
+  }
+  unload_binary_file(&binary);
+  if (error_code == JASM_SUCCESS && mode == 'j' && init_jit(&jit) == JASM_SUCCESS) {
+    cpu.jit = &jit;
+  }
+  if (error_code == JASM_SUCCESS && !trace) {
+    error_code = run_cpu(&cpu, instruction_limit);
+  }
+  while (error_code == JASM_SUCCESS && trace && !cpu.halted && instruction_limit-- > 0) {
+    char text[STRING_SIZE];
+    string_t line;
+    init_string(&line, STRING_SIZE, text);
+    render_instruction(fetch_instruction(&cpu), &line);
+    printf("%04x:%04x %-32.*s ", cpu.segments[SEG_CS], cpu.ip, (int)line.idx, line.buffer);
+    free_string(&line);
+    error_code = step_cpu(&cpu);
+    print_cpu(&cpu);
+  }
+  if (cpu.memory != NULL) {
+    printf("%04x:%04x after %llu instructions\n", cpu.segments[SEG_CS], cpu.ip, (unsigned long long)cpu.instruction_count);
+    print_cpu(&cpu);
+  }
+  if (cpu.jit != NULL) {
+    printf("jit: %llu blocks compiled, %llu rejected\n", (unsigned long long)jit.compiled, (unsigned long long)jit.rejected);
+    free_jit(&jit);
+  }
+  free_cpu(&cpu);
+  return error_code;
+}
@@ -0,0 +1,381 @@
+#define _DEFAULT_SOURCE
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "common.h"
+#include "error.h"
+#include "opcode_table.h"
+#include "decoder.h"
+#include "emulator.h"
+#include "jit.h"
+
+/** x86-64 JIT
+ * Translates hot blocks made only of register and immediate forms of mov,
+ * add, or, adc, sbb, and, sub, xor, cmp, test, inc and dec, ending in jcc,
+ * loop or jmp, into native code. Anything else, and every memory operand,
+ * stays in the interpreter.
+ *
+ * The 8086 register file lives in native registers for the whole block:
+ * ax cx dx bx in eax ecx edx ebx, so al..bh encode unchanged, and sp bp
+ * si di in r12d..r15d. The upper halves stay zero. 8086 and x86-64
+ * arithmetic flags have the same bits and semantics, so the status flags
+ * are loaded into EFLAGS on entry, used directly by jcc, and written back
+ * on exit. rdi holds the cpu_t; the next ip is returned in eax.
+ */
+
+#if defined(__x86_64__)
+
+/* Native register for each 8086 word register */
+const uint8_t native_registers[8] = {0, 1, 2, 3, 12, 13, 14, 15};
+
+typedef struct emitter_t {
+  uint8_t   code[JIT_BLOCK_SIZE];
+  size_t    idx;
+} emitter_t;
+
+void emit_byte(emitter_t *emitter, uint8_t byte) {
+  if (emitter->idx < JIT_BLOCK_SIZE) {
+    emitter->code[emitter->idx] = byte;
+  }
+  emitter->idx++;
+}
+
+void emit_dword(emitter_t *emitter, uint32_t value) {
+  for (uint8_t idx = 0; idx < 4; ++idx) {
+    emit_byte(emitter, (uint8_t)(value >> (idx * 8)));
+  }
+}
+
+void patch_rel32(emitter_t *emitter, size_t position, size_t target) {
+  /* rel32 at position, relative to the end of the field */
+  uint32_t relative = (uint32_t)(target - (position + 4));
+  if (position + 4 <= JIT_BLOCK_SIZE) {
+    memcpy(emitter->code + position, &relative, 4);
+  }
+}
+
+uint8_t native_register(uint8_t w_bit, uint8_t reg) {
+  /* Byte registers keep their legacy encodings, which need no REX */
+  return w_bit ? native_registers[reg] : reg;
+}
+
+void emit_register_op(emitter_t *emitter, uint8_t opcode, uint8_t w_bit, uint8_t reg, uint8_t rm) {
+  /** emit_register_op
+   * opcode | w with a register-direct mod reg r/m byte. reg (a native
+   * register or an opcode extension) and rm are native numbers.
+   */
+  if (w_bit) {
+    emit_byte(emitter, 0x66);
+    if (reg >= 8 || rm >= 8) {
+      emit_byte(emitter, 0x40 | ((reg >> 3) << 2) | (rm >> 3));
+    }
+  }
+  emit_byte(emitter, opcode | w_bit);
+  emit_byte(emitter, 0xc0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+void emit_cpu_access(emitter_t *emitter, uint8_t opcode_prefix, uint8_t opcode, uint8_t native, size_t offset) {
+  /** emit_cpu_access
+   * opcode with a [rdi + disp32] operand addressing a cpu_t field.
+   * opcode_prefix 0x66 gives a 16-bit store, 0x0f a movzx load.
+   */
+  if (opcode_prefix == 0x66) {
+    emit_byte(emitter, 0x66);
+  }
+  if (native >= 8) {
+    emit_byte(emitter, 0x44);
+  }
+  if (opcode_prefix == 0x0f) {
+    emit_byte(emitter, 0x0f);
+  }
+  emit_byte(emitter, opcode);
+  emit_byte(emitter, 0x80 | ((native & 7) << 3) | 0b111);
+  emit_dword(emitter, (uint32_t)offset);
+}
+
+void emit_prologue(emitter_t *emitter) {
+  /** emit_prologue
+   * Saves callee-saved registers, loads the register file and moves the
+   * status flags into EFLAGS
+   */
+  static const uint8_t saves[] = {0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57};
+  for (size_t idx = 0; idx < sizeof(saves); ++idx) {
+    emit_byte(emitter, saves[idx]);
+  }
+  for (uint8_t reg = 0; reg < 8; ++reg) {
+    emit_cpu_access(emitter, 0x0f, 0xb7, native_registers[reg], offsetof(cpu_t, registers) + reg * 2);
+  }
+  emit_cpu_access(emitter, 0x0f, 0xb7, 6, offsetof(cpu_t, flags));
+  emit_byte(emitter, 0x81); /* and esi, FLAG_STATUS */
+  emit_byte(emitter, 0xe6);
+  emit_dword(emitter, FLAG_STATUS);
+  emit_byte(emitter, 0x56); /* push rsi */
+  emit_byte(emitter, 0x9d); /* popfq */
+}
+
+void emit_epilogue(emitter_t *emitter, uint16_t status) {
+  /** emit_epilogue
+   * Stores the register file, merges the status bits given by status from
+   * EFLAGS into cpu->flags and returns the ip left in esi
+   */
+  static const uint8_t restores[] = {0x41, 0x5f, 0x41, 0x5e, 0x41, 0x5d, 0x41, 0x5c, 0x5b};
+  for (uint8_t reg = 0; reg < 8; ++reg) {
+    emit_cpu_access(emitter, 0x66, 0x89, native_registers[reg], offsetof(cpu_t, registers) + reg * 2);
+  }
+  emit_byte(emitter, 0x9c); /* pushfq */
+  emit_byte(emitter, 0x58); /* pop rax */
+  emit_byte(emitter, 0x25); /* and eax, status */
+  emit_dword(emitter, status);
+  emit_cpu_access(emitter, 0x0f, 0xb7, 1, offsetof(cpu_t, flags));
+  emit_byte(emitter, 0x81); /* and ecx, ~FLAG_STATUS */
+  emit_byte(emitter, 0xe1);
+  emit_dword(emitter, (uint16_t)~FLAG_STATUS);
+  emit_byte(emitter, 0x09); /* or eax, ecx */
+  emit_byte(emitter, 0xc8);
+  emit_cpu_access(emitter, 0x66, 0x89, 0, offsetof(cpu_t, flags));
+  emit_byte(emitter, 0x89); /* mov eax, esi */
+  emit_byte(emitter, 0xf0);
+  for (size_t idx = 0; idx < sizeof(restores); ++idx) {
+    emit_byte(emitter, restores[idx]);
+  }
+  emit_byte(emitter, 0xc3);
+}
+
+void emit_set_ip(emitter_t *emitter, uint16_t ip) {
+  emit_byte(emitter, 0xbe); /* mov esi, imm32 */
+  emit_dword(emitter, ip);
+}
+
+uint8_t alu_extension(uint8_t mnemonic) {
+  /* reg field of the 0x80/0x81 group, in the 8086's order */
+  switch (mnemonic) {
+    case MN_ADD: return 0;
+    case MN_OR: return 1;
+    case MN_ADC: return 2;
+    case MN_SBB: return 3;
+    case MN_AND: return 4;
+    case MN_SUB: return 5;
+    case MN_XOR: return 6;
+    case MN_CMP: return 7;
+  }
+  return 8;
+}
+
+uint8_t emit_operation(emitter_t *emitter, const instruction_t *instruction, uint8_t *logic) {
+  /** emit_operation
+   * Native code for one straight-line instruction; 0 if unsupported.
+   * logic tells whether it left AF undefined (and/or/xor/test).
+   */
+  uint8_t mnemonic = instruction->mnemonic;
+  uint8_t w_bit = (instruction->attributes & ATTR_W) != 0;
+  uint8_t register_kind = w_bit ? OPERAND_REG16 : OPERAND_REG8;
+  uint8_t reg = native_register(w_bit, instruction->registers[0]);
+  uint8_t source = native_register(w_bit, instruction->registers[1]);
+  uint8_t extension = alu_extension(mnemonic);
+  uint16_t immediate = instruction->immediate;
+  if (instruction->kinds[0] != OPERAND_NONE && instruction->kinds[0] != register_kind) {
+    return 0;
+  }
+  switch (mnemonic) {
+    case MN_NOP:
+      return 1;
+    case MN_CLC:
+      emit_byte(emitter, 0xf8);
+      return 1;
+    case MN_STC:
+      emit_byte(emitter, 0xf9);
+      return 1;
+    case MN_CMC:
+      emit_byte(emitter, 0xf5);
+      return 1;
+    case MN_INC:
+    case MN_DEC:
+      if (instruction->kinds[0] != register_kind) {
+        return 0;
+      }
+      emit_register_op(emitter, 0xfe, w_bit, mnemonic == MN_DEC, reg);
+      *logic = 0;
+      return 1;
+    case MN_MOV:
+    case MN_TEST:
+    case MN_ADD: case MN_OR: case MN_ADC: case MN_SBB:
+    case MN_AND: case MN_SUB: case MN_XOR: case MN_CMP:
+      if (instruction->kinds[0] != register_kind) {
+        return 0;
+      }
+      if (instruction->kinds[1] == register_kind) {
+        uint8_t opcode = mnemonic == MN_MOV ? 0x88 : mnemonic == MN_TEST ? 0x84 : (uint8_t)(extension << 3);
+        emit_register_op(emitter, opcode, w_bit, source, reg);
+      } else if (instruction->kinds[1] == OPERAND_IMM) {
+        if (mnemonic == MN_MOV) {
+          if (w_bit) {
+            emit_byte(emitter, 0x66);
+            if (reg >= 8) {
+              emit_byte(emitter, 0x41);
+            }
+            emit_byte(emitter, 0xb8 | (reg & 7));
+          } else {
+            emit_byte(emitter, 0xb0 | reg);
+          }
+        } else if (mnemonic == MN_TEST) {
+          emit_register_op(emitter, 0xf6, w_bit, 0, reg);
+        } else {
+          emit_register_op(emitter, 0x80, w_bit, extension, reg);
+        }
+        emit_byte(emitter, (uint8_t)immediate);
+        if (w_bit) {
+          emit_byte(emitter, (uint8_t)(immediate >> 8));
+        }
+      } else {
+        return 0;
+      }
+      if (mnemonic != MN_MOV) {
+        *logic = mnemonic == MN_TEST || mnemonic == MN_AND || mnemonic == MN_OR || mnemonic == MN_XOR;
+      }
+      return 1;
+  }
+  return 0;
+}
+
+error_t init_jit(jit_t *jit) {
+  /** init_jit
+   * Maps the code arena. It is never writable and executable at once:
+   * pages are read/write only while compile_block copies into them.
+   */
+  long page_size = sysconf(_SC_PAGESIZE);
+  memset(jit, 0, sizeof(*jit));
+  jit->page_size = page_size > 0 ? (size_t)page_size : 4096;
+  jit->buffer = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (jit->buffer == MAP_FAILED) {
+    jit->buffer = NULL;
+    return JASM_MEMORY_ERROR;
+  }
+  return JASM_SUCCESS;
+}
+
+int protect_code(jit_t *jit, size_t start, size_t end, int protection) {
+  /* Pages spanning arena bytes [start, end) */
+  size_t first = start & ~(jit->page_size - 1);
+  size_t last = (end + jit->page_size - 1) & ~(jit->page_size - 1);
+  if (last > JIT_BUFFER_SIZE) {
+    last = JIT_BUFFER_SIZE;
+  }
+  return mprotect(jit->buffer + first, last - first, protection);
+}
+
+error_t free_jit(jit_t *jit) {
+  if (jit->buffer != NULL) {
+    munmap(jit->buffer, JIT_BUFFER_SIZE);
+  }
+  jit->buffer = NULL;
+  jit->used = 0;
+  return JASM_SUCCESS;
+}
+
+void flush_blocks(cpu_t *cpu) {
+  /* Drops every compiled block and empties the arena */
+  for (size_t idx = 0; idx < BLOCK_CACHE_SIZE; ++idx) {
+    cpu->blocks[idx].native = NULL;
+    cpu->blocks[idx].hits = 0;
+  }
+  cpu->jit->used = 0;
+}
+
+uint8_t compile_block(cpu_t *cpu, block_t *block) {
+  /** compile_block
+   * Translates a block into the arena and sets block->native. Returns 0,
+   * leaving the block interpreted, if any instruction is unsupported. A
+   * full arena is flushed, dropping every compiled block.
+   */
+  jit_t *jit = cpu->jit;
+  emitter_t emitter;
+  const instruction_t *final = &block->ops[block->count - 1].instruction;
+  uint16_t next_ip = (uint16_t)(final->offset + final->length);
+  uint16_t target_ip = (uint16_t)(next_ip + final->immediate);
+  uint8_t logic = 0;
+  size_t branch = 0;
+  size_t epilogue;
+  uint8_t control = 0;
+  emitter.idx = 0;
+  emit_prologue(&emitter);
+  for (uint16_t idx = 0; idx < block->count; ++idx) {
+    const instruction_t *instruction = &block->ops[idx].instruction;
+    uint8_t mnemonic = instruction->mnemonic;
+    if (idx == block->count - 1 && mnemonic >= MN_JO && mnemonic <= MN_JG) {
+      emit_byte(&emitter, 0x0f); /* jcc rel32 to the taken exit */
+      emit_byte(&emitter, 0x80 | (mnemonic - MN_JO));
+      branch = emitter.idx;
+      emit_dword(&emitter, 0);
+      control = 1;
+    } else if (idx == block->count - 1 && mnemonic == MN_LOOP) {
+      static const uint8_t loop[] = {
+        0x66, 0x8d, 0x49, 0xff, /* lea cx, [rcx - 1], flags untouched */
+        0x67, 0xe3, 0x05,       /* jecxz over the jmp */
+        0xe9,                   /* jmp rel32 to the taken exit */
+      };
+      for (size_t byte = 0; byte < sizeof(loop); ++byte) {
+        emit_byte(&emitter, loop[byte]);
+      }
+      branch = emitter.idx;
+      emit_dword(&emitter, 0);
+      control = 1;
+    } else if (idx == block->count - 1 && mnemonic == MN_JMP && instruction->kinds[0] == OPERAND_REL) {
+      next_ip = target_ip;
+    } else if (!emit_operation(&emitter, instruction, &logic)) {
+      jit->rejected++;
+      return 0;
+    }
+  }
+  emit_set_ip(&emitter, next_ip);
+  epilogue = emitter.idx;
+  emit_epilogue(&emitter, logic ? FLAG_STATUS & ~FLAG_AF : FLAG_STATUS);
+  if (control) {
+    patch_rel32(&emitter, branch, emitter.idx);
+    emit_set_ip(&emitter, target_ip);
+    emit_byte(&emitter, 0xe9);
+    emit_dword(&emitter, (uint32_t)(epilogue - (emitter.idx + 4)));
+  }
+  if (emitter.idx > JIT_BLOCK_SIZE) {
+    jit->rejected++;
+    return 0;
+  }
+  if (jit->used + emitter.idx > JIT_BUFFER_SIZE) {
+    flush_blocks(cpu);
+  }
+  if (protect_code(jit, jit->used, jit->used + emitter.idx, PROT_READ | PROT_WRITE) != 0) {
+    jit->rejected++;
+    return 0;
+  }
+  memcpy(jit->buffer + jit->used, emitter.code, emitter.idx);
+  if (protect_code(jit, jit->used, jit->used + emitter.idx, PROT_READ | PROT_EXEC) != 0) {
+    /* Blocks sharing these pages can no longer run */
+    flush_blocks(cpu);
+    jit->rejected++;
+    return 0;
+  }
+  block->native = jit->buffer + jit->used;
+  jit->used += emitter.idx;
+  jit->compiled++;
+  return 1;
+}
+
+#else
+
+error_t init_jit(jit_t *jit) {
+  /* Only x86-64 hosts have a code generator */
+  memset(jit, 0, sizeof(*jit));
+  return JASM_MEMORY_ERROR;
+}
+
+error_t free_jit(jit_t *jit) {
+  (void)jit;
+  return JASM_SUCCESS;
+}
+
+uint8_t compile_block(cpu_t *cpu, block_t *block) {
+  (void)cpu;
+  (void)block;
+  return 0;
+}
+
+#endif
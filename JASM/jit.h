@@ -0,0 +1,28 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stddef.h>
+
+/* Interpreted runs before a block is compiled */
+#define JIT_THRESHOLD     32
+/* Executable arena; flushed and refilled when full */
+#define JIT_BUFFER_SIZE   (1 << 22)
+/* Largest native translation of one block */
+#define JIT_BLOCK_SIZE    1024
+
+typedef struct jit_t {
+  uint8_t   *buffer;  /* mmapped JIT_BUFFER_SIZE bytes, read/execute once written */
+  size_t    page_size;
+  size_t    used;
+  uint64_t  compiled;
+  uint64_t  rejected;
+} jit_t;
+
+/* Compiled block: runs it on cpu and returns the next ip */
+typedef uint16_t (*jit_function_t)(cpu_t *cpu);
+
+error_t init_jit(jit_t *jit);
+error_t free_jit(jit_t *jit);
+uint8_t compile_block(cpu_t *cpu, block_t *block);
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef KEYWORDS_H
+#define KEYWORDS_H
+
+/** Keywords
+ * Every reserved word of the assembler. The mnemonics come from
+ * MNEMONIC_LIST; KEYWORD_LIST adds X(text, kind, value) for the aliases,
+ * registers, directives and operand modifiers. gen_keywords turns both
+ * into the perfect hash table of keyword_table.h at build time.
+ */
+
+typedef enum keyword_kind_t {
+  KEYWORD_NONE = 0,   /* empty slot */
+  KEYWORD_MNEMONIC,   /* value is a mnemonic_t */
+  KEYWORD_REG8,       /* value is the register number */
+  KEYWORD_REG16,
+  KEYWORD_SEGMENT,
+  KEYWORD_DIRECTIVE,  /* value is a directive_t */
+  KEYWORD_MODIFIER,   /* value is a modifier_t */
+} keyword_kind_t;
+
+typedef enum directive_t {
+  DIRECTIVE_BITS = 0,
+  DIRECTIVE_ORG,
+  DIRECTIVE_DB,
+  DIRECTIVE_DW,
+} directive_t;
+
+typedef enum modifier_t {
+  MODIFIER_BYTE = 0,
+  MODIFIER_WORD,
+  MODIFIER_SHORT,
+  MODIFIER_FAR,
+  MODIFIER_PTR,
+  MODIFIER_NEAR,
+} modifier_t;
+
+#define KEYWORD_LIST(X) \
+  X("jz", MNEMONIC, MN_JE) X("jnz", MNEMONIC, MN_JNE) X("jc", MNEMONIC, MN_JB) \
+  X("jnae", MNEMONIC, MN_JB) X("jnc", MNEMONIC, MN_JNB) X("jae", MNEMONIC, MN_JNB) \
+  X("jna", MNEMONIC, MN_JBE) X("jnbe", MNEMONIC, MN_JA) X("jpe", MNEMONIC, MN_JP) \
+  X("jpo", MNEMONIC, MN_JNP) X("jnge", MNEMONIC, MN_JL) X("jge", MNEMONIC, MN_JNL) \
+  X("jng", MNEMONIC, MN_JLE) X("jnle", MNEMONIC, MN_JG) X("loope", MNEMONIC, MN_LOOPZ) \
+  X("loopne", MNEMONIC, MN_LOOPNZ) X("sal", MNEMONIC, MN_SHL) X("repe", MNEMONIC, MN_REP) \
+  X("repz", MNEMONIC, MN_REP) X("repnz", MNEMONIC, MN_REPNE) \
+  X("al", REG8, 0) X("cl", REG8, 1) X("dl", REG8, 2) X("bl", REG8, 3) \
+  X("ah", REG8, 4) X("ch", REG8, 5) X("dh", REG8, 6) X("bh", REG8, 7) \
+  X("ax", REG16, 0) X("cx", REG16, 1) X("dx", REG16, 2) X("bx", REG16, 3) \
+  X("sp", REG16, 4) X("bp", REG16, 5) X("si", REG16, 6) X("di", REG16, 7) \
+  X("es", SEGMENT, 0) X("cs", SEGMENT, 1) X("ss", SEGMENT, 2) X("ds", SEGMENT, 3) \
+  X("bits", DIRECTIVE, DIRECTIVE_BITS) X("org", DIRECTIVE, DIRECTIVE_ORG) \
+  X("db", DIRECTIVE, DIRECTIVE_DB) X("dw", DIRECTIVE, DIRECTIVE_DW) \
+  X("byte", MODIFIER, MODIFIER_BYTE) X("word", MODIFIER, MODIFIER_WORD) \
+  X("short", MODIFIER, MODIFIER_SHORT) X("far", MODIFIER, MODIFIER_FAR) \
+  X("ptr", MODIFIER, MODIFIER_PTR) X("near", MODIFIER, MODIFIER_NEAR)
+
+/* Longest keyword; longer identifiers are never looked up */
+#define KEYWORD_MAX_LENGTH 7
+
+/* Slots and first-level buckets of the table, powers of two */
+#define KEYWORD_SLOTS   256
+#define KEYWORD_BUCKETS 64
+
+/* FNV-1a over the lowercased identifier, started from KEYWORD_SEED. The
+ * lexer runs it while scanning, so a lookup only indexes the table. */
+#define keyword_hash_step(hash, c) (((hash) ^ (uint8_t)((c) | 0x20)) * 16777619u)
+
+/* Second level: the bucket's displacement shifts the upper hash bits */
+#define keyword_slot(hash) \
+  ((((hash) >> 8) + keyword_displacements[(hash) & (KEYWORD_BUCKETS - 1)]) & (KEYWORD_SLOTS - 1))
+
+typedef struct keyword_t {
+  const char  *name;
+  uint8_t     length;
+  uint8_t     kind;     /* keyword_kind_t */
+  uint8_t     value;
+} keyword_t;
+
+#endif
@@ -0,0 +1,174 @@
+#include "common.h"
+#include "error.h"
+#include "opcode_table.h"
+#include "lexer.h"
+#include "keyword_table.h"
+
+/** Lexer
+ * Splits assembly source into tokens that point back into the source
+ * buffer. Comments run from ';' to the end of the line. Identifiers are
+ * hashed as they are scanned, so resolving a keyword costs one table
+ * probe and one comparison.
+ */
+
+error_t init_lexer(lexer_t *lexer, const char *source, size_t size) {
+  lexer->cursor = source;
+  lexer->end = source + size;
+  lexer->line = 1;
+  return JASM_SUCCESS;
+}
+
+uint8_t is_identifier_char(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+         c == '_' || c == '.' || c == '@' || c == '?';
+}
+
+error_t next_token(lexer_t *lexer, token_t *token) {
+  /** next_token
+   * Reads the token at the cursor. Consecutive line breaks and blank or
+   * comment-only lines collapse into one TOKEN_NEWLINE.
+   */
+  const char *cursor = lexer->cursor;
+  while (cursor < lexer->end) {
+    if (*cursor == ' ' || *cursor == '\t' || *cursor == '\r') {
+      ++cursor;
+    } else if (*cursor == ';') {
+      while (cursor < lexer->end && *cursor != '\n') {
+        ++cursor;
+      }
+    } else {
+      break;
+    }
+  }
+  token->start = cursor;
+  token->line = lexer->line;
+  token->length = 1;
+  if (cursor >= lexer->end) {
+    token->type = TOKEN_END;
+    token->length = 0;
+    lexer->cursor = cursor;
+    return JASM_SUCCESS;
+  }
+  switch (*cursor) {
+    case '\n':
+      token->type = TOKEN_NEWLINE;
+      ++lexer->line;
+      lexer->cursor = cursor + 1;
+      return JASM_SUCCESS;
+    case ',':
+      token->type = TOKEN_COMMA;
+      break;
+    case ':':
+      token->type = TOKEN_COLON;
+      break;
+    case '+':
+      token->type = TOKEN_PLUS;
+      break;
+    case '-':
+      token->type = TOKEN_MINUS;
+      break;
+    case '[':
+      token->type = TOKEN_LBRACKET;
+      break;
+    case ']':
+      token->type = TOKEN_RBRACKET;
+      break;
+    case '$':
+      token->type = TOKEN_DOLLAR;
+      break;
+    default:
+      if (is_identifier_char(*cursor)) {
+        const char *start = cursor;
+        uint32_t hash = KEYWORD_SEED;
+        while (cursor < lexer->end && is_identifier_char(*cursor)) {
+          hash = keyword_hash_step(hash, *cursor);
+          ++cursor;
+        }
+        token->type = (*start >= '0' && *start <= '9') ? TOKEN_NUMBER : TOKEN_IDENTIFIER;
+        token->length = cursor - start;
+        token->hash = hash;
+        lexer->cursor = cursor;
+        return JASM_SUCCESS;
+      }
+      token->type = TOKEN_UNKNOWN;
+      break;
+  }
+  lexer->cursor = cursor + 1;
+  return JASM_SUCCESS;
+}
+
+uint8_t token_equals(const token_t *token, const char *text) {
+  /** token_equals
+   * Case-insensitive comparison of a token with a lowercase keyword
+   */
+  uint32_t idx = 0;
+  for (; idx < token->length; ++idx) {
+    char c = token->start[idx];
+    if (c >= 'A' && c <= 'Z') {
+      c += 'a' - 'A';
+    }
+    if (text[idx] == '\0' || text[idx] != c) {
+      return 0;
+    }
+  }
+  return text[idx] == '\0';
+}
+
+const keyword_t *lookup_keyword(const token_t *token) {
+  /** lookup_keyword
+   * The keyword an identifier spells, or NULL. The perfect hash gives the
+   * only slot it can occupy.
+   */
+  const keyword_t *keyword;
+  if (token->type != TOKEN_IDENTIFIER || token->length > KEYWORD_MAX_LENGTH) {
+    return NULL;
+  }
+  keyword = &keyword_table[keyword_slot(token->hash)];
+  if (keyword->length != token->length || !token_equals(token, keyword->name)) {
+    return NULL;
+  }
+  return keyword;
+}
+
+error_t token_number(const token_t *token, int32_t *value) {
+  /** token_number
+   * Parses a decimal, 0x-prefixed hex or h-suffixed hex number;
+   * JASM_RANGE_ERROR when it does not fit a 32-bit signed value
+   */
+  uint32_t base = 10;
+  uint32_t idx = 0;
+  uint32_t end = token->length;
+  uint64_t result = 0;
+  if (end > 2 && token->start[0] == '0' && (token->start[1] == 'x' || token->start[1] == 'X')) {
+    base = 16;
+    idx = 2;
+  } else if (end > 1 && (token->start[end - 1] == 'h' || token->start[end - 1] == 'H')) {
+    base = 16;
+    --end;
+  }
+  if (idx == end) {
+    return JASM_SYNTAX_ERROR;
+  }
+  for (; idx < end; ++idx) {
+    char c = token->start[idx];
+    uint32_t digit;
+    if (c >= '0' && c <= '9') {
+      digit = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      digit = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      digit = c - 'A' + 10;
+    } else {
+      return JASM_SYNTAX_ERROR;
+    }
+    if (digit >= base) {
+      return JASM_SYNTAX_ERROR;
+    }
+    result = result * base + digit;
+    if (result > INT32_MAX) {
+      return JASM_RANGE_ERROR;
+    }
+  }
+  *value = (int32_t)result;
+  return JASM_SUCCESS;
+}
@@ -0,0 +1,46 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <stddef.h>
+#include "keywords.h"
+
+typedef enum token_type_t {
+  TOKEN_END = 0,
+  TOKEN_NEWLINE,
+  TOKEN_IDENTIFIER,
+  TOKEN_NUMBER,
+  TOKEN_COMMA,
+  TOKEN_COLON,
+  TOKEN_PLUS,
+  TOKEN_MINUS,
+  TOKEN_LBRACKET,
+  TOKEN_RBRACKET,
+  TOKEN_DOLLAR,
+  TOKEN_UNKNOWN,
+} token_type_t;
+
+/** Token
+ * A slice of the source buffer; nothing is copied. Identifiers and
+ * numbers carry their keyword hash.
+ */
+typedef struct token_t {
+  uint8_t     type;
+  uint32_t    length;
+  uint32_t    line;
+  uint32_t    hash;
+  const char  *start;
+} token_t;
+
+typedef struct lexer_t {
+  const char  *cursor;
+  const char  *end;
+  uint32_t    line;
+} lexer_t;
+
+error_t init_lexer(lexer_t *lexer, const char *source, size_t size);
+error_t next_token(lexer_t *lexer, token_t *token);
+uint8_t token_equals(const token_t *token, const char *text);
+const keyword_t *lookup_keyword(const token_t *token);
+error_t token_number(const token_t *token, int32_t *value);
+
+#endif
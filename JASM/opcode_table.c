@@ -0,0 +1,230 @@
+#include "common.h"
+#include "opcode_table.h"
+
+/** 8086 opcode table
+ * One descriptor per first instruction byte. Entries left out are zero,
+ * which is MN_INVALID with no operands: the byte is rendered as data.
+ */
+
+#define OP(mn, form, flags, imm) { MN_##mn, form, flags, imm, GROUP_NONE }
+#define GROUP(grp, form, flags, imm) { MN_INVALID, form, flags, imm, grp }
+#define ROW(mn) { MN_##mn, FORM_NONE, 0, IMM_NONE, GROUP_NONE }
+
+/* op r/m,reg ; op reg,r/m ; op acc,imm */
+#define ALU_BLOCK(base, mn) \
+  [(base) + 0] = OP(mn, FORM_MODRM_REG, OPF_MODRM | OPF_D | OPF_W, IMM_NONE), \
+  [(base) + 1] = OP(mn, FORM_MODRM_REG, OPF_MODRM | OPF_D | OPF_W, IMM_NONE), \
+  [(base) + 2] = OP(mn, FORM_MODRM_REG, OPF_MODRM | OPF_D | OPF_W, IMM_NONE), \
+  [(base) + 3] = OP(mn, FORM_MODRM_REG, OPF_MODRM | OPF_D | OPF_W, IMM_NONE), \
+  [(base) + 4] = OP(mn, FORM_ACC_IMM, OPF_W, IMM_W), \
+  [(base) + 5] = OP(mn, FORM_ACC_IMM, OPF_W, IMM_W)
+
+/* eight consecutive opcodes with the register in the low 3 bits */
+#define REG_BLOCK(base, mn, form, flags, imm) \
+  [(base) + 0] = OP(mn, form, flags, imm), [(base) + 1] = OP(mn, form, flags, imm), \
+  [(base) + 2] = OP(mn, form, flags, imm), [(base) + 3] = OP(mn, form, flags, imm), \
+  [(base) + 4] = OP(mn, form, flags, imm), [(base) + 5] = OP(mn, form, flags, imm), \
+  [(base) + 6] = OP(mn, form, flags, imm), [(base) + 7] = OP(mn, form, flags, imm)
+
+const opcode_t opcode_table[256] = {
+  ALU_BLOCK(0x00, ADD),
+  [0x06] = OP(PUSH, FORM_SEG, OPF_WORD, IMM_NONE),
+  [0x07] = OP(POP, FORM_SEG, OPF_WORD, IMM_NONE),
+  ALU_BLOCK(0x08, OR),
+  [0x0e] = OP(PUSH, FORM_SEG, OPF_WORD, IMM_NONE),
+  [0x0f] = OP(POP, FORM_SEG, OPF_WORD, IMM_NONE),
+  ALU_BLOCK(0x10, ADC),
+  [0x16] = OP(PUSH, FORM_SEG, OPF_WORD, IMM_NONE),
+  [0x17] = OP(POP, FORM_SEG, OPF_WORD, IMM_NONE),
+  ALU_BLOCK(0x18, SBB),
+  [0x1e] = OP(PUSH, FORM_SEG, OPF_WORD, IMM_NONE),
+  [0x1f] = OP(POP, FORM_SEG, OPF_WORD, IMM_NONE),
+  ALU_BLOCK(0x20, AND),
+  [0x26] = OP(SEGMENT, FORM_PREFIX, 0, IMM_NONE),
+  [0x27] = OP(DAA, FORM_NONE, 0, IMM_NONE),
+  ALU_BLOCK(0x28, SUB),
+  [0x2e] = OP(SEGMENT, FORM_PREFIX, 0, IMM_NONE),
+  [0x2f] = OP(DAS, FORM_NONE, 0, IMM_NONE),
+  ALU_BLOCK(0x30, XOR),
+  [0x36] = OP(SEGMENT, FORM_PREFIX, 0, IMM_NONE),
+  [0x37] = OP(AAA, FORM_NONE, 0, IMM_NONE),
+  ALU_BLOCK(0x38, CMP),
+  [0x3e] = OP(SEGMENT, FORM_PREFIX, 0, IMM_NONE),
+  [0x3f] = OP(AAS, FORM_NONE, 0, IMM_NONE),
+  REG_BLOCK(0x40, INC, FORM_REG, OPF_WORD, IMM_NONE),
+  REG_BLOCK(0x48, DEC, FORM_REG, OPF_WORD, IMM_NONE),
+  REG_BLOCK(0x50, PUSH, FORM_REG, OPF_WORD, IMM_NONE),
+  REG_BLOCK(0x58, POP, FORM_REG, OPF_WORD, IMM_NONE),
+  [0x70] = OP(JO, FORM_REL8, 0, IMM_8),
+  [0x71] = OP(JNO, FORM_REL8, 0, IMM_8),
+  [0x72] = OP(JB, FORM_REL8, 0, IMM_8),
+  [0x73] = OP(JNB, FORM_REL8, 0, IMM_8),
+  [0x74] = OP(JE, FORM_REL8, 0, IMM_8),
+  [0x75] = OP(JNE, FORM_REL8, 0, IMM_8),
+  [0x76] = OP(JBE, FORM_REL8, 0, IMM_8),
+  [0x77] = OP(JA, FORM_REL8, 0, IMM_8),
+  [0x78] = OP(JS, FORM_REL8, 0, IMM_8),
+  [0x79] = OP(JNS, FORM_REL8, 0, IMM_8),
+  [0x7a] = OP(JP, FORM_REL8, 0, IMM_8),
+  [0x7b] = OP(JNP, FORM_REL8, 0, IMM_8),
+  [0x7c] = OP(JL, FORM_REL8, 0, IMM_8),
+  [0x7d] = OP(JNL, FORM_REL8, 0, IMM_8),
+  [0x7e] = OP(JLE, FORM_REL8, 0, IMM_8),
+  [0x7f] = OP(JG, FORM_REL8, 0, IMM_8),
+  [0x80] = GROUP(GROUP_IMM, FORM_MODRM_IMM, OPF_MODRM | OPF_W, IMM_W),
+  [0x81] = GROUP(GROUP_IMM, FORM_MODRM_IMM, OPF_MODRM | OPF_W, IMM_W),
+  [0x82] = GROUP(GROUP_IMM, FORM_MODRM_IMM, OPF_MODRM | OPF_W, IMM_W),
+  [0x83] = GROUP(GROUP_IMM, FORM_MODRM_IMM, OPF_MODRM | OPF_W, IMM_S),
+  [0x84] = OP(TEST, FORM_MODRM_REG, OPF_MODRM | OPF_W, IMM_NONE),
+  [0x85] = OP(TEST, FORM_MODRM_REG, OPF_MODRM | OPF_W, IMM_NONE),
+  [0x86] = OP(XCHG, FORM_MODRM_REG, OPF_MODRM | OPF_W, IMM_NONE),
+  [0x87] = OP(XCHG, FORM_MODRM_REG, OPF_MODRM | OPF_W, IMM_NONE),
+  [0x88] = OP(MOV, FORM_MODRM_REG, OPF_MODRM | OPF_D | OPF_W, IMM_NONE),
+  [0x89] = OP(MOV, FORM_MODRM_REG, OPF_MODRM | OPF_D | OPF_W, IMM_NONE),
+  [0x8a] = OP(MOV, FORM_MODRM_REG, OPF_MODRM | OPF_D | OPF_W, IMM_NONE),
+  [0x8b] = OP(MOV, FORM_MODRM_REG, OPF_MODRM | OPF_D | OPF_W, IMM_NONE),
+  [0x8c] = OP(MOV, FORM_MODRM_SEG, OPF_MODRM | OPF_D | OPF_WORD, IMM_NONE),
+  [0x8d] = OP(LEA, FORM_REG_MEM, OPF_MODRM | OPF_WORD, IMM_NONE),
+  [0x8e] = OP(MOV, FORM_MODRM_SEG, OPF_MODRM | OPF_D | OPF_WORD, IMM_NONE),
+  [0x8f] = OP(POP, FORM_MODRM, OPF_MODRM | OPF_WORD, IMM_NONE),
+  [0x90] = OP(NOP, FORM_NONE, 0, IMM_NONE),
+  [0x91] = OP(XCHG, FORM_ACC_REG, OPF_WORD, IMM_NONE),
+  [0x92] = OP(XCHG, FORM_ACC_REG, OPF_WORD, IMM_NONE),
+  [0x93] = OP(XCHG, FORM_ACC_REG, OPF_WORD, IMM_NONE),
+  [0x94] = OP(XCHG, FORM_ACC_REG, OPF_WORD, IMM_NONE),
+  [0x95] = OP(XCHG, FORM_ACC_REG, OPF_WORD, IMM_NONE),
+  [0x96] = OP(XCHG, FORM_ACC_REG, OPF_WORD, IMM_NONE),
+  [0x97] = OP(XCHG, FORM_ACC_REG, OPF_WORD, IMM_NONE),
+  [0x98] = OP(CBW, FORM_NONE, 0, IMM_NONE),
+  [0x99] = OP(CWD, FORM_NONE, 0, IMM_NONE),
+  [0x9a] = OP(CALL, FORM_FAR, 0, IMM_FAR),
+  [0x9b] = OP(WAIT, FORM_NONE, 0, IMM_NONE),
+  [0x9c] = OP(PUSHF, FORM_NONE, 0, IMM_NONE),
+  [0x9d] = OP(POPF, FORM_NONE, 0, IMM_NONE),
+  [0x9e] = OP(SAHF, FORM_NONE, 0, IMM_NONE),
+  [0x9f] = OP(LAHF, FORM_NONE, 0, IMM_NONE),
+  [0xa0] = OP(MOV, FORM_ACC_MEM, OPF_D | OPF_W, IMM_ADDR),
+  [0xa1] = OP(MOV, FORM_ACC_MEM, OPF_D | OPF_W, IMM_ADDR),
+  [0xa2] = OP(MOV, FORM_ACC_MEM, OPF_D | OPF_W, IMM_ADDR),
+  [0xa3] = OP(MOV, FORM_ACC_MEM, OPF_D | OPF_W, IMM_ADDR),
+  [0xa4] = OP(MOVSB, FORM_NONE, 0, IMM_NONE),
+  [0xa5] = OP(MOVSW, FORM_NONE, 0, IMM_NONE),
+  [0xa6] = OP(CMPSB, FORM_NONE, 0, IMM_NONE),
+  [0xa7] = OP(CMPSW, FORM_NONE, 0, IMM_NONE),
+  [0xa8] = OP(TEST, FORM_ACC_IMM, OPF_W, IMM_W),
+  [0xa9] = OP(TEST, FORM_ACC_IMM, OPF_W, IMM_W),
+  [0xaa] = OP(STOSB, FORM_NONE, 0, IMM_NONE),
+  [0xab] = OP(STOSW, FORM_NONE, 0, IMM_NONE),
+  [0xac] = OP(LODSB, FORM_NONE, 0, IMM_NONE),
+  [0xad] = OP(LODSW, FORM_NONE, 0, IMM_NONE),
+  [0xae] = OP(SCASB, FORM_NONE, 0, IMM_NONE),
+  [0xaf] = OP(SCASW, FORM_NONE, 0, IMM_NONE),
+  REG_BLOCK(0xb0, MOV, FORM_REG_IMM, OPF_W3, IMM_W),
+  REG_BLOCK(0xb8, MOV, FORM_REG_IMM, OPF_W3, IMM_W),
+  [0xc2] = OP(RET, FORM_IMM, 0, IMM_16),
+  [0xc3] = OP(RET, FORM_NONE, 0, IMM_NONE),
+  [0xc4] = OP(LES, FORM_REG_MEM, OPF_MODRM | OPF_WORD, IMM_NONE),
+  [0xc5] = OP(LDS, FORM_REG_MEM, OPF_MODRM | OPF_WORD, IMM_NONE),
+  [0xc6] = OP(MOV, FORM_MODRM_IMM, OPF_MODRM | OPF_W, IMM_W),
+  [0xc7] = OP(MOV, FORM_MODRM_IMM, OPF_MODRM | OPF_W, IMM_W),
+  [0xca] = OP(RETF, FORM_IMM, 0, IMM_16),
+  [0xcb] = OP(RETF, FORM_NONE, 0, IMM_NONE),
+  [0xcc] = OP(INT3, FORM_NONE, 0, IMM_NONE),
+  [0xcd] = OP(INT, FORM_IMM, 0, IMM_8),
+  [0xce] = OP(INTO, FORM_NONE, 0, IMM_NONE),
+  [0xcf] = OP(IRET, FORM_NONE, 0, IMM_NONE),
+  [0xd0] = GROUP(GROUP_SHIFT, FORM_SHIFT, OPF_MODRM | OPF_W, IMM_NONE),
+  [0xd1] = GROUP(GROUP_SHIFT, FORM_SHIFT, OPF_MODRM | OPF_W, IMM_NONE),
+  [0xd2] = GROUP(GROUP_SHIFT, FORM_SHIFT, OPF_MODRM | OPF_W | OPF_CL, IMM_NONE),
+  [0xd3] = GROUP(GROUP_SHIFT, FORM_SHIFT, OPF_MODRM | OPF_W | OPF_CL, IMM_NONE),
+  [0xd4] = OP(AAM, FORM_NONE, 0, IMM_8),
+  [0xd5] = OP(AAD, FORM_NONE, 0, IMM_8),
+  [0xd7] = OP(XLAT, FORM_NONE, 0, IMM_NONE),
+  REG_BLOCK(0xd8, ESC, FORM_ESC, OPF_MODRM, IMM_NONE),
+  [0xe0] = OP(LOOPNZ, FORM_REL8, 0, IMM_8),
+  [0xe1] = OP(LOOPZ, FORM_REL8, 0, IMM_8),
+  [0xe2] = OP(LOOP, FORM_REL8, 0, IMM_8),
+  [0xe3] = OP(JCXZ, FORM_REL8, 0, IMM_8),
+  [0xe4] = OP(IN, FORM_PORT_IMM, OPF_W, IMM_8),
+  [0xe5] = OP(IN, FORM_PORT_IMM, OPF_W, IMM_8),
+  [0xe6] = OP(OUT, FORM_PORT_IMM, OPF_W | OPF_CL, IMM_8),
+  [0xe7] = OP(OUT, FORM_PORT_IMM, OPF_W | OPF_CL, IMM_8),
+  [0xe8] = OP(CALL, FORM_REL16, 0, IMM_16),
+  [0xe9] = OP(JMP, FORM_REL16, 0, IMM_16),
+  [0xea] = OP(JMP, FORM_FAR, 0, IMM_FAR),
+  [0xeb] = OP(JMP, FORM_REL8, 0, IMM_8),
+  [0xec] = OP(IN, FORM_PORT_DX, OPF_W, IMM_NONE),
+  [0xed] = OP(IN, FORM_PORT_DX, OPF_W, IMM_NONE),
+  [0xee] = OP(OUT, FORM_PORT_DX, OPF_W | OPF_CL, IMM_NONE),
+  [0xef] = OP(OUT, FORM_PORT_DX, OPF_W | OPF_CL, IMM_NONE),
+  [0xf0] = OP(LOCK, FORM_PREFIX, 0, IMM_NONE),
+  [0xf2] = OP(REPNE, FORM_PREFIX, 0, IMM_NONE),
+  [0xf3] = OP(REP, FORM_PREFIX, 0, IMM_NONE),
+  [0xf4] = OP(HLT, FORM_NONE, 0, IMM_NONE),
+  [0xf5] = OP(CMC, FORM_NONE, 0, IMM_NONE),
+  [0xf6] = GROUP(GROUP_UNARY, FORM_MODRM, OPF_MODRM | OPF_W, IMM_NONE),
+  [0xf7] = GROUP(GROUP_UNARY, FORM_MODRM, OPF_MODRM | OPF_W, IMM_NONE),
+  [0xf8] = OP(CLC, FORM_NONE, 0, IMM_NONE),
+  [0xf9] = OP(STC, FORM_NONE, 0, IMM_NONE),
+  [0xfa] = OP(CLI, FORM_NONE, 0, IMM_NONE),
+  [0xfb] = OP(STI, FORM_NONE, 0, IMM_NONE),
+  [0xfc] = OP(CLD, FORM_NONE, 0, IMM_NONE),
+  [0xfd] = OP(STD, FORM_NONE, 0, IMM_NONE),
+  [0xfe] = GROUP(GROUP_INC_BYTE, FORM_MODRM, OPF_MODRM | OPF_W, IMM_NONE),
+  [0xff] = GROUP(GROUP_INC_WORD, FORM_MODRM, OPF_MODRM | OPF_W, IMM_NONE),
+};
+
+/** Group table
+ * Rows with a form other than FORM_NONE replace the form and immediate rule
+ * of the first byte; flags are merged.
+ */
+const opcode_t group_table[GROUP_COUNT][8] = {
+  [GROUP_IMM] = {
+    ROW(ADD), ROW(OR), ROW(ADC), ROW(SBB), ROW(AND), ROW(SUB), ROW(XOR), ROW(CMP)
+  },
+  [GROUP_SHIFT] = {
+    ROW(ROL), ROW(ROR), ROW(RCL), ROW(RCR), ROW(SHL), ROW(SHR), ROW(INVALID), ROW(SAR)
+  },
+  [GROUP_UNARY] = {
+    OP(TEST, FORM_MODRM_IMM, 0, IMM_W), ROW(INVALID), ROW(NOT), ROW(NEG),
+    ROW(MUL), ROW(IMUL), ROW(DIV), ROW(IDIV)
+  },
+  [GROUP_INC_BYTE] = {
+    ROW(INC), ROW(DEC), ROW(INVALID), ROW(INVALID),
+    ROW(INVALID), ROW(INVALID), ROW(INVALID), ROW(INVALID)
+  },
+  [GROUP_INC_WORD] = {
+    ROW(INC), ROW(DEC), ROW(CALL), OP(CALL, FORM_NONE, OPF_FAR, IMM_NONE),
+    ROW(JMP), OP(JMP, FORM_NONE, OPF_FAR, IMM_NONE), ROW(PUSH), ROW(INVALID)
+  },
+};
+
+#define MNEMONIC_NAME(name, text) text,
+const char *mnemonic_names[MNEMONIC_COUNT] = {
+  MNEMONIC_LIST(MNEMONIC_NAME)
+};
+#undef MNEMONIC_NAME
+
+#define MNEMONIC_LENGTH(name, text) sizeof(text) - 1,
+const uint8_t mnemonic_lengths[MNEMONIC_COUNT] = {
+  MNEMONIC_LIST(MNEMONIC_LENGTH)
+};
+#undef MNEMONIC_LENGTH
+
+opcode_t resolve_opcode(uint8_t byte_1, uint8_t byte_2) {
+  /** resolve_opcode
+   * Looks up the descriptor for byte_1, folding in the group row selected
+   * by the reg field of byte_2 when the opcode is a group
+   */
+  opcode_t opcode = opcode_table[byte_1];
+  if (opcode.group != GROUP_NONE) {
+    const opcode_t *row = &group_table[opcode.group][(byte_2 & REG_MASK) >> 3];
+    opcode.mnemonic = row->mnemonic;
+    opcode.flags |= row->flags;
+    if (row->form != FORM_NONE) {
+      opcode.form = row->form;
+      opcode.imm = row->imm;
+    }
+  }
+  return opcode;
+}
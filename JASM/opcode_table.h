@@ -0,0 +1,126 @@
+#ifndef OPCODE_TABLE_H
+#define OPCODE_TABLE_H
+
+#define D_MASK      0b00000010
+#define W_MASK      0b00000001
+#define MOD_MASK    0b11000000
+#define REG_MASK    0b00111000
+#define RM_MASK     0b00000111
+
+/** Mnemonic list
+ * X(identifier, text) for every 8086 mnemonic the decoder can emit.
+ * MN_INVALID renders as a raw data byte.
+ */
+#define MNEMONIC_LIST(X) \
+  X(INVALID, "db") \
+  X(ADD, "add") X(OR, "or") X(ADC, "adc") X(SBB, "sbb") \
+  X(AND, "and") X(SUB, "sub") X(XOR, "xor") X(CMP, "cmp") \
+  X(PUSH, "push") X(POP, "pop") X(INC, "inc") X(DEC, "dec") \
+  X(DAA, "daa") X(DAS, "das") X(AAA, "aaa") X(AAS, "aas") \
+  X(AAM, "aam") X(AAD, "aad") \
+  X(JO, "jo") X(JNO, "jno") X(JB, "jb") X(JNB, "jnb") \
+  X(JE, "je") X(JNE, "jne") X(JBE, "jbe") X(JA, "ja") \
+  X(JS, "js") X(JNS, "jns") X(JP, "jp") X(JNP, "jnp") \
+  X(JL, "jl") X(JNL, "jnl") X(JLE, "jle") X(JG, "jg") \
+  X(TEST, "test") X(XCHG, "xchg") X(MOV, "mov") X(LEA, "lea") \
+  X(LES, "les") X(LDS, "lds") X(NOP, "nop") \
+  X(CBW, "cbw") X(CWD, "cwd") X(CALL, "call") X(WAIT, "wait") \
+  X(PUSHF, "pushf") X(POPF, "popf") X(SAHF, "sahf") X(LAHF, "lahf") \
+  X(MOVSB, "movsb") X(MOVSW, "movsw") X(CMPSB, "cmpsb") X(CMPSW, "cmpsw") \
+  X(STOSB, "stosb") X(STOSW, "stosw") X(LODSB, "lodsb") X(LODSW, "lodsw") \
+  X(SCASB, "scasb") X(SCASW, "scasw") \
+  X(RET, "ret") X(RETF, "retf") X(INT3, "int3") X(INT, "int") \
+  X(INTO, "into") X(IRET, "iret") \
+  X(ROL, "rol") X(ROR, "ror") X(RCL, "rcl") X(RCR, "rcr") \
+  X(SHL, "shl") X(SHR, "shr") X(SAR, "sar") \
+  X(XLAT, "xlat") X(ESC, "esc") \
+  X(LOOPNZ, "loopnz") X(LOOPZ, "loopz") X(LOOP, "loop") X(JCXZ, "jcxz") \
+  X(IN, "in") X(OUT, "out") X(JMP, "jmp") \
+  X(LOCK, "lock") X(REPNE, "repne") X(REP, "rep") \
+  X(HLT, "hlt") X(CMC, "cmc") X(NOT, "not") X(NEG, "neg") \
+  X(MUL, "mul") X(IMUL, "imul") X(DIV, "div") X(IDIV, "idiv") \
+  X(CLC, "clc") X(STC, "stc") X(CLI, "cli") X(STI, "sti") \
+  X(CLD, "cld") X(STD, "std") \
+  X(SEGMENT, "segment")
+
+#define MNEMONIC_ENUM(name, text) MN_##name,
+typedef enum mnemonic_t {
+  MNEMONIC_LIST(MNEMONIC_ENUM)
+  MNEMONIC_COUNT
+} mnemonic_t;
+#undef MNEMONIC_ENUM
+
+/** Operand forms
+ * Every opcode is rendered by exactly one of these handlers.
+ */
+typedef enum operand_form_t {
+  FORM_NONE = 0,    /* no operands: clc, hlt, movsb */
+  FORM_PREFIX,      /* lock, rep, segment override */
+  FORM_MODRM_REG,   /* r/m and reg, ordered by the d bit */
+  FORM_REG_MEM,     /* reg, r/m: lea, les, lds */
+  FORM_MODRM_SEG,   /* r/m and segment register, ordered by the d bit */
+  FORM_MODRM,       /* r/m only: pop r/m, inc r/m, not r/m */
+  FORM_MODRM_IMM,   /* r/m, immediate */
+  FORM_SHIFT,       /* r/m, 1 or r/m, cl */
+  FORM_ACC_IMM,     /* accumulator, immediate */
+  FORM_REG_IMM,     /* register in the low 3 bits, immediate */
+  FORM_REG,         /* register in the low 3 bits */
+  FORM_ACC_REG,     /* ax, register in the low 3 bits */
+  FORM_SEG,         /* segment register in bits 3-4 */
+  FORM_ACC_MEM,     /* accumulator and direct address */
+  FORM_REL8,        /* short relative target */
+  FORM_REL16,       /* near relative target */
+  FORM_FAR,         /* segment:offset pointer */
+  FORM_IMM,         /* immediate only: ret imm16, int imm8 */
+  FORM_PORT_IMM,    /* in/out with an 8-bit port */
+  FORM_PORT_DX,     /* in/out with the port in dx */
+  FORM_ESC,         /* coprocessor escape */
+} operand_form_t;
+
+/* d/w handling and byte layout flags */
+#define OPF_MODRM   0x01 /* mod reg r/m byte follows the opcode */
+#define OPF_W       0x02 /* w bit in bit 0 */
+#define OPF_W3      0x04 /* w bit in bit 3 */
+#define OPF_D       0x08 /* d bit in bit 1 */
+#define OPF_WORD    0x10 /* always a word operation */
+#define OPF_FAR     0x20 /* indirect far call/jmp */
+#define OPF_CL      0x40 /* bit 1 selects cl instead of 1 (shifts), or out for ports */
+
+/* Immediate length rules */
+typedef enum immediate_t {
+  IMM_NONE = 0,
+  IMM_8,            /* one byte */
+  IMM_16,           /* two bytes */
+  IMM_W,            /* one byte when w = 0, two bytes when w = 1 */
+  IMM_S,            /* one byte, sign-extended to the operand size */
+  IMM_ADDR,         /* two byte direct address */
+  IMM_FAR,          /* two byte offset then two byte segment */
+} immediate_t;
+
+/* Groups indexed by the reg field of the mod reg r/m byte */
+typedef enum group_t {
+  GROUP_NONE = 0,
+  GROUP_IMM,        /* 0x80-0x83: add or adc sbb and sub xor cmp */
+  GROUP_SHIFT,      /* 0xd0-0xd3: rol ror rcl rcr shl shr - sar */
+  GROUP_UNARY,      /* 0xf6-0xf7: test - not neg mul imul div idiv */
+  GROUP_INC_BYTE,   /* 0xfe: inc dec */
+  GROUP_INC_WORD,   /* 0xff: inc dec call call far jmp jmp far push */
+  GROUP_COUNT
+} group_t;
+
+typedef struct opcode_t {
+  uint8_t mnemonic; /* mnemonic_t */
+  uint8_t form;     /* operand_form_t */
+  uint8_t flags;    /* OPF_* */
+  uint8_t imm;      /* immediate_t */
+  uint8_t group;    /* group_t, row picked by the reg field */
+} opcode_t;
+
+extern const opcode_t opcode_table[256];
+extern const opcode_t group_table[GROUP_COUNT][8];
+extern const char *mnemonic_names[MNEMONIC_COUNT];
+extern const uint8_t mnemonic_lengths[MNEMONIC_COUNT];
+
+opcode_t resolve_opcode(uint8_t byte_1, uint8_t byte_2);
+
+#endif
@@ -0,0 +1,222 @@
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "common.h"
+#include "error.h"
+#include "string_builder.h"
+#include "writer.h"
+#include "decoder.h"
+#include "disassembler.h"
+#include "parallel.h"
+
+/** Parallel disassembly
+ * The image is listed in windows of one chunk per thread, so only a window's
+ * text is held at a time. Every chunk is decoded from
+ * its speculative start as if it were an instruction boundary, recording
+ * the offset and listing position of each instruction. The merge walks the
+ * chunks in order: where the true stream enters a chunk at a recorded
+ * boundary the chunk's text is reused as is, otherwise the true stream is
+ * decoded serially until it lands on a recorded boundary. 8086 encodings
+ * resynchronize within a few instructions, so the serial part is tiny and
+ * the output is byte-identical to the serial dump.
+ */
+
+size_t online_threads(void) {
+  /** online_threads
+   * Number of online processors, at least one
+   */
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (size_t)count : 1;
+}
+
+error_t record_boundary(chunk_t *chunk, size_t offset) {
+  /** record_boundary
+   * Appends an instruction offset and its listing position to a chunk
+   */
+  if (chunk->count == chunk->capacity) {
+    size_t capacity = chunk->capacity ? chunk->capacity * 2 : 1024;
+    size_t *boundaries = realloc(chunk->boundaries, capacity * sizeof(size_t));
+    size_t *text_offsets;
+    if (boundaries == NULL) {
+      return JASM_MEMORY_ERROR;
+    }
+    chunk->boundaries = boundaries;
+    text_offsets = realloc(chunk->text_offsets, capacity * sizeof(size_t));
+    if (text_offsets == NULL) {
+      return JASM_MEMORY_ERROR;
+    }
+    chunk->text_offsets = text_offsets;
+    chunk->capacity = capacity;
+  }
+  chunk->boundaries[chunk->count] = offset;
+  chunk->text_offsets[chunk->count] = chunk->text.idx;
+  chunk->count++;
+  return JASM_SUCCESS;
+}
+
+void *decode_chunk(void *argument) {
+  /** decode_chunk
+   * Thread body: decodes a chunk from its speculative start into its own
+   * text buffer, a batch at a time. A batch is decoded with the bytes up
+   * to the longest instruction past end, so every instruction starting
+   * before end sees all of its bytes; those starting at or past end are
+   * the next chunk's.
+   */
+  chunk_t *chunk = argument;
+  const disassembler_t *context = chunk->context;
+  size_t width = expanded_width(context->format);
+  size_t idx = chunk->start;
+  ir_block_t block;
+  instruction_t instruction;
+  string_t expanded;
+  chunk->stop = idx;
+  chunk->error_code = init_string(&chunk->text, (chunk->end - chunk->start) * 20, NULL);
+  if (chunk->error_code == JASM_SUCCESS) {
+    chunk->error_code = init_ir_block(&block, IR_BATCH_SIZE);
+  }
+  if (chunk->error_code != JASM_SUCCESS) {
+    return NULL;
+  }
+  init_string(&expanded, 0, NULL);
+  while (idx < chunk->end && chunk->error_code == JASM_SUCCESS) {
+    size_t limit = chunk->byte_count - idx;
+    size_t consumed;
+    if (limit > chunk->end - idx + MAX_INSTRUCTION_LENGTH - 1) {
+      limit = chunk->end - idx + MAX_INSTRUCTION_LENGTH - 1;
+    }
+    block.base = idx;
+    consumed = decode_batch(chunk->bytes + idx, limit, &block);
+    chunk->error_code = expand_bytes(context->format, chunk->bytes + idx, consumed, &expanded);
+    for (size_t jdx = 0; jdx < block.count && chunk->error_code == JASM_SUCCESS; ++jdx) {
+      get_instruction(&block, jdx, &instruction);
+      if (instruction.offset >= chunk->end) {
+        break;
+      }
+      chunk->error_code = record_boundary(chunk, instruction.offset);
+      render_expanded_line(context, expanded.buffer + (instruction.offset - block.base) * width, &instruction,
+                           &chunk->text);
+      idx = instruction.offset + instruction.length;
+    }
+  }
+  chunk->stop = idx;
+  free_string(&expanded);
+  free_ir_block(&block);
+  return NULL;
+}
+
+size_t find_boundary(chunk_t *chunk, size_t offset) {
+  /** find_boundary
+   * Index of offset among the chunk's boundaries, or count when absent
+   */
+  size_t low = 0;
+  size_t high = chunk->count;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (chunk->boundaries[middle] < offset) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if (low < chunk->count && chunk->boundaries[low] == offset) {
+    return low;
+  }
+  return chunk->count;
+}
+
+error_t merge_chunk(writer_t *writer, chunk_t *chunk, size_t *next, string_t *line) {
+  /** merge_chunk
+   * Writes the part of a chunk's listing that lies on the true instruction
+   * stream, which currently stands at *next
+   */
+  size_t found;
+  error_t error_code = JASM_SUCCESS;
+  /* Resynchronize: decode serially until the true stream meets the chunk */
+  while (*next < chunk->stop && (found = find_boundary(chunk, *next)) == chunk->count) {
+    clear_string(line);
+    *next += disassemble_context_line(chunk->context, *next, line);
+    error_code = write_bytes(writer, line->idx, line->buffer);
+    if (error_code != JASM_SUCCESS) {
+      return error_code;
+    }
+  }
+  if (*next >= chunk->stop) {
+    return JASM_SUCCESS;
+  }
+  error_code = write_bytes(writer, chunk->text.idx - chunk->text_offsets[found],
+                           chunk->text.buffer + chunk->text_offsets[found]);
+  *next = chunk->stop;
+  return error_code;
+}
+
+error_t dump_buffer_parallel(const disassembler_t *context) {
+  /** dump_buffer_parallel
+   * Writes the same listing lines as the serial dump, decoding one chunk
+   * per context thread concurrently. Each window of chunks is merged and
+   * freed before the next is decoded. A thread_count of 0 uses every
+   * online processor.
+   */
+  const uint8_t *bytes = context->bytes;
+  size_t byte_count = context->byte_count;
+  size_t thread_count = context->thread_count;
+  chunk_t *chunks;
+  pthread_t *threads;
+  string_t line;
+  size_t next = 0;
+  error_t error_code = JASM_SUCCESS;
+  if (thread_count == 0) {
+    thread_count = online_threads();
+  }
+  if (thread_count > byte_count / PARALLEL_MIN_CHUNK) {
+    thread_count = byte_count / PARALLEL_MIN_CHUNK ? byte_count / PARALLEL_MIN_CHUNK : 1;
+  }
+  chunks = calloc(thread_count, sizeof(chunk_t));
+  threads = calloc(thread_count, sizeof(pthread_t));
+  if (chunks == NULL || threads == NULL) {
+    free(chunks);
+    free(threads);
+    return JASM_MEMORY_ERROR;
+  }
+  error_code = init_string(&line, STRING_SIZE, NULL);
+  for (size_t window = 0; window < byte_count && error_code == JASM_SUCCESS; window += thread_count * PARALLEL_CHUNK) {
+    size_t chunk_count = 0;
+    for (size_t idx = 0; idx < thread_count && window + idx * PARALLEL_CHUNK < byte_count; ++idx) {
+      chunk_t *chunk = &chunks[idx];
+      memset(chunk, 0, sizeof(*chunk));
+      chunk->bytes = bytes;
+      chunk->byte_count = byte_count;
+      chunk->context = context;
+      chunk->start = window + idx * PARALLEL_CHUNK;
+      chunk->end = byte_count - chunk->start > PARALLEL_CHUNK ? chunk->start + PARALLEL_CHUNK : byte_count;
+      if (idx > 0) {
+        chunk->threaded = pthread_create(&threads[idx], NULL, decode_chunk, chunk) == 0;
+        if (!chunk->threaded) {
+          decode_chunk(chunk);
+        }
+      }
+      chunk_count++;
+    }
+    /* The calling thread decodes the first chunk of each window */
+    decode_chunk(&chunks[0]);
+    for (size_t idx = 0; idx < chunk_count; ++idx) {
+      if (chunks[idx].threaded) {
+        pthread_join(threads[idx], NULL);
+      }
+      if (error_code == JASM_SUCCESS) {
+        error_code = chunks[idx].error_code;
+      }
+      if (error_code == JASM_SUCCESS) {
+        error_code = merge_chunk(context->writer, &chunks[idx], &next, &line);
+      }
+      free_string(&chunks[idx].text);
+      free(chunks[idx].boundaries);
+      free(chunks[idx].text_offsets);
+    }
+  }
+  free_string(&line);
+  free(chunks);
+  free(threads);
+  return error_code;
+}
@@ -0,0 +1,32 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>
+
+/* Buffers at least this large are split across threads */
+#define PARALLEL_THRESHOLD (1 << 20)
+/* Smallest chunk worth a thread */
+#define PARALLEL_MIN_CHUNK BUFFER_SIZE
+/* Bytes each thread decodes per window; bounds the listing text in flight */
+#define PARALLEL_CHUNK     (1 << 18)
+
+typedef struct chunk_t {
+  const uint8_t *bytes;     /* whole image */
+  size_t    byte_count;
+  const disassembler_t *context; /* listing the chunk belongs to */
+  size_t    start;          /* speculative first instruction */
+  size_t    end;            /* nominal end, exclusive */
+  size_t    stop;           /* first instruction boundary at or past end */
+  size_t    *boundaries;    /* instruction offsets decoded from start */
+  size_t    *text_offsets;  /* where each instruction's line starts in text */
+  size_t    count;
+  size_t    capacity;
+  string_t  text;
+  error_t   error_code;
+  uint8_t   threaded;       /* decoded on its own thread */
+} chunk_t;
+
+size_t online_threads(void);
+error_t dump_buffer_parallel(const disassembler_t *context);
+
+#endif
@@ -0,0 +1,138 @@
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "common.h"
+#include "error.h"
+#include "string_builder.h"
+#include "writer.h"
+#include "decoder.h"
+#include "disassembler.h"
+#include "stream.h"
+
+error_t open_stream(stream_t *stream, char *file_name, size_t offset, size_t length) {
+  /** open_stream
+   * Opens a file, "-" for stdin, to be read from offset for at most
+   * length bytes. Seekable inputs seek to offset; pipes read up to it.
+   */
+  error_t error_code = JASM_SUCCESS;
+  stream->file_descriptor = strcmp(file_name, "-") == 0 ? STDIN_FILENO : open(file_name, O_RDONLY);
+  if (stream->file_descriptor < 0) {
+    return JASM_FILE_OPEN_ERROR;
+  }
+  stream->ring = malloc(RING_SIZE + MAX_INSTRUCTION_LENGTH);
+  if (stream->ring == NULL) {
+    close_stream(stream);
+    return JASM_MEMORY_ERROR;
+  }
+  stream->head = 0;
+  stream->tail = 0;
+  stream->end = length > SIZE_MAX - offset ? SIZE_MAX : offset + length;
+  stream->eof = 0;
+  if (offset > 0 && lseek(stream->file_descriptor, (off_t)offset, SEEK_SET) == (off_t)offset) {
+    stream->head = offset;
+    stream->tail = offset;
+  }
+  while (stream->head < offset && error_code == JASM_SUCCESS) {
+    /* Not seekable: read and drop */
+    if (stream->head == stream->tail) {
+      error_code = fill_stream(stream, 1);
+      if (stream->eof && stream->head == stream->tail) {
+        break;
+      }
+    }
+    stream->head = stream->tail < offset ? stream->tail : offset;
+  }
+  if (error_code != JASM_SUCCESS) {
+    close_stream(stream);
+  }
+  return error_code;
+}
+
+error_t close_stream(stream_t *stream) {
+  error_t error_code = JASM_SUCCESS;
+  if (stream->file_descriptor != STDIN_FILENO && close(stream->file_descriptor) != 0) {
+    error_code = JASM_FILE_CLOSE_ERROR;
+  }
+  free(stream->ring);
+  stream->ring = NULL;
+  stream->file_descriptor = -1;
+  return error_code;
+}
+
+error_t fill_stream(stream_t *stream, size_t count) {
+  /** fill_stream
+   * Reads until at least count bytes are buffered, the input ends or the
+   * ring is full. Each read takes all the free space up to the wrap.
+   */
+  while (stream->tail - stream->head < count && !stream->eof) {
+    size_t position = stream->tail & RING_MASK;
+    size_t space = RING_SIZE - (stream->tail - stream->head);
+    ssize_t read_count;
+    if (space == 0) {
+      break;
+    }
+    if (space > RING_SIZE - position) {
+      space = RING_SIZE - position;
+    }
+    read_count = read(stream->file_descriptor, stream->ring + position, space);
+    if (read_count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return JASM_FILE_READ_ERROR;
+    }
+    if (read_count == 0) {
+      stream->eof = 1;
+      break;
+    }
+    if (position < MAX_INSTRUCTION_LENGTH) {
+      size_t mirrored = MAX_INSTRUCTION_LENGTH - position;
+      memcpy(stream->ring + RING_SIZE + position, stream->ring + position,
+             (size_t)read_count < mirrored ? (size_t)read_count : mirrored);
+    }
+    stream->tail += (size_t)read_count;
+  }
+  return JASM_SUCCESS;
+}
+
+error_t dump_stream(writer_t *writer, stream_t *stream, uint8_t format) {
+  /** Dump stream
+   * dump_buffer over a stream, in a list_format_t. The ring is refilled
+   * whenever less than one longest instruction is buffered, so every
+   * instruction decodes in place and memory use is fixed whatever the
+   * input size. Offsets are stream offsets.
+   */
+  char text[STRING_SIZE];
+  string_t line;
+  instruction_t instruction;
+  error_t error_code;
+  init_string(&line, STRING_SIZE, text);
+  append_format_header(format, &line);
+  error_code = write_bytes(writer, line.idx, line.buffer);
+  while (stream->head < stream->end && error_code == JASM_SUCCESS) {
+    const uint8_t *code = stream->ring + (stream->head & RING_MASK);
+    size_t remaining;
+    if (stream->tail - stream->head < MAX_INSTRUCTION_LENGTH) {
+      error_code = fill_stream(stream, MAX_INSTRUCTION_LENGTH);
+      if (error_code != JASM_SUCCESS) {
+        break;
+      }
+    }
+    remaining = (stream->tail < stream->end ? stream->tail : stream->end) - stream->head;
+    if (remaining == 0) {
+      break;
+    }
+    stream->head += decode_instruction(code, remaining, stream->head, &instruction);
+    clear_string(&line);
+    render_format_line(format, code, &instruction, &line);
+    error_code = write_bytes(writer, line.idx, line.buffer);
+  }
+  free_string(&line);
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  return flush_writer(writer);
+}
@@ -0,0 +1,30 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stddef.h>
+
+/* Ring capacity in bytes, a power of two */
+#define RING_SIZE (1 << 16)
+#define RING_MASK (RING_SIZE - 1)
+
+/** Stream
+ * Bounded window over a file descriptor, for inputs that are never held
+ * whole. The ring holds stream bytes [head, tail) at their offset modulo
+ * RING_SIZE, and its first MAX_INSTRUCTION_LENGTH bytes are mirrored past
+ * the end so an instruction that wraps around still reads contiguously.
+ */
+typedef struct stream_t {
+  int       file_descriptor;
+  uint8_t   *ring;
+  size_t    head;   /* stream offset of the next byte to decode */
+  size_t    tail;   /* stream offset after the last byte read */
+  size_t    end;    /* stream offset to stop at */
+  uint8_t   eof;
+} stream_t;
+
+error_t open_stream(stream_t *stream, char *file_name, size_t offset, size_t length);
+error_t close_stream(stream_t *stream);
+error_t fill_stream(stream_t *stream, size_t count);
+error_t dump_stream(writer_t *writer, stream_t *stream, uint8_t format);
+
+#endif
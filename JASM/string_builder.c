@@ -1,39 +1,100 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "common.h"
 #include "error.h"
 #include "string_builder.h"
 
-error_t init_string(string_t *string, uint8_t size, char *input) {
+error_t init_string(string_t *string, size_t size, char *input) {
+  /** init_string
+   * Starts an empty string in caller storage of size bytes. The builder
+   * moves to the heap when it outgrows that storage. A NULL input starts
+   * on the heap.
+   */
   string->idx = 0;
-  string->cnt = size;
+  string->cnt = input == NULL ? 0 : size;
   string->buffer = input;
+  string->owned = 0;
+  if (input == NULL && size > 0) {
+    return reserve_string(string, size);
+  }
   return JASM_SUCCESS;
 }
 
-error_t push_char(string_t *string, char c) {
-  if (string->idx >= (string->cnt - 1)) {
-    string->idx = 0;
+error_t reserve_string(string_t *string, size_t size) {
+  /** reserve_string
+   * Makes room for size more bytes, at least doubling the capacity
+   */
+  size_t capacity = string->cnt;
+  char *grown;
+  if (string->idx + size <= string->cnt) {
+    return JASM_SUCCESS;
+  }
+  if (capacity < STRING_SIZE) {
+    capacity = STRING_SIZE;
+  }
+  while (capacity < string->idx + size) {
+    capacity *= 2;
+  }
+  if (string->owned) {
+    grown = realloc(string->buffer, capacity);
+  } else {
+    grown = malloc(capacity);
+    if (grown != NULL && string->idx > 0) {
+      memcpy(grown, string->buffer, string->idx);
+    }
   }
-  string->buffer[string->idx] = c;
-  string->idx++;
+  if (grown == NULL) {
+    return JASM_MEMORY_ERROR;
+  }
+  string->buffer = grown;
+  string->cnt = capacity;
+  string->owned = 1;
   return JASM_SUCCESS;
 }
 
-error_t append_string(string_t *string, uint8_t size, char *input) {
-  for (uint8_t jdx = 0; jdx < size; ++jdx) {
-    if (input[jdx] == '\0') {
-      push_char(string, ' ');
+error_t push_char(string_t *string, char c) {
+  if (string->idx >= string->cnt) {
+    error_t error_code = reserve_string(string, 1);
+    if (error_code != JASM_SUCCESS) {
+      return error_code;
     }
-    else {
-      push_char(string, input[jdx]);
+  }
+  string->buffer[string->idx++] = c;
+  return JASM_SUCCESS;
+}
+
+error_t append_string(string_t *string, size_t size, const char *input) {
+  if (string->idx + size > string->cnt) {
+    error_t error_code = reserve_string(string, size);
+    if (error_code != JASM_SUCCESS) {
+      return error_code;
     }
   }
+  memcpy(string->buffer + string->idx, input, size);
+  string->idx += size;
+  return JASM_SUCCESS;
+}
+
+error_t clear_string(string_t *string) {
+  string->idx = 0;
+  return JASM_SUCCESS;
+}
+
+error_t free_string(string_t *string) {
+  if (string->owned) {
+    free(string->buffer);
+  }
+  string->idx = 0;
+  string->cnt = 0;
+  string->buffer = NULL;
+  string->owned = 0;
   return JASM_SUCCESS;
 }
 
 error_t print_string(string_t *string) {
-  for (uint8_t jdx = 0; jdx < string->idx; ++jdx) {
-    putchar(string->buffer[jdx]);
+  if (fwrite(string->buffer, sizeof(char), string->idx, stdout) != string->idx) {
+    return JASM_PRINT_STDOUT_ERROR;
   }
   return JASM_SUCCESS;
-}
\ No newline at end of file
+}
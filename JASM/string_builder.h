@@ -1,15 +1,24 @@
-#ifndef STRING_BUILDERH_H
+#ifndef STRING_BUILDER_H
 #define STRING_BUILDER_H
 
+#include <stddef.h>
+
 typedef struct string_t {
-  uint8_t   idx;
-  uint8_t   cnt;
+  size_t    idx;
+  size_t    cnt;
   char      *buffer;
+  uint8_t   owned;    /* buffer was allocated by the builder */
 } string_t;
 
-error_t init_string(string_t *string, uint8_t size, char *input);
+/* Appends a string literal; its length is a compile-time constant */
+#define append_literal(string, literal) append_string((string), sizeof(literal) - 1, (literal))
+
+error_t init_string(string_t *string, size_t size, char *input);
+error_t reserve_string(string_t *string, size_t size);
 error_t push_char(string_t *string, char c);
-error_t append_string(string_t *string, uint8_t size, char *input);
+error_t append_string(string_t *string, size_t size, const char *input);
+error_t clear_string(string_t *string);
+error_t free_string(string_t *string);
 error_t print_string(string_t *string);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,497 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "common.h"
+#include "error.h"
+#include "file_handler.h"
+#include "string_builder.h"
+#include "symbols.h"
+
+void init_arena(arena_t *arena) {
+  arena->head = NULL;
+}
+
+void free_arena(arena_t *arena) {
+  while (arena->head != NULL) {
+    arena_block_t *next = arena->head->next;
+    free(arena->head);
+    arena->head = next;
+  }
+}
+
+void *arena_alloc(arena_t *arena, size_t size) {
+  /** arena_alloc
+   * size bytes that live as long as the arena; NULL when out of memory.
+   * A request that does not fit the current block starts a new one, and
+   * the rest of the old block is left unused.
+   */
+  arena_block_t *block = arena->head;
+  if (block == NULL || block->size - block->used < size) {
+    size_t block_size = size > ARENA_BLOCK ? size : ARENA_BLOCK;
+    block = malloc(sizeof(arena_block_t) + block_size);
+    if (block == NULL) {
+      return NULL;
+    }
+    block->used = 0;
+    block->size = block_size;
+    block->next = arena->head;
+    arena->head = block;
+  }
+  block->used += size;
+  return (char *)(block + 1) + block->used - size;
+}
+
+error_t init_symbol_table(symbol_table_t *table) {
+  memset(table, 0, sizeof(*table));
+  init_arena(&table->names);
+  return JASM_SUCCESS;
+}
+
+error_t free_symbol_table(symbol_table_t *table) {
+  free_arena(&table->names);
+  free(table->symbols);
+  free(table->name_slots);
+  memset(table, 0, sizeof(*table));
+  return JASM_SUCCESS;
+}
+
+uint32_t hash_name(const char *name, size_t length) {
+  /* FNV-1a, case-sensitive */
+  uint32_t hash = 2166136261u;
+  for (size_t idx = 0; idx < length; ++idx) {
+    hash = (hash ^ (uint8_t)name[idx]) * 16777619u;
+  }
+  return hash;
+}
+
+uint32_t hash_address(uint32_t address) {
+  /* Fibonacci hashing, with the well mixed high bits folded down */
+  uint32_t hash = address * 2654435769u;
+  return hash ^ (hash >> 16);
+}
+
+size_t find_name_slot(const symbol_table_t *table, const char *name, size_t length, uint32_t hash) {
+  /** find_name_slot
+   * Slot holding the name, or the empty slot where it would go
+   */
+  size_t mask = table->name_slot_count - 1;
+  size_t slot = hash & mask;
+  while (table->name_slots[slot] != 0) {
+    const symbol_t *symbol = &table->symbols[table->name_slots[slot] - 1];
+    if (symbol->hash == hash && symbol->length == length && memcmp(symbol->name, name, length) == 0) {
+      break;
+    }
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+error_t grow_name_slots(symbol_table_t *table) {
+  /** grow_name_slots
+   * Doubles the name slots and re-enters every symbol
+   */
+  size_t slot_count = table->name_slot_count ? table->name_slot_count * 2 : 1024;
+  uint32_t *slots = calloc(slot_count, sizeof(uint32_t));
+  if (slots == NULL) {
+    return JASM_MEMORY_ERROR;
+  }
+  free(table->name_slots);
+  table->name_slots = slots;
+  table->name_slot_count = slot_count;
+  for (size_t idx = 0; idx < table->count; ++idx) {
+    const symbol_t *symbol = &table->symbols[idx];
+    slots[find_name_slot(table, symbol->name, symbol->length, symbol->hash)] = (uint32_t)idx + 1;
+  }
+  return JASM_SUCCESS;
+}
+
+error_t add_symbol(symbol_table_t *table, const char *name, size_t length, uint32_t address) {
+  /** add_symbol
+   * Interns a name at an address. A name already in the table keeps its
+   * first address.
+   */
+  uint32_t hash = hash_name(name, length);
+  symbol_t *symbol;
+  char *copy;
+  size_t slot;
+  if (length > UINT32_MAX || table->count >= UINT32_MAX - 1) {
+    return JASM_RANGE_ERROR;
+  }
+  if (2 * (table->count + 1) > table->name_slot_count && grow_name_slots(table) != JASM_SUCCESS) {
+    return JASM_MEMORY_ERROR;
+  }
+  slot = find_name_slot(table, name, length, hash);
+  if (table->name_slots[slot] != 0) {
+    return JASM_SUCCESS;
+  }
+  if (table->count == table->capacity) {
+    size_t capacity = table->capacity ? table->capacity * 2 : 1024;
+    symbol_t *symbols = realloc(table->symbols, capacity * sizeof(symbol_t));
+    if (symbols == NULL) {
+      return JASM_MEMORY_ERROR;
+    }
+    table->symbols = symbols;
+    table->capacity = capacity;
+  }
+  copy = arena_alloc(&table->names, length);
+  if (copy == NULL && length > 0) {
+    return JASM_MEMORY_ERROR;
+  }
+  memcpy(copy, name, length);
+  symbol = &table->symbols[table->count];
+  symbol->name = copy;
+  symbol->length = (uint32_t)length;
+  symbol->hash = hash;
+  symbol->address = address;
+  table->name_slots[slot] = (uint32_t)++table->count;
+  return JASM_SUCCESS;
+}
+
+size_t find_symbol(const symbol_table_t *table, const char *name, size_t length) {
+  /** find_symbol
+   * Index of a name in table->symbols, or NO_SYMBOL
+   */
+  size_t slot;
+  if (table->count == 0) {
+    return NO_SYMBOL;
+  }
+  slot = find_name_slot(table, name, length, hash_name(name, length));
+  return table->name_slots[slot] != 0 ? table->name_slots[slot] - 1 : NO_SYMBOL;
+}
+
+
+error_t parse_map_number(const char *token, size_t length, unsigned base, uint32_t *value) {
+  /** parse_map_number
+   * Digits in base 10 or 16; JASM_SYNTAX_ERROR unless the whole token is
+   * digits, JASM_RANGE_ERROR past 32 bits
+   */
+  uint64_t number = 0;
+  if (length == 0) {
+    return JASM_SYNTAX_ERROR;
+  }
+  for (size_t idx = 0; idx < length; ++idx) {
+    char c = token[idx];
+    unsigned digit = 16;
+    if (c >= '0' && c <= '9') {
+      digit = (unsigned)(c - '0');
+    } else if (c >= 'a' && c <= 'f') {
+      digit = (unsigned)(c - 'a' + 10);
+    } else if (c >= 'A' && c <= 'F') {
+      digit = (unsigned)(c - 'A' + 10);
+    }
+    if (digit >= base) {
+      return JASM_SYNTAX_ERROR;
+    }
+    if (number <= UINT32_MAX) {
+      number = number * base + digit;
+    }
+  }
+  if (number > UINT32_MAX) {
+    return JASM_RANGE_ERROR;
+  }
+  *value = (uint32_t)number;
+  return JASM_SUCCESS;
+}
+
+int map_line_has(const char *line, size_t length, const char *word) {
+  /* Whether word occurs in the line */
+  size_t word_length = strlen(word);
+  for (size_t idx = 0; idx + word_length <= length; ++idx) {
+    if (memcmp(line + idx, word, word_length) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+error_t load_symbol_map(symbol_table_t *table, const char *text, size_t length) {
+  /** load_symbol_map
+   * Adds the symbols of a NASM map file, or of text with an "offset name"
+   * pair per line, offsets decimal or 0x hex and ';' or '#' starting a
+   * comment. NASM maps, which NASM starts with a blank line, give hex
+   * addresses from the program origin; their constants, and symbols below
+   * the origin, are skipped.
+   */
+  const char nasm_banner[] = "- NASM Map file";
+  size_t start = 0;
+  int nasm, in_origin = 0, in_symbols = 0;
+  uint32_t origin = 0;
+  error_t error_code = JASM_SUCCESS;
+  while (start < length && (text[start] == '\n' || text[start] == '\r')) {
+    ++start;
+  }
+  nasm = length - start >= sizeof(nasm_banner) - 1 &&
+         memcmp(text + start, nasm_banner, sizeof(nasm_banner) - 1) == 0;
+  while (start < length && error_code == JASM_SUCCESS) {
+    const char *tokens[4];
+    size_t lengths[4];
+    size_t count = 0;
+    size_t end = start;
+    uint32_t address, real;
+    while (end < length && text[end] != '\n') {
+      ++end;
+    }
+    for (size_t idx = start; idx < end && count < 4;) {
+      size_t first = idx;
+      if (text[idx] == ' ' || text[idx] == '\t' || text[idx] == '\r') {
+        ++idx;
+        continue;
+      }
+      if (!nasm && (text[idx] == ';' || text[idx] == '#')) {
+        break;
+      }
+      while (idx < end && text[idx] != ' ' && text[idx] != '\t' && text[idx] != '\r') {
+        ++idx;
+      }
+      tokens[count] = text + first;
+      lengths[count++] = idx - first;
+    }
+    if (nasm && count > 0 && lengths[0] >= 2 && memcmp(tokens[0], "--", 2) == 0) {
+      /* "-- Section --" headings; "---- Section .text" ones divide the symbols */
+      if (lengths[0] == 2) {
+        in_origin = map_line_has(text + start, end - start, "Program origin");
+        in_symbols = map_line_has(text + start, end - start, "Symbols");
+      }
+    } else if (nasm && in_origin && count == 1) {
+      error_code = parse_map_number(tokens[0], lengths[0], 16, &origin);
+      in_origin = 0;
+    } else if (nasm && in_symbols && count == 3 &&
+               parse_map_number(tokens[0], lengths[0], 16, &real) == JASM_SUCCESS &&
+               parse_map_number(tokens[1], lengths[1], 16, &address) == JASM_SUCCESS && real >= origin) {
+      error_code = add_symbol(table, tokens[2], lengths[2], real - origin);
+    } else if (!nasm && count == 2) {
+      if (lengths[0] > 2 && tokens[0][0] == '0' && (tokens[0][1] == 'x' || tokens[0][1] == 'X')) {
+        error_code = parse_map_number(tokens[0] + 2, lengths[0] - 2, 16, &address);
+      } else {
+        error_code = parse_map_number(tokens[0], lengths[0], 10, &address);
+      }
+      if (error_code == JASM_SUCCESS) {
+        error_code = add_symbol(table, tokens[1], lengths[1], address);
+      }
+    } else if (!nasm && count != 0) {
+      error_code = JASM_SYNTAX_ERROR;
+    }
+    start = end + 1;
+  }
+  return error_code;
+}
+
+void put_index_word(uint8_t *bytes, uint32_t value) {
+  /* Little-endian store */
+  bytes[0] = (uint8_t)value;
+  bytes[1] = (uint8_t)(value >> 8);
+  bytes[2] = (uint8_t)(value >> 16);
+  bytes[3] = (uint8_t)(value >> 24);
+}
+
+uint32_t index_word(const uint8_t *bytes) {
+  /* Little-endian load */
+  return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+int compare_keys(const void *left, const void *right) {
+  uint64_t a = *(const uint64_t *)left;
+  uint64_t b = *(const uint64_t *)right;
+  return a < b ? -1 : a > b;
+}
+
+error_t export_symbol_index(const symbol_table_t *table, string_t *output) {
+  /** export_symbol_index
+   * Appends the index file described in symbols.h. Names are laid out in
+   * address order, next to each other for neighbouring symbols.
+   */
+  size_t slot_count = 16;
+  size_t name_bytes = 0;
+  size_t size;
+  uint64_t *keys;
+  uint8_t *records, *slots;
+  char *names;
+  error_t error_code;
+  for (size_t idx = 0; idx < table->count; ++idx) {
+    name_bytes += table->symbols[idx].length;
+  }
+  if (name_bytes > UINT32_MAX) {
+    return JASM_RANGE_ERROR;
+  }
+  while (slot_count < 2 * table->count) {
+    slot_count *= 2;
+  }
+  size = SYMBOL_HEADER + table->count * 12 + slot_count * 4 + name_bytes;
+  keys = malloc((table->count + 1) * sizeof(uint64_t));
+  if (keys == NULL) {
+    return JASM_MEMORY_ERROR;
+  }
+  error_code = reserve_string(output, size);
+  if (error_code != JASM_SUCCESS) {
+    free(keys);
+    return error_code;
+  }
+  for (size_t idx = 0; idx < table->count; ++idx) {
+    keys[idx] = (uint64_t)table->symbols[idx].address << 32 | idx;
+  }
+  qsort(keys, table->count, sizeof(uint64_t), compare_keys);
+  records = (uint8_t *)output->buffer + output->idx;
+  put_index_word(records, SYMBOL_MAGIC);
+  put_index_word(records + 4, SYMBOL_VERSION);
+  put_index_word(records + 8, (uint32_t)table->count);
+  put_index_word(records + 12, (uint32_t)slot_count);
+  put_index_word(records + 16, (uint32_t)name_bytes);
+  records += SYMBOL_HEADER;
+  slots = records + table->count * 12;
+  names = (char *)slots + slot_count * 4;
+  memset(slots, 0, slot_count * 4);
+  name_bytes = 0;
+  for (size_t position = 0; position < table->count; ++position) {
+    const symbol_t *symbol = &table->symbols[(uint32_t)keys[position]];
+    put_index_word(records + position * 12, symbol->address);
+    put_index_word(records + position * 12 + 4, (uint32_t)name_bytes);
+    put_index_word(records + position * 12 + 8, symbol->length);
+    memcpy(names + name_bytes, symbol->name, symbol->length);
+    name_bytes += symbol->length;
+    if (position == 0 || (uint32_t)(keys[position - 1] >> 32) != symbol->address) {
+      size_t slot = hash_address(symbol->address) & (slot_count - 1);
+      while (index_word(slots + slot * 4) != 0) {
+        slot = (slot + 1) & (slot_count - 1);
+      }
+      put_index_word(slots + slot * 4, (uint32_t)position + 1);
+    }
+  }
+  free(keys);
+  output->idx += size;
+  return JASM_SUCCESS;
+}
+
+error_t open_symbol_index(const uint8_t *bytes, size_t byte_count, symbol_index_t *index) {
+  /** open_symbol_index
+   * Reads an index file in place, checking only its header and size;
+   * JASM_FILE_READ_ERROR if it is not one
+   */
+  uint64_t count, slot_count, name_bytes;
+  if (byte_count < SYMBOL_HEADER || index_word(bytes) != SYMBOL_MAGIC || index_word(bytes + 4) != SYMBOL_VERSION) {
+    return JASM_FILE_READ_ERROR;
+  }
+  count = index_word(bytes + 8);
+  slot_count = index_word(bytes + 12);
+  name_bytes = index_word(bytes + 16);
+  if (slot_count == 0 || (slot_count & (slot_count - 1)) != 0 ||
+      (uint64_t)byte_count != SYMBOL_HEADER + count * 12 + slot_count * 4 + name_bytes) {
+    return JASM_FILE_READ_ERROR;
+  }
+  index->records = bytes + SYMBOL_HEADER;
+  index->slots = index->records + count * 12;
+  index->names = (const char *)index->slots + slot_count * 4;
+  index->count = count;
+  index->slot_count = slot_count;
+  index->name_bytes = name_bytes;
+  return JASM_SUCCESS;
+}
+
+uint32_t symbol_address(const symbol_index_t *index, size_t position) {
+  return index_word(index->records + position * 12);
+}
+
+const char *symbol_name(const symbol_index_t *index, size_t position, size_t *length) {
+  /* Name of the symbol at a position; empty if the index points outside its names */
+  uint32_t offset = index_word(index->records + position * 12 + 4);
+  *length = index_word(index->records + position * 12 + 8);
+  if (offset > index->name_bytes || *length > index->name_bytes - offset) {
+    *length = 0;
+    return index->names;
+  }
+  return index->names + offset;
+}
+
+size_t first_symbol_at(const symbol_index_t *index, uint32_t address) {
+  /** first_symbol_at
+   * Position of the first symbol at address, or NO_SYMBOL
+   */
+  size_t mask = index->slot_count - 1;
+  size_t slot = hash_address(address) & mask;
+  for (size_t probe = 0; probe < index->slot_count; ++probe, slot = (slot + 1) & mask) {
+    size_t position = index_word(index->slots + slot * 4);
+    if (position == 0) {
+      break;
+    }
+    if (position <= index->count && symbol_address(index, position - 1) == address) {
+      return position - 1;
+    }
+  }
+  return NO_SYMBOL;
+}
+
+size_t symbol_below(const symbol_index_t *index, uint32_t address) {
+  /** symbol_below
+   * Position of the first symbol at the highest address not above
+   * address, or NO_SYMBOL
+   */
+  size_t low = 0;
+  size_t high = index->count;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (symbol_address(index, middle) <= address) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if (low == 0) {
+    return NO_SYMBOL;
+  }
+  address = symbol_address(index, --low);
+  while (low > 0 && symbol_address(index, low - 1) == address) {
+    --low;
+  }
+  return low;
+}
+
+error_t index_map_file(char *map_name, string_t *exported) {
+  /* Reads a symbol map and appends its symbol index */
+  binary_file_t map;
+  symbol_table_t symbols;
+  error_t error_code = load_binary_file(map_name, &map);
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  init_symbol_table(&symbols);
+  error_code = load_symbol_map(&symbols, (const char *)map.bytes, map.byte_count);
+  if (error_code == JASM_SUCCESS) {
+    error_code = export_symbol_index(&symbols, exported);
+  }
+  free_symbol_table(&symbols);
+  unload_binary_file(&map);
+  return error_code;
+}
+
+error_t open_map_index(char *map_name, struct binary_file_t *index_file, string_t *exported, symbol_index_t *index) {
+  /** open_map_index
+   * Opens the index of a symbol map. map.idx is mapped into index_file and
+   * read in place while it is newer than the map and a valid index;
+   * otherwise the index is rebuilt from the map into exported and saved
+   * as map.idx. The caller unloads index_file if it holds bytes.
+   */
+  string_t index_name;
+  struct stat map_status, index_status;
+  error_t error_code = init_string(&index_name, strlen(map_name) + 5, NULL);
+  index_file->bytes = NULL;
+  if (error_code != JASM_SUCCESS) {
+    return error_code;
+  }
+  append_string(&index_name, strlen(map_name), map_name);
+  append_string(&index_name, 5, ".idx");
+  if (stat(map_name, &map_status) == 0 && stat(index_name.buffer, &index_status) == 0 &&
+      index_status.st_mtime > map_status.st_mtime &&
+      load_binary_file(index_name.buffer, index_file) == JASM_SUCCESS &&
+      open_symbol_index(index_file->bytes, index_file->byte_count, index) != JASM_SUCCESS) {
+    unload_binary_file(index_file);
+  }
+  if (index_file->bytes == NULL) {
+    error_code = index_map_file(map_name, exported);
+    if (error_code == JASM_SUCCESS) {
+      /* A map in a read-only directory is still listed, only not cached */
+      save_binary_file(index_name.buffer, (const uint8_t *)exported->buffer, exported->idx);
+      error_code = open_symbol_index((const uint8_t *)exported->buffer, exported->idx, index);
+    }
+  }
+  free_string(&index_name);
+  return error_code;
+}
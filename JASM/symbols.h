@@ -0,0 +1,87 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <stddef.h>
+
+/* Arena block size; longer requests get a block of their own */
+#define ARENA_BLOCK (1 << 16)
+/* Returned for a symbol that is not in the table */
+#define NO_SYMBOL   ((size_t)-1)
+/* Symbol index magic, "JSYM" little-endian, and layout version */
+#define SYMBOL_MAGIC   0x4d59534aU
+#define SYMBOL_VERSION 1
+/* Symbol index header: magic, version, count, slot_count, name_bytes */
+#define SYMBOL_HEADER  20
+
+/* Bump allocator: memory is only released all at once */
+typedef struct arena_block_t {
+  struct arena_block_t *next;
+  size_t    used;
+  size_t    size;
+} arena_block_t;
+
+typedef struct arena_t {
+  arena_block_t *head;  /* block being filled */
+} arena_t;
+
+typedef struct symbol_t {
+  const char  *name;    /* interned in the table's arena */
+  uint32_t    length;
+  uint32_t    hash;
+  uint32_t    address;
+} symbol_t;
+
+/** Symbol table
+ * Names are interned in an arena and found through open addressing. The
+ * table collects symbols; export_symbol_index turns it into the index the
+ * listing reads.
+ */
+typedef struct symbol_table_t {
+  arena_t   names;
+  symbol_t  *symbols;
+  size_t    count;
+  size_t    capacity;
+  uint32_t  *name_slots;      /* symbol + 1, 0 for empty */
+  size_t    name_slot_count;  /* power of two */
+} symbol_table_t;
+
+/** Symbol index
+ * Symbols by address, read in place from an exported index, whether it was
+ * just built or mapped from a file, so opening one costs the same for any
+ * number of symbols. Positions count records in address order.
+ *
+ * Index file, little-endian: the uint32_t header fields magic, version,
+ * count, slot_count and name_bytes, then records[count] of uint32_t
+ * address, name offset and length sorted by address and then by insertion,
+ * uint32_t slots[slot_count] holding the position + 1 of each address's
+ * first record by open addressing, 0 for empty, and the names.
+ */
+typedef struct symbol_index_t {
+  const uint8_t *records;
+  const uint8_t *slots;
+  const char    *names;
+  size_t    count;
+  size_t    slot_count;       /* power of two */
+  size_t    name_bytes;
+} symbol_index_t;
+
+struct binary_file_t;
+
+void init_arena(arena_t *arena);
+void free_arena(arena_t *arena);
+void *arena_alloc(arena_t *arena, size_t size);
+error_t init_symbol_table(symbol_table_t *table);
+error_t free_symbol_table(symbol_table_t *table);
+error_t add_symbol(symbol_table_t *table, const char *name, size_t length, uint32_t address);
+size_t find_symbol(const symbol_table_t *table, const char *name, size_t length);
+error_t load_symbol_map(symbol_table_t *table, const char *text, size_t length);
+error_t export_symbol_index(const symbol_table_t *table, string_t *output);
+error_t open_symbol_index(const uint8_t *bytes, size_t byte_count, symbol_index_t *index);
+uint32_t symbol_address(const symbol_index_t *index, size_t position);
+const char *symbol_name(const symbol_index_t *index, size_t position, size_t *length);
+size_t first_symbol_at(const symbol_index_t *index, uint32_t address);
+size_t symbol_below(const symbol_index_t *index, uint32_t address);
+error_t index_map_file(char *map_name, string_t *exported);
+error_t open_map_index(char *map_name, struct binary_file_t *index_file, string_t *exported, symbol_index_t *index);
+
+#endif
@@ -0,0 +1,73 @@
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "common.h"
+#include "error.h"
+#include "writer.h"
+
+error_t init_writer(writer_t *writer, int file_descriptor, size_t size, char *buffer) {
+  /** init_writer
+   * Attaches a caller-owned output arena to a file descriptor
+   */
+  writer->file_descriptor = file_descriptor;
+  writer->idx = 0;
+  writer->cnt = size;
+  writer->buffer = buffer;
+  return JASM_SUCCESS;
+}
+
+error_t flush_writer(writer_t *writer) {
+  /** flush_writer
+   * Writes the arena out with write(2), retrying short writes
+   */
+  size_t written = 0;
+  while (written < writer->idx) {
+    ssize_t return_code = write(writer->file_descriptor, writer->buffer + written, writer->idx - written);
+    if (return_code < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      writer->idx = 0;
+      return JASM_FILE_WRITE_ERROR;
+    }
+    written += return_code;
+  }
+  writer->idx = 0;
+  return JASM_SUCCESS;
+}
+
+error_t write_char(writer_t *writer, char c) {
+  /** write_char
+   * Appends one character, flushing first when the arena is full
+   */
+  if (writer->idx == writer->cnt) {
+    error_t error_code = flush_writer(writer);
+    if (error_code != JASM_SUCCESS) {
+      return error_code;
+    }
+  }
+  writer->buffer[writer->idx++] = c;
+  return JASM_SUCCESS;
+}
+
+error_t write_bytes(writer_t *writer, size_t size, const char *input) {
+  /** write_bytes
+   * Appends size bytes with one copy, flushing first when they don't fit.
+   * Inputs larger than the whole arena are written straight through.
+   */
+  if (writer->idx + size > writer->cnt) {
+    error_t error_code = flush_writer(writer);
+    if (error_code != JASM_SUCCESS) {
+      return error_code;
+    }
+    if (size > writer->cnt) {
+      writer_t direct = *writer;
+      direct.buffer = (char *)input;
+      direct.idx = size;
+      return flush_writer(&direct);
+    }
+  }
+  memcpy(writer->buffer + writer->idx, input, size);
+  writer->idx += size;
+  return JASM_SUCCESS;
+}
@@ -0,0 +1,18 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stddef.h>
+
+typedef struct writer_t {
+  int       file_descriptor;
+  size_t    idx;
+  size_t    cnt;
+  char      *buffer;
+} writer_t;
+
+error_t init_writer(writer_t *writer, int file_descriptor, size_t size, char *buffer);
+error_t flush_writer(writer_t *writer);
+error_t write_char(writer_t *writer, char c);
+error_t write_bytes(writer_t *writer, size_t size, const char *input);
+
+#endif